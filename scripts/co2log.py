@@ -14,6 +14,8 @@ import time
 import argparse
 import textwrap
 import re
+import shutil
+import subprocess
 
 DEBUG = False
 
@@ -21,6 +23,13 @@ prog_path, prog_name = os.path.split(sys.argv[0])
 log_dir = "/var/log/co2Monitor/"
 #log_dir='./var_log_co2monitor/'
 
+# converts binary log segments (YYYY/MM/DD.bin or DD.co2z) to CSV
+co2logcsv = shutil.which('co2logcsv') or os.path.join(prog_path, 'co2logcsv')
+
+# native query tool which takes the same arguments but, unlike this
+# script, doesn't have to read every line of every log file
+co2logq = shutil.which('co2logq') or os.path.join(prog_path, 'co2logq')
+
 
 def get_date_time(date_time):
 	try:
@@ -70,6 +79,20 @@ def print_log_line(line):
 	date_str = time.strftime('%Y-%m-%d %H:%M:%S', time.localtime(int(log_items[7])))
 	print(f'{t:.2f}C, {rh:.2f}% ({rh_filt:.2f}%), {co2:<7}{co2_filt:<9}, fan: {fan_state:3} {man_auto:6}, {date_str}')
 
+def read_log_lines(log_file_name, start_timestamp, end_timestamp):
+	for ext in ['.bin', '.co2z']:
+		bin_file_name = log_file_name + ext
+		if os.path.isfile(bin_file_name) and os.access(bin_file_name, os.R_OK):
+			print(f'opened: {bin_file_name}')
+			csv = subprocess.run([co2logcsv, '-s', str(start_timestamp), '-e', str(end_timestamp), bin_file_name],
+					     capture_output=True, text=True, check=True)
+			return csv.stdout.splitlines()
+	if os.path.isfile(log_file_name) and os.access(log_file_name, os.R_OK):
+		with open(log_file_name) as in_file:
+			print(f'opened: {log_file_name}')
+			return in_file.read().splitlines()
+	return None
+
 def read_log_for_date_time(dt, duration):
 	if duration.total_seconds() < 0:
 		start_dt = dt + duration
@@ -84,19 +107,17 @@ def read_log_for_date_time(dt, duration):
 	log_dt  = start_dt
 	while log_dt <= end_dt:
 		log_file_name = f'{log_dir}{log_dt.year:04d}/{log_dt.month:02d}/{log_dt.day:02d}'
-		if os.path.isfile(log_file_name) and os.access(log_file_name, os.R_OK):
-			with open(log_file_name) as in_file:
-				print(f'opened: {log_file_name}')
-				log_lines = in_file.read().splitlines()
-				for log_line in log_lines:
-					log_items = log_line.split(',')
-					if len(log_items) < 8:
-						continue
-					if start_timestamp > int(log_items[7]):
-						continue
-					if end_timestamp < int(log_items[7]):
-						break
-					print_log_line(log_line)		        
+		log_lines = read_log_lines(log_file_name, start_timestamp, end_timestamp)
+		if log_lines is not None:
+			for log_line in log_lines:
+				log_items = log_line.split(',')
+				if len(log_items) < 8:
+					continue
+				if start_timestamp > int(log_items[7]):
+					continue
+				if end_timestamp < int(log_items[7]):
+					break
+				print_log_line(log_line)
 		else:
 			sys.stderr.write(f'\nNo log "{log_file_name}" for {dt.strftime("%Y-%m-%d")}\n')
 			break
@@ -107,6 +128,8 @@ def usage():
 	sys.exit(1)
 
 def main():
+	if os.access(co2logq, os.X_OK):
+		os.execv(co2logq, [co2logq, '-d', log_dir] + sys.argv[1:])
 	parser = argparse.ArgumentParser(formatter_class=argparse.RawDescriptionHelpFormatter, description=textwrap.dedent('''\
 		Pretty prints CO2 Monitor readings for given: date or date-time 
 		 - date (yymmdd); or
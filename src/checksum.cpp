@@ -0,0 +1,167 @@
+/*
+ * checksum.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <array>
+#include <cstring>
+
+#include "checksum.h"
+
+namespace Checksum
+{
+
+// Table k gives the CRC contribution of a byte followed by k zero bytes,
+// so that four bytes can be folded in with four independent lookups.
+static constexpr std::array<std::array<uint16_t, 256>, 4> makeCrc16Tables()
+{
+    std::array<std::array<uint16_t, 256>, 4> tables {};
+
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : (crc >> 1);
+        }
+
+        tables[0][i] = crc;
+    }
+
+    for (int k = 1; k < 4; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint16_t prev = tables[k - 1][i];
+            tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+        }
+    }
+
+    return tables;
+}
+
+static constexpr std::array<uint8_t, 256> makeCrc8Table()
+{
+    std::array<uint8_t, 256> table {};
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr std::array<uint32_t, 256> makeCrc32Table()
+{
+    std::array<uint32_t, 256> table {};
+
+    for (int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : (crc >> 1);
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr auto kCrc16Tables = makeCrc16Tables();
+static constexpr auto kCrc8Table = makeCrc8Table();
+static constexpr auto kCrc32Table = makeCrc32Table();
+
+static_assert(kCrc16Tables[0][1] == 0xc0c1, "CRC-16/MODBUS table");
+static_assert(kCrc8Table[1] == 0x31, "CRC-8 table");
+static_assert(kCrc32Table[1] == 0x77073096, "CRC-32 table");
+
+static inline uint16_t crc16Bytes(uint16_t crc, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 8) ^ kCrc16Tables[0][(crc ^ data[i]) & 0xff];
+    }
+
+    return crc;
+}
+
+uint16_t crc16Modbus(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0xffff;
+
+    while (len >= 4) {
+        uint32_t x = crc ^ (uint32_t(data[0]) | (uint32_t(data[1]) << 8) |
+                            (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24));
+
+        crc = kCrc16Tables[3][x & 0xff] ^
+              kCrc16Tables[2][(x >> 8) & 0xff] ^
+              kCrc16Tables[1][(x >> 16) & 0xff] ^
+              kCrc16Tables[0][x >> 24];
+
+        data += 4;
+        len -= 4;
+    }
+
+    return crc16Bytes(crc, data, len);
+}
+
+uint16_t crc16ModbusBytewise(const uint8_t* data, size_t len)
+{
+    return crc16Bytes(0xffff, data, len);
+}
+
+uint8_t crc8Sensirion(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0xff;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = kCrc8Table[crc ^ data[i]];
+    }
+
+    return crc;
+}
+
+uint32_t crc32(const uint8_t* data, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 8) ^ kCrc32Table[(crc ^ data[i]) & 0xff];
+    }
+
+    return ~crc;
+}
+
+uint16_t internet(const void* data, size_t len)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t sum = 0;
+
+    // Main summing loop
+    while (len > 1) {
+        uint16_t word16;
+        memcpy(&word16, p, sizeof(word16));
+        sum += word16;
+        p += sizeof(word16);
+        len -= sizeof(word16);
+    }
+
+    // Add left-over byte, if any
+    if (len > 0) {
+        sum += *p;
+    }
+
+    // Fold 32-bit sum to 16 bits
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
+} // namespace Checksum
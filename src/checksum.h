@@ -0,0 +1,44 @@
+/*
+ * checksum.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Checksums used by sensor drivers, Ping and compressed logs.
+//
+// CRCs use lookup tables generated at compile time rather than a loop per
+// bit. "co2Bench crc" compares them with the bitwise versions they replace.
+//
+namespace Checksum
+{
+
+// CRC-16/MODBUS (poly 0x8005 reflected, init 0xffff) as used by the K30.
+// The result goes on the wire low byte first.
+// Folds in four bytes per step (slice-by-4), which is faster than a
+// lookup per byte even for a 5 byte K30 reply.
+uint16_t crc16Modbus(const uint8_t* data, size_t len);
+
+// As crc16Modbus(), but one table lookup per byte.
+uint16_t crc16ModbusBytewise(const uint8_t* data, size_t len);
+
+// CRC-8 (poly 0x31, init 0xff) which follows each word to or from the SCD30.
+uint8_t crc8Sensirion(const uint8_t* data, size_t len);
+
+// CRC-32 (poly 0x04c11db7 reflected, init and final XOR 0xffffffff) as
+// used by zlib, so it can be checked with other tools.
+uint32_t crc32(const uint8_t* data, size_t len);
+
+// RFC 1071 internet checksum, e.g. for IPv4 and ICMP headers.
+// Result is in network byte order, ready to be put in the header.
+uint16_t internet(const void* data, size_t len);
+
+} // namespace Checksum
+
+#endif /* CHECKSUM_H */
@@ -0,0 +1,1325 @@
+/*
+ * co2Bench.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ *
+ * Benchmarks for Co2Monitor components, run on the build host or the Pi:
+ *
+ *     co2Bench <benchmark> [args]
+ *
+ * Run without arguments for a list of benchmarks.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <poll.h>
+
+#include "checksum.h"
+#include "co2EventBus.h"
+#include "co2Filter.h"
+#include "co2LogCompress.h"
+#include "co2LogSegment.h"
+#include "co2LogWriter.h"
+#include "co2Scheduler.h"
+#include "co2SensorReader.h"
+#include "co2SensorReplay.h"
+#include "co2SensorSCD30.h"
+#include "co2SensorSim.h"
+#include "latencyHistogram.h"
+#include "utils.h"
+
+// Every heap allocation in co2Bench is counted, so benchmarks
+// can check that code which shouldn't allocate doesn't. Also
+// counted per thread, for benchmarks with several threads.
+static std::atomic<uint64_t> allocationCount(0);
+static thread_local uint64_t threadAllocationCount = 0;
+
+// The replacement new and delete are kept out of line. Otherwise GCC
+// inlines malloc() or free() into callers, pairs them with the standard
+// operator new/delete and fails the build with -Wmismatched-new-delete.
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    threadAllocationCount++;
+
+    void* p = malloc(size ? size : 1);
+
+    if (!p) {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+typedef struct {
+    const char* name;
+    const char* args;
+    const char* description;
+    int (*fn)(int argc, char* argv[]);
+} Benchmark;
+
+static double secondsSince(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Simulates a day of readings, filtered and with fan switched on thresholds
+// as in Co2Monitor, into the slots of a segment.
+static size_t simulateDay(Co2SensorSim& sensor, uint16_t slotInterval, time_t baseTime,
+                          std::vector<Co2LogSegment::Record>& records, int& filterRelHumidity, int& filterCo2)
+{
+    time_t nextDay = Co2LogSegment::dayStart(baseTime + (30 * 60 * 60));
+    uint32_t slotCount = (Co2LogSegment::kSecondsPerSegment + slotInterval - 1) / slotInterval;
+    size_t count = 0;
+
+    records.assign(slotCount, Co2LogSegment::Record());
+
+    for (uint32_t slot = 0; (slot < slotCount) && ((baseTime + (time_t(slot) * slotInterval)) < nextDay); slot++) {
+        int co2;
+        int temperature;
+        int relHumidity;
+
+        sensor.readMeasurements(co2, temperature, relHumidity);
+
+        filterRelHumidity = filterRelHumidity ? ((relHumidity * 20) + (filterRelHumidity * 80)) / 100 : relHumidity;
+        filterCo2 = filterCo2 ? ((co2 * 20) + (filterCo2 * 80)) / 100 : co2;
+
+        Co2LogSegment::Record& rec = records[slot];
+        bool fanOn = (filterRelHumidity >= 7000) || (filterCo2 >= 999);
+
+        rec.timeOffset = slot * slotInterval;
+        rec.temperature = temperature;
+        rec.relHumidity = relHumidity;
+        rec.co2 = co2;
+        rec.filterRelHumidity = filterRelHumidity;
+        rec.filterCo2 = filterCo2;
+        rec.flags = Co2LogSegment::Valid | Co2LogSegment::FanAuto | (fanOn ? Co2LogSegment::FanOn : 0);
+        count++;
+    }
+
+    return count;
+}
+
+static int benchCompress(int argc, char* argv[])
+{
+    int days = (argc > 0) ? atoi(argv[0]) : 365;
+    const uint16_t kSlotInterval = 10;
+
+    if (days <= 0) {
+        fprintf(stderr, "days must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    struct tm tmStart;
+    memset(&tmStart, 0, sizeof(tmStart));
+    tmStart.tm_year = 2025 - 1900;
+    tmStart.tm_mday = 1;
+    tmStart.tm_isdst = -1;
+
+    Co2SensorSim sensor;
+    sensor.init();
+
+    int filterRelHumidity = 0;
+    int filterCo2 = 0;
+    size_t recordCount = 0;
+    size_t csvBytes = 0;
+    size_t segmentBytes = 0;
+    size_t compressedBytes = 0;
+    double encodeSecs = 0.0;
+    double decodeSecs = 0.0;
+
+    std::vector<Co2LogSegment::Record> records;
+    std::vector<Co2LogSegment::Record> decoded;
+    std::vector<uint8_t> encoded;
+    std::string csv;
+
+    time_t baseTime = mktime(&tmStart);
+
+    for (int day = 0; day < days; day++) {
+        size_t count = simulateDay(sensor, kSlotInterval, baseTime, records, filterRelHumidity, filterCo2);
+
+        csv.clear();
+
+        for (auto& rec : records) {
+            if (rec.flags & Co2LogSegment::Valid) {
+                Co2LogSegment::formatCsv(csv, rec, baseTime + rec.timeOffset);
+            }
+        }
+
+        encoded.clear();
+
+        auto startTime = std::chrono::steady_clock::now();
+        size_t encodedCount = Co2LogCompress::encode(records.data(), records.size(), encoded);
+        encodeSecs += secondsSince(startTime);
+
+        decoded.clear();
+
+        startTime = std::chrono::steady_clock::now();
+        bool isOk = Co2LogCompress::decode(encoded.data(), encoded.size(), encodedCount, decoded);
+        decodeSecs += secondsSince(startTime);
+
+        if (!isOk || (decoded.size() != count) || memcmp(decoded.data(), records.data(), count * sizeof(Co2LogSegment::Record))) {
+            fprintf(stderr, "day %d: decoded records don't match originals\n", day);
+            return EXIT_FAILURE;
+        }
+
+        recordCount += count;
+        csvBytes += csv.size();
+        segmentBytes += count * sizeof(Co2LogSegment::Record);
+        compressedBytes += encoded.size() + sizeof(Co2LogCompress::Header);
+
+        baseTime = Co2LogSegment::dayStart(baseTime + (30 * 60 * 60));
+    }
+
+    double segmentMB = segmentBytes / (1024.0 * 1024.0);
+
+    printf("%d days, %zu readings from Co2SensorSim every %us\n", days, recordCount, kSlotInterval);
+    printf("  CSV:         %12zu bytes  %6.2f bytes/reading\n", csvBytes, double(csvBytes) / recordCount);
+    printf("  segment:     %12zu bytes  %6.2f bytes/reading\n", segmentBytes, double(segmentBytes) / recordCount);
+    printf("  compressed:  %12zu bytes  %6.2f bytes/reading\n", compressedBytes, double(compressedBytes) / recordCount);
+    printf("  ratio:       %.1f:1 vs CSV, %.1f:1 vs segment\n",
+           double(csvBytes) / compressedBytes, double(segmentBytes) / compressedBytes);
+    printf("  encode:      %8.3fs  %6.1fM readings/s  %7.1fMB/s\n",
+           encodeSecs, recordCount / encodeSecs / 1e6, segmentMB / encodeSecs);
+    printf("  decode:      %8.3fs  %6.1fM readings/s  %7.1fMB/s\n",
+           decodeSecs, recordCount / decodeSecs / 1e6, segmentMB / decodeSecs);
+
+    return EXIT_SUCCESS;
+}
+
+// Builds what the SCD30 would send in reply: each word followed by its CRC8.
+static void scd30Response(const uint16_t* words, int nWords, uint8_t* buf)
+{
+    for (int w = 0; w < nWords; w++) {
+        std::array<uint8_t, Co2SensorSCD30::kCommandBufSize> cmdBuf;
+
+        // encodeCommand() frames an argument exactly as the sensor frames a response word
+        Co2SensorSCD30::encodeCommand(0, std::span<const uint16_t>(&words[w], 1), cmdBuf);
+        memcpy(&buf[w * 3], &cmdBuf[2], 3);
+    }
+}
+
+static int benchScd30(int argc, char* argv[])
+{
+    long iterations = (argc > 0) ? atol(argv[0]) : 1000000;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "iterations must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    // SCD30 command codes for data ready status and read measurement
+    const uint16_t kDataReadyStatusCmd = 0x0202;
+    const uint16_t kReadMeasurementCmd = 0x0300;
+
+    // 612.5ppm, 21.25C, 48.5%RH as big endian floats
+    const float kMeasurements[] = { 612.5f, 21.25f, 48.5f };
+    uint16_t words[Co2SensorSCD30::kMeasurementWords];
+
+    for (int i = 0; i < 3; i++) {
+        uint32_t u32;
+        memcpy(&u32, &kMeasurements[i], sizeof(u32));
+        words[i * 2] = u32 >> 16;
+        words[(i * 2) + 1] = u32 & 0xffff;
+    }
+
+    const uint16_t kReady = 1;
+    uint8_t readyBuf[3];
+    uint8_t measurementBuf[Co2SensorSCD30::kResponseBufSize];
+
+    scd30Response(&kReady, 1, readyBuf);
+    scd30Response(words, Co2SensorSCD30::kMeasurementWords, measurementBuf);
+
+    float co2ppm = 0.0;
+    float temperature = 0.0;
+    float relHumidity = 0.0;
+    size_t cmdBytes = 0;
+
+    // Same framing as each Co2SensorSCD30::readMeasurements():
+    // data ready status command and response, then read measurement
+    // command and response. Only the I2C transfers are left out.
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        std::array<uint8_t, Co2SensorSCD30::kCommandBufSize> cmdBuf;
+        uint16_t ready;
+        std::array<uint16_t, Co2SensorSCD30::kMeasurementWords> responseWords;
+
+        cmdBytes += Co2SensorSCD30::encodeCommand(kDataReadyStatusCmd, std::span<const uint16_t>(), cmdBuf);
+        Co2SensorSCD30::decodeResponse(readyBuf, std::span<uint16_t>(&ready, 1));
+
+        cmdBytes += Co2SensorSCD30::encodeCommand(kReadMeasurementCmd, std::span<const uint16_t>(), cmdBuf);
+        Co2SensorSCD30::decodeResponse(measurementBuf, responseWords);
+        Co2SensorSCD30::decodeMeasurements(responseWords, co2ppm, temperature, relHumidity);
+    }
+
+    double secs = secondsSince(startTime);
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    printf("%ld SCD30 reads (%zu command bytes): %.1f C  %.1f %%RH  %.1f ppm\n",
+           iterations, cmdBytes, temperature, relHumidity, co2ppm);
+    printf("  heap allocations: %llu (%.3f per read)\n", (unsigned long long)allocations, double(allocations) / iterations);
+    printf("  framing:          %.1fns per read\n", (secs * 1e9) / iterations);
+
+    if ((co2ppm != kMeasurements[0]) || (temperature != kMeasurements[1]) || (relHumidity != kMeasurements[2])) {
+        fprintf(stderr, "decoded measurements don't match\n");
+        return EXIT_FAILURE;
+    }
+
+    if (allocations) {
+        fprintf(stderr, "SCD30 read path allocated memory\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Bitwise CRCs and word at a time internet checksum, as they were in
+// Co2SensorK30, Co2SensorSCD30 and Ping before the Checksum module.
+static uint16_t legacyCrc16(const uint8_t* data, size_t len)
+{
+    uint16_t crc16 = 0xffff;
+    const uint16_t polyVal = 0xa001;
+
+    for (size_t i = 0; i < len; i++) {
+        crc16 ^= data[i] & 0xff;
+
+        for (int j = 0; j < 8; j++) {
+            if (crc16 & 1) {
+                crc16 >>= 1;
+                crc16 ^= polyVal;
+            } else {
+                crc16 >>= 1;
+            }
+        }
+    }
+
+    return crc16;
+}
+
+static uint8_t legacyCrc8(const uint8_t* data, size_t len)
+{
+    const uint8_t polynomial = 0x31;
+    uint8_t crc = 0xff;
+
+    for (size_t j = 0; j < len; j++) {
+        crc ^= data[j];
+
+        for (int i = 8; i; --i) {
+            crc = (crc & 0x80) ? (crc << 1) ^ polynomial : (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t legacyInternet(const void* addr, size_t len)
+{
+    uint32_t sum = 0;
+    const uint16_t* pBuf = (const uint16_t*)addr;
+
+    while (len > 1) {
+        sum += *pBuf++;
+        len -= sizeof(uint16_t);
+    }
+
+    if (len > 0) {
+        sum += *(const uint8_t*)pBuf;
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
+typedef struct {
+    const char* name;
+    size_t len;
+    uint32_t (*legacyFn)(const uint8_t* data, size_t len);
+    uint32_t (*fn)(const uint8_t* data, size_t len);
+} ChecksumCase;
+
+// Times fn over len bytes, iterations times; returns ns per call
+static double timeChecksum(uint32_t (*fn)(const uint8_t* data, size_t len), const uint8_t* data, size_t len, long iterations)
+{
+    // Summing results stops the compiler throwing the work away
+    volatile uint32_t sink = 0;
+    uint32_t sum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        sum += fn(data + (i & 7), len);
+    }
+
+    sink = sum;
+    (void)sink;
+
+    return (secondsSince(startTime) * 1e9) / iterations;
+}
+
+static int benchCrc(int argc, char* argv[])
+{
+    long iterations = (argc > 0) ? atol(argv[0]) : 10000000;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "iterations must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    static const ChecksumCase kCases[] = {
+        // SCD30: CRC8 per 2 byte word
+        { "crc8 SCD30 word", 2,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc8(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc8Sensirion(d, n); } },
+        // K30: single register reply, multi-register reply
+        { "crc16 bytewise K30 read", 5,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16ModbusBytewise(d, n); } },
+        { "crc16 slice-by-4 K30 read", 5,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16Modbus(d, n); } },
+        { "crc16 bytewise K30 read all", 17,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16ModbusBytewise(d, n); } },
+        { "crc16 slice-by-4 K30 read all", 17,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16Modbus(d, n); } },
+        { "crc16 bytewise 256 bytes", 256,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16ModbusBytewise(d, n); } },
+        { "crc16 slice-by-4 256 bytes", 256,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyCrc16(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::crc16Modbus(d, n); } },
+        // Ping: IPv4 header, ICMP echo request
+        { "internet IPv4 hdr", 20,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyInternet(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::internet(d, n); } },
+        { "internet ICMP echo", 8 + 56,
+          [](const uint8_t* d, size_t n) -> uint32_t { return legacyInternet(d, n); },
+          [](const uint8_t* d, size_t n) -> uint32_t { return Checksum::internet(d, n); } },
+    };
+
+    uint8_t data[512];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = uint8_t((i * 131) + 7);
+    }
+
+    // Check new against legacy for every length and alignment first
+    for (auto& c : kCases) {
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t len = 0; len <= 300; len++) {
+                if (c.legacyFn(data + offset, len) != c.fn(data + offset, len)) {
+                    fprintf(stderr, "%s: result differs from legacy for %zu bytes at offset %zu\n", c.name, len, offset);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    printf("%-30s %6s %12s %12s %8s\n", "checksum", "bytes", "legacy ns", "new ns", "speedup");
+
+    for (auto& c : kCases) {
+        double legacyNs = timeChecksum(c.legacyFn, data, c.len, iterations);
+        double ns = timeChecksum(c.fn, data, c.len, iterations);
+
+        printf("%-30s %6zu %12.2f %12.2f %7.1fx\n", c.name, c.len, legacyNs, ns, legacyNs / ns);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Runs each filter over a slowly varying CO2 level with noise and the
+// occasional spike, as from a sensor glitch, timing it and measuring how
+// far its output strays from the underlying level.
+static int benchFilter(int argc, char* argv[])
+{
+    int sampleCount = (argc > 0) ? atoi(argv[0]) : 1000000;
+    const int kSpikeInterval = 97;  // samples
+
+    if (sampleCount <= 0) {
+        fprintf(stderr, "samples must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* specs[] = {
+        "none", "ema:0.2", "median:5", "hampel:7:3", "kalman:1:100", "hampel:7:3,ema:0.2", "median:15,kalman:1:100"
+    };
+
+    std::vector<Co2Filter::Sample> samples(sampleCount);
+    std::vector<float> levels(sampleCount);
+    uint32_t random = 12345;
+
+    for (int i = 0; i < sampleCount; i++) {
+        random = (random * 1103515245) + 12345;
+
+        float level = 600 + (300 * std::sin(i / 5000.0));
+        float noise = (int((random >> 16) % 41) - 20);
+
+        levels[i] = level;
+        samples[i].value[Co2Filter::Co2] = level + noise + (((i % kSpikeInterval) == (kSpikeInterval - 1)) ? 5000 : 0);
+        samples[i].value[Co2Filter::Temperature] = 2000 + (noise / 10);
+        samples[i].value[Co2Filter::RelHumidity] = 5000 + noise;
+    }
+
+    printf("%d samples with noise of +/-20ppm and a 5000ppm spike every %d\n", sampleCount, kSpikeInterval);
+    printf("%-24s %10s %12s %12s %12s\n", "filter (all channels)", "ns/sample", "mean error", "max error", "allocations");
+
+    for (auto spec : specs) {
+        Co2Filter co2Filter;
+        double errorSum = 0;
+        double maxError = 0;
+
+        for (int channel = 0; channel < Co2Filter::ChannelCount; channel++) {
+            co2Filter.configure(Co2Filter::Channel(channel), spec);
+        }
+
+        uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        auto startTime = std::chrono::steady_clock::now();
+
+        for (auto& sample : samples) {
+            co2Filter.update(sample);
+        }
+
+        double secs = secondsSince(startTime);
+        uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+        // again, for error, outside timed loop
+        co2Filter.reset();
+
+        for (int i = 0; i < sampleCount; i++) {
+            double error = std::fabs(co2Filter.update(samples[i]).value[Co2Filter::Co2] - levels[i]);
+
+            errorSum += error;
+            maxError = std::max(maxError, error);
+        }
+
+        printf("%-24s %10.1f %10.1fppm %10.1fppm %12llu\n", spec, (secs * 1e9) / sampleCount,
+               errorSum / sampleCount, maxError, (unsigned long long)allocations);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int benchReplay(int argc, char* argv[])
+{
+    time_t startTime;
+    time_t endTime;
+
+    if ((argc < 2) || !Co2SensorReplay::parseTime(argv[1], startTime)) {
+        fprintf(stderr, "replay needs a log dir and start time (YYYY-MM-DD [HH:MM[:SS]])\n");
+        return EXIT_FAILURE;
+    }
+
+    if (argc < 3) {
+        endTime = startTime + (24 * 60 * 60) - 1;
+    } else if (!Co2SensorReplay::parseTime(argv[2], endTime)) {
+        fprintf(stderr, "invalid end time \"%s\"\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    // Default fan thresholds (Co2Defaults), in the same units as readings
+    const int kRelHumidityThreshold = 70 * 100;
+    const int kCo2Threshold = 999;
+
+    Co2SensorReplay sensor(argv[0], startTime, endTime, 0, false);
+
+    try {
+        sensor.init();
+    } catch (CO2::exceptionLevel& el) {
+        fprintf(stderr, "%s\n", el.what());
+        return EXIT_FAILURE;
+    }
+
+    Co2Filter co2Filter;
+    bool fanStateOn = false;
+    size_t fanSwitchCount = 0;
+    size_t readCount = 0;
+    uint64_t digest = 0xcbf29ce484222325ULL; // FNV-1a
+    double readSecs = 0.0;
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+
+    // Step through readings with the same (default) filters and Auto fan
+    // decision as Co2Monitor, so that runs over the same logs can be
+    // compared before and after a change.
+    while (true) {
+        int co2;
+        int temperature;
+        int relHumidity;
+
+        auto startRead = std::chrono::steady_clock::now();
+
+        try {
+            sensor.readMeasurements(co2, temperature, relHumidity);
+        } catch (CO2::exceptionLevel& el) {
+            break;  // replay finished
+        }
+
+        readSecs += secondsSince(startRead);
+        readCount++;
+
+        const Co2Filter::Sample& filtered = co2Filter.update({ { float(co2), float(temperature), float(relHumidity) } });
+        int filterCo2 = std::lround(filtered.value[Co2Filter::Co2]);
+        int filterRelHumidity = std::lround(filtered.value[Co2Filter::RelHumidity]);
+
+        bool newFanStateOn = (filterRelHumidity > kRelHumidityThreshold) || (filterCo2 > kCo2Threshold);
+
+        if (newFanStateOn != fanStateOn) {
+            fanSwitchCount++;
+            fanStateOn = newFanStateOn;
+        }
+
+        for (int value : { co2, temperature, relHumidity, filterCo2, filterRelHumidity, int(fanStateOn) }) {
+            digest = (digest ^ uint32_t(value)) * 0x100000001b3ULL;
+        }
+    }
+
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    printf("%zu readings replayed from %s\n", readCount, argv[0]);
+    printf("  fan switched:     %zu times (RH > %d%% or CO2 > %dppm)\n", fanSwitchCount, kRelHumidityThreshold / 100, kCo2Threshold);
+    printf("  digest:           %016llx\n", (unsigned long long)digest);
+    printf("  replay:           %.1fns per reading  %.2fM readings/s\n",
+           (readSecs * 1e9) / readCount, readCount / readSecs / 1e6);
+    printf("  heap allocations: %llu (%.3f per reading)\n", (unsigned long long)allocations, double(allocations) / readCount);
+
+    return EXIT_SUCCESS;
+}
+
+// A CO2_STATE as Co2Monitor::publishCo2State() sends it, with two sensors
+static void fillCo2State(co2Message::Co2Message& co2Msg, long i)
+{
+    co2Message::Co2State* co2State = co2Msg.mutable_co2state();
+
+    co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_CO2_STATE);
+    co2State->set_temperature(2125 + (i % 100));
+    co2State->set_relhumidity(4850 + (i % 500));
+    co2State->set_co2(612 + (i % 400));
+    co2State->set_fanstate(co2Message::Co2State_FanStates_AUTO_OFF);
+    co2State->set_fandutycycle(0);
+
+    const char* names[] = { "scd30", "k30" };
+
+    for (auto name : names) {
+        co2Message::Co2State_SensorReading* sensorReading = co2State->add_sensors();
+
+        sensorReading->set_name(name);
+        sensorReading->set_sensortype(name);
+        sensorReading->set_isfresh(true);
+        sensorReading->set_temperature(co2State->temperature());
+        sensorReading->set_relhumidity(co2State->relhumidity());
+        sensorReading->set_co2(co2State->co2());
+    }
+
+    co2Message::FanRuntime* fanRuntime = co2State->mutable_fanruntime();
+
+    fanRuntime->set_day(20260);
+    fanRuntime->set_ontime(i % 86400);
+    fanRuntime->set_dutytime(i % 86400);
+    fanRuntime->set_switchcount(i % 100);
+    co2State->mutable_timestamp()->set_seconds(static_cast<int>(1790000000 + i));
+}
+
+// One message from publisher to listener, the way every publisher and
+// listener used to do it: serialize to a std::string, copy that into a
+// new zmq message, copy the zmq message into another std::string and
+// parse that into a new Co2Message. Against CO2::serializeMsg() and
+// CO2::parseMsg() with Co2Messages reused, and parsing into a
+// CO2::MsgArena as the listeners now do.
+//
+// All make one zmq message per message sent, as the socket takes it.
+// zmq allocates message buffers with malloc(), so they are not counted.
+static int benchMessaging(int argc, char* argv[])
+{
+    long iterations = (argc > 0) ? atol(argv[0]) : 1000000;
+
+    if (iterations <= 0) {
+        fprintf(stderr, "iterations must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t checksum[3] = { 0, 0, 0 };
+    uint64_t allocations[3];
+    uint64_t bytesCopied[3] = { 0, 0, 0 };
+    size_t msgSize = 0;
+    double secs[3];
+
+    uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        co2Message::Co2Message txMsg;
+        std::string txStr;
+
+        fillCo2State(txMsg, i);
+        txMsg.SerializeToString(&txStr);
+
+        zmq::message_t msg(txStr.size());
+
+        memcpy(msg.data(), txStr.c_str(), txStr.size());
+
+        std::string msg_str(static_cast<char*>(msg.data()), msg.size());
+        co2Message::Co2Message rxMsg;
+
+        if (rxMsg.ParseFromString(msg_str)) {
+            checksum[0] += rxMsg.co2state().co2() + rxMsg.co2state().sensors_size();
+        }
+
+        bytesCopied[0] += txStr.size() + msg_str.size();
+        msgSize = msg.size();
+    }
+
+    secs[0] = secondsSince(startTime);
+    allocations[0] = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    co2Message::Co2Message txMsg;
+    co2Message::Co2Message rxMsg;
+
+    // first message allocates the Co2State, sensors and strings, which are reused from then on
+    fillCo2State(txMsg, 0);
+
+    allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    startTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        zmq::message_t msg;
+
+        txMsg.mutable_co2state()->Clear();
+        fillCo2State(txMsg, i);
+        CO2::serializeMsg(txMsg, msg);
+
+        if (CO2::parseMsg(msg, rxMsg)) {
+            checksum[1] += rxMsg.co2state().co2() + rxMsg.co2state().sensors_size();
+        }
+    }
+
+    secs[1] = secondsSince(startTime);
+    allocations[1] = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    // and parsed into a CO2::MsgArena, as the listeners do
+    CO2::MsgArena msgArena;
+
+    allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+    startTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < iterations; i++) {
+        zmq::message_t msg;
+        co2Message::Co2Message& arenaMsg = *msgArena.newMsg();
+
+        txMsg.mutable_co2state()->Clear();
+        fillCo2State(txMsg, i);
+        CO2::serializeMsg(txMsg, msg);
+
+        if (CO2::parseMsg(msg, arenaMsg)) {
+            checksum[2] += arenaMsg.co2state().co2() + arenaMsg.co2state().sensors_size();
+        }
+    }
+
+    secs[2] = secondsSince(startTime);
+    allocations[2] = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+
+    printf("%ld CO2_STATE messages of %zu bytes, build + serialize + parse:\n", iterations, msgSize);
+    printf("  %-22s %8s %10s %12s\n", "", "ns/msg", "allocs/msg", "copied/msg");
+
+    const char* ways[] = { "string copies", "serializeMsg/parseMsg", "parseMsg into MsgArena" };
+
+    for (int w = 0; w < 3; w++) {
+        printf("  %-22s %8.1f %10.2f %12.1f\n", ways[w], (secs[w] * 1e9) / iterations,
+               double(allocations[w]) / iterations, double(bytesCopied[w]) / iterations);
+    }
+
+    printf("  MsgArena: %llu resets, %llu batches overflowed its block\n",
+           (unsigned long long)msgArena.resetCount(), (unsigned long long)msgArena.overflowCount());
+
+    if ((checksum[0] != checksum[1]) || (checksum[0] != checksum[2])) {
+        fprintf(stderr, "parsed messages don't match\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Stands in for the zmq PUB/SUB socket pair between Co2Monitor and the
+// display thread. Like a zmq socket at its high water mark, messages
+// are dropped when the display falls too far behind.
+class BenchBus
+{
+    public:
+        typedef struct {
+            zmq::message_t msg;
+            std::chrono::steady_clock::time_point readTime;
+            std::chrono::steady_clock::time_point sendTime;
+        } Entry;
+
+        BenchBus(size_t highWaterMark) : kHighWaterMark_(highWaterMark), isClosed_(false), dropCount_(0) {}
+
+        void send(Entry& entry)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (queue_.size() >= kHighWaterMark_) {
+                    dropCount_++;
+                    return;
+                }
+
+                queue_.push_back(std::move(entry));
+            }
+
+            cv_.notify_one();
+        }
+
+        // false once closed and empty
+        bool receive(Entry& entry)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            cv_.wait(lock, [this] { return isClosed_ || !queue_.empty(); });
+
+            if (queue_.empty()) {
+                return false;
+            }
+
+            entry = std::move(queue_.front());
+            queue_.pop_front();
+
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                isClosed_ = true;
+            }
+
+            cv_.notify_all();
+        }
+
+        uint64_t dropCount() { return dropCount_; }
+
+    private:
+        const size_t kHighWaterMark_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Entry> queue_;
+        bool isClosed_;
+        uint64_t dropCount_;
+};
+
+static void printStage(const char* stage, const LatencyHistogram& latency)
+{
+    printf("  %-16s %s\n", stage, latency.summary().c_str());
+}
+
+static void printCpu(const char* stage, uint64_t cpuNsec, double secs)
+{
+    printf("  %-16s %.3fs (%.1f%% of one core)\n", stage, cpuNsec / 1e9, (cpuNsec / 1e7) / secs);
+}
+
+// Drives the Co2Monitor pipeline in stress mode: a sim sensor read by
+// Co2SensorReader, readings fused, filtered and published as Co2State
+// by a Co2Scheduler task, parsed by a display thread and logged by
+// Co2LogWriter. zmq is replaced by an in-process queue, so this
+// measures our own stages rather than the transport.
+static int benchPipeline(int argc, char* argv[])
+{
+    int sampleRate = (argc > 0) ? atoi(argv[0]) : 1000;
+    int seconds = (argc > 1) ? atoi(argv[1]) : 5;
+
+    if ((sampleRate <= 0) || (sampleRate > 1000000) || (seconds <= 0)) {
+        fprintf(stderr, "rate must be 1..1000000 samples/s and seconds > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::microseconds sampleInterval(1000000 / sampleRate);
+    std::filesystem::path logDir = std::filesystem::temp_directory_path() / fmt::format("co2Bench.{}", getpid());
+
+    std::filesystem::create_directories(logDir);
+
+    Co2SensorReader sensorReader("sim", "sim", new Co2SensorSim(), sampleInterval);
+    Co2LogWriter logWriter(logDir.string(), Co2LogWriter::Binary, 1, false, 64, 60, 600);
+    BenchBus bus(1000);  // zmq's default high water mark
+
+    LatencyHistogram fuseLatency;
+    LatencyHistogram publishLatency;
+    LatencyHistogram busLatency;
+    LatencyHistogram parseLatency;
+    LatencyHistogram endToEndLatency;
+
+    uint64_t lastSequence = 0;
+    uint64_t missedCount = 0;
+    uint64_t publishCount = 0;
+    uint64_t displayCount = 0;
+    uint64_t logDropCount = 0;
+    Co2Filter co2Filter;
+    uint64_t publisherCpuNsec = 0;
+    uint64_t displayCpuNsec = 0;
+    uint64_t publisherAllocations = 0;
+    uint64_t displayAllocations = 0;
+
+    Co2Scheduler scheduler;
+    co2Message::Co2Message co2Msg;
+
+    // As Co2Monitor::acquireCo2Reading() and publishCo2State()
+    scheduler.addTask("sensor fusion", sampleInterval, sampleInterval / 2, [&] {
+        Co2SensorReader::Reading reading = sensorReader.latest();
+
+        if (!reading.isValid || (reading.sequence == lastSequence)) {
+            return;
+        }
+
+        missedCount += reading.sequence - lastSequence - 1;
+        lastSequence = reading.sequence;
+
+        auto startPublish = std::chrono::steady_clock::now();
+
+        fuseLatency.record(startPublish - reading.readTime);
+
+        const Co2Filter::Sample& filtered = co2Filter.update({ { float(reading.co2), float(reading.temperature),
+                                                                 float(reading.relHumidity) } });
+
+        co2Message::Co2State* co2State = co2Msg.mutable_co2state();
+        time_t timeNow = time(0);
+
+        co2State->Clear();
+
+        co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_CO2_STATE);
+        co2State->set_temperature(reading.temperature);
+        co2State->set_relhumidity(reading.relHumidity);
+        co2State->set_co2(reading.co2);
+        co2State->set_fanstate(co2Message::Co2State_FanStates_AUTO_OFF);
+
+        co2Message::Co2State_SensorReading* sensorReading = co2State->add_sensors();
+
+        sensorReading->set_name(sensorReader.name());
+        sensorReading->set_sensortype(sensorReader.sensorType());
+        sensorReading->set_isfresh(true);
+        sensorReading->set_temperature(reading.temperature);
+        sensorReading->set_relhumidity(reading.relHumidity);
+        sensorReading->set_co2(reading.co2);
+        co2State->mutable_timestamp()->set_seconds(static_cast<int>(timeNow));
+
+        BenchBus::Entry entry;
+
+        CO2::serializeMsg(co2Msg, entry.msg);
+        entry.readTime = reading.readTime;
+        entry.sendTime = std::chrono::steady_clock::now();
+        bus.send(entry);
+
+        Co2LogWriter::Reading logReading;
+
+        logReading.temperature = reading.temperature;
+        logReading.relHumidity = reading.relHumidity;
+        logReading.co2 = reading.co2;
+        logReading.fanStateOn = false;
+        logReading.fanAuto = true;
+        logReading.fanDuty = 0;
+        logReading.filterRelHumidity = std::lround(filtered.value[Co2Filter::RelHumidity]);
+        logReading.filterCo2 = std::lround(filtered.value[Co2Filter::Co2]);
+        logReading.timestamp = timeNow;
+
+        if (!logWriter.push(logReading)) {
+            logDropCount++;
+        }
+
+        publishCount++;
+        publishLatency.record(std::chrono::steady_clock::now() - startPublish);
+    });
+
+    // As Co2Display::listener() receiving CO2_STATE
+    std::thread displayThread([&] {
+        BenchBus::Entry entry;
+        CO2::MsgArena msgArena;
+
+        while (bus.receive(entry)) {
+            co2Message::Co2Message& co2Msg = *msgArena.newMsg();
+            auto receiveTime = std::chrono::steady_clock::now();
+
+            busLatency.record(receiveTime - entry.sendTime);
+
+            if (CO2::parseMsg(entry.msg, co2Msg) && co2Msg.has_co2state()) {
+                displayCount++;
+            }
+
+            auto parsedTime = std::chrono::steady_clock::now();
+
+            parseLatency.record(parsedTime - receiveTime);
+            endToEndLatency.record(parsedTime - entry.readTime);
+        }
+
+        displayCpuNsec = LatencyHistogram::threadCpuNsec();
+        displayAllocations = threadAllocationCount;
+    });
+
+    std::thread publisherThread([&] {
+        scheduler.run();
+        publisherCpuNsec = LatencyHistogram::threadCpuNsec();
+        publisherAllocations = threadAllocationCount;
+    });
+
+    logWriter.start();
+    sensorReader.initSensor();
+    sensorReader.start();
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    sensorReader.stop();
+    scheduler.stop();
+    publisherThread.join();
+
+    double secs = secondsSince(startTime);
+
+    bus.close();
+    displayThread.join();
+    logWriter.stop();
+
+    Co2LogWriter::Stats logStats = logWriter.stats();
+    uint64_t readCount = sensorReader.readLatency().count();
+
+    std::filesystem::remove_all(logDir);
+
+    printf("pipeline at %d samples/s for %.1fs (sim sensor, in-process bus)\n", sampleRate, secs);
+    printf("  sensor reads:    %llu (%.0f/s)\n", (unsigned long long)readCount, readCount / secs);
+    printf("  published:       %llu (%.0f/s)  missed %llu readings never fused\n",
+           (unsigned long long)publishCount, publishCount / secs, (unsigned long long)missedCount);
+    printf("  displayed:       %llu (%.0f/s)  %llu dropped by bus\n",
+           (unsigned long long)displayCount, displayCount / secs, (unsigned long long)bus.dropCount());
+    printf("  logged:          %llu (%.0f/s)  %llu dropped by log writer\n",
+           (unsigned long long)logStats.recordsWritten, logStats.recordsWritten / secs,
+           (unsigned long long)(logDropCount + logStats.recordsDropped));
+    printf("latency per stage:\n");
+    printStage("sensor read", sensorReader.readLatency());
+    printStage("read to fused", fuseLatency);
+    printStage("publish", publishLatency);
+    printStage("bus", busLatency);
+    printStage("display parse", parseLatency);
+    printStage("read to display", endToEndLatency);
+    printf("  %-16s flushes=%llu mean=%.1fus max=%.1fus\n", "log flush", (unsigned long long)logStats.flushCount,
+           logStats.flushCount ? double(logStats.totalFlushUsec) / logStats.flushCount : 0.0, double(logStats.maxFlushUsec));
+    printf("cpu per stage:\n");
+    printCpu("sensor reader", sensorReader.cpuNsec(), secs);
+    printCpu("fuse/publish", publisherCpuNsec, secs);
+    printCpu("display", displayCpuNsec, secs);
+    printCpu("log writer", logStats.cpuUsec * 1000, secs);
+    printf("heap allocations per message:\n");
+    printf("  %-16s %.2f\n", "fuse/publish", publishCount ? double(publisherAllocations) / publishCount : 0.0);
+    printf("  %-16s %.2f\n", "display", displayCount ? double(displayAllocations) / displayCount : 0.0);
+
+    return EXIT_SUCCESS;
+}
+
+typedef struct {
+    LatencyHistogram toMain;
+    LatencyHistogram toDisplay;
+    uint64_t monitorCpuNsec;
+    uint64_t mainCpuNsec;
+    uint64_t displayCpuNsec;
+    uint64_t mainCount;
+    uint64_t displayCount;
+    double secs;
+} BusResult;
+
+// Sends messages Co2States, one every interval (or back to back), by
+// calling send(i) and waiting until it's time for the next one.
+template <typename SendFn>
+static void sendCo2States(long messages, std::chrono::microseconds interval, SendFn send)
+{
+    auto nextTime = std::chrono::steady_clock::now();
+
+    for (long i = 0; i < messages; i++) {
+        send(i);
+
+        if (interval.count() > 0) {
+            nextTime += interval;
+            std::this_thread::sleep_until(nextTime);
+        }
+    }
+}
+
+// As Co2Monitor -> Co2Main -> Co2Display with MessageTransport "zmq":
+// serialized and sent on an inproc PAIR socket, parsed by Co2Main and
+// forwarded on PUB with a topic frame, parsed again by Co2Display.
+static void runZmqBus(long messages, std::chrono::microseconds interval, BusResult& result)
+{
+    const char* monitorEndpoint = "inproc://co2BenchMonitor";
+    const char* mainPubEndpoint = "inproc://co2BenchMainPub";
+    zmq::context_t context(1);
+    std::vector<std::chrono::steady_clock::time_point> sendTimes(messages);
+    auto msgIndex = [](const co2Message::Co2Message& co2Msg) {
+        return co2Msg.co2state().timestamp().seconds() - 1790000000;  // as set by fillCo2State()
+    };
+
+    zmq::socket_t monitorSkt(context, ZMQ_PAIR);
+    zmq::socket_t mainSkt(context, ZMQ_PAIR);
+    zmq::socket_t mainPubSkt(context, ZMQ_PUB);
+    zmq::socket_t displaySkt(context, ZMQ_SUB);
+
+    mainSkt.bind(monitorEndpoint);
+    monitorSkt.connect(monitorEndpoint);
+    mainPubSkt.bind(mainPubEndpoint);
+    displaySkt.connect(mainPubEndpoint);
+    CO2::subscribe(displaySkt, co2Message::Co2Message_Co2MessageType_CO2_STATE);
+    CO2::subscribe(displaySkt, co2Message::Co2Message_Co2MessageType_TERMINATE);
+
+    // let the subscriptions reach the PUB socket
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::thread mainThread([&] {
+        CO2::MsgArena msgArena;
+
+        while (true) {
+            zmq::message_t msg;
+
+            if (!mainSkt.recv(msg)) {
+                continue;
+            }
+
+            co2Message::Co2Message& co2Msg = *msgArena.newMsg();
+
+            if (!CO2::parseMsg(msg, co2Msg)) {
+                continue;
+            }
+
+            if (co2Msg.messagetype() == co2Message::Co2Message_Co2MessageType_TERMINATE) {
+                CO2::publishMsg(mainPubSkt, co2Msg);
+                break;
+            }
+
+            result.toMain.record(std::chrono::steady_clock::now() - sendTimes[msgIndex(co2Msg)]);
+            result.mainCount++;
+            CO2::publishMsg(mainPubSkt, co2Msg.messagetype(), msg);
+        }
+
+        result.mainCpuNsec = LatencyHistogram::threadCpuNsec();
+    });
+
+    std::thread displayThread([&] {
+        CO2::MsgArena msgArena;
+        CO2::MsgCounters rxMsgCounters;
+
+        while (true) {
+            zmq::message_t msg;
+
+            if (!CO2::recvPublished(displaySkt, msg, rxMsgCounters)) {
+                continue;
+            }
+
+            co2Message::Co2Message& co2Msg = *msgArena.newMsg();
+
+            if (!CO2::parseMsg(msg, co2Msg)) {
+                continue;
+            }
+
+            if (co2Msg.messagetype() == co2Message::Co2Message_Co2MessageType_TERMINATE) {
+                break;
+            }
+
+            result.toDisplay.record(std::chrono::steady_clock::now() - sendTimes[msgIndex(co2Msg)]);
+            result.displayCount++;
+        }
+
+        result.displayCpuNsec = LatencyHistogram::threadCpuNsec();
+    });
+
+    std::thread monitorThread([&] {
+        co2Message::Co2Message co2Msg;
+        auto startTime = std::chrono::steady_clock::now();
+
+        sendCo2States(messages, interval, [&](long i) {
+            co2Msg.mutable_co2state()->Clear();
+            fillCo2State(co2Msg, i);
+            sendTimes[i] = std::chrono::steady_clock::now();
+            CO2::sendMsg(monitorSkt, co2Msg);
+        });
+
+        result.secs = secondsSince(startTime);
+        result.monitorCpuNsec = LatencyHistogram::threadCpuNsec();
+
+        co2Message::Co2Message terminateMsg;
+
+        terminateMsg.set_messagetype(co2Message::Co2Message_Co2MessageType_TERMINATE);
+        CO2::sendMsg(monitorSkt, terminateMsg);
+    });
+
+    monitorThread.join();
+    mainThread.join();
+    displayThread.join();
+}
+
+// Waits on queue's eventfd as Co2Main and Co2Display do, calling
+// receive() for each Co2State, until isDone and the queue is empty.
+template <typename ReceiveFn>
+static uint64_t receiveCo2States(Co2EventBus::Co2StateQueue& queue, const std::atomic<bool>& isDone, ReceiveFn receive)
+{
+    Co2EventBus::Co2StateEvent co2State;
+    struct pollfd pfd = { queue.fd(), POLLIN, 0 };
+
+    while (true) {
+        bool isLast = isDone.load(std::memory_order_acquire);
+
+        while (queue.pop(co2State)) {
+            receive(co2State);
+        }
+
+        if (isLast) {
+            break;
+        }
+
+        int timeoutMsec = queue.prepareWait() ? 100 : 0;
+
+        poll(&pfd, 1, timeoutMsec);
+        queue.endWait();
+    }
+
+    return LatencyHistogram::threadCpuNsec();
+}
+
+// As Co2Monitor -> Co2Main and Co2Display with MessageTransport "bus":
+// the Co2State is built as a Co2Message, as Co2Monitor still does for
+// the log and zmq, converted to a Co2StateEvent and pushed to both.
+static void runEventBus(long messages, std::chrono::microseconds interval, BusResult& result)
+{
+    Co2EventBus eventBus;
+    std::atomic<bool> isDone(false);
+
+    std::thread mainThread([&] {
+        result.mainCpuNsec = receiveCo2States(eventBus.co2StateToMain(), isDone, [&](const Co2EventBus::Co2StateEvent& co2State) {
+            result.toMain.record(std::chrono::steady_clock::now() - co2State.publishTime);
+            result.mainCount++;
+        });
+    });
+
+    std::thread displayThread([&] {
+        result.displayCpuNsec = receiveCo2States(eventBus.co2StateToDisplay(), isDone, [&](const Co2EventBus::Co2StateEvent& co2State) {
+            result.toDisplay.record(std::chrono::steady_clock::now() - co2State.publishTime);
+            result.displayCount++;
+        });
+    });
+
+    std::thread monitorThread([&] {
+        co2Message::Co2Message co2Msg;
+        Co2EventBus::Co2StateEvent co2State;
+        auto startTime = std::chrono::steady_clock::now();
+
+        sendCo2States(messages, interval, [&](long i) {
+            co2Msg.mutable_co2state()->Clear();
+            fillCo2State(co2Msg, i);
+            Co2EventBus::fromMsg(co2Msg.co2state(), co2State);
+            co2State.publishTime = std::chrono::steady_clock::now();
+            eventBus.publish(co2State);
+        });
+
+        result.secs = secondsSince(startTime);
+        result.monitorCpuNsec = LatencyHistogram::threadCpuNsec();
+        isDone.store(true, std::memory_order_release);
+    });
+
+    monitorThread.join();
+    mainThread.join();
+    displayThread.join();
+}
+
+static void printBusResult(const char* transport, long messages, const BusResult& result)
+{
+    // each thread's CPU over the messages it handled, so drops don't flatter it
+    double monitorNsec = double(result.monitorCpuNsec) / messages;
+    double mainNsec = result.mainCount ? double(result.mainCpuNsec) / result.mainCount : 0.0;
+    double displayNsec = result.displayCount ? double(result.displayCpuNsec) / result.displayCount : 0.0;
+
+    printf("%s: %.1fs, %llu to Co2Main (%llu dropped), %llu to Co2Display (%llu dropped)\n", transport, result.secs,
+           (unsigned long long)result.mainCount, (unsigned long long)(messages - result.mainCount),
+           (unsigned long long)result.displayCount, (unsigned long long)(messages - result.displayCount));
+    printStage("to Co2Main", result.toMain);
+    printStage("to Co2Display", result.toDisplay);
+    printf("  %-16s monitor=%.0fns main=%.0fns display=%.0fns total=%.0fns\n", "cpu per message",
+           monitorNsec, mainNsec, displayNsec, monitorNsec + mainNsec + displayNsec);
+}
+
+// Co2State from Co2Monitor to Co2Main and Co2Display over each
+// MessageTransport: latency from publish to each consumer, and CPU per
+// message of all three threads, including waiting and waking. Both
+// build and fill the same Co2Message first, as Co2Monitor does.
+static int benchBus(int argc, char* argv[])
+{
+    long messages = (argc > 0) ? atol(argv[0]) : 100000;
+    long intervalUsec = (argc > 1) ? atol(argv[1]) : 100;
+
+    if ((messages <= 0) || (intervalUsec < 0)) {
+        fprintf(stderr, "messages must be > 0 and interval >= 0\n");
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::microseconds interval(intervalUsec);
+
+    printf("%ld CO2_STATE messages, %s\n", messages,
+           intervalUsec ? fmt::format("one every {}us", intervalUsec).c_str() : "back to back");
+
+    BusResult zmqResult = {};
+
+    runZmqBus(messages, interval, zmqResult);
+    printBusResult("zmq", messages, zmqResult);
+
+    BusResult busResult = {};
+
+    runEventBus(messages, interval, busResult);
+    printBusResult("bus", messages, busResult);
+
+    return EXIT_SUCCESS;
+}
+
+static const Benchmark kBenchmarks[] = {
+    { "bus", "[messages] [interval usec]", "latency and CPU per CO2_STATE message over zmq and Co2EventBus (default 100000, 100us)", benchBus },
+    { "compress", "[days]", "compressed log segment size and encode/decode speed (default 365 days)", benchCompress },
+    { "crc", "[iterations]", "CRC and internet checksums against the bitwise versions they replaced", benchCrc },
+    { "filter", "[samples]", "time and error of each Co2Filter over noisy CO2 readings with spikes", benchFilter },
+    { "messaging", "[iterations]", "copies, allocations and time per CO2_STATE message from publisher to listener", benchMessaging },
+    { "pipeline", "[rate] [seconds]", "samples/s, per-stage latency and CPU of the Co2Monitor pipeline driven by the sim sensor", benchPipeline },
+    { "replay", "dir start [end]", "step through logged readings with Co2SensorReplay; prints fan switches and a digest", benchReplay },
+    { "scd30", "[reads]", "heap allocations and time for SCD30 command/response framing (fails if any)", benchScd30 },
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        for (auto& bench : kBenchmarks) {
+            if (!strcmp(argv[1], bench.name)) {
+                return bench.fn(argc - 2, argv + 2);
+            }
+        }
+    }
+
+    fprintf(stderr, "usage: %s <benchmark> [args]\n\n", argv[0]);
+
+    for (auto& bench : kBenchmarks) {
+        fprintf(stderr, "  %-10s %-16s %s\n", bench.name, bench.args, bench.description);
+    }
+
+    return EXIT_FAILURE;
+}
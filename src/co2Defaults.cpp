@@ -29,11 +29,30 @@ void Co2Defaults::setConfigDefaults(ConfigMap& cfg)
 
     cfg["SensorType"] = new Config("sim");
     cfg["SensorPort"] = new Config("dummy");
+    cfg["SCD30RdyGpio"] = new Config(-1, -1, 511);
+    cfg["ReplayStart"] = new Config("");
+    cfg["ReplayEnd"] = new Config("");
+    cfg["ReplaySpeed"] = new Config(1, 0, 100000);
+    cfg["StressSampleRate"] = new Config(0, 0, 10000);
+    cfg["SampleIntervalMin"] = new Config(5, 2, 3600);
+    cfg["SampleIntervalMax"] = new Config(40, 2, 3600);
+    cfg["FastSampleCo2Rate"] = new Config(20, 1, 10000);
+    cfg["FastSampleRelHumRate"] = new Config(1.0);
+    cfg["FilterCo2"] = new Config("ema:0.2");
+    cfg["FilterTemperature"] = new Config("none");
+    cfg["FilterRelHumidity"] = new Config("ema:0.2");
 
     cfg["PersistentStoreFileName"] = new Config("/var/tmp/co2mon/state.info");
     cfg["PersistentStoreConfigFile"] = new Config("/var/tmp/co2mon/state.cfg");
+    cfg["FanRuntimeCheckpointInterval"] = new Config(600, 10, 86400);
 
     cfg["Co2LogBaseDir"] = new Config("/var/log/co2mon");
+    cfg["Co2LogFormat"] = new Config("binary");
+    cfg["MessageTransport"] = new Config("zmq");
+    cfg["Co2LogCompress"] = new Config(1, 0, 1);
+    cfg["Co2LogQueueSize"] = new Config(64, 8, 4096);
+    cfg["Co2LogFlushInterval"] = new Config(60, 0, 3600);
+    cfg["Co2LogFsyncInterval"] = new Config(600, 0, 86400);
 
     cfg["NetworkCheckPeriod"] = new Config(60);
     cfg["WatchdogKickPeriod"] = new Config(60);
@@ -61,6 +80,19 @@ void Co2Defaults::setConfigDefaults(ConfigMap& cfg)
     cfg["FanOnOverrideTime"] = new Config(30, 1, 180);
     cfg["RelHumFanOnThreshold"] = new Config(70, 10, 95);
     cfg["CO2FanOnThreshold"] = new Config(999, 200, 2000);
+    cfg["FanControlMode"] = new Config("threshold");
+    cfg["FanPredictHorizon"] = new Config(300, 0, 3600);
+    cfg["FanTrendWindow"] = new Config(300, 30, 3600);
+    cfg["CO2FanHysteresis"] = new Config(0, 0, 500);
+    cfg["RelHumFanHysteresis"] = new Config(0, 0, 20);
+    cfg["FanMinOnTime"] = new Config(0, 0, 3600);
+    cfg["FanMinOffTime"] = new Config(0, 0, 3600);
+    cfg["FanOutput"] = new Config("gpio");
+    cfg["FanOutputPath"] = new Config("");
+    cfg["FanPwmFrequency"] = new Config(25000, 1, 1000000);
+    cfg["FanPwmCurve"] = new Config("0:30,20:70,50:100");
+    cfg["FanPwmKp"] = new Config(0.0);
+    cfg["FanPwmKi"] = new Config(0.0);
 }
 
 void Co2Defaults::clearConfigDefaults(ConfigMap& cfg)
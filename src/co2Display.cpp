@@ -15,7 +15,7 @@
 
 #include "co2Screen.h"
 
-Co2Display::Co2Display(zmq::context_t& ctx, int sockType) :
+Co2Display::Co2Display(zmq::context_t& ctx, int sockType, Co2SampleRing& sampleRing, Co2EventBus& eventBus) :
     ctx_(ctx),
     mainSocket_(ctx, sockType),
     subSocket_(ctx, ZMQ_SUB),
@@ -32,6 +32,9 @@ Co2Display::Co2Display(zmq::context_t& ctx, int sockType) :
     screenRefreshRate_(0),
     screenTimeout_(0),
     timerId_(0),
+    sampleRing_(sampleRing),
+    ringHistory_(sampleRing.capacity()),
+    eventBus_(eventBus),
     relHumThreshold_(0),
     relHumThresholdChanged_(false),
     co2Threshold_(0),
@@ -50,10 +53,19 @@ Co2Display::Co2Display(zmq::context_t& ctx, int sockType) :
     co2Changed_.store(false, std::memory_order_relaxed);
     fanStateOn_.store(false, std::memory_order_relaxed);
     fanStateChanged_.store(false, std::memory_order_relaxed);
+    fanDuty_.store(0, std::memory_order_relaxed);
     fanAutoManStateChangeReq_.store(Auto, std::memory_order_relaxed);
     fanAutoManState_.store(Auto, std::memory_order_relaxed);
     wifiStateOn_.store(false, std::memory_order_relaxed);
     wifiStateChanged_.store(false, std::memory_order_relaxed);
+    undrawnReadNsec_.store(0, std::memory_order_relaxed);
+    undrawnRxNsec_.store(0, std::memory_order_relaxed);
+    shouldSendStats_.store(false, std::memory_order_relaxed);
+
+    co2TrendCursor_ = { 0, 0 };
+    co2TrendTime_ = 0;
+    co2TrendCheckTime_ = 0;
+    co2TrendCheckCount_ = 0;
 
     fontName_ = std::string("FreeSans.ttf");
 
@@ -184,6 +196,7 @@ for (auto & font: fonts_) {
     statusScreen_->setCo2(co2_.load(std::memory_order_relaxed));
     statusScreen_->setFanState(fanStateOn_.load(std::memory_order_relaxed));
     statusScreen_->setFanAuto(fanAutoManState_.load(std::memory_order_relaxed));
+    statusScreen_->setFanDuty(fanDuty_.load(std::memory_order_relaxed));
     statusScreen_->setWiFiState(wifiStateOn_.load(std::memory_order_relaxed));
 
     relHumCo2ThresholdScreen_->setRelHumThreshold(relHumThreshold_);
@@ -619,6 +632,7 @@ void Co2Display::drawScreen(bool refreshOnly)
     switch (currentScreen_) {
         case Status_Screen:
             statusScreen_->draw(refreshOnly);
+            recordCo2StateDrawn();
             break;
 
         case RelHumCo2Threshold_Screen:
@@ -851,99 +865,217 @@ void Co2Display::getCo2StateFromMsg(co2Message::Co2Message& co2Msg)
 {
     DBG_TRACE();
 
-    int rc;
+    if (co2Msg.has_co2state()) {
+        Co2EventBus::Co2StateEvent co2State;
 
+        Co2EventBus::fromMsg(co2Msg.co2state(), co2State);
+        setCo2State(co2State);
+    } else {
+        syslog(LOG_ERR, "missing Co2State");
+    }
+}
+
+void Co2Display::setCo2State(const Co2EventBus::Co2StateEvent& co2State)
+{
     co2Message::ThreadState_ThreadStates myThreadState = threadState_->state();
 
-    if (co2Msg.has_co2state()) {
-        const co2Message::Co2State& co2State = co2Msg.co2state();
+    if (myThreadState == co2Message::ThreadState_ThreadStates_RUNNING) {
+        auto rxTime = std::chrono::steady_clock::now();
 
-        if (myThreadState == co2Message::ThreadState_ThreadStates_RUNNING) {
+        if (co2State.publishTime != std::chrono::steady_clock::time_point()) {
+            publishToDisplayLatency_.record(rxTime - co2State.publishTime);
+        }
 
-            if (co2State.has_temperature()) {
-                temperature_.store(co2State.temperature(), std::memory_order_relaxed);
-                statusScreen_->setTemperature(temperature_.load(std::memory_order_relaxed));
-                DBG_MSG(LOG_DEBUG, "temperature now: %d", temperature_.load(std::memory_order_relaxed));
-            }
+        undrawnReadNsec_.store(CO2::steadyNsec(co2State.readTime), std::memory_order_relaxed);
+        undrawnRxNsec_.store(CO2::steadyNsec(rxTime), std::memory_order_release);
+
+        temperature_.store(co2State.temperature, std::memory_order_relaxed);
+        statusScreen_->setTemperature(temperature_.load(std::memory_order_relaxed));
+        DBG_MSG(LOG_DEBUG, "temperature now: %d", temperature_.load(std::memory_order_relaxed));
+
+        relHumidity_.store(co2State.relHumidity, std::memory_order_relaxed);
+        statusScreen_->setRelHumidity(relHumidity_.load(std::memory_order_relaxed));
+        DBG_MSG(LOG_DEBUG, "RH now: %d", relHumidity_.load(std::memory_order_relaxed));
+
+        co2_.store(co2State.co2, std::memory_order_relaxed);
+        statusScreen_->setCo2(co2_.load(std::memory_order_relaxed));
+        DBG_MSG(LOG_DEBUG, "co2 now: %d", co2_.load(std::memory_order_relaxed));
+
+        updateCo2Trend();
+
+        bool fanOn = false;
+        FanAutoManStates fanAutoManState = Auto;
+        const char* fanStateStr = "";
+
+        switch (co2State.fanState) {
+            case co2Message::Co2State_FanStates_AUTO_OFF:
+                fanStateStr = "Auto-Off";
+                break;
+
+            case co2Message::Co2State_FanStates_AUTO_ON:
+                fanOn = true;
+                fanStateStr = "Auto-On";
+                break;
+
+            case co2Message::Co2State_FanStates_MANUAL_OFF:
+                fanAutoManState = ManOff;
+                fanStateStr = "Man-Off";
+                break;
+
+            case co2Message::Co2State_FanStates_MANUAL_ON:
+                fanAutoManState = ManOn;
+                fanOn = true;
+                fanStateStr = "Man-On";
+                break;
 
-            if (co2State.has_relhumidity()) {
-                relHumidity_.store(co2State.relhumidity(), std::memory_order_relaxed);
-                statusScreen_->setRelHumidity(relHumidity_.load(std::memory_order_relaxed));
-                DBG_MSG(LOG_DEBUG, "RH now: %d", relHumidity_.load(std::memory_order_relaxed));
+            default:
+                syslog(LOG_ERR, "Co2State - unknown fan state:%d", co2State.fanState);
+                break;
+        }
+
+        if (fanOn != fanStateOn_.load(std::memory_order_relaxed)) {
+            statusScreen_->setFanState(fanOn);
+            fanStateOn_.store(fanOn, std::memory_order_relaxed);
+            DBG_MSG(LOG_DEBUG, "fan now: %s", (fanOn) ? "On" : "Off");
+        }
+
+        if (fanAutoManState != fanAutoManState_.load(std::memory_order_relaxed)) {
+            fanControlScreen_->setFanAuto(fanAutoManState);
+            statusScreen_->setFanAuto(fanAutoManState == Auto);
+
+            // stop timer if no longer manual on, but
+            // start timer if new state is manual on
+            //
+            if (fanAutoManState_.load(std::memory_order_relaxed) == ManOn) {
+                statusScreen_->stopFanManOnTimer();
+            } else if (fanAutoManState == ManOn) {
+                // fanOnOverrideTime is in minutes, so convert to seconds
+                statusScreen_->startFanManOnTimer(fanOnOverrideTime_ * 60);
             }
 
-            if (co2State.has_co2()) {
-                co2_.store(co2State.co2(), std::memory_order_relaxed);
-                statusScreen_->setCo2(co2_.load(std::memory_order_relaxed));
-                DBG_MSG(LOG_DEBUG, "co2 now: %d", co2_.load(std::memory_order_relaxed));
+            fanAutoManState_.store(fanAutoManState, std::memory_order_relaxed);
+
+            if (currentScreen_ == Status_Screen) {
+                drawScreen(false);
             }
 
-            if (co2State.has_fanstate()) {
-                bool fanOn = false;
-                FanAutoManStates fanAutoManState = Auto;
-                const char* fanStateStr = "";
+            DBG_MSG(LOG_DEBUG, "fan now: %s", (fanAutoManState_.load(std::memory_order_relaxed) == Auto) ? "Auto" : "Man");
+        }
 
-                switch (co2State.fanstate()) {
-                    case co2Message::Co2State_FanStates_AUTO_OFF:
-                        fanStateStr = "Auto-Off";
-                        break;
+        if (int(co2State.fanDutyCycle) != fanDuty_.load(std::memory_order_relaxed)) {
+            fanDuty_.store(co2State.fanDutyCycle, std::memory_order_relaxed);
+            statusScreen_->setFanDuty(fanDuty_.load(std::memory_order_relaxed));
+            DBG_MSG(LOG_DEBUG, "fan duty now: %d%%", fanDuty_.load(std::memory_order_relaxed));
+        }
+    }
+}
 
-                    case co2Message::Co2State_FanStates_AUTO_ON:
-                        fanOn = true;
-                        fanStateStr = "Auto-On";
-                        break;
+// Called once the status screen has been drawn, so the newest Co2State
+// received is now on the framebuffer
+void Co2Display::recordCo2StateDrawn()
+{
+    uint64_t rxNsec = undrawnRxNsec_.exchange(0, std::memory_order_acquire);
 
-                    case co2Message::Co2State_FanStates_MANUAL_OFF:
-                        fanAutoManState = ManOff;
-                        fanStateStr = "Man-Off";
-                        break;
+    if (rxNsec == 0) {
+        return;
+    }
 
-                    case co2Message::Co2State_FanStates_MANUAL_ON:
-                        fanAutoManState = ManOn;
-                        fanOn = true;
-                        fanStateStr = "Man-On";
-                        break;
+    uint64_t readNsec = undrawnReadNsec_.load(std::memory_order_relaxed);
+    auto drawnTime = std::chrono::steady_clock::now();
 
-                    default:
-                        syslog(LOG_ERR, "Co2State - unknown fan state:%d", co2State.fanstate());
-                        break;
-                }
+    displayToScreenLatency_.record(drawnTime - CO2::steadyTime(rxNsec));
 
-                if (fanOn != fanStateOn_.load(std::memory_order_relaxed)) {
-                    statusScreen_->setFanState(fanOn);
-                    fanStateOn_.store(fanOn, std::memory_order_relaxed);
-                    DBG_MSG(LOG_DEBUG, "fan now: %s", (fanOn) ? "On" : "Off");
-                }
+    if (readNsec) {
+        readToScreenLatency_.record(drawnTime - CO2::steadyTime(readNsec));
+    }
+}
 
-                if (fanAutoManState != fanAutoManState_.load(std::memory_order_relaxed)) {
-                    fanControlScreen_->setFanAuto(fanAutoManState);
-                    statusScreen_->setFanAuto(fanAutoManState == Auto);
+// Fits a line to the last kCo2TrendWindow_ of filtered CO2 from the
+// sample ring, rather than asking Co2Monitor for its history. Only
+// samples pushed since the last Co2State are added.
+void Co2Display::updateCo2Trend()
+{
+    Co2SampleRing::Sample sample;
+    const int64_t windowMsec = kCo2TrendWindow_ * 1000;
+    int trend = 0;
 
-                    // stop timer if no longer manual on, but
-                    // start timer if new state is manual on
-                    //
-                    if (fanAutoManState_.load(std::memory_order_relaxed) == ManOn) {
-                        statusScreen_->stopFanManOnTimer();
-                    } else if (fanAutoManState == ManOn) {
-                        // fanOnOverrideTime is in minutes, so convert to seconds
-                        statusScreen_->startFanManOnTimer(fanOnOverrideTime_ * 60);
-                    }
+    if (co2Trend_.capacity() == 0) {
+        rebuildCo2Trend();
+    }
 
-                    fanAutoManState_.store(fanAutoManState, std::memory_order_relaxed);
+    while (sampleRing_.next(co2TrendCursor_, sample)) {
+        if (co2TrendCursor_.overruns || (sample.timestamp < co2TrendTime_)) {
+            // missed some, or clock went back, so start again from the ring
+            rebuildCo2Trend();
+            break;
+        }
 
-                    if (currentScreen_ == Status_Screen) {
-                        drawScreen(false);
-                    }
+        co2Trend_.add(sample.timestamp / 1000.0, sample.filterCo2);
+        co2TrendTime_ = sample.timestamp;
+        co2TrendCheckCount_++;
 
-                    DBG_MSG(LOG_DEBUG, "fan now: %s", (fanAutoManState_.load(std::memory_order_relaxed) == Auto) ? "Auto" : "Man");
-                }
+        int64_t checkMsec = sample.timestamp - co2TrendCheckTime_;
+
+        if ((co2TrendCheckCount_ >= co2Trend_.capacity()) || (checkMsec >= windowMsec)) {
+            // resize if samples are now much closer together or further apart
+            size_t capacity = std::clamp<size_t>((int64_t(co2TrendCheckCount_) * windowMsec) / std::max<int64_t>(checkMsec, 1),
+                                                 1, ringHistory_.size());
+
+            if (((4 * capacity) < (3 * co2Trend_.capacity())) || ((4 * capacity) > (5 * co2Trend_.capacity()))) {
+                co2Trend_.resize(capacity);
             }
 
+            co2TrendCheckTime_ = sample.timestamp;
+            co2TrendCheckCount_ = 0;
         }
+    }
 
-    } else {
-        syslog(LOG_ERR, "missing Co2State");
+    double slope = co2Trend_.slope() * 60;   // ppm/minute
+
+    if (slope >= kCo2TrendMinSlope_) {
+        trend = 1;
+    } else if (slope <= -kCo2TrendMinSlope_) {
+        trend = -1;
     }
+
+    statusScreen_->setCo2Trend(trend);
+}
+
+// Refills co2Trend_ from the whole sample ring, sized to hold the
+// samples in the last kCo2TrendWindow_. Only needed when samples have
+// been missed, as it reads every sample in the ring.
+void Co2Display::rebuildCo2Trend()
+{
+    uint64_t written = sampleRing_.writeCount();
+    size_t count = 0;
+
+    co2TrendCursor_ = { written - std::min<uint64_t>(written, ringHistory_.size()), 0 };
+
+    while ((count < ringHistory_.size()) && sampleRing_.next(co2TrendCursor_, ringHistory_[count])) {
+        count++;
+    }
+
+    co2TrendCursor_.overruns = 0;
+
+    // back from the newest sample to the start of the window, or to
+    // where the clock went back
+    size_t first = count;
+
+    while ((first > 0) &&
+           ((first == count) || (ringHistory_[first - 1].timestamp <= ringHistory_[first].timestamp)) &&
+           ((ringHistory_[count - 1].timestamp - ringHistory_[first - 1].timestamp) <= (kCo2TrendWindow_ * 1000))) {
+        first--;
+    }
+
+    co2Trend_.setCapacity(count - first);
+
+    for (size_t i = first; i < count; i++) {
+        co2Trend_.add(ringHistory_[i].timestamp / 1000.0, ringHistory_[i].filterCo2);
+    }
+
+    co2TrendTime_ = count ? ringHistory_[count - 1].timestamp : 0;
+    co2TrendCheckTime_ = co2TrendTime_;
+    co2TrendCheckCount_ = 0;
 }
 
 void Co2Display::getNetStateFromMsg(co2Message::Co2Message& co2Msg)
@@ -1008,18 +1140,45 @@ void Co2Display::listener()
     bool shouldTerminate = false;
 
     subSocket_.connect(CO2::co2MainPubEndpoint);
-    subSocket_.set(zmq::sockopt::subscribe, "");
+
+    // only the messages handled below
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_UI_CFG);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_FAN_CFG);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_CO2_STATE);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_NET_STATE);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_STATS);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_TERMINATE);
+
+    Co2EventBus::Co2StateQueue& co2StateQueue = eventBus_.co2StateToDisplay();
+    Co2EventBus::Co2StateEvent co2State;
+
+    zmq::pollitem_t rxItems [] = {
+        { static_cast<void*>(subSocket_), 0, ZMQ_POLLIN, 0 },
+        { nullptr, co2StateQueue.fd(), ZMQ_POLLIN, 0 }
+    };
+    int numRxItems = sizeof(rxItems) / sizeof(rxItems[0]);
+
+    // reused for every message, so that its buffer is too
+    zmq::message_t msg;
+    CO2::MsgArena msgArena;
 
     while (!shouldTerminate) {
         try {
-            zmq::message_t msg;
+            // wake up now and then to check whether we should terminate
+            std::chrono::milliseconds timeout(co2StateQueue.prepareWait() ? 1000 : 0);
 
-            if (subSocket_.recv(msg, zmq::recv_flags::none)) {
+            zmq::poll(rxItems, numRxItems, timeout);
+            co2StateQueue.endWait();
 
-                std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-                co2Message::Co2Message co2Msg;
+            while (co2StateQueue.pop(co2State)) {
+                setCo2State(co2State);
+            }
 
-                if (!co2Msg.ParseFromString(msg_str)) {
+            if ((rxItems[0].revents & ZMQ_POLLIN) && CO2::recvPublished(subSocket_, msg, rxMsgCounters_)) {
+
+                co2Message::Co2Message& co2Msg = *msgArena.newMsg();
+
+                if (!CO2::parseMsg(msg, co2Msg)) {
                     throw CO2::exceptionLevel("couldn't parse published message", false);
                 }
 
@@ -1042,6 +1201,16 @@ void Co2Display::listener()
                         getNetStateFromMsg(co2Msg);
                         break;
 
+                    case co2Message::Co2Message_Co2MessageType_STATS:
+                        // replied to from the run loop, which sends on mainSocket_,
+                        // so wake it up in case the screen is off
+                        shouldSendStats_.store(true, std::memory_order_relaxed);
+
+                        SDL_Event timerEvent;
+                        timerEvent.type = Co2TouchScreen::Timer;
+                        SDL_PushEvent(&timerEvent);
+                        break;
+
                     case co2Message::Co2Message_Co2MessageType_TERMINATE:
                         // send event to wake up ruun loop if necessary
                         SDL_Event uEvent;
@@ -1139,13 +1308,7 @@ void Co2Display::publishUiChanges()
 
     }
 
-    std::string cfgStr;
-    co2Msg.SerializeToString(&cfgStr);
-
-    zmq::message_t configMsg(cfgStr.size());
-
-    memcpy(configMsg.data(), cfgStr.c_str(), cfgStr.size());
-    mainSocket_.send(configMsg, zmq::send_flags::none);
+    CO2::sendMsg(mainSocket_, co2Msg);
 
     DBG_MSG(LOG_DEBUG, "sent Fan config");
 
@@ -1156,11 +1319,26 @@ void Co2Display::publishUiChanges()
     timeLastUiPublish_ = timeNow;
 }
 
+// Reply to STATS from Co2Main with our latency histograms
+void Co2Display::sendStats()
+{
+    co2Message::Co2Message co2Msg;
+    co2Message::Stats* stats = co2Msg.mutable_stats();
+
+    co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_STATS);
+    stats->set_threadname("Co2Display");
+
+    CO2::addLatency(*stats, "publish to display", publishToDisplayLatency_);
+    CO2::addLatency(*stats, "display to screen", displayToScreenLatency_);
+    CO2::addLatency(*stats, "read to screen", readToScreenLatency_);
+
+    CO2::sendMsg(mainSocket_, co2Msg);
+}
+
 void Co2Display::sendShutdownMsg(bool reboot)
 {
     DBG_TRACE();
 
-    std::string shutdownStr;
     co2Message::Co2Message co2Msg;
     co2Message::RestartMsg* restartMsg = co2Msg.mutable_restartmsg();
 
@@ -1168,12 +1346,7 @@ void Co2Display::sendShutdownMsg(bool reboot)
 
     restartMsg->set_restarttype(reboot ? co2Message::RestartMsg_RestartType_REBOOT : co2Message::RestartMsg_RestartType_SHUTDOWN);
 
-    co2Msg.SerializeToString(&shutdownStr);
-
-    zmq::message_t shutdownMsg(shutdownStr.size());
-
-    memcpy (shutdownMsg.data(), shutdownStr.c_str(), shutdownStr.size());
-    mainSocket_.send(shutdownMsg, zmq::send_flags::none);
+    CO2::sendMsg(mainSocket_, co2Msg);
     syslog(LOG_DEBUG, "Sent %s message", reboot ? "restart" : "shutdown");
 }
 
@@ -1501,6 +1674,10 @@ void Co2Display::run()
                 // check and see if there are any unpublished changes
                 publishUiChanges();
 
+                if (shouldSendStats_.exchange(false, std::memory_order_relaxed)) {
+                    sendStats();
+                }
+
             } else {
                 if ( (threadState_->state() == co2Message::ThreadState_ThreadStates_RUNNING) &&
                         !Co2Display::shouldTerminate_.load(std::memory_order_relaxed) ) {
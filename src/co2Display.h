@@ -10,7 +10,10 @@
 
 #include <SDL_ttf.h>
 
+#include "co2EventBus.h"
+#include "co2SampleRing.h"
 #include "co2TouchScreen.h"
+#include "co2Trend.h"
 #include "screenBacklight.h"
 #include "utils.h"
 
@@ -62,12 +65,15 @@ class SplashScreen;
 class Co2Display
 {
     public:
-        Co2Display(zmq::context_t& ctx, int sockType);
+        Co2Display(zmq::context_t& ctx, int sockType, Co2SampleRing& sampleRing, Co2EventBus& eventBus);
 
         ~Co2Display();
 
         void run();
 
+        // Messages received from Co2Main, by type
+        const CO2::MsgCounters& rxMsgCounters() const { return rxMsgCounters_; }
+
         static std::atomic<bool> shouldTerminate_;
 
         typedef enum {
@@ -159,10 +165,15 @@ class Co2Display
         void getUIConfigFromMsg(co2Message::Co2Message& cfgMsg);
         void getFanConfigFromMsg(co2Message::Co2Message& cfgMsg);
         void getCo2StateFromMsg(co2Message::Co2Message& co2Msg);
+        void setCo2State(const Co2EventBus::Co2StateEvent& co2State);
         void getNetStateFromMsg(co2Message::Co2Message& co2Msg);
+        void updateCo2Trend();
+        void rebuildCo2Trend();
         void listener();
 
         void publishUiChanges();
+        void recordCo2StateDrawn();
+        void sendStats();
 
         //void sendNetState();
 
@@ -171,6 +182,7 @@ class Co2Display
         zmq::context_t& ctx_;
         zmq::socket_t mainSocket_;
         zmq::socket_t subSocket_;
+        CO2::MsgCounters rxMsgCounters_;
 
         CO2::ThreadFSM* threadState_;
 
@@ -213,6 +225,37 @@ class Co2Display
         std::atomic<bool> relHumChanged_;
         std::atomic<int> co2_;
         std::atomic<bool> co2Changed_;
+
+        // Recent samples are read straight from Co2Monitor's ring, to show
+        // whether CO2 is rising or falling.
+        Co2SampleRing& sampleRing_;
+        std::vector<Co2SampleRing::Sample> ringHistory_;
+
+        // Co2State comes from here, or from zmq, depending on Co2Monitor's MessageTransport
+        Co2EventBus& eventBus_;
+
+        // Per-hop latency of Co2State, through to it being drawn. The
+        // newest one not yet drawn is noted (in steady clock nsec) by the
+        // listener, for the run loop to pick up when it next draws.
+        LatencyHistogram publishToDisplayLatency_;
+        LatencyHistogram displayToScreenLatency_;
+        LatencyHistogram readToScreenLatency_;
+        std::atomic<uint64_t> undrawnReadNsec_;
+        std::atomic<uint64_t> undrawnRxNsec_;
+        std::atomic<bool> shouldSendStats_;
+
+        // co2Trend_ is only given the samples new since co2TrendCursor_,
+        // and holds as many as are taken in kCo2TrendWindow_. That is
+        // checked once it has been refilled, or the window has passed, in
+        // case samples are now closer together or further apart.
+        Co2Trend co2Trend_;
+        Co2SampleRing::Cursor co2TrendCursor_;
+        int64_t co2TrendTime_;       // msec, newest sample in co2Trend_
+        int64_t co2TrendCheckTime_;  // msec
+        size_t co2TrendCheckCount_;  // samples added since co2TrendCheckTime_
+        const int64_t kCo2TrendWindow_ = 600;     // seconds
+        const double kCo2TrendMinSlope_ = 5.0;    // ppm/minute
+
         int relHumThreshold_;
         bool relHumThresholdChanged_;
         const int relHumThresholdChangeDelta_ = 1;
@@ -221,6 +264,7 @@ class Co2Display
         const int co2ThresholdChangeDelta_ = 10;
         std::atomic<bool> fanStateOn_;
         std::atomic<bool> fanStateChanged_;
+        std::atomic<int> fanDuty_;
         std::atomic<FanAutoManStates> fanAutoManStateChangeReq_;
         std::atomic<FanAutoManStates> fanAutoManState_;
         bool fanAutoManStateChanged_;
@@ -0,0 +1,128 @@
+/*
+ * co2EventBus.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2EVENTBUS_H
+#define CO2EVENTBUS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <fmt/core.h>
+
+#include "co2Message.pb.h"
+#include "co2MpscQueue.h"
+#include "utils.h"
+
+// In-process alternative to zmq for the busiest message, Co2State, which
+// otherwise goes from Co2Monitor to Co2Main and is then republished to
+// Co2Display: serialized and parsed twice, through two sockets.
+//
+// On the bus Co2Monitor pushes a plain struct straight onto a queue for
+// each of Co2Main and Co2Display. Everything else, and Co2State when
+// MessageTransport is "zmq", still goes through zmq. Co2Main and
+// Co2Display wait on both, so only Co2Monitor needs to know which
+// transport is in use.
+//
+class Co2EventBus
+{
+    public:
+        // Co2State, without the per-sensor readings which nothing in this
+        // process uses
+        typedef struct {
+            int32_t temperature;    // 1/100 C
+            int32_t relHumidity;    // 1/100 %
+            int32_t co2;            // ppm
+            co2Message::Co2State_FanStates fanState;
+            uint32_t fanDutyCycle;  // percent
+            bool hasFanRuntime;
+            int64_t fanRuntimeDay;  // seconds since epoch of local midnight
+            uint32_t fanOnTime;     // seconds
+            uint32_t fanDutyTime;   // seconds
+            uint32_t fanSwitchCount;
+            int64_t timestamp;      // seconds since epoch
+            std::chrono::steady_clock::time_point readTime;
+            std::chrono::steady_clock::time_point publishTime;
+        } Co2StateEvent;
+
+        typedef Co2MpscQueue<Co2StateEvent> Co2StateQueue;
+
+        typedef enum {
+            Zmq,
+            Bus
+        } Transport;
+
+        Co2EventBus() :
+            co2StateToMain_(kQueueCapacity_),
+            co2StateToDisplay_(kQueueCapacity_)
+        {
+        }
+
+        ~Co2EventBus()
+        {
+        }
+
+        // Throws a fatal exceptionLevel unless transportStr is "zmq" or "bus"
+        static Transport transportFromStr(const std::string& transportStr)
+        {
+            if (transportStr == "zmq") {
+                return Zmq;
+            } else if (transportStr == "bus") {
+                return Bus;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("unknown message transport \"{}\" - must be zmq or bus", transportStr), true);
+        }
+
+        void publish(const Co2StateEvent& co2State)
+        {
+            co2StateToMain_.push(co2State);
+            co2StateToDisplay_.push(co2State);
+        }
+
+        Co2StateQueue& co2StateToMain() { return co2StateToMain_; }
+        Co2StateQueue& co2StateToDisplay() { return co2StateToDisplay_; }
+
+        // Same as the Co2State in co2Msg, for consumers which handle both
+        static void fromMsg(const co2Message::Co2State& co2StateMsg, Co2StateEvent& co2State)
+        {
+            co2State.temperature = co2StateMsg.temperature();
+            co2State.relHumidity = co2StateMsg.relhumidity();
+            co2State.co2 = co2StateMsg.co2();
+            co2State.fanState = co2StateMsg.fanstate();
+            co2State.fanDutyCycle = co2StateMsg.fandutycycle();
+            co2State.hasFanRuntime = co2StateMsg.has_fanruntime();
+            co2State.fanRuntimeDay = co2StateMsg.fanruntime().day();
+            co2State.fanOnTime = co2StateMsg.fanruntime().ontime();
+            co2State.fanDutyTime = co2StateMsg.fanruntime().dutytime();
+            co2State.fanSwitchCount = co2StateMsg.fanruntime().switchcount();
+            co2State.timestamp = co2StateMsg.timestamp().seconds();
+            co2State.readTime = CO2::steadyTime(co2StateMsg.readtimensec());
+            co2State.publishTime = CO2::steadyTime(co2StateMsg.publishtimensec());
+        }
+
+        static void toFanRuntime(const Co2StateEvent& co2State, co2Message::FanRuntime& fanRuntime)
+        {
+            fanRuntime.set_day(co2State.fanRuntimeDay);
+            fanRuntime.set_ontime(co2State.fanOnTime);
+            fanRuntime.set_dutytime(co2State.fanDutyTime);
+            fanRuntime.set_switchcount(co2State.fanSwitchCount);
+        }
+
+    private:
+        Co2EventBus(const Co2EventBus& rhs);
+        Co2EventBus& operator=(const Co2EventBus& rhs);
+
+        // zmq's default high water mark
+        static const size_t kQueueCapacity_ = 1024;
+
+        Co2StateQueue co2StateToMain_;
+        Co2StateQueue co2StateToDisplay_;
+
+    protected:
+};
+
+#endif /* CO2EVENTBUS_H */
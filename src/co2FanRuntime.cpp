@@ -0,0 +1,88 @@
+/*
+ * co2FanRuntime.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+
+#include "co2FanRuntime.h"
+#include "co2LogSegment.h"
+
+Co2FanRuntime::Co2FanRuntime() :
+    day_(0),
+    today_({ 0, 0, 0 }),
+    pending_({ 0, 0, 0 }),
+    hasUpdated_(false),
+    isOn_(false),
+    duty_(0)
+{
+}
+
+Co2FanRuntime::~Co2FanRuntime()
+{
+}
+
+void Co2FanRuntime::add(Counters& counters, uint64_t onMsec, uint64_t dutyMsec, uint32_t switchCount)
+{
+    counters.onMsec += onMsec;
+    counters.dutyMsec += dutyMsec;
+    counters.switchCount += switchCount;
+}
+
+void Co2FanRuntime::update(std::chrono::steady_clock::time_point timeNow, time_t wallTime, bool isOn, int duty)
+{
+    uint64_t onMsec = 0;
+    uint64_t dutyMsec = 0;
+    uint32_t switchCount = 0;
+
+    if (hasUpdated_) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(timeNow - lastUpdateTime_);
+
+        if (elapsed.count() > 0) {
+            // only whole msec are counted, so the remainder isn't lost
+            lastUpdateTime_ += elapsed;
+
+            if (isOn_) {
+                onMsec = elapsed.count();
+                dutyMsec = (onMsec * std::clamp(duty_, 0, 100)) / 100;
+            }
+        }
+
+        switchCount = (isOn && !isOn_) ? 1 : 0;
+    } else {
+        lastUpdateTime_ = timeNow;
+        hasUpdated_ = true;
+    }
+
+    // An interval spanning midnight is counted in the day it ends, which
+    // is out by no more than the time between updates.
+    time_t day = Co2LogSegment::dayStart(wallTime);
+
+    if (day != day_) {
+        day_ = day;
+        today_ = { 0, 0, 0 };
+    }
+
+    add(today_, onMsec, dutyMsec, switchCount);
+    add(pending_, onMsec, dutyMsec, switchCount);
+
+    isOn_ = isOn;
+    duty_ = duty;
+}
+
+void Co2FanRuntime::restore(time_t day, const Counters& counters)
+{
+    day_ = day;
+    today_ = counters;
+}
+
+Co2FanRuntime::Counters Co2FanRuntime::takePending()
+{
+    Counters pending = pending_;
+
+    pending_ = { 0, 0, 0 };
+
+    return pending;
+}
@@ -0,0 +1,70 @@
+/*
+ * co2FanRuntime.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2FANRUNTIME_H
+#define CO2FANRUNTIME_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+// How long the fan has run today, how often it was switched on, and its
+// on time weighted by duty cycle (i.e. time at full speed equivalent,
+// which is what energy use follows for a variable speed fan).
+//
+// Intervals are timed with the monotonic clock, so a wall clock step
+// (NTP, DST) cannot add or lose runtime. The wall clock only decides
+// which day they are counted in. Counts since they were last taken are
+// also kept, for rollup buckets.
+//
+class Co2FanRuntime
+{
+    public:
+        typedef struct {
+            uint64_t onMsec;
+            uint64_t dutyMsec;     // on time weighted by duty cycle
+            uint32_t switchCount;  // times fan switched on
+        } Counters;
+
+        Co2FanRuntime();
+
+        ~Co2FanRuntime();
+
+        // Counts the time since the last update against the fan state
+        // then, and a switch if the fan has just come on. Starts a new
+        // day once wallTime is past midnight.
+        void update(std::chrono::steady_clock::time_point timeNow, time_t wallTime, bool isOn, int duty);
+
+        // Carries on from counters saved earlier, e.g. before a restart.
+        // They are dropped at the next update if day is not today.
+        void restore(time_t day, const Counters& counters);
+
+        // Seconds since epoch of local midnight starting today_, or 0
+        // before the first update.
+        time_t day() const { return day_; }
+
+        const Counters& today() const { return today_; }
+
+        // Counts since last taken, then starts again from zero.
+        Counters takePending();
+
+    private:
+        static void add(Counters& counters, uint64_t onMsec, uint64_t dutyMsec, uint32_t switchCount);
+
+        time_t day_;
+        Counters today_;
+        Counters pending_;
+
+        bool hasUpdated_;
+        bool isOn_;
+        int duty_;
+        std::chrono::steady_clock::time_point lastUpdateTime_;
+
+    protected:
+};
+
+#endif /* CO2FANRUNTIME_H */
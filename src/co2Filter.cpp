@@ -0,0 +1,288 @@
+/*
+ * co2Filter.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <fmt/core.h>
+
+#include "co2Filter.h"
+
+// MAD of normally distributed samples times this is their standard deviation
+static const float kMadToSigma = 1.4826;
+
+static std::vector<std::string> split(const std::string& str, char separator)
+{
+    std::vector<std::string> items;
+    size_t startPos = 0;
+
+    while (startPos <= str.length()) {
+        size_t endPos = str.find(separator, startPos);
+
+        if (endPos == std::string::npos) {
+            endPos = str.length();
+        }
+
+        std::string item = str.substr(startPos, endPos - startPos);
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+
+        items.push_back((first == std::string::npos) ? "" : item.substr(first, last - first + 1));
+        startPos = endPos + 1;
+    }
+
+    return items;
+}
+
+Co2Filter::Co2Filter() : sampleCount_(0)
+{
+    for (int channel = 0; channel < ChannelCount; channel++) {
+        configure(Channel(channel), kDefaultSpec);
+    }
+}
+
+Co2Filter::~Co2Filter()
+{
+}
+
+const char* Co2Filter::channelStr(Channel channel)
+{
+    switch (channel) {
+        case Co2:
+            return "CO2";
+
+        case Temperature:
+            return "temperature";
+
+        case RelHumidity:
+            return "relative humidity";
+
+        default:
+            return "unknown";
+    }
+}
+
+Co2Filter::Stage Co2Filter::parseStage(const std::string& stageStr)
+{
+    std::vector<std::string> fields = split(stageStr, ':');
+    const std::string& name = fields[0];
+    Stage stage = { None, 0, 0, 0 };
+    size_t paramCount = 0;
+
+    if (name == "none") {
+        stage.type = None;
+    } else if (name == "ema") {
+        stage.type = Ema;
+        paramCount = 1;
+    } else if (name == "median") {
+        stage.type = Median;
+        paramCount = 1;
+    } else if (name == "hampel") {
+        stage.type = Hampel;
+        paramCount = 2;
+    } else if (name == "kalman") {
+        stage.type = Kalman;
+        paramCount = 2;
+    } else {
+        throw CO2::exceptionLevel(fmt::format("unknown filter \"{}\"", name), true);
+    }
+
+    if (fields.size() != paramCount + 1) {
+        throw CO2::exceptionLevel(fmt::format("filter \"{}\" needs {} parameter(s)", stageStr, paramCount), true);
+    }
+
+    try {
+        switch (stage.type) {
+            case Ema:
+                stage.param1 = std::stof(fields[1]);
+
+                if ((stage.param1 <= 0) || (stage.param1 > 1)) {
+                    throw CO2::exceptionLevel("alpha must be > 0 and <= 1", true);
+                }
+                break;
+
+            case Median:
+            case Hampel:
+                stage.window = std::stoi(fields[1]);
+
+                if ((stage.window < ((stage.type == Median) ? 1 : 3)) || (stage.window > kMaxWindow) || !(stage.window % 2)) {
+                    throw CO2::exceptionLevel(fmt::format("window must be odd and no more than {}", kMaxWindow), true);
+                }
+
+                if (stage.type == Hampel) {
+                    stage.param1 = std::stof(fields[2]);
+
+                    if (stage.param1 <= 0) {
+                        throw CO2::exceptionLevel("threshold must be > 0", true);
+                    }
+                }
+                break;
+
+            case Kalman:
+                stage.param1 = std::stof(fields[1]);
+                stage.param2 = std::stof(fields[2]);
+
+                if ((stage.param1 < 0) || (stage.param2 <= 0)) {
+                    throw CO2::exceptionLevel("process noise must be >= 0 and measurement noise > 0", true);
+                }
+                break;
+
+            default:
+                break;
+        }
+    } catch (CO2::exceptionLevel& el) {
+        throw CO2::exceptionLevel(fmt::format("filter \"{}\": {}", stageStr, el.what()), true);
+    } catch (std::exception& e) {
+        throw CO2::exceptionLevel(fmt::format("filter \"{}\": invalid parameter", stageStr), true);
+    }
+
+    return stage;
+}
+
+void Co2Filter::configure(Channel channel, const std::string& spec)
+{
+    ChannelFilter& channelFilter = channels_[channel];
+    std::vector<std::string> stageStrs = split(spec.empty() ? "none" : spec, ',');
+    int stageCount = 0;
+    Stage stages[kMaxStages];
+
+    for (auto& stageStr : stageStrs) {
+        Stage stage = parseStage(stageStr);
+
+        if (stage.type == None) {
+            continue;
+        }
+
+        if (stageCount >= kMaxStages) {
+            throw CO2::exceptionLevel(fmt::format("{} filter \"{}\" has more than {} stages",
+                                                  channelStr(channel), spec, kMaxStages), true);
+        }
+
+        stages[stageCount++] = stage;
+    }
+
+    std::copy(stages, stages + stageCount, channelFilter.stages);
+    channelFilter.stageCount = stageCount;
+
+    reset();
+}
+
+void Co2Filter::reset()
+{
+    for (auto& channelFilter : channels_) {
+        for (auto& state : channelFilter.state) {
+            state.windowHead = 0;
+            state.windowCount = 0;
+            state.ema = 0;
+            state.kalmanX = 0;
+            state.kalmanP = 0;
+        }
+    }
+
+    for (auto& value : filtered_.value) {
+        value = 0;
+    }
+
+    sampleCount_ = 0;
+}
+
+// Windows are small, so an insertion sort beats nth_element here.
+float Co2Filter::medianOf(float values[], int n)
+{
+    for (int i = 1; i < n; i++) {
+        float value = values[i];
+        int j = i;
+
+        for (; (j > 0) && (values[j - 1] > value); j--) {
+            values[j] = values[j - 1];
+        }
+
+        values[j] = value;
+    }
+
+    return (n % 2) ? values[n / 2] : (values[(n / 2) - 1] + values[n / 2]) / 2;
+}
+
+float Co2Filter::runStage(const Stage& stage, StageState& state, float value)
+{
+    switch (stage.type) {
+        case Ema:
+            if (sampleCount_ == 0) {
+                state.ema = value;
+            } else {
+                state.ema += stage.param1 * (value - state.ema);
+            }
+
+            return state.ema;
+
+        case Median:
+        case Hampel:
+        {
+            state.window[state.windowHead] = value;
+            state.windowHead = (state.windowHead + 1) % stage.window;
+            state.windowCount = std::min(state.windowCount + 1, stage.window);
+
+            float sorted[kMaxWindow];
+            int n = state.windowCount;
+
+            std::copy(state.window, state.window + n, sorted);
+
+            float median = medianOf(sorted, n);
+
+            if (stage.type == Median) {
+                return median;
+            }
+
+            if (n < 3) {
+                return value;
+            }
+
+            for (int i = 0; i < n; i++) {
+                sorted[i] = std::fabs(state.window[i] - median);
+            }
+
+            float mad = medianOf(sorted, n);
+
+            return (std::fabs(value - median) > (stage.param1 * kMadToSigma * mad)) ? median : value;
+        }
+
+        case Kalman:
+            if (sampleCount_ == 0) {
+                state.kalmanX = value;
+                state.kalmanP = stage.param2;
+            } else {
+                float p = state.kalmanP + stage.param1;
+                float gain = p / (p + stage.param2);
+
+                state.kalmanX += gain * (value - state.kalmanX);
+                state.kalmanP = (1 - gain) * p;
+            }
+
+            return state.kalmanX;
+
+        default:
+            return value;
+    }
+}
+
+const Co2Filter::Sample& Co2Filter::update(const Sample& sample)
+{
+    for (int channel = 0; channel < ChannelCount; channel++) {
+        ChannelFilter& channelFilter = channels_[channel];
+        float value = sample.value[channel];
+
+        for (int i = 0; i < channelFilter.stageCount; i++) {
+            value = runStage(channelFilter.stages[i], channelFilter.state[i], value);
+        }
+
+        filtered_.value[channel] = value;
+    }
+
+    sampleCount_++;
+
+    return filtered_;
+}
@@ -0,0 +1,120 @@
+/*
+ * co2Filter.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2FILTER_H
+#define CO2FILTER_H
+
+#include <string>
+
+#include "utils.h"
+
+// Streaming filters for fused sensor readings.
+//
+// Each channel (CO2, temperature, RH) has its own chain of up to
+// kMaxStages filters, applied in order, chosen from config as a comma
+// separated list of stages:
+//
+//     none                no filtering
+//     ema:ALPHA           exponential moving average, ALPHA in (0, 1]
+//                         is the weight given to each new sample
+//     median:N            median of last N samples (odd, up to kMaxWindow)
+//     hampel:N:K          passes samples through unless more than K scaled
+//                         MADs from median of last N, when median is used
+//     kalman:Q:R          1-D Kalman filter of a random walk with process
+//                         noise Q and measurement noise R (variances)
+//
+// e.g. "hampel:7:3,ema:0.2" rejects outliers before smoothing.
+//
+// All channels are updated together, in one pass over a Sample, and
+// state is held in fixed arrays so no memory is allocated per sample.
+//
+class Co2Filter
+{
+    public:
+        typedef enum {
+            Co2,
+            Temperature,
+            RelHumidity,
+            ChannelCount
+        } Channel;
+
+        // Same units as readings: ppm, 1/100 degrees C and 1/100 %
+        typedef struct {
+            float value[ChannelCount];
+        } Sample;
+
+        typedef enum {
+            None,
+            Ema,
+            Median,
+            Hampel,
+            Kalman
+        } FilterType;
+
+        typedef struct {
+            FilterType type;
+            int window;   // median and Hampel
+            float param1; // EMA alpha, Hampel K, Kalman Q
+            float param2; // Kalman R
+        } Stage;
+
+        static const int kMaxStages = 4;
+        static const int kMaxWindow = 15;
+
+        // As the integer EMA previously hard-coded in Co2Monitor
+        static constexpr const char* kDefaultSpec = "ema:0.2";
+
+        Co2Filter();
+
+        ~Co2Filter();
+
+        // Throws a fatal exceptionLevel if spec is invalid.
+        void configure(Channel channel, const std::string& spec);
+
+        // Forgets all samples, e.g. after sensors restart.
+        void reset();
+
+        const Sample& update(const Sample& sample);
+
+        // false until the first sample
+        bool hasFiltered() const { return sampleCount_ > 0; }
+
+        const Sample& filtered() const { return filtered_; }
+
+        static const char* channelStr(Channel channel);
+
+    private:
+        typedef struct {
+            float window[kMaxWindow]; // last samples, oldest first once full
+            int windowHead;
+            int windowCount;
+            float ema;
+            float kalmanX;
+            float kalmanP;
+        } StageState;
+
+        typedef struct {
+            Stage stages[kMaxStages];
+            StageState state[kMaxStages];
+            int stageCount;
+        } ChannelFilter;
+
+        static Stage parseStage(const std::string& stageStr);
+
+        // Runs one stage on value, which it sees as sample number sampleCount_
+        float runStage(const Stage& stage, StageState& state, float value);
+
+        static float medianOf(float values[], int n);
+
+        ChannelFilter channels_[ChannelCount];
+        Sample filtered_;
+        uint64_t sampleCount_;
+
+    protected:
+};
+
+#endif /* CO2FILTER_H */
@@ -0,0 +1,405 @@
+/*
+ * co2LogCompress.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fmt/core.h>
+
+#include "checksum.h"
+#include "co2LogCompress.h"
+
+namespace Co2LogCompress
+{
+
+// Bits following each '1...10' prefix (index is number of 1s)
+static const int kTimeBits[] = { 0, 7, 12, 20, 32 };
+static const int kValueBits[] = { 0, 4, 8, 12, 32 };
+static const int kMaxPrefixBits = 4;
+static const int kValueCount = 5;
+
+class BitWriter
+{
+    public:
+        BitWriter(std::vector<uint8_t>& out) : out_(out), acc_(0), nBits_(0) {}
+
+        // bits must not be more than 32
+        void write(uint32_t value, int bits) {
+            acc_ = (acc_ << bits) | (value & ((1ULL << bits) - 1));
+            nBits_ += bits;
+
+            while (nBits_ >= 8) {
+                nBits_ -= 8;
+                out_.push_back(uint8_t(acc_ >> nBits_));
+            }
+        }
+
+        void finish() {
+            if (nBits_) {
+                out_.push_back(uint8_t(acc_ << (8 - nBits_)));
+                nBits_ = 0;
+            }
+        }
+
+    private:
+        std::vector<uint8_t>& out_;
+        uint64_t acc_;
+        int nBits_;
+};
+
+class BitReader
+{
+    public:
+        BitReader(const uint8_t* data, size_t size) : data_(data), size_(size), pos_(0), acc_(0), nBits_(0) {}
+
+        bool read(int bits, uint32_t& value) {
+            while (nBits_ < bits) {
+                if (pos_ >= size_) {
+                    return false;
+                }
+
+                acc_ = (acc_ << 8) | data_[pos_++];
+                nBits_ += 8;
+            }
+
+            nBits_ -= bits;
+            value = uint32_t((acc_ >> nBits_) & ((1ULL << bits) - 1));
+
+            return true;
+        }
+
+    private:
+        const uint8_t* data_;
+        size_t size_;
+        size_t pos_;
+        uint64_t acc_;
+        int nBits_;
+};
+
+static inline uint32_t zigzag(int64_t value)
+{
+    return uint32_t((value << 1) ^ (value >> 63));
+}
+
+static inline int64_t unzigzag(uint32_t value)
+{
+    return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+static void writeBucketed(BitWriter& writer, uint32_t value, const int* bucketBits)
+{
+    if (value == 0) {
+        writer.write(0, 1);
+        return;
+    }
+
+    for (int ones = 1; ones < kMaxPrefixBits; ones++) {
+        if (value < (1U << bucketBits[ones])) {
+            writer.write(((1U << ones) - 1) << 1, ones + 1);
+            writer.write(value, bucketBits[ones]);
+            return;
+        }
+    }
+
+    writer.write((1U << kMaxPrefixBits) - 1, kMaxPrefixBits);
+    writer.write(value, bucketBits[kMaxPrefixBits]);
+}
+
+static bool readBucketed(BitReader& reader, uint32_t& value, const int* bucketBits)
+{
+    int ones = 0;
+    uint32_t bit;
+
+    while (ones < kMaxPrefixBits) {
+        if (!reader.read(1, bit)) {
+            return false;
+        }
+
+        if (!bit) {
+            break;
+        }
+
+        ones++;
+    }
+
+    if (ones == 0) {
+        value = 0;
+        return true;
+    }
+
+    return reader.read(bucketBits[ones], value);
+}
+
+static inline void getValues(const Co2LogSegment::Record& rec, int32_t* values)
+{
+    values[0] = rec.temperature;
+    values[1] = rec.relHumidity;
+    values[2] = rec.co2;
+    values[3] = rec.filterRelHumidity;
+    values[4] = rec.filterCo2;
+}
+
+static inline void setValues(Co2LogSegment::Record& rec, const int32_t* values)
+{
+    rec.temperature = int16_t(values[0]);
+    rec.relHumidity = uint16_t(values[1]);
+    rec.co2 = uint16_t(values[2]);
+    rec.filterRelHumidity = uint16_t(values[3]);
+    rec.filterCo2 = uint16_t(values[4]);
+}
+
+size_t encode(const Co2LogSegment::Record* records, size_t count, std::vector<uint8_t>& out)
+{
+    BitWriter writer(out);
+    int64_t prevTime = 0;
+    int64_t prevDelta = 0;
+    int32_t prevValues[kValueCount] = { 0 };
+    int32_t values[kValueCount];
+    uint32_t prevFlags = 0;
+    size_t encodedCount = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const Co2LogSegment::Record& rec = records[i];
+
+        if (!(rec.flags & Co2LogSegment::Valid)) {
+            continue;
+        }
+
+        if (encodedCount == 0) {
+            writer.write(rec.timeOffset, 32);
+        } else {
+            int64_t delta = int64_t(rec.timeOffset) - prevTime;
+            writeBucketed(writer, zigzag(delta - prevDelta), kTimeBits);
+            prevDelta = delta;
+        }
+
+        prevTime = rec.timeOffset;
+
+        getValues(rec, values);
+
+        for (int v = 0; v < kValueCount; v++) {
+            writeBucketed(writer, zigzag(int64_t(values[v]) - prevValues[v]), kValueBits);
+            prevValues[v] = values[v];
+        }
+
+        uint32_t flags = rec.flags | (uint32_t(rec.fanDuty) << 8);
+
+        if (flags == prevFlags) {
+            writer.write(0, 1);
+        } else {
+            writer.write(1, 1);
+            writer.write(flags, 16);
+            prevFlags = flags;
+        }
+
+        encodedCount++;
+    }
+
+    writer.finish();
+
+    return encodedCount;
+}
+
+bool decode(const uint8_t* data, size_t size, size_t recordCount, std::vector<Co2LogSegment::Record>& records)
+{
+    BitReader reader(data, size);
+    int64_t prevTime = 0;
+    int64_t prevDelta = 0;
+    int32_t values[kValueCount] = { 0 };
+    uint32_t flags = 0;
+    uint32_t value;
+
+    records.reserve(records.size() + recordCount);
+
+    for (size_t i = 0; i < recordCount; i++) {
+        Co2LogSegment::Record rec;
+
+        if (i == 0) {
+            if (!reader.read(32, value)) {
+                return false;
+            }
+
+            prevTime = value;
+        } else {
+            if (!readBucketed(reader, value, kTimeBits)) {
+                return false;
+            }
+
+            prevDelta += unzigzag(value);
+            prevTime += prevDelta;
+        }
+
+        // as every later record is relative to this one, give up now
+        if ((prevDelta < 0) || (prevTime >= Co2LogSegment::kSecondsPerSegment)) {
+            return false;
+        }
+
+        rec.timeOffset = uint32_t(prevTime);
+
+        for (int v = 0; v < kValueCount; v++) {
+            if (!readBucketed(reader, value, kValueBits)) {
+                return false;
+            }
+
+            values[v] += int32_t(unzigzag(value));
+        }
+
+        setValues(rec, values);
+
+        if (!reader.read(1, value)) {
+            return false;
+        }
+
+        if (value && !reader.read(16, flags)) {
+            return false;
+        }
+
+        rec.flags = uint8_t(flags);
+        rec.fanDuty = uint8_t(flags >> 8);
+
+        records.push_back(rec);
+    }
+
+    return true;
+}
+
+static void writeAll(int fd, const void* buf, size_t len, const std::string& fileName)
+{
+    const char* p = static_cast<const char*>(buf);
+
+    while (len) {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("Error writing \"{}\" ({})", fileName, strerror(errno)), false);
+        }
+
+        p += n;
+        len -= n;
+    }
+}
+
+void compressSegment(const std::string& segmentFileName, const std::string& compressedFileName)
+{
+    Co2LogSegment::Reader segment;
+
+    if (!segment.open(segmentFileName)) {
+        throw CO2::exceptionLevel(fmt::format("\"{}\" is not a readable CO2 log segment", segmentFileName), false);
+    }
+
+    std::vector<uint8_t> data;
+    Header header;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.schemaVersion = kSchemaVersion;
+    header.headerSize = sizeof(Header);
+    header.recordCount = encode(segment.records(), segment.slotCount(), data);
+    header.dataSize = data.size();
+    header.baseTime = segment.header().baseTime;
+    header.slotInterval = segment.header().slotInterval;
+    header.segmentSchemaVersion = segment.header().schemaVersion;
+    header.dataCrc = Checksum::crc32(data.data(), data.size());
+
+    // Check it decodes back to the original before we rely on it
+    std::vector<Co2LogSegment::Record> decoded;
+
+    if (!decode(data.data(), data.size(), header.recordCount, decoded)) {
+        throw CO2::exceptionLevel(fmt::format("Unable to decode compressed \"{}\"", segmentFileName), false);
+    }
+
+    auto decodedRec = decoded.begin();
+
+    for (uint32_t slot = 0; slot < segment.slotCount(); slot++) {
+        const Co2LogSegment::Record& rec = segment.record(slot);
+
+        if (rec.flags & Co2LogSegment::Valid) {
+            if ((decodedRec == decoded.end()) || memcmp(&rec, &*decodedRec, sizeof(rec))) {
+                throw CO2::exceptionLevel(fmt::format("Compressed \"{}\" doesn't match original", segmentFileName), false);
+            }
+
+            ++decodedRec;
+        }
+    }
+
+    std::string tmpFileName = compressedFileName + ".tmp";
+    int fd = open(tmpFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        throw CO2::exceptionLevel(fmt::format("Unable to create \"{}\" ({})", tmpFileName, strerror(errno)), false);
+    }
+
+    try {
+        writeAll(fd, &header, sizeof(header), tmpFileName);
+        writeAll(fd, data.data(), data.size(), tmpFileName);
+
+        if (fdatasync(fd) < 0) {
+            throw CO2::exceptionLevel(fmt::format("Error syncing \"{}\" ({})", tmpFileName, strerror(errno)), false);
+        }
+    } catch (...) {
+        close(fd);
+        unlink(tmpFileName.c_str());
+        throw;
+    }
+
+    close(fd);
+
+    if (rename(tmpFileName.c_str(), compressedFileName.c_str()) < 0) {
+        unlink(tmpFileName.c_str());
+        throw CO2::exceptionLevel(fmt::format("Unable to rename \"{}\" ({})", tmpFileName, strerror(errno)), false);
+    }
+}
+
+FileStatus readFile(const std::string& fileName, Header& header, std::vector<Co2LogSegment::Record>& records)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return FileMissing;
+    }
+
+    if ((read(fd, &header, sizeof(header)) != sizeof(header)) || (header.magic != kMagic)) {
+        close(fd);
+        return FileMissing;
+    }
+
+    struct stat st;
+    std::vector<uint8_t> data;
+    bool isOk = (fstat(fd, &st) == 0) &&
+                (st.st_size == off_t(sizeof(Header) + header.dataSize)) &&
+                (header.schemaVersion >= kMinSchemaVersion) &&
+                (header.schemaVersion <= kSchemaVersion) &&
+                (header.headerSize == sizeof(Header)) &&
+                (header.segmentSchemaVersion >= Co2LogSegment::kMinSchemaVersion) &&
+                (header.segmentSchemaVersion <= Co2LogSegment::kSchemaVersion) &&
+                (header.recordCount <= Co2LogSegment::kSecondsPerSegment);
+
+    if (isOk) {
+        data.resize(header.dataSize);
+        isOk = (pread(fd, data.data(), data.size(), sizeof(Header)) == ssize_t(data.size()));
+    }
+
+    close(fd);
+
+    if (isOk && (header.schemaVersion >= 2)) {
+        isOk = (Checksum::crc32(data.data(), data.size()) == header.dataCrc);
+    }
+
+    if (!isOk || !decode(data.data(), data.size(), header.recordCount, records)) {
+        syslog(LOG_ERR, "\"%s\" is a corrupt compressed CO2 log", fileName.c_str());
+        return FileCorrupt;
+    }
+
+    return FileOk;
+}
+
+} // namespace Co2LogCompress
@@ -0,0 +1,90 @@
+/*
+ * co2LogCompress.h
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#ifndef CO2LOGCOMPRESS_H
+#define CO2LOGCOMPRESS_H
+
+#include <string>
+#include <vector>
+
+#include "co2LogSegment.h"
+
+// Compressed daily log segment (YYYY/MM/DD.co2z).
+//
+// Once a day is over its binary segment is compressed and the original
+// removed. Only valid records are kept and each is encoded, in the style
+// of Gorilla, as a bit stream of differences from the previous record:
+//
+//   time offset   delta-of-delta (zigzag)       '0'             same interval
+//                                               '10'   + 7 bits
+//                                               '110'  + 12 bits
+//                                               '1110' + 20 bits
+//                                               '1111' + 32 bits
+//
+//   temperature,  delta (zigzag)                '0'             unchanged
+//   relHumidity,                                '10'   + 4 bits
+//   co2,                                        '110'  + 8 bits
+//   filterRelHumidity,                          '1110' + 12 bits
+//   filterCo2                                   '1111' + 32 bits
+//
+//   flags and     '0' unchanged, '1' + 16 bits
+//   fanDuty
+//
+// Readings are fixed point integers rather than floats, so values are
+// delta rather than XOR encoded. A reading 10s after the last one with
+// nothing changed takes 7 bits, compared to 16 bytes in a segment.
+//
+namespace Co2LogCompress
+{
+
+const uint32_t kMagic = 0x5a324f43; // "CO2Z"
+const uint16_t kSchemaVersion = 2;
+const uint16_t kMinSchemaVersion = 1;  // version 1 has no dataCrc
+
+typedef struct {
+    uint32_t magic;
+    uint16_t schemaVersion;
+    uint16_t headerSize;
+    uint32_t recordCount;
+    uint32_t dataSize;              // bytes of encoded records following header
+    int64_t  baseTime;              // as Co2LogSegment::Header
+    uint16_t slotInterval;          // as Co2LogSegment::Header
+    uint16_t segmentSchemaVersion;  // of decoded records
+    uint32_t dataCrc;               // Checksum::crc32() of encoded records
+} Header;
+
+typedef enum {
+    FileOk,
+    FileMissing,    // or not a compressed segment at all
+    FileCorrupt     // fails its CRC, or doesn't decode
+} FileStatus;
+
+static_assert(sizeof(Header) == 32, "Co2LogCompress::Header must be 32 bytes");
+
+// Appends encoded records (which must be in time order) to out.
+// Records without the Valid flag are skipped.
+// Returns number of records encoded.
+size_t encode(const Co2LogSegment::Record* records, size_t count, std::vector<uint8_t>& out);
+
+// Appends recordCount decoded records to records.
+// Returns false if data is truncated or corrupt, including time offsets
+// which go backwards or are beyond the end of a segment.
+bool decode(const uint8_t* data, size_t size, size_t recordCount, std::vector<Co2LogSegment::Record>& records);
+
+// Compresses segmentFileName to compressedFileName, which is only
+// replaced once it has been written, synced and checked.
+// Throws CO2::exceptionLevel on error.
+void compressSegment(const std::string& segmentFileName, const std::string& compressedFileName);
+
+// Reads and decodes whole of compressed segment. The .bin it came from
+// has gone, so anything which doesn't check out is FileCorrupt rather
+// than being passed on.
+FileStatus readFile(const std::string& fileName, Header& header, std::vector<Co2LogSegment::Record>& records);
+
+} // namespace Co2LogCompress
+
+#endif /* CO2LOGCOMPRESS_H */
@@ -0,0 +1,105 @@
+/*
+ * co2LogCsv.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ *
+ * Exports binary CO2 log segments (YYYY/MM/DD.bin), or compressed
+ * segments (YYYY/MM/DD.co2z), in the daily CSV log format so that
+ * existing tools can read them.
+ */
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "co2LogCompress.h"
+#include "co2LogSegment.h"
+
+static Co2LogCompress::FileStatus exportCompressedCsv(const char* fileName, time_t startTime, time_t endTime)
+{
+    Co2LogCompress::Header header;
+    std::vector<Co2LogSegment::Record> records;
+    Co2LogCompress::FileStatus status = Co2LogCompress::readFile(fileName, header, records);
+
+    if (status != Co2LogCompress::FileOk) {
+        return status;
+    }
+
+    std::string buf;
+
+    for (auto& rec : records) {
+        time_t timestamp = header.baseTime + rec.timeOffset;
+
+        if ((timestamp >= startTime) && (timestamp <= endTime)) {
+            Co2LogSegment::formatCsv(buf, rec, timestamp);
+        }
+    }
+
+    fwrite(buf.data(), 1, buf.size(), stdout);
+
+    return Co2LogCompress::FileOk;
+}
+
+static void usage(const char* progName)
+{
+    fprintf(stderr, "usage: %s [-s start_time] [-e end_time] segment_file...\n"
+                    "  start_time and end_time are seconds since epoch\n", progName);
+}
+
+int main(int argc, char* argv[])
+{
+    time_t startTime = 0;
+    time_t endTime = LONG_MAX;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:e:h")) != -1) {
+        switch (opt) {
+        case 's':
+            startTime = strtol(optarg, nullptr, 10);
+            break;
+
+        case 'e':
+            endTime = strtol(optarg, nullptr, 10);
+            break;
+
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int rc = EXIT_SUCCESS;
+
+    for (int i = optind; i < argc; i++) {
+        Co2LogSegment::Reader reader;
+
+        if (reader.open(argv[i])) {
+            reader.exportCsv(stdout, startTime, endTime);
+            continue;
+        }
+
+        switch (exportCompressedCsv(argv[i], startTime, endTime)) {
+        case Co2LogCompress::FileMissing:
+            fprintf(stderr, "%s: \"%s\" is not a readable CO2 log segment\n", argv[0], argv[i]);
+            rc = EXIT_FAILURE;
+            break;
+
+        case Co2LogCompress::FileCorrupt:
+            fprintf(stderr, "%s: \"%s\" is corrupt\n", argv[0], argv[i]);
+            rc = EXIT_FAILURE;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return rc;
+}
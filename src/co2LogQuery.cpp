@@ -0,0 +1,328 @@
+/*
+ * co2LogQuery.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ *
+ * Prints Co2Monitor log readings for a given date/time and duration.
+ * Takes the same arguments as co2log.py, i.e.
+ *
+ *     co2logq [-c] [-d log_dir] [-r 1m|1h|1d] date_time [+duration|-duration]
+ *
+ * where date_time is yymmdd-HHMM, yymmdd, HHMM, now or today and
+ * duration is n days (d), hours (h) or minutes (m), e.g. +2d, -1h, +30m.
+ * With -r it prints per minute, hour or day rollups rather than readings.
+ */
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#include "co2LogReader.h"
+
+static const char* kDefaultLogDir = "/var/log/co2Monitor";
+
+static void usage(const char* progName)
+{
+    fprintf(stderr, "\nusage: %s [-c] [-d log_dir] [-r 1m|1h|1d] yymmdd-HHMM [+duration|-duration]\n"
+                    "or:    %s [-c] [-d log_dir] [-r 1m|1h|1d] yymmdd [+duration|-duration]\n"
+                    "or:    %s [-c] [-d log_dir] [-r 1m|1h|1d] HHMM|now|today [+duration|-duration]\n\n"
+                    "duration (default +1m, or -1m for now) is n days (d), hours (h) or minutes (m)\n"
+                    "before (-) or after (+) date-time, e.g. +2d, -1h, +30m\n"
+                    "-c prints readings in CSV log format\n"
+                    "-r prints min/mean/max per minute, hour or day rather than readings\n\n",
+                    progName, progName, progName);
+    exit(EXIT_FAILURE);
+}
+
+// True if str matches pattern, in which each 'd' is a digit and
+// anything else must match exactly.
+static bool matchPattern(const char* str, const char* pattern)
+{
+    for ( ; *pattern; str++, pattern++) {
+        if ((*pattern == 'd') ? !isdigit((unsigned char)*str) : (*str != *pattern)) {
+            return false;
+        }
+    }
+
+    return (*str == '\0');
+}
+
+static bool parseDateTime(const char* dateTimeStr, time_t& dateTime)
+{
+    time_t timeNow = time(0);
+    struct tm tmDateTime;
+
+    localtime_r(&timeNow, &tmDateTime);
+
+    if (!strcmp(dateTimeStr, "now")) {
+        dateTime = timeNow;
+        return true;
+    }
+
+    const char* end = nullptr;
+    tmDateTime.tm_sec = 0;
+
+    if (!strcmp(dateTimeStr, "today")) {
+        tmDateTime.tm_hour = 0;
+        tmDateTime.tm_min = 0;
+        end = dateTimeStr + strlen(dateTimeStr);
+    } else if (matchPattern(dateTimeStr, "dddddd-dddd")) {
+        end = strptime(dateTimeStr, "%y%m%d-%H%M", &tmDateTime);
+    } else if (matchPattern(dateTimeStr, "dddddd")) {
+        tmDateTime.tm_hour = 0;
+        tmDateTime.tm_min = 0;
+        end = strptime(dateTimeStr, "%y%m%d", &tmDateTime);
+    } else if (matchPattern(dateTimeStr, "dddd")) {
+        end = strptime(dateTimeStr, "%H%M", &tmDateTime);
+    }
+
+    if (!end || *end) {
+        return false;
+    }
+
+    tmDateTime.tm_isdst = -1;
+    dateTime = mktime(&tmDateTime);
+
+    return (dateTime != -1);
+}
+
+static bool parseResolution(const char* resolutionStr, Co2Rollup::Resolution& resolution)
+{
+    for (int r = Co2Rollup::Minute; r < Co2Rollup::ResolutionCount; r++) {
+        if (!strcmp(resolutionStr, Co2Rollup::resolutionStr(Co2Rollup::Resolution(r)))) {
+            resolution = Co2Rollup::Resolution(r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Like co2log.py, the duration is applied in local time, so a day is a
+// calendar day (23 or 25 hours when daylight saving time changes).
+static bool parseDuration(const char* durationStr, time_t dateTime, time_t& otherTime)
+{
+    // [+-], digits, then d, h or m
+    if (((durationStr[0] != '+') && (durationStr[0] != '-')) || !isdigit((unsigned char)durationStr[1])) {
+        return false;
+    }
+
+    char* unit;
+    int duration = int(strtol(durationStr + 1, &unit, 10));
+
+    if (!*unit || !strchr("dhm", *unit) || unit[1]) {
+        return false;
+    }
+
+    if (durationStr[0] == '-') {
+        duration = -duration;
+    }
+
+    struct tm tmOther;
+
+    if (!localtime_r(&dateTime, &tmOther)) {
+        return false;
+    }
+
+    switch (*unit) {
+    case 'd':
+        tmOther.tm_mday += duration;
+        break;
+
+    case 'h':
+        tmOther.tm_hour += duration;
+        break;
+
+    default:
+        tmOther.tm_min += duration;
+        break;
+    }
+
+    tmOther.tm_isdst = -1;
+    otherTime = mktime(&tmOther);
+
+    return (otherTime != -1);
+}
+
+int main(int argc, char* argv[])
+{
+    const char* progName = basename(argv[0]);
+    std::string logDir(kDefaultLogDir);
+    bool isCsv = false;
+    bool isRollup = false;
+    Co2Rollup::Resolution resolution = Co2Rollup::Minute;
+    const char* dateTimeStr = nullptr;
+    const char* durationStr = nullptr;
+
+    // Not getopt() as durations look like options
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c")) {
+            isCsv = true;
+        } else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) {
+            logDir = argv[++i];
+        } else if (!strcmp(argv[i], "-r") && (i + 1 < argc)) {
+            isRollup = true;
+
+            if (!parseResolution(argv[++i], resolution)) {
+                usage(progName);
+            }
+        } else if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            usage(progName);
+        } else if (!dateTimeStr) {
+            dateTimeStr = argv[i];
+        } else if (!durationStr) {
+            durationStr = argv[i];
+        } else {
+            usage(progName);
+        }
+    }
+
+    time_t dateTime;
+    time_t otherTime;
+
+    if (!dateTimeStr || !parseDateTime(dateTimeStr, dateTime)) {
+        usage(progName);
+    }
+
+    if (!durationStr) {
+        durationStr = strcmp(dateTimeStr, "now") ? "+1m" : "-1m";
+    }
+
+    if (!parseDuration(durationStr, dateTime, otherTime)) {
+        usage(progName);
+    }
+
+    time_t startTime = std::min(dateTime, otherTime);
+    time_t endTime = std::min(std::max(dateTime, otherTime), time(0));
+
+    // Output is built up in a buffer and streamed out in chunks.
+    const size_t kMaxBufSize = 64 * 1024;
+    std::string buf;
+    buf.reserve(kMaxBufSize + 256);
+
+    int dayOfMonth = -1;
+    char dateStr[16] = "";
+
+    auto writeBuf = [&buf]() {
+        if (fwrite(buf.data(), 1, buf.size(), stdout) != buf.size()) {
+            return false; // e.g. broken pipe
+        }
+
+        buf.clear();
+        return true;
+    };
+
+    Co2LogReader logReader(logDir);
+
+    auto printBucket = [&](const Co2Rollup::Bucket& bucket) {
+        uint32_t n = bucket.count;
+
+        if (isCsv) {
+            fmt::format_to(std::back_inserter(buf), "{},{},{},{},{:.0f},{},{},{:.0f},{},{},{:.0f},{},{:.0f},{:.0f},{}\n",
+                           bucket.startTime, n, bucket.fanOnCount,
+                           bucket.temperature.min, Co2Rollup::mean(bucket.temperature, n), bucket.temperature.max,
+                           bucket.relHumidity.min, Co2Rollup::mean(bucket.relHumidity, n), bucket.relHumidity.max,
+                           bucket.co2.min, Co2Rollup::mean(bucket.co2, n), bucket.co2.max,
+                           bucket.fanOnMsec / 1000.0, bucket.fanDutyMsec / 1000.0, bucket.fanSwitchCount);
+        } else {
+            time_t bucketStart = bucket.startTime;
+            struct tm tmBucket;
+            char startStr[32];
+
+            localtime_r(&bucketStart, &tmBucket);
+            strftime(startStr, sizeof(startStr), (resolution == Co2Rollup::Day) ? "%Y-%m-%d" : "%Y-%m-%d %H:%M", &tmBucket);
+
+            fmt::format_to(std::back_inserter(buf), "{}, {:.2f}C ({:.2f}-{:.2f}), {:.2f}% ({:.2f}-{:.2f}), "
+                           "{:.0f}ppm ({}-{}), fan on: {:3.0f}% {:.1f}min ({:.1f}min full speed) x{}, readings: {}\n",
+                           startStr,
+                           Co2Rollup::mean(bucket.temperature, n) * 0.01, bucket.temperature.min * 0.01, bucket.temperature.max * 0.01,
+                           Co2Rollup::mean(bucket.relHumidity, n) * 0.01, bucket.relHumidity.min * 0.01, bucket.relHumidity.max * 0.01,
+                           Co2Rollup::mean(bucket.co2, n), bucket.co2.min, bucket.co2.max,
+                           n ? (bucket.fanOnCount * 100.0) / n : 0.0,
+                           bucket.fanOnMsec / 60000.0, bucket.fanDutyMsec / 60000.0, bucket.fanSwitchCount, n);
+        }
+
+        return (buf.size() < kMaxBufSize) || writeBuf();
+    };
+
+    if (isRollup) {
+        size_t count = logReader.readRollups(resolution, startTime, endTime, printBucket);
+
+        writeBuf();
+
+        if (!count) {
+            fprintf(stderr, "No %s rollups in \"%s\" for %s %s\n",
+                    Co2Rollup::resolutionStr(resolution), logDir.c_str(), dateTimeStr, durationStr);
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    size_t count = logReader.read(startTime, endTime, [&](const Co2LogReader::Reading& reading) {
+        if (isCsv) {
+            fmt::format_to(std::back_inserter(buf), "{},{},{},{},{},{},{},{}\n",
+                           reading.temperature,
+                           reading.relHumidity,
+                           reading.co2,
+                           reading.fanStateOn ? "on" : "off",
+                           reading.fanAuto ? "auto" : "man",
+                           reading.filterRelHumidity,
+                           reading.filterCo2,
+                           reading.timestamp);
+        } else {
+            struct tm tmReading;
+            localtime_r(&reading.timestamp, &tmReading);
+
+            if (tmReading.tm_mday != dayOfMonth) {
+                dayOfMonth = tmReading.tm_mday;
+                strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &tmReading);
+            }
+
+            char co2Str[16];
+            char filterCo2Str[16];
+            char fanStr[8];
+
+            *fmt::format_to_n(co2Str, sizeof(co2Str) - 1, "{}ppm", reading.co2).out = '\0';
+            *fmt::format_to_n(filterCo2Str, sizeof(filterCo2Str) - 1, "({}ppm)", reading.filterCo2).out = '\0';
+
+            if (!reading.fanStateOn) {
+                strcpy(fanStr, "off");
+            } else if (reading.fanDuty < 100) {
+                *fmt::format_to_n(fanStr, sizeof(fanStr) - 1, "{}%", reading.fanDuty).out = '\0';
+            } else {
+                strcpy(fanStr, "on");
+            }
+
+            fmt::format_to(std::back_inserter(buf), "{:.2f}C, {:.2f}% ({:.2f}%), {:<7}{:<9}, fan: {:3} {:6}, {} {:02}:{:02}:{:02}\n",
+                           reading.temperature * 0.01,
+                           reading.relHumidity * 0.01,
+                           reading.filterRelHumidity * 0.01,
+                           co2Str,
+                           filterCo2Str,
+                           fanStr,
+                           reading.fanAuto ? "(auto)" : "(man)",
+                           dateStr, tmReading.tm_hour, tmReading.tm_min, tmReading.tm_sec);
+        }
+
+        return (buf.size() < kMaxBufSize) || writeBuf();
+    });
+
+    writeBuf();
+
+    for (auto& fileName : logReader.corruptFiles()) {
+        fprintf(stderr, "\"%s\" is corrupt, so its readings are missing\n", fileName.c_str());
+    }
+
+    if (!logReader.corruptFiles().empty()) {
+        return EXIT_FAILURE;
+    }
+
+    if (!count) {
+        fprintf(stderr, "No readings logged in \"%s\" for %s %s\n", logDir.c_str(), dateTimeStr, durationStr);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,401 @@
+/*
+ * co2LogReader.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "co2LogCompress.h"
+#include "co2LogReader.h"
+#include "co2LogSegment.h"
+
+Co2LogReader::Co2LogReader(const std::string& logBaseDir) :
+    logBaseDir_(logBaseDir)
+{
+}
+
+Co2LogReader::~Co2LogReader()
+{
+}
+
+size_t Co2LogReader::read(time_t startTime, time_t endTime, const ReadingFn& readingFn)
+{
+    size_t count = 0;
+    bool shouldStop = false;
+
+    corruptFiles_.clear();
+
+    for (time_t day = Co2LogSegment::dayStart(startTime); !shouldStop && (day <= endTime);
+         day = Co2LogSegment::dayStart(day + (30 * 60 * 60))) {
+        std::string fileName = Co2LogSegment::dayFileName(logBaseDir_, day);
+
+        if (!readSegment(fileName + ".bin", startTime, endTime, readingFn, count, shouldStop) &&
+            !readCompressed(fileName + ".co2z", startTime, endTime, readingFn, count, shouldStop) &&
+            !readCsv(fileName, startTime, endTime, readingFn, count, shouldStop)) {
+            syslog(LOG_DEBUG, "No CO2 log \"%s\"", fileName.c_str());
+        }
+    }
+
+    return count;
+}
+
+void Co2LogReader::toReading(const Co2LogSegment::Record& rec, time_t baseTime, Reading& reading)
+{
+    reading.timestamp = baseTime + rec.timeOffset;
+    reading.temperature = rec.temperature;
+    reading.relHumidity = rec.relHumidity;
+    reading.co2 = rec.co2;
+    reading.fanStateOn = (rec.flags & Co2LogSegment::FanOn);
+    reading.fanAuto = (rec.flags & Co2LogSegment::FanAuto);
+    reading.fanDuty = rec.fanDuty ? rec.fanDuty : (reading.fanStateOn ? 100 : 0);
+    reading.filterRelHumidity = rec.filterRelHumidity;
+    reading.filterCo2 = rec.filterCo2;
+}
+
+bool Co2LogReader::readSegment(const std::string& fileName, time_t startTime, time_t endTime,
+                               const ReadingFn& readingFn, size_t& count, bool& shouldStop)
+{
+    Co2LogSegment::Reader segment;
+
+    if (!segment.open(fileName)) {
+        return false;
+    }
+
+    for (uint32_t slot = segment.slot(startTime); slot < segment.slotCount(); slot++) {
+        const Co2LogSegment::Record& rec = segment.record(slot);
+
+        if (!(rec.flags & Co2LogSegment::Valid)) {
+            continue;
+        }
+
+        time_t timestamp = segment.timestamp(rec);
+
+        if (timestamp < startTime) {
+            continue;
+        } else if (timestamp > endTime) {
+            break;
+        }
+
+        Reading reading;
+        toReading(rec, segment.baseTime(), reading);
+
+        count++;
+
+        if (!readingFn(reading)) {
+            shouldStop = true;
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool Co2LogReader::readCompressed(const std::string& fileName, time_t startTime, time_t endTime,
+                                  const ReadingFn& readingFn, size_t& count, bool& shouldStop)
+{
+    Co2LogCompress::Header header;
+
+    // A compressed day is small, so it's decoded in one go
+    records_.clear();
+
+    switch (Co2LogCompress::readFile(fileName, header, records_)) {
+    case Co2LogCompress::FileMissing:
+        return false;
+
+    case Co2LogCompress::FileCorrupt:
+        // found, but no use to anyone
+        corruptFiles_.push_back(fileName);
+        return true;
+
+    default:
+        break;
+    }
+
+    time_t baseTime = static_cast<time_t>(header.baseTime);
+
+    auto rec = std::lower_bound(records_.begin(), records_.end(), startTime,
+                                [baseTime](const Co2LogSegment::Record& r, time_t t) { return (baseTime + r.timeOffset) < t; });
+
+    for ( ; rec != records_.end(); ++rec) {
+        Reading reading;
+        toReading(*rec, baseTime, reading);
+
+        if (reading.timestamp > endTime) {
+            break;
+        }
+
+        count++;
+
+        if (!readingFn(reading)) {
+            shouldStop = true;
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool Co2LogReader::parseCsvLine(const char* line, const char* lineEnd, Reading& reading)
+{
+    const char* p = line;
+
+    auto parseInt = [&p, lineEnd](auto& value) {
+        auto [next, ec] = std::from_chars(p, lineEnd, value);
+
+        if ((ec != std::errc()) || ((next < lineEnd) && (*next != ',') && (*next != '\n'))) {
+            return false;
+        }
+
+        p = (next < lineEnd) ? next + 1 : next;
+        return true;
+    };
+
+    auto parseWord = [&p, lineEnd](const char* trueWord, const char* falseWord, bool& value) {
+        const char* comma = static_cast<const char*>(memchr(p, ',', lineEnd - p));
+
+        if (!comma) {
+            return false;
+        }
+
+        std::string_view word(p, comma - p);
+
+        if (word == trueWord) {
+            value = true;
+        } else if (word == falseWord) {
+            value = false;
+        } else {
+            return false;
+        }
+
+        p = comma + 1;
+        return true;
+    };
+
+    long timestamp = 0;
+
+    if (!(parseInt(reading.temperature) &&
+          parseInt(reading.relHumidity) &&
+          parseInt(reading.co2) &&
+          parseWord("on", "off", reading.fanStateOn) &&
+          parseWord("auto", "man", reading.fanAuto) &&
+          parseInt(reading.filterRelHumidity) &&
+          parseInt(reading.filterCo2) &&
+          parseInt(timestamp))) {
+        return false;
+    }
+
+    // CSV logs have no fan duty cycle, so it is all or nothing
+    reading.fanDuty = reading.fanStateOn ? 100 : 0;
+    reading.timestamp = timestamp;
+
+    return true;
+}
+
+bool Co2LogReader::readCsv(const std::string& fileName, time_t startTime, time_t endTime,
+                           const ReadingFn& readingFn, size_t& count, bool& shouldStop)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    } else if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Unable to map CO2 log \"%s\" (%s)", fileName.c_str(), strerror(errno));
+        return false;
+    }
+
+    const char* data = static_cast<const char*>(map);
+    const char* dataEnd = data + size;
+
+    auto lineEnd = [dataEnd](const char* line) {
+        const char* nl = static_cast<const char*>(memchr(line, '\n', dataEnd - line));
+        return nl ? nl : dataEnd;
+    };
+
+    // Binary search for the first line with a timestamp >= startTime.
+    // Lines starting before lo are all earlier than startTime, and lines
+    // starting at or after hi are all at or after it. lo is always the
+    // start of a line.
+    size_t lo = 0;
+    size_t hi = size;
+
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+
+        // start of first line at or after mid
+        size_t lineOffset = (mid == lo) ? lo : (lineEnd(data + mid - 1) - data) + 1;
+
+        if (lineOffset >= hi) {
+            hi = mid;
+            continue;
+        }
+
+        const char* line = data + lineOffset;
+        const char* end = lineEnd(line);
+        Reading reading;
+
+        if (parseCsvLine(line, end, reading) && (reading.timestamp >= startTime)) {
+            hi = lineOffset;
+        } else {
+            lo = std::min<size_t>((end - data) + 1, size);
+        }
+    }
+
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    for (const char* line = data + lo; line < dataEnd; ) {
+        const char* end = lineEnd(line);
+        Reading reading;
+
+        if (parseCsvLine(line, end, reading)) {
+            if (reading.timestamp > endTime) {
+                break;
+            }
+
+            if (reading.timestamp >= startTime) {
+                count++;
+
+                if (!readingFn(reading)) {
+                    shouldStop = true;
+                    break;
+                }
+            }
+        }
+
+        line = end + 1;
+    }
+
+    munmap(map, size);
+
+    return true;
+}
+
+size_t Co2LogReader::readRollups(Co2Rollup::Resolution resolution, time_t startTime, time_t endTime, const BucketFn& bucketFn)
+{
+    size_t count = 0;
+    bool shouldStop = false;
+
+    startTime = Co2Rollup::bucketStart(resolution, startTime);
+
+    // Minute and hour rollups are in daily files, day rollups in monthly files.
+    time_t fileStart = Co2LogSegment::dayStart(startTime);
+
+    while (!shouldStop && (fileStart <= endTime)) {
+        readRollupFile(Co2Rollup::fileName(logBaseDir_, resolution, fileStart),
+                       startTime, endTime, bucketFn, count, shouldStop);
+
+        struct tm tmNext;
+
+        if (!localtime_r(&fileStart, &tmNext)) {
+            break;
+        }
+
+        if (resolution == Co2Rollup::Day) {
+            tmNext.tm_mon++;
+            tmNext.tm_mday = 1;
+        } else {
+            tmNext.tm_mday++;
+        }
+
+        tmNext.tm_hour = 0;
+        tmNext.tm_min = 0;
+        tmNext.tm_sec = 0;
+        tmNext.tm_isdst = -1;
+        fileStart = mktime(&tmNext);
+    }
+
+    return count;
+}
+
+void Co2LogReader::readRollupFile(const std::string& fileName, time_t startTime, time_t endTime,
+                                  const BucketFn& bucketFn, size_t& count, bool& shouldStop)
+{
+    int fd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) < 0) || (size_t(st.st_size) < sizeof(Co2Rollup::Header))) {
+        close(fd);
+        return;
+    }
+
+    size_t size = st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Unable to map CO2 rollup \"%s\" (%s)", fileName.c_str(), strerror(errno));
+        return;
+    }
+
+    const Co2Rollup::Header* header = static_cast<const Co2Rollup::Header*>(map);
+
+    size_t bucketSize = Co2Rollup::bucketSize(*header);
+
+    if (!bucketSize) {
+        syslog(LOG_ERR, "\"%s\" is not a valid CO2 rollup", fileName.c_str());
+        munmap(map, size);
+        return;
+    }
+
+    const char* data = static_cast<const char*>(map) + sizeof(Co2Rollup::Header);
+    const Co2Rollup::Bucket* first = reinterpret_cast<const Co2Rollup::Bucket*>(data);
+    const Co2Rollup::Bucket* last = first + ((size - sizeof(Co2Rollup::Header)) / sizeof(Co2Rollup::Bucket));
+    std::vector<Co2Rollup::Bucket> oldBuckets;
+
+    if (bucketSize != sizeof(Co2Rollup::Bucket)) {
+        // older schema, which is only ever in files from before an upgrade
+        Co2Rollup::toBuckets(*header, data, size - sizeof(Co2Rollup::Header), oldBuckets);
+        first = oldBuckets.data();
+        last = first + oldBuckets.size();
+    }
+
+    // Buckets are in time order, so go straight to the first one in range
+    const Co2Rollup::Bucket* bucket = std::lower_bound(first, last, startTime,
+                                                       [](const Co2Rollup::Bucket& b, time_t t) { return b.startTime < t; });
+
+    while (!shouldStop && (bucket < last) && (bucket->startTime <= endTime)) {
+        Co2Rollup::Bucket merged = *bucket++;
+
+        // a bucket split by a restart
+        while ((bucket < last) && (bucket->startTime == merged.startTime)) {
+            Co2Rollup::merge(merged, *bucket++);
+        }
+
+        count++;
+
+        if (!bucketFn(merged)) {
+            shouldStop = true;
+        }
+    }
+
+    munmap(map, size);
+}
@@ -0,0 +1,81 @@
+/*
+ * co2LogReader.h
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#ifndef CO2LOGREADER_H
+#define CO2LOGREADER_H
+
+#include <functional>
+#include <string>
+
+#include "co2LogSegment.h"
+#include "co2LogWriter.h"
+#include "co2Rollup.h"
+
+// Reads back the daily logs written by Co2LogWriter.
+//
+// Each day is read from its binary segment (YYYY/MM/DD.bin) if there is
+// one, otherwise from its compressed segment (YYYY/MM/DD.co2z) or CSV file
+// (YYYY/MM/DD). None is scanned from the start: a segment is indexed
+// directly by slot, a compressed segment is decoded then binary searched,
+// and a CSV file (whose lines are in timestamp order) is binary searched by
+// byte offset for the first line in range.
+//
+// Rollups (see co2Rollup.h) are read back in the same way.
+//
+class Co2LogReader
+{
+    public:
+        typedef Co2LogWriter::Reading Reading;
+
+        // Return false to stop reading.
+        typedef std::function<bool(const Reading& reading)> ReadingFn;
+        typedef std::function<bool(const Co2Rollup::Bucket& bucket)> BucketFn;
+
+        Co2LogReader(const std::string& logBaseDir);
+
+        ~Co2LogReader();
+
+        // Calls readingFn, in timestamp order, for each reading logged
+        // between startTime and endTime (inclusive).
+        // Returns number of readings passed to readingFn.
+        size_t read(time_t startTime, time_t endTime, const ReadingFn& readingFn);
+
+        // Compressed logs found to be corrupt by the last read(). None of
+        // their readings are passed on.
+        const std::vector<std::string>& corruptFiles() const { return corruptFiles_; }
+
+        // Calls bucketFn, in time order, for each rollup bucket at the given
+        // resolution covering any of startTime to endTime (inclusive).
+        // Returns number of buckets passed to bucketFn.
+        size_t readRollups(Co2Rollup::Resolution resolution, time_t startTime, time_t endTime, const BucketFn& bucketFn);
+
+        // Parse one CSV log line from [line, lineEnd).
+        static bool parseCsvLine(const char* line, const char* lineEnd, Reading& reading);
+
+    private:
+        Co2LogReader();
+
+        static void toReading(const Co2LogSegment::Record& rec, time_t baseTime, Reading& reading);
+
+        // Return true if the day's log was found.
+        bool readSegment(const std::string& fileName, time_t startTime, time_t endTime,
+                         const ReadingFn& readingFn, size_t& count, bool& shouldStop);
+        bool readCompressed(const std::string& fileName, time_t startTime, time_t endTime,
+                            const ReadingFn& readingFn, size_t& count, bool& shouldStop);
+        bool readCsv(const std::string& fileName, time_t startTime, time_t endTime,
+                     const ReadingFn& readingFn, size_t& count, bool& shouldStop);
+        void readRollupFile(const std::string& fileName, time_t startTime, time_t endTime,
+                            const BucketFn& bucketFn, size_t& count, bool& shouldStop);
+
+        std::string logBaseDir_;
+        std::vector<Co2LogSegment::Record> records_; // decoded compressed segment
+        std::vector<std::string> corruptFiles_;
+
+    protected:
+};
+
+#endif /* CO2LOGREADER_H */
@@ -0,0 +1,341 @@
+/*
+ * co2LogSegment.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#include <cstddef>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fmt/core.h>
+
+#include "co2LogSegment.h"
+
+namespace Co2LogSegment
+{
+
+time_t dayStart(time_t timestamp)
+{
+    struct tm tmDay;
+
+    if (!localtime_r(&timestamp, &tmDay)) {
+        return timestamp - (timestamp % (24 * 60 * 60));
+    }
+
+    tmDay.tm_hour = 0;
+    tmDay.tm_min = 0;
+    tmDay.tm_sec = 0;
+    tmDay.tm_isdst = -1;
+
+    return mktime(&tmDay);
+}
+
+std::string dayFileName(const std::string& logBaseDir, time_t timestamp)
+{
+    struct tm tmDay;
+
+    if (!localtime_r(&timestamp, &tmDay)) {
+        return std::string();
+    }
+
+    return fmt::format("{}/{}/{}/{}",
+                       logBaseDir,
+                       CO2::zeroPadNumber(2, tmDay.tm_year + 1900),
+                       CO2::zeroPadNumber(2, tmDay.tm_mon + 1),
+                       CO2::zeroPadNumber(2, tmDay.tm_mday));
+}
+
+void formatCsv(std::string& buf, const Record& record, time_t timestamp)
+{
+    fmt::format_to(std::back_inserter(buf), "{},{},{},{},{},{},{},{}\n",
+                   record.temperature,
+                   record.relHumidity,
+                   record.co2,
+                   (record.flags & FanOn) ? "on" : "off",
+                   (record.flags & FanAuto) ? "auto" : "man",
+                   record.filterRelHumidity,
+                   record.filterCo2,
+                   timestamp);
+}
+
+Writer::Writer() :
+    fd_(-1),
+    baseTime_(0),
+    slotInterval_(1),
+    slotCount_(0)
+{
+}
+
+Writer::~Writer()
+{
+    close();
+}
+
+void Writer::open(const std::string& pathName, time_t baseTime, uint16_t slotInterval)
+{
+    close();
+
+    if (!slotInterval) {
+        slotInterval = 1;
+    }
+
+    int fd = ::open(pathName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd < 0) {
+        throw CO2::exceptionLevel(fmt::format("Unable to open CO2 log segment \"{}\" ({})", pathName, strerror(errno)), false);
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw CO2::exceptionLevel(fmt::format("Unable to stat CO2 log segment \"{}\" ({})", pathName, strerror(errno)), false);
+    }
+
+    Header header;
+
+    if (st.st_size == 0) {
+        // New segment. Size it for all its slots up front: the file stays
+        // sparse, so only the blocks which get written take up space.
+        memset(&header, 0, sizeof(header));
+        header.magic = kMagic;
+        header.schemaVersion = kSchemaVersion;
+        header.headerSize = sizeof(Header);
+        header.recordSize = sizeof(Record);
+        header.slotInterval = slotInterval;
+        header.slotCount = (kSecondsPerSegment + slotInterval - 1) / slotInterval;
+        header.baseTime = baseTime;
+
+        if ((pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) ||
+            (ftruncate(fd, sizeof(Header) + (off_t(header.slotCount) * sizeof(Record))) < 0)) {
+            ::close(fd);
+            throw CO2::exceptionLevel(fmt::format("Unable to initialise CO2 log segment \"{}\" ({})", pathName, strerror(errno)), false);
+        }
+    } else if ((pread(fd, &header, sizeof(header), 0) != sizeof(header)) ||
+               (header.magic != kMagic) ||
+               (header.schemaVersion < kMinSchemaVersion) ||
+               (header.schemaVersion > kSchemaVersion) ||
+               (header.headerSize != sizeof(Header)) ||
+               (header.recordSize != sizeof(Record)) ||
+               (header.slotInterval == 0)) {
+        ::close(fd);
+        throw CO2::exceptionLevel(fmt::format("\"{}\" is not a valid CO2 log segment", pathName), false);
+    } else if (header.schemaVersion < kSchemaVersion) {
+        // Older records have fanDuty 0, which readers take as unknown
+        uint16_t schemaVersion = kSchemaVersion;
+
+        if (pwrite(fd, &schemaVersion, sizeof(schemaVersion), offsetof(Header, schemaVersion)) != sizeof(schemaVersion)) {
+            ::close(fd);
+            throw CO2::exceptionLevel(fmt::format("Unable to upgrade CO2 log segment \"{}\" ({})", pathName, strerror(errno)), false);
+        }
+    }
+
+    if (header.slotInterval != slotInterval) {
+        // Carry on with the existing layout so that records already in
+        // the file remain where readers expect them.
+        syslog(LOG_WARNING, "CO2 log segment \"%s\" has slot interval %us (wanted %us)",
+               pathName.c_str(), header.slotInterval, slotInterval);
+    }
+
+    fd_ = fd;
+    baseTime_ = static_cast<time_t>(header.baseTime);
+    slotInterval_ = header.slotInterval;
+    slotCount_ = header.slotCount;
+}
+
+void Writer::close()
+{
+    if (fd_ < 0) {
+        return;
+    }
+
+    if (::close(fd_) < 0) {
+        syslog(LOG_ERR, "Error (%d) when closing CO2 log segment", errno);
+    }
+
+    fd_ = -1;
+}
+
+size_t Writer::write(const std::vector<Record>& records)
+{
+    if ((fd_ < 0) || records.empty()) {
+        return 0;
+    }
+
+    size_t bytesWritten = 0;
+    size_t runStart = 0;
+
+    while (runStart < records.size()) {
+        uint32_t slot = records[runStart].timeOffset / slotInterval_;
+
+        if (slot >= slotCount_) {
+            syslog(LOG_WARNING, "CO2 log record at offset %us is outside segment", records[runStart].timeOffset);
+            runStart++;
+            continue;
+        }
+
+        // extend run for as long as records fall into consecutive slots
+        size_t runEnd = runStart + 1;
+
+        while ((runEnd < records.size()) &&
+               ((slot + (runEnd - runStart)) < slotCount_) &&
+               ((records[runEnd].timeOffset / slotInterval_) == (slot + (runEnd - runStart)))) {
+            runEnd++;
+        }
+
+        const char* buf = reinterpret_cast<const char*>(&records[runStart]);
+        size_t len = (runEnd - runStart) * sizeof(Record);
+        off_t offset = sizeof(Header) + (off_t(slot) * sizeof(Record));
+        size_t done = 0;
+
+        while (done < len) {
+            ssize_t n = pwrite(fd_, buf + done, len - done, offset + done);
+
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                syslog(LOG_ERR, "Error writing CO2 log segment (%s)", strerror(errno));
+                break;
+            }
+
+            done += n;
+        }
+
+        bytesWritten += done;
+        runStart = runEnd;
+    }
+
+    return bytesWritten;
+}
+
+Reader::Reader() :
+    map_(nullptr),
+    mapSize_(0),
+    header_(nullptr),
+    records_(nullptr),
+    slotCount_(0)
+{
+}
+
+Reader::~Reader()
+{
+    close();
+}
+
+bool Reader::open(const std::string& pathName)
+{
+    close();
+
+    int fd = ::open(pathName.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) < 0) || (st.st_size < off_t(sizeof(Header)))) {
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED) {
+        syslog(LOG_ERR, "Unable to map CO2 log segment \"%s\" (%s)", pathName.c_str(), strerror(errno));
+        return false;
+    }
+
+    const Header* header = static_cast<const Header*>(map);
+
+    if ((header->magic != kMagic) ||
+        (header->schemaVersion < kMinSchemaVersion) ||
+        (header->schemaVersion > kSchemaVersion) ||
+        (header->headerSize != sizeof(Header)) ||
+        (header->recordSize != sizeof(Record)) ||
+        (header->slotInterval == 0)) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    map_ = map;
+    mapSize_ = st.st_size;
+    header_ = header;
+    records_ = reinterpret_cast<const Record*>(static_cast<const char*>(map) + sizeof(Header));
+    slotCount_ = std::min<size_t>(header->slotCount, (mapSize_ - sizeof(Header)) / sizeof(Record));
+
+    madvise(map_, mapSize_, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void Reader::close()
+{
+    if (map_) {
+        munmap(map_, mapSize_);
+    }
+
+    map_ = nullptr;
+    mapSize_ = 0;
+    header_ = nullptr;
+    records_ = nullptr;
+    slotCount_ = 0;
+}
+
+uint32_t Reader::slot(time_t timestamp) const
+{
+    if (!slotCount_ || (timestamp <= baseTime())) {
+        return 0;
+    }
+
+    time_t s = (timestamp - baseTime()) / header_->slotInterval;
+
+    return (s < time_t(slotCount_)) ? uint32_t(s) : slotCount_ - 1;
+}
+
+void Reader::exportCsv(FILE* outFile, time_t startTime, time_t endTime) const
+{
+    if (!slotCount_ || (endTime < baseTime())) {
+        return;
+    }
+
+    const size_t kMaxBufSize = 64 * 1024;
+    std::string buf;
+    buf.reserve(kMaxBufSize + 128);
+
+    for (uint32_t s = slot(startTime); s < slotCount_; s++) {
+        const Record& rec = records_[s];
+
+        if (!(rec.flags & Valid)) {
+            continue;
+        }
+
+        time_t t = timestamp(rec);
+
+        if (t < startTime) {
+            continue;
+        } else if (t > endTime) {
+            break;
+        }
+
+        formatCsv(buf, rec, t);
+
+        if (buf.size() >= kMaxBufSize) {
+            fwrite(buf.data(), 1, buf.size(), outFile);
+            buf.clear();
+        }
+    }
+
+    if (!buf.empty()) {
+        fwrite(buf.data(), 1, buf.size(), outFile);
+    }
+}
+
+} // namespace Co2LogSegment
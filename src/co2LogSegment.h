@@ -0,0 +1,170 @@
+/*
+ * co2LogSegment.h
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#ifndef CO2LOGSEGMENT_H
+#define CO2LOGSEGMENT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Binary daily log segment.
+//
+// A segment holds one (local) day of readings. It starts with a fixed
+// header followed by an array of fixed size records, one slot for every
+// slotInterval seconds since baseTime (local midnight):
+//
+//     slot = (timestamp - baseTime) / slotInterval
+//
+// so a reader can mmap a day and go straight to the record for any second
+// without parsing anything. Slots which were never written read back as
+// zero, i.e. without the Valid flag set. The file is sized for a 25 hour
+// day so that DST changes still fit.
+//
+// All fields are stored in host byte order at fixed offsets, so each field
+// can be walked as a column with a stride of sizeof(Record).
+//
+namespace Co2LogSegment
+{
+
+const uint32_t kMagic = 0x53324f43; // "CO2S"
+const uint16_t kSchemaVersion = 2;
+const uint16_t kMinSchemaVersion = 1;  // same layout, without fan duty
+const uint32_t kSecondsPerSegment = 25 * 60 * 60;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t schemaVersion;
+    uint16_t headerSize;
+    uint16_t recordSize;
+    uint16_t slotInterval;  // seconds per record slot
+    uint32_t slotCount;
+    int64_t  baseTime;      // seconds since epoch of first slot (local midnight)
+    uint8_t  reserved[40];
+} Header;
+
+typedef enum {
+    Valid   = 0x01,
+    FanOn   = 0x02,
+    FanAuto = 0x04
+} RecordFlags;
+
+typedef struct {
+    uint32_t timeOffset;        // seconds since baseTime
+    int16_t  temperature;       // 1/100 degrees C
+    uint16_t relHumidity;       // 1/100 %
+    uint16_t co2;               // ppm
+    uint16_t filterRelHumidity; // 1/100 %
+    uint16_t filterCo2;         // ppm
+    uint8_t  flags;             // RecordFlags
+    uint8_t  fanDuty;           // percent, 0 if not known (schema 1)
+} Record;
+
+static_assert(sizeof(Header) == 64, "Co2LogSegment::Header must be 64 bytes");
+static_assert(sizeof(Record) == 16, "Co2LogSegment::Record must be 16 bytes");
+
+// Seconds since epoch of local midnight at the start of the day containing timestamp.
+time_t dayStart(time_t timestamp);
+
+// Log file name, without extension, for day containing timestamp,
+// i.e. logBaseDir/YYYY/MM/DD
+std::string dayFileName(const std::string& logBaseDir, time_t timestamp);
+
+// Writes records into a segment file, creating it (and its header) if necessary.
+class Writer
+{
+    public:
+        Writer();
+
+        ~Writer();
+
+        void open(const std::string& pathName, time_t baseTime, uint16_t slotInterval);
+        void close();
+
+        bool isOpen() const {
+            return fd_ >= 0;
+        }
+
+        int fd() const {
+            return fd_;
+        }
+
+        time_t baseTime() const {
+            return baseTime_;
+        }
+
+        // Records are written to the slot for their timestamp. Runs of
+        // consecutive slots are coalesced into a single write.
+        // Returns number of bytes written.
+        size_t write(const std::vector<Record>& records);
+
+    private:
+        int fd_;
+        time_t baseTime_;
+        uint16_t slotInterval_;
+        uint32_t slotCount_;
+};
+
+// Read-only mmap of a segment file.
+class Reader
+{
+    public:
+        Reader();
+
+        ~Reader();
+
+        // Returns false if the file doesn't exist or isn't a valid segment.
+        bool open(const std::string& pathName);
+        void close();
+
+        const Header& header() const {
+            return *header_;
+        }
+
+        uint32_t slotCount() const {
+            return slotCount_;
+        }
+
+        time_t baseTime() const {
+            return static_cast<time_t>(header_->baseTime);
+        }
+
+        time_t timestamp(const Record& record) const {
+            return baseTime() + record.timeOffset;
+        }
+
+        // Slot containing timestamp (clamped to the segment).
+        uint32_t slot(time_t timestamp) const;
+
+        const Record& record(uint32_t slot) const {
+            return records_[slot];
+        }
+
+        const Record* records() const {
+            return records_;
+        }
+
+        // Writes valid records in [startTime, endTime] in the daily CSV
+        // log format, i.e.
+        // temperature,relHumidity,co2,on|off,auto|man,filterRelHumidity,filterCo2,timestamp
+        void exportCsv(FILE* outFile, time_t startTime, time_t endTime) const;
+
+    private:
+        void* map_;
+        size_t mapSize_;
+        const Header* header_;
+        const Record* records_;
+        uint32_t slotCount_;
+};
+
+void formatCsv(std::string& buf, const Record& record, time_t timestamp);
+
+} // namespace Co2LogSegment
+
+#endif /* CO2LOGSEGMENT_H */
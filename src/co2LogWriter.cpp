@@ -0,0 +1,626 @@
+/*
+ * co2LogWriter.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <filesystem>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fmt/core.h>
+
+#include "co2LogCompress.h"
+#include "co2LogWriter.h"
+#include "latencyHistogram.h"
+
+namespace fs = std::filesystem;
+
+Co2LogWriter::Co2LogWriter(const std::string& logBaseDir, LogFormat logFormat, uint16_t slotInterval, bool compress,
+                           size_t queueSize, time_t flushInterval, time_t fsyncInterval) :
+    logBaseDir_(logBaseDir),
+    kLogFormat_(logFormat),
+    kSlotInterval_(slotInterval ? slotInterval : 1),
+    kCompress_(compress),
+    kQueueSize_(queueSize ? queueSize : 1),
+    kFlushInterval_(flushInterval),
+    kFsyncInterval_(fsyncInterval),
+    queueHead_(0),
+    queueCount_(0),
+    shouldStop_(false),
+    flushRequested_(false),
+    writerThread_(nullptr),
+    logFd_(-1),
+    logFileDay_(0),
+    pendingReadings_(0),
+    timeNextFsync_(0),
+    hasUnsyncedData_(false)
+{
+    queue_.resize(kQueueSize_);
+    pendingBuf_.reserve(kMaxPendingBytes_ * 2);
+    pendingRecords_.reserve((kMaxPendingBytes_ / sizeof(Co2LogSegment::Record)) * 2);
+    rollupQueue_.reserve(kRollupQueueSize_);
+    pendingRollups_.reserve(kRollupQueueSize_);
+    memset(&stats_, 0, sizeof(stats_));
+
+    for (auto& fd : rollupFd_) {
+        fd = -1;
+    }
+}
+
+Co2LogWriter::~Co2LogWriter()
+{
+    stop();
+}
+
+void Co2LogWriter::start()
+{
+    if (writerThread_) {
+        return;
+    }
+
+    shouldStop_ = false;
+    writerThread_ = new std::thread(&Co2LogWriter::run, this);
+}
+
+void Co2LogWriter::stop()
+{
+    if (!writerThread_) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shouldStop_ = true;
+    }
+
+    cv_.notify_one();
+
+    writerThread_->join();
+    delete writerThread_;
+    writerThread_ = nullptr;
+
+    logStats(LOG_INFO);
+}
+
+bool Co2LogWriter::push(const Reading& reading)
+{
+    size_t queueDepth;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (queueCount_ >= kQueueSize_) {
+            std::lock_guard<std::mutex> statsLock(statsMutex_);
+            stats_.recordsDropped++;
+            return false;
+        }
+
+        queue_[(queueHead_ + queueCount_) % kQueueSize_] = reading;
+        queueDepth = ++queueCount_;
+    }
+
+    cv_.notify_one();
+
+    std::lock_guard<std::mutex> statsLock(statsMutex_);
+    stats_.queueDepth = queueDepth;
+
+    if (queueDepth > stats_.queueHighWater) {
+        stats_.queueHighWater = queueDepth;
+    }
+
+    return true;
+}
+
+void Co2LogWriter::requestFlush()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushRequested_ = true;
+    }
+
+    cv_.notify_one();
+}
+
+bool Co2LogWriter::pushRollup(Co2Rollup::Resolution resolution, const Co2Rollup::Bucket& bucket)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (rollupQueue_.size() >= kRollupQueueSize_) {
+            return false;
+        }
+
+        rollupQueue_.push_back({resolution, bucket});
+    }
+
+    cv_.notify_one();
+
+    return true;
+}
+
+Co2LogWriter::Stats Co2LogWriter::stats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    return stats_;
+}
+
+void Co2LogWriter::logStats(int priority)
+{
+    Stats s = stats();
+
+    syslog(priority, "Co2 log writer: queue depth=%zu (max %zu)  records written=%llu  dropped=%llu  rollups=%llu  bytes=%llu"
+           "  bytes dropped=%llu  flushes=%llu  fsyncs=%llu  flush latency last=%lluus max=%lluus mean=%lluus  cpu=%.3fs",
+           s.queueDepth, s.queueHighWater,
+           (unsigned long long)s.recordsWritten, (unsigned long long)s.recordsDropped, (unsigned long long)s.rollupsWritten,
+           (unsigned long long)s.bytesWritten, (unsigned long long)s.bytesDropped, (unsigned long long)s.flushCount, (unsigned long long)s.fsyncCount,
+           (unsigned long long)s.lastFlushUsec, (unsigned long long)s.maxFlushUsec,
+           (unsigned long long)(s.flushCount ? s.totalFlushUsec / s.flushCount : 0), s.cpuUsec / 1e6);
+}
+
+Co2LogWriter::LogFormat Co2LogWriter::logFormatFromStr(const std::string& logFormatStr)
+{
+    if (logFormatStr == "binary") {
+        return Binary;
+    } else if (logFormatStr == "csv") {
+        return Csv;
+    } else if (logFormatStr == "both") {
+        return Both;
+    }
+
+    syslog(LOG_WARNING, "Unknown CO2 log format \"%s\" - using binary", logFormatStr.c_str());
+
+    return Binary;
+}
+
+void Co2LogWriter::openLogFile(time_t timestamp)
+{
+    struct tm tmNow;
+
+    if (!localtime_r(&timestamp, &tmNow)) {
+        return;
+    }
+
+    int day = ((tmNow.tm_year + 1900) * 10000) + ((tmNow.tm_mon + 1) * 100) + tmNow.tm_mday;
+
+    if (day == logFileDay_) {
+        return;
+    }
+
+    if (logFileDay_) {
+        // date has rolled over, so finish off yesterday's file(s)
+        flush(true);
+        closeLogFile();
+        logStats(LOG_INFO);
+    }
+
+    // Readings are stored in logBaseDir_/YYYY/MM/DD (CSV) and/or
+    // logBaseDir_/YYYY/MM/DD.bin (binary segment)
+    std::string filePathStr = Co2LogSegment::dayFileName(logBaseDir_, timestamp);
+
+    // Create parent directory if necessary
+    fs::path filePath(filePathStr);
+    std::error_code ec;
+
+    if (!fs::exists(filePath.parent_path(), ec)) {
+        if (!fs::create_directories(filePath.parent_path(), ec)) {
+            syslog(LOG_ERR, "Unable to create directory \"%s\"", filePath.parent_path().c_str());
+            return;
+        }
+    }
+
+    if (kLogFormat_ & Csv) {
+        logFd_ = open(filePathStr.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+        if (logFd_ < 0) {
+            syslog(LOG_ERR, "Unable to open CO2 log \"%s\" (%s)", filePathStr.c_str(), strerror(errno));
+        }
+    }
+
+    if (kLogFormat_ & Binary) {
+        try {
+            segment_.open(filePathStr + ".bin", Co2LogSegment::dayStart(timestamp), kSlotInterval_);
+        } catch (CO2::exceptionLevel& el) {
+            syslog(LOG_ERR, "%s", el.what());
+        }
+    }
+
+    if ((logFd_ >= 0) || segment_.isOpen()) {
+        logFileDay_ = day;
+    }
+
+    if ((kLogFormat_ & Binary) && kCompress_) {
+        compressSegment(Co2LogSegment::dayStart(timestamp) - 1);
+    }
+}
+
+void Co2LogWriter::compressSegment(time_t timestamp)
+{
+    std::string fileName = Co2LogSegment::dayFileName(logBaseDir_, timestamp);
+    std::string segmentFileName = fileName + ".bin";
+    std::string compressedFileName = fileName + ".co2z";
+    struct stat st;
+
+    if (stat(segmentFileName.c_str(), &st) < 0) {
+        return;
+    }
+
+    try {
+        Co2LogCompress::compressSegment(segmentFileName, compressedFileName);
+
+        std::error_code ec;
+
+        // segments are sparse, so compare with space actually used on disk
+        syslog(LOG_INFO, "Compressed CO2 log \"%s\" from %llu to %llu bytes",
+               segmentFileName.c_str(), (unsigned long long)st.st_blocks * 512,
+               (unsigned long long)fs::file_size(compressedFileName, ec));
+
+        fs::remove(segmentFileName, ec);
+    } catch (CO2::exceptionLevel& el) {
+        // leave segment as it is, readers will still find it
+        syslog(LOG_ERR, "%s", el.what());
+    }
+}
+
+void Co2LogWriter::closeLogFile()
+{
+    if ((logFd_ >= 0) && (close(logFd_) < 0)) {
+        syslog(LOG_ERR, "Error (%d) when closing CO2 log", errno);
+    }
+
+    segment_.close();
+
+    logFd_ = -1;
+    logFileDay_ = 0;
+}
+
+void Co2LogWriter::appendRecord(const Reading& reading)
+{
+    openLogFile(reading.timestamp);
+
+    if ((logFd_ < 0) && !segment_.isOpen()) {
+        std::lock_guard<std::mutex> statsLock(statsMutex_);
+        stats_.recordsDropped++;
+        return;
+    }
+
+    if (logFd_ >= 0) {
+        fmt::format_to(std::back_inserter(pendingBuf_), "{},{},{},{},{},{},{},{}\n",
+                       reading.temperature,
+                       reading.relHumidity,
+                       reading.co2,
+                       reading.fanStateOn ? "on" : "off",
+                       reading.fanAuto ? "auto" : "man",
+                       reading.filterRelHumidity,
+                       reading.filterCo2,
+                       reading.timestamp);
+    }
+
+    if (segment_.isOpen() && (reading.timestamp >= segment_.baseTime())) {
+        auto clamp16 = [](int value) { return uint16_t(std::clamp(value, 0, 0xffff)); };
+        Co2LogSegment::Record record;
+
+        record.timeOffset = uint32_t(reading.timestamp - segment_.baseTime());
+        record.temperature = int16_t(std::clamp(reading.temperature, -0x8000, 0x7fff));
+        record.relHumidity = clamp16(reading.relHumidity);
+        record.co2 = clamp16(reading.co2);
+        record.filterRelHumidity = clamp16(reading.filterRelHumidity);
+        record.filterCo2 = clamp16(reading.filterCo2);
+        record.flags = Co2LogSegment::Valid |
+                       (reading.fanStateOn ? Co2LogSegment::FanOn : 0) |
+                       (reading.fanAuto ? Co2LogSegment::FanAuto : 0);
+        record.fanDuty = uint8_t(std::clamp(reading.fanDuty, 0, 100));
+
+        pendingRecords_.push_back(record);
+    }
+
+    // only counted as written once flush() has got it to the file(s)
+    pendingReadings_++;
+}
+
+void Co2LogWriter::flush(bool doFsync)
+{
+    if (!logFileDay_ && pendingReadings_) {
+        // no log file(s) to write pending readings to
+        std::lock_guard<std::mutex> statsLock(statsMutex_);
+        stats_.recordsDropped += pendingReadings_;
+        stats_.bytesDropped += pendingBuf_.size() + (pendingRecords_.size() * sizeof(Co2LogSegment::Record));
+        pendingBuf_.clear();
+        pendingRecords_.clear();
+        pendingReadings_ = 0;
+    }
+
+    if (pendingBuf_.empty() && pendingRecords_.empty() && pendingRollups_.empty() && !(doFsync && hasUnsyncedData_)) {
+        return;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    size_t csvBytesWritten = 0;
+
+    while ((logFd_ >= 0) && (csvBytesWritten < pendingBuf_.size())) {
+        ssize_t n = write(logFd_, pendingBuf_.data() + csvBytesWritten, pendingBuf_.size() - csvBytesWritten);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            syslog(LOG_ERR, "Error writing CO2 log (%s)", strerror(errno));
+            break;
+        }
+
+        csvBytesWritten += n;
+    }
+
+    size_t segmentBytes = pendingRecords_.size() * sizeof(Co2LogSegment::Record);
+    size_t segmentBytesWritten = segment_.write(pendingRecords_);
+    size_t bytesDropped = (pendingBuf_.size() - csvBytesWritten) + (segmentBytes - segmentBytesWritten);
+    size_t bytesWritten = csvBytesWritten + segmentBytesWritten + writeRollups();
+
+    // A reading only counts as written if it reached every log it was
+    // queued for. Any short write means the batch is counted as dropped.
+    uint64_t readings = pendingReadings_;
+
+    pendingBuf_.clear();
+    pendingRecords_.clear();
+    pendingReadings_ = 0;
+
+    if (bytesWritten) {
+        hasUnsyncedData_ = true;
+    }
+
+    bool didFsync = false;
+
+    if (doFsync && hasUnsyncedData_) {
+        if ((logFd_ >= 0) && (fdatasync(logFd_) < 0)) {
+            syslog(LOG_ERR, "Error syncing CO2 log (%s)", strerror(errno));
+        }
+
+        if (segment_.isOpen() && (fdatasync(segment_.fd()) < 0)) {
+            syslog(LOG_ERR, "Error syncing CO2 log segment (%s)", strerror(errno));
+        }
+
+        for (auto fd : rollupFd_) {
+            if ((fd >= 0) && (fdatasync(fd) < 0)) {
+                syslog(LOG_ERR, "Error syncing CO2 rollup (%s)", strerror(errno));
+            }
+        }
+
+        hasUnsyncedData_ = false;
+        didFsync = true;
+    }
+
+    uint64_t flushUsec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::lock_guard<std::mutex> statsLock(statsMutex_);
+
+    if (bytesDropped) {
+        stats_.recordsDropped += readings;
+    } else {
+        stats_.recordsWritten += readings;
+    }
+
+    stats_.bytesWritten += bytesWritten;
+    stats_.bytesDropped += bytesDropped;
+    stats_.flushCount++;
+    stats_.fsyncCount += didFsync ? 1 : 0;
+    stats_.lastFlushUsec = flushUsec;
+    stats_.totalFlushUsec += flushUsec;
+
+    if (flushUsec > stats_.maxFlushUsec) {
+        stats_.maxFlushUsec = flushUsec;
+    }
+}
+
+size_t Co2LogWriter::writeRollups()
+{
+    size_t bytesWritten = 0;
+
+    for (auto& entry : pendingRollups_) {
+        int& fd = rollupFd_[entry.resolution];
+        std::string fileName = Co2Rollup::fileName(logBaseDir_, entry.resolution, entry.bucket.startTime);
+
+        if ((fd < 0) || (fileName != rollupFileName_[entry.resolution])) {
+            if (fd >= 0) {
+                close(fd);
+            }
+
+            std::error_code ec;
+            fs::create_directories(fs::path(fileName).parent_path(), ec);
+
+            // read as well, to check the header's schema
+            fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+            if (fd < 0) {
+                syslog(LOG_ERR, "Unable to open CO2 rollup \"%s\" (%s)", fileName.c_str(), strerror(errno));
+                continue;
+            }
+
+            rollupFileName_[entry.resolution] = fileName;
+
+            struct stat st;
+            Co2Rollup::Header header;
+            bool hasStat = (fstat(fd, &st) == 0);
+
+            if (hasStat && (st.st_size == 0)) {
+                memset(&header, 0, sizeof(header));
+                header.magic = Co2Rollup::kMagic;
+                header.schemaVersion = Co2Rollup::kSchemaVersion;
+                header.headerSize = sizeof(Co2Rollup::Header);
+                header.recordSize = sizeof(Co2Rollup::Bucket);
+                header.resolution = entry.resolution;
+
+                if (write(fd, &header, sizeof(header)) == sizeof(header)) {
+                    bytesWritten += sizeof(header);
+                }
+            } else if (hasStat && (pread(fd, &header, sizeof(header), 0) == sizeof(header)) &&
+                       (header.magic == Co2Rollup::kMagic) && (header.schemaVersion < Co2Rollup::kSchemaVersion)) {
+                fd = upgradeRollupFile(fd, fileName);
+
+                if (fd < 0) {
+                    continue;
+                }
+            }
+        }
+
+        if (write(fd, &entry.bucket, sizeof(entry.bucket)) != sizeof(entry.bucket)) {
+            syslog(LOG_ERR, "Error writing CO2 rollup \"%s\" (%s)", fileName.c_str(), strerror(errno));
+            continue;
+        }
+
+        bytesWritten += sizeof(entry.bucket);
+
+        std::lock_guard<std::mutex> statsLock(statsMutex_);
+        stats_.rollupsWritten++;
+    }
+
+    pendingRollups_.clear();
+
+    return bytesWritten;
+}
+
+// Rewrites a rollup file of an older schema in the current one, so
+// buckets can be appended to it. The new file replaces the old one
+// atomically, so readers see one or the other. Returns fd of the new
+// file, open for append, or -1 (with fd closed) on error.
+int Co2LogWriter::upgradeRollupFile(int fd, const std::string& fileName)
+{
+    struct stat st;
+    Co2Rollup::Header header;
+    std::vector<char> data;
+    std::vector<Co2Rollup::Bucket> buckets;
+
+    if ((fstat(fd, &st) == 0) && (pread(fd, &header, sizeof(header), 0) == sizeof(header))) {
+        data.resize(st.st_size - sizeof(header));
+
+        if (pread(fd, data.data(), data.size(), sizeof(header)) == ssize_t(data.size())) {
+            Co2Rollup::toBuckets(header, data.data(), data.size(), buckets);
+        }
+    }
+
+    close(fd);
+
+    if (!Co2Rollup::bucketSize(header)) {
+        syslog(LOG_ERR, "\"%s\" is not a valid CO2 rollup - not upgraded", fileName.c_str());
+        return -1;
+    }
+
+    std::string tmpFileName = fileName + ".tmp";
+    int tmpFd = open(tmpFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    uint16_t oldSchemaVersion = header.schemaVersion;
+
+    header.schemaVersion = Co2Rollup::kSchemaVersion;
+    header.recordSize = sizeof(Co2Rollup::Bucket);
+
+    size_t bucketsSize = buckets.size() * sizeof(Co2Rollup::Bucket);
+
+    if ((tmpFd < 0) ||
+        (write(tmpFd, &header, sizeof(header)) != sizeof(header)) ||
+        (write(tmpFd, buckets.data(), bucketsSize) != ssize_t(bucketsSize)) ||
+        (fsync(tmpFd) < 0) ||
+        (rename(tmpFileName.c_str(), fileName.c_str()) < 0)) {
+        syslog(LOG_ERR, "Unable to upgrade CO2 rollup \"%s\" (%s)", fileName.c_str(), strerror(errno));
+
+        if (tmpFd >= 0) {
+            close(tmpFd);
+            unlink(tmpFileName.c_str());
+        }
+
+        return -1;
+    }
+
+    close(tmpFd);
+
+    syslog(LOG_INFO, "Upgraded CO2 rollup \"%s\" from schema %u to %u", fileName.c_str(), oldSchemaVersion, header.schemaVersion);
+
+    return open(fileName.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+void Co2LogWriter::closeRollupFiles()
+{
+    for (int r = 0; r < Co2Rollup::ResolutionCount; r++) {
+        if (rollupFd_[r] >= 0) {
+            close(rollupFd_[r]);
+        }
+
+        rollupFd_[r] = -1;
+        rollupFileName_[r].clear();
+    }
+}
+
+void Co2LogWriter::run()
+{
+    std::vector<Reading> batch;
+    batch.reserve(kQueueSize_);
+
+    time_t timeNow = time(0);
+    timeNextFsync_ = timeNow + kFsyncInterval_;
+
+    bool shouldStop = false;
+    bool flushRequested = false;
+
+    while (!shouldStop) {
+        try {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+
+                // Flushes are paced by requestFlush(), so there's no
+                // need to wake up until there is something to do.
+                cv_.wait(lock, [this] { return shouldStop_ || flushRequested_ || (queueCount_ > 0) || !rollupQueue_.empty(); });
+
+                while (queueCount_) {
+                    batch.push_back(queue_[queueHead_]);
+                    queueHead_ = (queueHead_ + 1) % kQueueSize_;
+                    queueCount_--;
+                }
+
+                pendingRollups_.insert(pendingRollups_.end(), rollupQueue_.begin(), rollupQueue_.end());
+                rollupQueue_.clear();
+
+                shouldStop = shouldStop_;
+                flushRequested = flushRequested_;
+                flushRequested_ = false;
+            }
+
+            {
+                std::lock_guard<std::mutex> statsLock(statsMutex_);
+                stats_.queueDepth = 0;
+            }
+
+            for (auto& reading : batch) {
+                appendRecord(reading);
+            }
+
+            batch.clear();
+
+            timeNow = time(0);
+
+            bool doFsync = shouldStop || (timeNow >= timeNextFsync_);
+
+            size_t pendingBytes = pendingBuf_.size() + (pendingRecords_.size() * sizeof(Co2LogSegment::Record));
+
+            if (doFsync || flushRequested || (kFlushInterval_ == 0) || (pendingBytes >= kMaxPendingBytes_)) {
+                flush(doFsync);
+
+                if (doFsync) {
+                    timeNextFsync_ = timeNow + kFsyncInterval_;
+                }
+            }
+
+            std::lock_guard<std::mutex> statsLock(statsMutex_);
+            stats_.cpuUsec = LatencyHistogram::threadCpuNsec() / 1000;
+        } catch (CO2::exceptionLevel& el) {
+            syslog(LOG_ERR, "%s exception: %s", __FUNCTION__, el.what());
+        } catch (std::exception& e) {
+            syslog(LOG_ERR, "%s exception: %s", __FUNCTION__, e.what());
+        } catch (...) {
+            syslog(LOG_ERR, "%s unknown exception", __FUNCTION__);
+        }
+    }
+
+    closeLogFile();
+    closeRollupFiles();
+}
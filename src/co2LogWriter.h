@@ -0,0 +1,160 @@
+/*
+ * co2LogWriter.h
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#ifndef CO2LOGWRITER_H
+#define CO2LOGWRITER_H
+
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "co2LogSegment.h"
+#include "co2Rollup.h"
+#include "utils.h"
+
+// Writes Co2Monitor readings to the daily log files in its own thread,
+// so the sensor thread never waits on the file system.
+//
+// Each day's readings go to a binary segment (YYYY/MM/DD.bin, see
+// co2LogSegment.h), a CSV file (YYYY/MM/DD) or both, depending on logFormat.
+// If compress is set, the previous day's segment is compressed (see
+// co2LogCompress.h) once the day is over.
+// Closed rollup buckets (see co2Rollup.h) are appended to their rollup files
+// at the same time.
+//
+// Readings are handed over through a bounded queue. The current daily file
+// stays open between readings and records are batched, then written out
+// when the owner calls requestFlush() (Co2Monitor schedules this every
+// flushInterval seconds) and fsync'd on the first flush after fsyncInterval
+// seconds (group commit). A flush interval of 0 writes each record as it
+// arrives. Records are also written early if too many are pending.
+//
+class Co2LogWriter
+{
+    public:
+        typedef enum {
+            Csv    = 0x01,
+            Binary = 0x02,
+            Both   = Csv | Binary
+        } LogFormat;
+
+        typedef struct {
+            int temperature;
+            int relHumidity;
+            int co2;
+            bool fanStateOn;
+            bool fanAuto;
+            int fanDuty;            // percent
+            int filterRelHumidity;
+            int filterCo2;
+            time_t timestamp;
+        } Reading;
+
+        typedef struct {
+            size_t queueDepth;
+            size_t queueHighWater;
+            uint64_t recordsWritten;
+            uint64_t recordsDropped;
+            uint64_t rollupsWritten;
+            uint64_t bytesWritten;
+            uint64_t bytesDropped;
+            uint64_t flushCount;
+            uint64_t fsyncCount;
+            uint64_t lastFlushUsec;
+            uint64_t maxFlushUsec;
+            uint64_t totalFlushUsec;
+            uint64_t cpuUsec;        // used by writer thread
+        } Stats;
+
+        Co2LogWriter(const std::string& logBaseDir, LogFormat logFormat, uint16_t slotInterval, bool compress,
+                     size_t queueSize, time_t flushInterval, time_t fsyncInterval);
+
+        ~Co2LogWriter();
+
+        void start();
+        void stop();
+
+        // Never blocks. Returns false (and counts a dropped record)
+        // if the queue is full.
+        bool push(const Reading& reading);
+        bool pushRollup(Co2Rollup::Resolution resolution, const Co2Rollup::Bucket& bucket);
+
+        // Never blocks. Pending records are written (and fsync'd if
+        // due) by the writer thread.
+        void requestFlush();
+
+        Stats stats();
+        void logStats(int priority);
+
+        // "binary", "csv" or "both"
+        static LogFormat logFormatFromStr(const std::string& logFormatStr);
+
+    private:
+        Co2LogWriter();
+
+        typedef struct {
+            Co2Rollup::Resolution resolution;
+            Co2Rollup::Bucket bucket;
+        } RollupEntry;
+
+        void run();
+
+        void appendRecord(const Reading& reading);
+        void openLogFile(time_t timestamp);
+        void closeLogFile();
+        void compressSegment(time_t timestamp);
+        void flush(bool doFsync);
+        size_t writeRollups();
+        int upgradeRollupFile(int fd, const std::string& fileName);
+        void closeRollupFiles();
+
+        std::string logBaseDir_;
+        const LogFormat kLogFormat_;
+        const uint16_t kSlotInterval_;
+        const bool kCompress_;
+
+        const size_t kQueueSize_;
+        const time_t kFlushInterval_;
+        const time_t kFsyncInterval_;
+
+        // Pending records are flushed early if they grow beyond this.
+        const size_t kMaxPendingBytes_ = 4096;
+
+        // Buckets close at most once a minute, so this needn't be large.
+        const size_t kRollupQueueSize_ = 64;
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::vector<Reading> queue_; // ring of kQueueSize_ readings
+        size_t queueHead_;
+        size_t queueCount_;
+        std::vector<RollupEntry> rollupQueue_;
+        bool shouldStop_;
+        bool flushRequested_;
+
+        std::thread* writerThread_;
+
+        // These are only touched by the writer thread
+        int logFd_;
+        int logFileDay_; // yyyymmdd of open log file(s)
+        std::string pendingBuf_;
+        Co2LogSegment::Writer segment_;
+        std::vector<Co2LogSegment::Record> pendingRecords_;
+        uint64_t pendingReadings_; // readings in pendingBuf_/pendingRecords_
+        std::vector<RollupEntry> pendingRollups_;
+        int rollupFd_[Co2Rollup::ResolutionCount];
+        std::string rollupFileName_[Co2Rollup::ResolutionCount];
+        time_t timeNextFsync_;
+        bool hasUnsyncedData_;
+
+        std::mutex statsMutex_;
+        Stats stats_;
+
+    protected:
+};
+
+#endif /* CO2LOGWRITER_H */
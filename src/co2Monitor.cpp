@@ -5,42 +5,71 @@
  *     Author: patw
  */
 
-#include <fstream>
-#include <filesystem>
+#include <algorithm>
+#include <cmath>
 #include <thread>          // std::thread
 #include <fcntl.h>
 #include <syslog.h>
 #include <fmt/core.h>
-#ifdef HAS_WIRINGPI
-#include <wiringPi.h>
-#endif
 
 #include "co2Monitor.h"
-#include "co2SensorK30.h"
-#include "co2SensorSCD30.h"
-#include "co2SensorSim.h"
+#include "co2SensorFactory.h"
 
 
-namespace fs = std::filesystem;
-
-Co2Monitor::Co2Monitor(zmq::context_t& ctx, int sockType) :
+Co2Monitor::Co2Monitor(zmq::context_t& ctx, int sockType, Co2SampleRing& sampleRing, Co2EventBus& eventBus) :
     ctx_(ctx),
     mainSocket_(ctx, sockType),
     subSocket_(ctx, ZMQ_SUB),
+    failedSensorMask_(0),
+    co2SensorsHaveFailed_(false),
     temperature_(0),
     relHumidity_(0),
     filterRelHumidity_(-1),
     co2_(0),
     filterCo2_(-1),
+    sampleRing_(sampleRing),
+    eventBus_(eventBus),
+    messageTransport_(Co2EventBus::Zmq),
     fanOnOverrideTime_(0),
     fanStateOn_(false),
-    fanManOnEndTime_(0),
+    fanControlMode_(co2Message::FanConfig_FanControlMode_THRESHOLD),
+    fanPredictHorizon_(300),
+    fanTrendWindow_(300),
+    co2Hysteresis_(0),
+    relHumidityHysteresis_(0),
+    fanMinOnTime_(0),
+    fanMinOffTime_(0),
+    fanSwitchTime_(),
+    hasFanSwitched_(false),
+    fanOutputType_("gpio"),
+    fanPwmFrequency_(25000),
+    fanOutput_(nullptr),
+    fanDuty_(0),
+    scd30RdyGpio_(-1),
+    replaySpeed_(1),
+    co2LogFormat_(Co2LogWriter::Binary),
+    co2LogCompress_(true),
+    co2LogQueueSize_(64),
+    co2LogFlushInterval_(60),
+    co2LogFsyncInterval_(600),
+    co2LogWriter_(nullptr),
+    co2Rollup_(nullptr),
     hasCo2Config_(false),
     hasFanConfig_(false),
     kFanGpioPin_(Co2Display::GPIO_FanControl),
     kPublishInterval_(10),  // seconds
-    consecutiveCo2SensorHwErrorCount_(0),
-    kHwErrorThreshold_(3)
+    kPublishOffset_(1),     // seconds after sensor read
+    kFuseOffset_(500),      // msec after sensor read
+    stressSampleRate_(0),
+    sampleInterval_(std::chrono::seconds(kPublishInterval_)),
+    sampleIntervalMin_(kPublishInterval_),
+    sampleIntervalMax_(kPublishInterval_),
+    fastSampleCo2Rate_(20),
+    fastSampleRelHumRate_(100),
+    settledSampleCount_(0),
+    missedSampleCount_(0),
+    fusedReadTime_(),
+    logFlushTask_(-1)
 {
     threadState_ = new CO2::ThreadFSM("Co2Monitor", &mainSocket_);
 
@@ -48,13 +77,47 @@ Co2Monitor::Co2Monitor(zmq::context_t& ctx, int sockType) :
     co2Threshold_.store(0, std::memory_order_relaxed);
     fanAutoManState_.store(Co2Display::Auto, std::memory_order_relaxed);
 
-    timeLastPublish_ = time(0);
+    for (auto& lastSequence : lastSequence_) {
+        lastSequence = 0;
+    }
+
+    // Sensors are read every kPublishInterval_ seconds in their own
+    // threads. Their readings are fused kFuseOffset_ later, which leaves
+    // time for a slow read to complete, and the result published shortly
+    // afterwards. The listener thread triggers an early publish or
+    // (re)starts the fan override timer, so these tasks must exist
+    // before it starts.
+    sensorFusionTask_ = scheduler_.addTask("sensor fusion", std::chrono::seconds(kPublishInterval_),
+                                         kFuseOffset_, [this] { acquireCo2Reading(); });
+    publishTask_ = scheduler_.addTask("publish", std::chrono::seconds(kPublishInterval_),
+                                      std::chrono::seconds(kPublishOffset_), [this] { publishCo2State(); });
+    fanTimerTask_ = scheduler_.addTask("fan override timer", std::chrono::seconds(0),
+                                       std::chrono::seconds(0), [this] { fanManOnTimerExpired(); });
+
+    // replies to STATS from this thread, as mainSocket_ is used here
+    statsTask_ = scheduler_.addTask("stats", std::chrono::seconds(0),
+                                    std::chrono::seconds(0), [this] { sendStats(); });
 }
 
 
 Co2Monitor::~Co2Monitor()
 {
     // Delete all dynamic memory.
+    for (auto co2SensorReader : co2SensorReaders_) {
+        delete co2SensorReader;
+    }
+
+    if (co2Rollup_) {
+        delete co2Rollup_;
+    }
+
+    if (co2LogWriter_) {
+        delete co2LogWriter_;
+    }
+
+    if (fanOutput_) {
+        delete fanOutput_;
+    }
 }
 
 std::mutex Co2Monitor::fanControlMutex_;
@@ -73,15 +136,28 @@ void Co2Monitor::getCo2ConfigFromMsg(co2Message::Co2Message& cfgMsg)
 
         if (myThreadState == co2Message::ThreadState_ThreadStates_AWAITING_CONFIG) {
 
-            if (co2Cfg.has_sensortype()) {
-                sensorType_ = std::string(co2Cfg.sensortype());
-            } else {
-                throw CO2::exceptionLevel("missing sensor type", true);
+            // We'll check sensor ports later when instantiating sensors.
+            sensorConfigs_.clear();
+
+            for (auto& sensorCfg : co2Cfg.sensors()) {
+                if (!sensorCfg.has_sensortype()) {
+                    throw CO2::exceptionLevel("missing sensor type", true);
+                }
+
+                sensorConfigs_.push_back({ sensorCfg.sensortype(), sensorCfg.has_sensorport() ? sensorCfg.sensorport() : "" });
             }
 
-            // We'll check sensor port later when instantiating sensor.
-            if (co2Cfg.has_sensorport()) {
-                sensorPort_ = std::string(co2Cfg.sensorport());
+            if (sensorConfigs_.empty()) {
+                if (co2Cfg.has_sensortype()) {
+                    sensorConfigs_.push_back({ co2Cfg.sensortype(), co2Cfg.has_sensorport() ? co2Cfg.sensorport() : "" });
+                } else {
+                    throw CO2::exceptionLevel("missing sensor type", true);
+                }
+            }
+
+            if (sensorConfigs_.size() > kMaxSensors_) {
+                throw CO2::exceptionLevel(fmt::format("too many sensors ({}) - no more than {} supported",
+                                                      sensorConfigs_.size(), kMaxSensors_), true);
             }
 
             if (co2Cfg.has_co2monlogbasedir()) {
@@ -90,6 +166,88 @@ void Co2Monitor::getCo2ConfigFromMsg(co2Message::Co2Message& cfgMsg)
                 throw CO2::exceptionLevel("missing CO2 log base dir", true);
             }
 
+            if (co2Cfg.has_messagetransport()) {
+                messageTransport_ = Co2EventBus::transportFromStr(co2Cfg.messagetransport());
+            }
+
+            if (co2Cfg.has_co2logformat()) {
+                co2LogFormat_ = Co2LogWriter::logFormatFromStr(co2Cfg.co2logformat());
+            }
+
+            if (co2Cfg.has_scd30rdygpio()) {
+                scd30RdyGpio_ = co2Cfg.scd30rdygpio();
+            }
+
+            if (co2Cfg.has_lastsensorinfo()) {
+                lastSensorInfo_ = co2Cfg.lastsensorinfo();
+            }
+
+            if (co2Cfg.has_replaystart()) {
+                replayStart_ = co2Cfg.replaystart();
+            }
+
+            if (co2Cfg.has_replayend()) {
+                replayEnd_ = co2Cfg.replayend();
+            }
+
+            if (co2Cfg.has_replayspeed()) {
+                replaySpeed_ = co2Cfg.replayspeed();
+            }
+
+            if (co2Cfg.has_stresssamplerate()) {
+                stressSampleRate_ = co2Cfg.stresssamplerate();
+            }
+
+            if (co2Cfg.has_sampleintervalmin()) {
+                sampleIntervalMin_ = std::chrono::seconds(co2Cfg.sampleintervalmin());
+            }
+
+            if (co2Cfg.has_sampleintervalmax()) {
+                sampleIntervalMax_ = std::chrono::seconds(co2Cfg.sampleintervalmax());
+            }
+
+            if ((sampleIntervalMin_.count() <= 0) || (sampleIntervalMin_ > sampleIntervalMax_)) {
+                throw CO2::exceptionLevel(fmt::format("sample interval min ({}s) must be > 0 and no more than max ({}s)",
+                                                      sampleIntervalMin_.count(), sampleIntervalMax_.count()), true);
+            }
+
+            if (co2Cfg.has_fastsampleco2rate()) {
+                fastSampleCo2Rate_ = co2Cfg.fastsampleco2rate();
+            }
+
+            if (co2Cfg.has_fastsamplerelhumrate()) {
+                fastSampleRelHumRate_ = co2Cfg.fastsamplerelhumrate() * 100;
+            }
+
+            // Invalid filters are fatal, rather than quietly leaving readings unfiltered
+            if (co2Cfg.has_filterco2()) {
+                co2Filter_.configure(Co2Filter::Co2, co2Cfg.filterco2());
+            }
+
+            if (co2Cfg.has_filtertemperature()) {
+                co2Filter_.configure(Co2Filter::Temperature, co2Cfg.filtertemperature());
+            }
+
+            if (co2Cfg.has_filterrelhumidity()) {
+                co2Filter_.configure(Co2Filter::RelHumidity, co2Cfg.filterrelhumidity());
+            }
+
+            if (co2Cfg.has_co2logcompress()) {
+                co2LogCompress_ = co2Cfg.co2logcompress();
+            }
+
+            if (co2Cfg.has_co2logqueuesize()) {
+                co2LogQueueSize_ = co2Cfg.co2logqueuesize();
+            }
+
+            if (co2Cfg.has_co2logflushinterval()) {
+                co2LogFlushInterval_ = co2Cfg.co2logflushinterval();
+            }
+
+            if (co2Cfg.has_co2logfsyncinterval()) {
+                co2LogFsyncInterval_ = co2Cfg.co2logfsyncinterval();
+            }
+
             hasCo2Config_ = true;
 
             if (hasFanConfig_) {
@@ -98,7 +256,10 @@ void Co2Monitor::getCo2ConfigFromMsg(co2Message::Co2Message& cfgMsg)
                 threadState_->stateEvent(CO2::ThreadFSM::ConfigOk);
             }
 
-            syslog(LOG_DEBUG, "Co2Monitor co2 config: CO2 Sensor=\"%s\"", sensorType_.c_str());
+            for (auto& sensorConfig : sensorConfigs_) {
+                syslog(LOG_DEBUG, "Co2Monitor co2 config: CO2 Sensor=\"%s\" port=\"%s\"",
+                       sensorConfig.sensorType.c_str(), sensorConfig.sensorPort.c_str());
+            }
         }
 
     } else {
@@ -118,8 +279,76 @@ void Co2Monitor::getFanConfigFromMsg(co2Message::Co2Message& cfgMsg)
     if (cfgMsg.has_fanconfig()) {
         const co2Message::FanConfig& fanCfg = cfgMsg.fanconfig();
 
+        // Auto tuning is optional, and may change at any time
+        {
+            std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+            if (fanCfg.has_fancontrolmode()) {
+                fanControlMode_ = fanCfg.fancontrolmode();
+            }
+
+            if (fanCfg.has_predicthorizon()) {
+                fanPredictHorizon_ = fanCfg.predicthorizon();
+            }
+
+            if (fanCfg.has_trendwindow()) {
+                fanTrendWindow_ = fanCfg.trendwindow();
+            }
+
+            if (fanCfg.has_co2hysteresis()) {
+                co2Hysteresis_ = fanCfg.co2hysteresis();
+            }
+
+            if (fanCfg.has_relhumhysteresis()) {
+                relHumidityHysteresis_ = fanCfg.relhumhysteresis() * 100;
+            }
+
+            if (fanCfg.has_fanminontime()) {
+                fanMinOnTime_ = fanCfg.fanminontime();
+            }
+
+            if (fanCfg.has_fanminofftime()) {
+                fanMinOffTime_ = fanCfg.fanminofftime();
+            }
+
+            if (fanCfg.has_pwmcurve()) {
+                fanSpeedController_.setCurve(fanCfg.pwmcurve());
+            }
+
+            if (fanCfg.has_pwmkp() || fanCfg.has_pwmki()) {
+                fanSpeedController_.setGains(fanCfg.pwmkp(), fanCfg.pwmki());
+            }
+        }
+
         if (myThreadState == co2Message::ThreadState_ThreadStates_AWAITING_CONFIG) {
 
+            // Carry on from today's runtime before a restart
+            if (fanCfg.has_fanruntime()) {
+                const co2Message::FanRuntime& fanRuntime = fanCfg.fanruntime();
+                std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+                fanRuntime_.restore(fanRuntime.day(), { uint64_t(fanRuntime.ontime()) * 1000,
+                                                        uint64_t(fanRuntime.dutytime()) * 1000,
+                                                        fanRuntime.switchcount() });
+            }
+
+            // Fan output is created by init(), so cannot change after that
+            if (fanCfg.has_fanoutput()) {
+                fanOutputType_ = fanCfg.fanoutput();
+            }
+
+            if (fanCfg.has_fanoutputpath()) {
+                fanOutputPath_ = fanCfg.fanoutputpath();
+            }
+
+            if (fanCfg.has_pwmfrequency()) {
+                fanPwmFrequency_ = fanCfg.pwmfrequency();
+            }
+
+            if ((fanOutputType_ != "gpio") && fanOutputPath_.empty()) {
+                throw CO2::exceptionLevel(fmt::format("missing fan output path for {} fan output", fanOutputType_), true);
+            }
+
             if (fanCfg.has_fanonoverridetime()) {
                 fanOnOverrideTime_ = fanCfg.fanonoverridetime();
             } else {
@@ -218,18 +447,24 @@ void Co2Monitor::listener()
     bool shouldTerminate = false;
 
     subSocket_.connect(CO2::co2MainPubEndpoint);
-    subSocket_.set(zmq::sockopt::subscribe, "");
+
+    // only the messages handled below
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_CO2_CFG);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_FAN_CFG);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_STATS);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_TERMINATE);
+
+    // reused for every message, so that its buffer is too
+    zmq::message_t msg;
+    CO2::MsgArena msgArena;
 
     while (!shouldTerminate) {
         try {
-            zmq::message_t msg;
-
-            if (subSocket_.recv(msg, zmq::recv_flags::none)) {
+            if (CO2::recvPublished(subSocket_, msg, rxMsgCounters_)) {
 
-                std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-                co2Message::Co2Message co2Msg;
+                co2Message::Co2Message& co2Msg = *msgArena.newMsg();
 
-                if (!co2Msg.ParseFromString(msg_str)) {
+                if (!CO2::parseMsg(msg, co2Msg)) {
                     throw CO2::exceptionLevel("couldn't parse published message", false);
                 }
 
@@ -244,9 +479,14 @@ void Co2Monitor::listener()
                         getFanConfigFromMsg(co2Msg);
                         break;
 
+                    case co2Message::Co2Message_Co2MessageType_STATS:
+                        scheduler_.trigger(statsTask_);
+                        break;
+
                     case co2Message::Co2Message_Co2MessageType_TERMINATE:
                         threadState_->stateEvent(CO2::ThreadFSM::Terminate);
                         shouldTerminate_.store(true, std::memory_order_relaxed);
+                        scheduler_.stop();
                         break;
 
                     default:
@@ -277,20 +517,25 @@ void Co2Monitor::listener()
 }
 void Co2Monitor::publishCo2State()
 {
-    time_t timeNow = time(0);
-
-    // Don't publish more then once every 10 seconds
-    //
-    if ((timeNow - timeLastPublish_) < kPublishInterval_) {
+    if (co2SensorsHaveFailed_) {
+        // readings are stale until sensors are restarted
         return;
     }
 
-    DBG_TRACE();
+    auto startTime = std::chrono::steady_clock::now();
+    auto wallTime = std::chrono::system_clock::now();
+    time_t timeNow = std::chrono::system_clock::to_time_t(wallTime);
 
-    co2Message::Co2Message co2Msg;
+    DBG_TRACE();
 
+    // Reused, so the Co2State and its sensors and strings keep their
+    // allocations. Only the Co2State is cleared, as clearing co2Msg would
+    // delete it along with the rest of the oneof.
+    co2Message::Co2Message& co2Msg = co2StateMsg_;
     co2Message::Co2State* co2State = co2Msg.mutable_co2state();
 
+    co2State->Clear();
+
     co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_CO2_STATE);
 
     co2State->set_temperature(temperature_);
@@ -311,104 +556,145 @@ void Co2Monitor::publishCo2State()
     }
 
     co2State->set_fanstate(fanState);
+    co2State->set_fandutycycle(fanDuty_);
+
+    Co2FanRuntime::Counters fanRuntimePending = { 0, 0, 0 };
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+        fanRuntime_.update(std::chrono::steady_clock::now(), timeNow, fanStateOn_, fanDuty_);
+
+        const Co2FanRuntime::Counters& today = fanRuntime_.today();
+        co2Message::FanRuntime* fanRuntime = co2State->mutable_fanruntime();
+
+        fanRuntime->set_day(fanRuntime_.day());
+        fanRuntime->set_ontime(today.onMsec / 1000);
+        fanRuntime->set_dutytime(today.dutyMsec / 1000);
+        fanRuntime->set_switchcount(today.switchCount);
+
+        // rollups get whatever has been counted since the last one
+        if ((filterRelHumidity_ > 0) && co2Rollup_) {
+            fanRuntimePending = fanRuntime_.takePending();
+        }
+    }
+
+    auto timeNowSteady = std::chrono::steady_clock::now();
+
+    for (auto co2SensorReader : co2SensorReaders_) {
+        Co2SensorReader::Reading reading = co2SensorReader->latest();
+        co2Message::Co2State_SensorReading* sensorReading = co2State->add_sensors();
+
+        sensorReading->set_name(co2SensorReader->name());
+        sensorReading->set_sensortype(co2SensorReader->sensorType());
+        sensorReading->set_isfresh(reading.isValid && !co2SensorReader->hasFailed() &&
+                                   ((timeNowSteady - reading.readTime) <= (2 * sampleInterval_)));
+
+        if (reading.isValid) {
+            sensorReading->set_temperature(reading.temperature);
+            sensorReading->set_relhumidity(reading.relHumidity);
+            sensorReading->set_co2(reading.co2);
+        }
+    }
 
     co2Message::Co2State_Timestamp* timeStamp = co2State->mutable_timestamp();
     timeStamp->set_seconds(static_cast<int>(timeNow));
+    timeStamp->set_nanos(static_cast<int>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              wallTime - std::chrono::system_clock::from_time_t(timeNow)).count()));
 
-    std::string co2StateStr;
-    co2Msg.SerializeToString(&co2StateStr);
+    auto publishTime = std::chrono::steady_clock::now();
 
-    zmq::message_t co2StateMsg(co2StateStr.size());
+    co2State->set_publishtimensec(CO2::steadyNsec(publishTime));
 
-    memcpy(co2StateMsg.data(), co2StateStr.c_str(), co2StateStr.size());
-    mainSocket_.send(co2StateMsg, zmq::send_flags::none);
+    if (fusedReadTime_ != std::chrono::steady_clock::time_point()) {
+        co2State->set_readtimensec(CO2::steadyNsec(fusedReadTime_));
+        readToPublishLatency_.record(publishTime - fusedReadTime_);
+    }
 
-    // Store readings in co2LogBaseDirStr_/YYYY/MM/DD (Base dir is in config file.)
-    //
-    // If date changed since last time we need to create new file and,
-    // if month changed, create new directory.
-    //
-    do { // once
-        if (filterRelHumidity_ > 0) {
-            struct tm tmThen;
-            struct tm tmNow;
-            std::string filePathStr;
-            int mode = R_OK | W_OK | X_OK;
-            int dirMode = 0755;
-
-
-            if ( timeLastPublish_ && timeNow &&
-                    localtime_r(&timeLastPublish_, &tmThen) &&
-                    localtime_r(&timeNow, &tmNow) ) {
-
-                filePathStr = fmt::format("{}/{}/{}/{}",
-                                          co2LogBaseDirStr_,
-                                          CO2::zeroPadNumber(2, tmNow.tm_year + 1900),
-                                          CO2::zeroPadNumber(2, tmNow.tm_mon + 1),
-                                          CO2::zeroPadNumber(2, tmNow.tm_mday));
-                // Create parent directory if necessary
-                fs::path filePath(filePathStr);
-
-                if (!fs::exists(filePath.parent_path())) {
-                    if (!fs::create_directories(filePath.parent_path())) {
-                        syslog(LOG_ERR, "Unable to create directory \"%s\"", filePath.parent_path().c_str());
-                        break;
-                    }
-                }
-            }
+    if (messageTransport_ == Co2EventBus::Bus) {
+        Co2EventBus::Co2StateEvent co2StateEvent;
 
-            std::ofstream co2Log;
-            co2Log.open(filePathStr, std::ios::out | std::ios::app);
+        Co2EventBus::fromMsg(*co2State, co2StateEvent);
+        eventBus_.publish(co2StateEvent);
+    } else {
+        CO2::sendMsg(mainSocket_, co2Msg);
+    }
 
-            if (co2Log.is_open()) {
-                co2Log << temperature_ << ","
-                       << relHumidity_ << ","
-                       << co2_ << ","
-                       << (fanStateOn_ ? "on" : "off") << ","
-                       << (fanAutoManState == Co2Display::Auto ? "auto" : "man") << ","
-                       << filterRelHumidity_ << ","
-                       << filterCo2_ << ","
-                       << timeNow << std::endl << std::flush;
-                co2Log.close();
-            }
+    // Readings are stored in co2LogBaseDirStr_/YYYY/MM/DD[.bin] by the log
+    // writer thread, so we don't hold up this thread with file I/O.
+    //
+    if ((filterRelHumidity_ > 0) && co2LogWriter_) {
+        Co2LogWriter::Reading reading;
+
+        reading.temperature = temperature_;
+        reading.relHumidity = relHumidity_;
+        reading.co2 = co2_;
+        reading.fanStateOn = fanStateOn_;
+        reading.fanAuto = (fanAutoManState == Co2Display::Auto);
+        reading.fanDuty = fanDuty_;
+        reading.filterRelHumidity = filterRelHumidity_;
+        reading.filterCo2 = filterCo2_;
+        reading.timestamp = timeNow;
+
+        if (!co2LogWriter_->push(reading)) {
+            syslog(LOG_ERR, "CO2 log writer queue full - reading dropped");
         }
-    } while (false);
 
-    timeLastPublish_ = timeNow;
+        if (co2Rollup_) {
+            co2Rollup_->add(timeNow, temperature_, relHumidity_, co2_, fanStateOn_, fanRuntimePending);
+        }
+    }
+
+    publishLatency_.record(std::chrono::steady_clock::now() - startTime);
+}
+
+// Reply to STATS from Co2Main with our latency histograms
+void Co2Monitor::sendStats()
+{
+    co2Message::Co2Message co2Msg;
+    co2Message::Stats* stats = co2Msg.mutable_stats();
+
+    co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_STATS);
+    stats->set_threadname("Co2Monitor");
+
+    for (auto co2SensorReader : co2SensorReaders_) {
+        CO2::addLatency(*stats, fmt::format("{} read", co2SensorReader->name()), co2SensorReader->readLatency());
+    }
+
+    CO2::addLatency(*stats, "read to fused", fuseLatency_);
+    CO2::addLatency(*stats, "publish", publishLatency_);
+    CO2::addLatency(*stats, "read to publish", readToPublishLatency_);
+
+    CO2::sendMsg(mainSocket_, co2Msg);
 }
 
 void Co2Monitor::startFanManOnTimer()
 {
-    // fanOnOverrideTime is in minutes, so convert to seconds
-    fanManOnEndTime_.store(time(0) + (fanOnOverrideTime_ * 60), std::memory_order_relaxed);
+    // fanOnOverrideTime is in minutes
+    scheduler_.schedule(fanTimerTask_, std::chrono::minutes(fanOnOverrideTime_));
 }
 
 void Co2Monitor::stopFanManOnTimer()
 {
-    if (fanManOnEndTime_.load(std::memory_order_relaxed)) {
-        fanManOnEndTime_.store(0, std::memory_order_relaxed);
-    }
+    scheduler_.cancel(fanTimerTask_);
 }
 
-void Co2Monitor::updateFanState()
+void Co2Monitor::fanManOnTimerExpired()
 {
     if (fanAutoManState_.load(std::memory_order_relaxed) == Co2Display::ManOn) {
+        // Auto/Man state reverts to Auto
+        fanAutoManState_.store(Co2Display::Auto, std::memory_order_relaxed);
+        syslog(LOG_DEBUG, "fan override timer expired - state now Auto");
 
-        time_t endTime = fanManOnEndTime_.load(std::memory_order_relaxed);
-        time_t timeNow = time(0);
-
-        if (endTime < timeNow) {
-            // timer has expired, so Auto/Man state reverts to Auto
-            fanManOnEndTime_.store(0, std::memory_order_relaxed);
-            stopFanManOnTimer();
-            fanAutoManState_.store(Co2Display::Auto, std::memory_order_relaxed);
-            syslog(LOG_DEBUG, "fan override timer expired - state now Auto");
+        fanControl();
 
-            // force early publish
-            timeLastPublish_ -= kPublishInterval_;
-        }
+        // force early publish
+        scheduler_.trigger(publishTask_);
     }
+}
 
+void Co2Monitor::updateFanState()
+{
     fanControl();
 }
 
@@ -455,7 +741,7 @@ void Co2Monitor::updateFanState(Co2Display::FanAutoManStates newFanAutoManState)
         DBG_MSG(LOG_DEBUG, "new fan state is: %s (%s => %s)", fanStateStr, oldFanStateOn ? "on" : "off", fanStateOn_ ? "on" : "off");
 
         // force early publish
-        timeLastPublish_ -= kPublishInterval_;
+        scheduler_.trigger(publishTask_);
 
     } else {
         updateFanState();
@@ -491,10 +777,9 @@ void Co2Monitor::fanControl()
     std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
 
     bool newFanStateOn = fanStateOn_;
+    Co2Display::FanAutoManStates fanAutoManState = fanAutoManState_.load(std::memory_order_relaxed);
 
     do { // once
-        Co2Display::FanAutoManStates fanAutoManState = fanAutoManState_.load(std::memory_order_relaxed);
-
         if (fanAutoManState == Co2Display::ManOff) {
             if (fanStateOn_) {
                 // turn fan off
@@ -510,125 +795,466 @@ void Co2Monitor::fanControl()
 
             break;
         } else if (fanAutoManState == Co2Display::Auto) {
-            if ((filterRelHumidity_ > relHumidityThreshold_.load(std::memory_order_relaxed)) ||
-                    (filterCo2_ > co2Threshold_.load(std::memory_order_relaxed)) ) {
-                if (!fanStateOn_) {
-                    // turn fan on
-                    newFanStateOn = true;
-                }
-            } else {
-                if (fanStateOn_) {
-                    // turn fan off
-                    newFanStateOn = false;
+            // Don't switch again until fan has been on (or off) for its minimum time
+            if (hasFanSwitched_) {
+                auto timeSinceSwitch = std::chrono::steady_clock::now() - fanSwitchTime_;
+
+                if (timeSinceSwitch < std::chrono::seconds(fanStateOn_ ? fanMinOnTime_ : fanMinOffTime_)) {
+                    break;
                 }
             }
+
+            newFanStateOn = autoFanStateOn();
         }
     } while (false);
 
     if (newFanStateOn != fanStateOn_) {
-#ifdef HAS_WIRINGPI
-        digitalWrite(kFanGpioPin_, newFanStateOn ? 1 : 0);
-#endif
         fanStateOn_ = newFanStateOn;
+        fanSwitchTime_ = std::chrono::steady_clock::now();
+        hasFanSwitched_ = true;
+        fanSpeedController_.reset();
+        lastSpeedUpdateTime_ = fanSwitchTime_;
     }
-}
 
-void Co2Monitor::initCo2Sensor()
-{
-    int permittedInitFails = 3;
+    int newFanDuty = 0;
+
+    if (fanStateOn_) {
+        // Manual On is always full speed
+        bool isVariableSpeed = fanOutput_ && fanOutput_->isVariableSpeed();
 
-    while (true) {
+        newFanDuty = (isVariableSpeed && (fanAutoManState == Co2Display::Auto)) ? fanSpeedDuty() : 100;
+    }
+
+    if (fanOutput_ && (newFanDuty != fanDuty_)) {
         try {
-            co2Sensor_->init();
-            return;
+            fanOutput_->setDuty(newFanDuty);
         } catch (CO2::exceptionLevel& el) {
-            if ( (--permittedInitFails <= 0) || el.isFatal() ) {
-                throw;
-            }
-        } catch (...) {
-            throw;
+            syslog(LOG_ERR, "cannot set fan duty cycle to %d%%: %s", newFanDuty, el.what());
         }
     }
+
+    fanDuty_ = newFanDuty;
+    fanRuntime_.update(std::chrono::steady_clock::now(), time(0), fanStateOn_, fanDuty_);
 }
 
-void Co2Monitor::readCo2Sensor()
+// Fan speed in Auto, from whichever of CO2 and RH is furthest above its
+// threshold, as a percentage of that threshold. Called with
+// fanControlMutex_ held.
+int Co2Monitor::fanSpeedDuty()
 {
-    int co2ppm;
-    int t;
-    int rh;
+    int co2Threshold = co2Threshold_.load(std::memory_order_relaxed);
+    int relHumidityThreshold = relHumidityThreshold_.load(std::memory_order_relaxed);
+    double excessPct = -100;
 
-    try {
-        co2Sensor_->readMeasurements(co2ppm, t, rh);
-
-        // ignore readings if co2ppm is 0 as it
-        // probably means that sensor is not ready
-        if (co2ppm) {
-            consecutiveCo2SensorHwErrorCount_ = 0;
-            co2_ = co2ppm;
-            temperature_ = t;
-            relHumidity_ = rh;
-        }
-    } catch (CO2::exceptionLevel& el) {
-        consecutiveCo2SensorHwErrorCount_++;
-        syslog(LOG_DEBUG, "%s: consecutive error count = %d", el.what(), consecutiveCo2SensorHwErrorCount_);
+    if (co2Threshold > 0) {
+        excessPct = std::max(excessPct, (filterCo2_ - co2Threshold) * 100.0 / co2Threshold);
+    }
 
-        if (el.isFatal()) {
-            throw;
+    if (relHumidityThreshold > 0) {
+        excessPct = std::max(excessPct, (filterRelHumidity_ - relHumidityThreshold) * 100.0 / relHumidityThreshold);
+    }
+
+    auto timeNow = std::chrono::steady_clock::now();
+    double dtSecs = std::chrono::duration<double>(timeNow - lastSpeedUpdateTime_).count();
+
+    lastSpeedUpdateTime_ = timeNow;
+
+    return fanSpeedController_.update(excessPct, dtSecs);
+}
+
+// Whether fan should be on in Auto. Called with fanControlMutex_ held.
+//
+// Fan goes on when CO2 or RH is over its threshold or, in predictive
+// mode, when its trend will take it there within fanPredictHorizon_.
+// It stays on until both are at least their hysteresis below threshold,
+// and (in predictive mode) are not heading back over it.
+bool Co2Monitor::autoFanStateOn()
+{
+    int co2Threshold = co2Threshold_.load(std::memory_order_relaxed);
+    int relHumidityThreshold = relHumidityThreshold_.load(std::memory_order_relaxed);
+
+    if (fanStateOn_) {
+        co2Threshold -= co2Hysteresis_;
+        relHumidityThreshold -= relHumidityHysteresis_;
+    }
+
+    if ((filterRelHumidity_ > relHumidityThreshold) || (filterCo2_ > co2Threshold)) {
+        return true;
+    }
+
+    if (fanControlMode_ != co2Message::FanConfig_FanControlMode_PREDICTIVE) {
+        return false;
+    }
+
+    double timeNow = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    double co2Time = co2Trend_.timeToRise(co2Threshold_.load(std::memory_order_relaxed), timeNow);
+    double relHumidityTime = relHumidityTrend_.timeToRise(relHumidityThreshold_.load(std::memory_order_relaxed), timeNow);
+
+    if ((co2Time <= fanPredictHorizon_) || (relHumidityTime <= fanPredictHorizon_)) {
+        if (!fanStateOn_) {
+            syslog(LOG_DEBUG, "fan on: thresholds projected to be reached in %.0fs (CO2) %.0fs (RH)",
+                   co2Time, relHumidityTime);
         }
 
-        // non fatal sensor errors might be cured
-        // with re-initialisation.
-        initCo2Sensor();
-    } catch (...) {
-        throw;
+        return true;
     }
+
+    return false;
 }
 
-void Co2Monitor::init()
+// Median of n values (mean of middle two when n is even), so that a
+// single sensor reading way out cannot drag the fused value with it.
+static int medianOf(int values[], int n)
 {
-    DBG_TRACE();
+    std::sort(values, values + n);
 
-    if (sensorType_ == "K30") {
-        if (!sensorPort_.empty()) {
-            co2Sensor_ = new Co2SensorK30(sensorPort_);
-        } else {
-            throw CO2::exceptionLevel("No sensor port configured for K30 sensor", true);
+    if (n % 2) {
+        return values[n / 2];
+    }
+
+    return (values[(n / 2) - 1] + values[n / 2]) / 2;
+}
+
+bool Co2Monitor::fuseCo2Readings()
+{
+    int co2[kMaxSensors_];
+    int temperature[kMaxSensors_];
+    int relHumidity[kMaxSensors_];
+    int nFresh = 0;
+    int nFailed = 0;
+    auto timeNow = std::chrono::steady_clock::now();
+    auto newestReadTime = std::chrono::steady_clock::time_point::min();
+
+    for (size_t i = 0; i < co2SensorReaders_.size(); i++) {
+        Co2SensorReader* co2SensorReader = co2SensorReaders_[i];
+        uint32_t sensorBit = 1 << i;
+
+        if (co2SensorReader->hasFailed()) {
+            if (!(failedSensorMask_ & sensorBit)) {
+                syslog(LOG_WARNING, "%s sensor has failed - its readings are ignored", co2SensorReader->name().c_str());
+                failedSensorMask_ |= sensorBit;
+            }
+
+            nFailed++;
+            continue;
+        } else if (failedSensorMask_ & sensorBit) {
+            syslog(LOG_NOTICE, "%s sensor has recovered", co2SensorReader->name().c_str());
+            failedSensorMask_ &= ~sensorBit;
         }
-    } else if (sensorType_ == "SCD30") {
-        if (!sensorPort_.empty()) {
-            if (sensorPort_ == "I2C") {
-#ifdef HAS_I2C
-                // find the I2C bus to which the device is attached
-                int i2cBus = Co2SensorSCD30::findI2cBus();
-
-                if (i2cBus >= 0) {
-                    co2Sensor_ = new Co2SensorSCD30(i2cBus);
-                } else {
-                    throw CO2::exceptionLevel("SCD30 sensor not found on any I2C bus", true);
-                }
 
-#else
-                throw CO2::exceptionLevel("No I2C support for SCD30 sensor", true);
-#endif /* HAS_I2C */
-            } else {
-                std::string errStr = "Unsupported port (" + sensorPort_ + ") for SCD30 sensor";
-                throw CO2::exceptionLevel(errStr, true);
+        Co2SensorReader::Reading reading = co2SensorReader->latest();
+
+        // A reading missed by a slow sensor is covered by its
+        // previous one, but no further back than that.
+        if (reading.isValid && ((timeNow - reading.readTime) <= (2 * sampleInterval_))) {
+            co2[nFresh] = reading.co2;
+            temperature[nFresh] = reading.temperature;
+            relHumidity[nFresh] = reading.relHumidity;
+            nFresh++;
+
+            if (reading.sequence > lastSequence_[i] + 1) {
+                missedSampleCount_ += reading.sequence - lastSequence_[i] - 1;
             }
-        } else {
-            throw CO2::exceptionLevel("No sensor port configured for SCD30 sensor", true);
-            co2Sensor_ = new Co2SensorSCD30(sensorPort_);
+
+            lastSequence_[i] = reading.sequence;
+            newestReadTime = std::max(newestReadTime, reading.readTime);
         }
-    } else if (sensorType_ == "sim") {
-        co2Sensor_ = new Co2SensorSim();
     }
 
-    if (co2Sensor_) {
-        initCo2Sensor();
+    co2SensorsHaveFailed_ = (nFailed == int(co2SensorReaders_.size()));
+
+    if (nFresh == 0) {
+        // keep previous readings until a sensor has a fresh one
+        return false;
+    }
+
+    co2_ = medianOf(co2, nFresh);
+    temperature_ = medianOf(temperature, nFresh);
+    relHumidity_ = medianOf(relHumidity, nFresh);
+
+    fuseLatency_.record(std::chrono::steady_clock::now() - newestReadTime);
+    fusedReadTime_ = newestReadTime;
+
+    return true;
+}
+
+void Co2Monitor::acquireCo2Reading()
+{
+    if (fuseCo2Readings()) {
+        Co2Filter::Sample sample;
+
+        sample.value[Co2Filter::Co2] = co2_;
+        sample.value[Co2Filter::Temperature] = temperature_;
+        sample.value[Co2Filter::RelHumidity] = relHumidity_;
+
+        // Filtering is done in floating point, so rounded only once here
+        const Co2Filter::Sample& filtered = co2Filter_.update(sample);
+
+        filterCo2_ = std::lround(filtered.value[Co2Filter::Co2]);
+        filterRelHumidity_ = std::lround(filtered.value[Co2Filter::RelHumidity]);
+
+        double timeNow = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+        co2Trend_.add(timeNow, filtered.value[Co2Filter::Co2]);
+        relHumidityTrend_.add(timeNow, filtered.value[Co2Filter::RelHumidity]);
+        co2RateTrend_.add(timeNow, filtered.value[Co2Filter::Co2]);
+        relHumidityRateTrend_.add(timeNow, filtered.value[Co2Filter::RelHumidity]);
+
+        Co2SampleRing::Sample ringSample;
+
+        ringSample.timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch()).count();
+        ringSample.co2 = co2_;
+        ringSample.filterCo2 = filterCo2_;
+        ringSample.temperature = temperature_;
+        ringSample.relHumidity = relHumidity_;
+        ringSample.filterRelHumidity = filterRelHumidity_;
+        ringSample.fanDuty = fanDuty_;    // speed the fan ran at while this was sampled
+
+        sampleRing_.push(ringSample);
+    }
+
+    updateFanState();
+    adaptSampleInterval();
+
+    if (co2SensorsHaveFailed_) {
+        // we need to try restarting to try to fix hardware error
+        threadState_->stateEvent(CO2::ThreadFSM::HardwareFail);
+    } else if (stressSampleRate_ > 0) {
+        publishCo2State();
+    }
+}
+
+// Sampling speeds up straight away when CO2 or RH starts changing quickly,
+// but only slows down once they have changed by less than half as much for
+// kSettledSamples_ samples in a row, so it doesn't flip back and forth.
+void Co2Monitor::adaptSampleInterval()
+{
+    if ((stressSampleRate_ > 0) || (sampleIntervalMin_ == sampleIntervalMax_)) {
+        return;
+    }
+
+    if (!co2RateTrend_.hasSlope() || !relHumidityRateTrend_.hasSlope()) {
+        return;
+    }
+
+    double co2Rate;
+    double relHumidityRate;
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+        co2Rate = std::fabs(co2RateTrend_.slope()) * 60;
+        relHumidityRate = std::fabs(relHumidityRateTrend_.slope()) * 60;
+    }
+
+    auto sampleInterval = std::chrono::duration_cast<std::chrono::seconds>(sampleInterval_);
+
+    if ((co2Rate >= fastSampleCo2Rate_) || (relHumidityRate >= fastSampleRelHumRate_)) {
+        settledSampleCount_ = 0;
+        sampleInterval = sampleIntervalMin_;
+    } else if ((co2Rate < (fastSampleCo2Rate_ / 2)) && (relHumidityRate < (fastSampleRelHumRate_ / 2))) {
+        if (++settledSampleCount_ >= kSettledSamples_) {
+            settledSampleCount_ = 0;
+            sampleInterval = std::min(sampleInterval * 2, sampleIntervalMax_);
+        }
     } else {
-        throw CO2::exceptionLevel("Unable to initialise CO2 sensor", true);
+        settledSampleCount_ = 0;
+    }
+
+    if (sampleInterval != sampleInterval_) {
+        syslog(LOG_INFO, "Sample interval now %llds (CO2 %.0fppm/min, RH %.1f%%/min)",
+               static_cast<long long>(sampleInterval.count()), co2Rate, relHumidityRate / 100);
+        changeSampleInterval(sampleInterval);
     }
 }
 
+// Called by the sensor fusion task, so sensors were read kFuseOffset_ ago.
+// Everything is rescheduled from then, so that sensor reads, fusion and
+// publishing keep the same offsets from each other.
+void Co2Monitor::changeSampleInterval(std::chrono::seconds sampleInterval)
+{
+    auto nextReadTime = (std::chrono::steady_clock::now() - kFuseOffset_) + sampleInterval;
+
+    for (auto co2SensorReader : co2SensorReaders_) {
+        co2SensorReader->setReadInterval(sampleInterval, nextReadTime);
+    }
+
+    scheduler_.changePeriod(sensorFusionTask_, sampleInterval, nextReadTime + kFuseOffset_);
+    scheduler_.changePeriod(publishTask_, sampleInterval, nextReadTime + std::chrono::seconds(kPublishOffset_));
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+        size_t capacity = trendCapacity(sampleInterval);
+
+        // the fan trends still cover fanTrendWindow_, now with more or fewer samples
+        co2Trend_.resize(capacity);
+        relHumidityTrend_.resize(capacity);
+
+        // the short trends start again, as the samples in them are now further apart or closer together
+        co2RateTrend_.clear();
+        relHumidityRateTrend_.clear();
+    }
+
+    sampleInterval_ = sampleInterval;
+}
+
+// Trends are fitted to (at least) the last fanTrendWindow_ of readings
+size_t Co2Monitor::trendCapacity(std::chrono::microseconds sampleInterval) const
+{
+    auto trendSamples = std::chrono::seconds(fanTrendWindow_) / sampleInterval;
+
+    return std::clamp<size_t>(trendSamples, 3, kMaxTrendSamples_);
+}
+
+void Co2Monitor::createCo2Sensors()
+{
+    Co2SensorFactory::SensorParams params;
+
+    params.scd30RdyGpio = scd30RdyGpio_;
+    params.replayStart = replayStart_;
+    params.replayEnd = replayEnd_;
+    params.replaySpeed = replaySpeed_;
+
+    for (auto& sensorConfig : sensorConfigs_) {
+        params.port = sensorConfig.sensorPort;
+        params.lastLocation = { -1, -1, -1 };
+
+        if (lastSensorInfo_.has_i2cbus() && (lastSensorInfo_.sensortype() == sensorConfig.sensorType)) {
+            params.lastLocation.i2cBus = lastSensorInfo_.i2cbus();
+            params.lastLocation.i2cAddress = lastSensorInfo_.i2caddress();
+            params.lastLocation.firmwareRevision = lastSensorInfo_.has_firmwarerevision() ? lastSensorInfo_.firmwarerevision() : -1;
+        }
+
+        // name sensors by type, unless there is more than one of a type
+        std::string name = sensorConfig.sensorType;
+        int sameTypeCount = 0;
+
+        for (auto& otherConfig : sensorConfigs_) {
+            sameTypeCount += (otherConfig.sensorType == sensorConfig.sensorType) ? 1 : 0;
+        }
+
+        if (sameTypeCount > 1) {
+            name += fmt::format("#{}", co2SensorReaders_.size() + 1);
+        }
+
+        Co2Sensor* co2Sensor = Co2SensorFactory::create(sensorConfig.sensorType, params);
+        Co2SensorReader* co2SensorReader = new Co2SensorReader(name, sensorConfig.sensorType, co2Sensor,
+                                                               sampleInterval_);
+
+        co2SensorReaders_.push_back(co2SensorReader);
+        co2SensorReader->initSensor();
+
+        Co2Sensor::Location location;
+
+        if (co2SensorReader->location(location)) {
+            publishSensorInfo(sensorConfig.sensorType, location);
+        }
+    }
+}
+
+// Co2Main keeps where the sensor was found in the persistent store, and
+// tells us in our config after a restart. Only sent if it has changed.
+void Co2Monitor::publishSensorInfo(const std::string& sensorType, const Co2Sensor::Location& location)
+{
+    bool isSameSensor = (lastSensorInfo_.sensortype() == sensorType);
+
+    if (isSameSensor && (lastSensorInfo_.i2cbus() == uint32_t(location.i2cBus)) &&
+        (lastSensorInfo_.i2caddress() == uint32_t(location.i2cAddress)) &&
+        (lastSensorInfo_.firmwarerevision() == uint32_t(location.firmwareRevision))) {
+        return;
+    }
+
+    if (isSameSensor && lastSensorInfo_.has_firmwarerevision() && (location.firmwareRevision >= 0) &&
+        (lastSensorInfo_.firmwarerevision() != uint32_t(location.firmwareRevision))) {
+        syslog(LOG_NOTICE, "%s firmware revision now %d.%d (was %d.%d)", sensorType.c_str(),
+               location.firmwareRevision >> 8, location.firmwareRevision & 0xff,
+               lastSensorInfo_.firmwarerevision() >> 8, lastSensorInfo_.firmwarerevision() & 0xff);
+    }
+
+    co2Message::Co2Message co2Msg;
+    co2Message::SensorInfo* sensorInfo = co2Msg.mutable_sensorinfo();
+
+    co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_SENSOR_INFO);
+
+    sensorInfo->set_sensortype(sensorType);
+    sensorInfo->set_i2cbus(location.i2cBus);
+    sensorInfo->set_i2caddress(location.i2cAddress);
+
+    if (location.firmwareRevision >= 0) {
+        sensorInfo->set_firmwarerevision(location.firmwareRevision);
+    }
+
+    lastSensorInfo_ = *sensorInfo;
+
+    CO2::sendMsg(mainSocket_, co2Msg);
+}
+
+void Co2Monitor::init()
+{
+    DBG_TRACE();
+
+    if (stressSampleRate_ > 0) {
+        // Every sample is published as soon as it has been fused, so
+        // the publish task is only left to run early publishes.
+        sampleInterval_ = std::chrono::microseconds(1000000 / stressSampleRate_);
+        scheduler_.setPeriod(sensorFusionTask_, sampleInterval_, sampleInterval_ / 2);
+        scheduler_.setPeriod(publishTask_, std::chrono::microseconds(0), std::chrono::microseconds(0));
+
+        syslog(LOG_NOTICE, "Stress mode: %d samples/s", stressSampleRate_);
+    } else if (sampleIntervalMin_ != sampleIntervalMax_) {
+        // start in the middle, so that sampling speeds up or slows down as soon as it needs to
+        sampleInterval_ = std::clamp<std::chrono::microseconds>(sampleInterval_, sampleIntervalMin_, sampleIntervalMax_);
+        scheduler_.setPeriod(sensorFusionTask_, sampleInterval_, kFuseOffset_);
+        scheduler_.setPeriod(publishTask_, sampleInterval_, std::chrono::seconds(kPublishOffset_));
+
+        syslog(LOG_INFO, "Sample interval %llds to %llds", static_cast<long long>(sampleIntervalMin_.count()),
+               static_cast<long long>(sampleIntervalMax_.count()));
+    } else {
+        sampleInterval_ = sampleIntervalMin_;
+        scheduler_.setPeriod(sensorFusionTask_, sampleInterval_, kFuseOffset_);
+        scheduler_.setPeriod(publishTask_, sampleInterval_, std::chrono::seconds(kPublishOffset_));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+        fanOutput_ = FanOutput::create(fanOutputType_, fanOutputPath_, kFanGpioPin_, fanPwmFrequency_);
+        fanOutput_->init();
+
+        // fan may have been switched on by config before there was an output
+        fanOutput_->setDuty(fanDuty_);
+    }
+
+    createCo2Sensors();
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+        size_t capacity = trendCapacity(std::min<std::chrono::microseconds>(sampleInterval_, sampleIntervalMin_));
+
+        co2Trend_.setCapacity(capacity);
+        relHumidityTrend_.setCapacity(capacity);
+        co2RateTrend_.setCapacity(kRateTrendSamples_);
+        relHumidityRateTrend_.setCapacity(kRateTrendSamples_);
+    }
+
+    // one slot per reading at the fastest sample interval; slower
+    // sampling just leaves some slots empty
+    uint16_t logSlotInterval = (stressSampleRate_ > 0) ? 1 : static_cast<uint16_t>(sampleIntervalMin_.count());
+
+    co2LogWriter_ = new Co2LogWriter(co2LogBaseDirStr_, co2LogFormat_, logSlotInterval, co2LogCompress_,
+                                     co2LogQueueSize_, co2LogFlushInterval_, co2LogFsyncInterval_);
+    co2LogWriter_->start();
+
+    // Closed minute/hour/day buckets are persisted by the log writer
+    co2Rollup_ = new Co2Rollup([this](Co2Rollup::Resolution resolution, const Co2Rollup::Bucket& bucket) {
+        if (!co2LogWriter_->pushRollup(resolution, bucket)) {
+            syslog(LOG_ERR, "CO2 log writer rollup queue full - %s rollup dropped", Co2Rollup::resolutionStr(resolution));
+        }
+    });
+}
+
 void Co2Monitor::run()
 {
     DBG_TRACE_MSG("Start of Co2Monitor::run");
@@ -638,12 +1264,6 @@ void Co2Monitor::run()
 
     co2Message::ThreadState_ThreadStates myThreadState = threadState_->state();
 
-#ifdef HAS_WIRINGPI
-    // setup GPIO pin to control fan
-    pinMode(kFanGpioPin_, OUTPUT);
-    digitalWrite(kFanGpioPin_, 0);
-#endif
-
     /**************************************************************************/
     /*                                                                        */
     /* Start listener thread and await config                                 */
@@ -709,41 +1329,20 @@ void Co2Monitor::run()
     /*                                                                        */
     /**************************************************************************/
     try {
-        time_t publishIntervalCounter = 0;
-
-        while (!shouldTerminate_.load(std::memory_order_relaxed)) {
-            if (++publishIntervalCounter >= kPublishInterval_) {
-
-                readCo2Sensor();
-
-                if (filterRelHumidity_ >= 0) {
-                    filterRelHumidity_ = ((relHumidity_ * 20) + (filterRelHumidity_ * 80)) / 100;
-                } else {
-                    filterRelHumidity_ = relHumidity_;
-                }
-
-                if (filterCo2_ >= 0) {
-                    filterCo2_ = ((co2_ * 20) + (filterCo2_ * 80)) / 100;
-                } else {
-                    filterCo2_ = co2_;
-                }
-
-                updateFanState();
-
-                publishIntervalCounter = 0;
-            }
+        if (co2LogWriter_ && (co2LogFlushInterval_ > 0)) {
+            logFlushTask_ = scheduler_.addTask("log flush", std::chrono::seconds(co2LogFlushInterval_),
+                                               std::chrono::seconds(co2LogFlushInterval_), [this] { co2LogWriter_->requestFlush(); });
+        }
 
-            if (consecutiveCo2SensorHwErrorCount_ > kHwErrorThreshold_) {
-                // we need to try restarting to try to fix hardware error
-                threadState_->stateEvent(CO2::ThreadFSM::HardwareFail);
-                myThreadState = threadState_->state();
-                continue;
+        // Sensor fusion, publish, log flush and fan override timer are
+        // run by the scheduler until we are told to terminate.
+        if (!shouldTerminate_.load(std::memory_order_relaxed)) {
+            for (auto co2SensorReader : co2SensorReaders_) {
+                co2SensorReader->start();
             }
 
-            publishCo2State();
-
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-        } // end main run loop
+            scheduler_.run();
+        }
 
     } catch (CO2::exceptionLevel& el) {
         if (el.isFatal()) {
@@ -764,10 +1363,51 @@ void Co2Monitor::run()
     /**************************************************************************/
     DBG_TRACE_MSG("end of Co2Monitor::run loop");
 
+    for (auto co2SensorReader : co2SensorReaders_) {
+        co2SensorReader->stop();
+    }
+
+    scheduler_.logStats(LOG_INFO);
+
+    syslog(LOG_INFO, "Co2Monitor: fuse latency %s", fuseLatency_.summary().c_str());
+    syslog(LOG_INFO, "Co2Monitor: publish latency %s", publishLatency_.summary().c_str());
+    syslog(LOG_INFO, "Co2Monitor: read to publish latency %s", readToPublishLatency_.summary().c_str());
+    syslog(LOG_INFO, "Co2Monitor: missed samples=%llu  cpu=%.3fs", (unsigned long long)missedSampleCount_,
+           LatencyHistogram::threadCpuNsec() / 1e9);
+
+    for (auto co2SensorReader : co2SensorReaders_) {
+        co2SensorReader->logStats(LOG_INFO);
+    }
+
     // remember to turn fan off
-#ifdef HAS_WIRINGPI
-    digitalWrite(kFanGpioPin_, 0);
-#endif
+    if (fanOutput_) {
+        try {
+            fanOutput_->setDuty(0);
+        } catch (CO2::exceptionLevel& el) {
+            syslog(LOG_ERR, "cannot turn fan off: %s", el.what());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(Co2Monitor::fanControlMutex_);
+
+        fanRuntime_.update(std::chrono::steady_clock::now(), time(0), fanStateOn_, fanDuty_);
+
+        const Co2FanRuntime::Counters& today = fanRuntime_.today();
+
+        syslog(LOG_INFO, "Co2Monitor: fan on today %.1f minutes (%.1f at full speed), switched on %u times",
+               today.onMsec / 60000.0, today.dutyMsec / 60000.0, today.switchCount);
+    }
+
+    // write out any readings still waiting to be logged,
+    // along with partly filled rollup buckets
+    if (co2Rollup_) {
+        co2Rollup_->flush();
+    }
+
+    if (co2LogWriter_) {
+        co2LogWriter_->stop();
+    }
 
     listenerThread->join();
     DBG_TRACE_MSG("Co2Monitor joined listenerThread");
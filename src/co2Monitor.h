@@ -9,17 +9,31 @@
 #define CO2MONITOR_H
 
 #include "co2Display.h"
-#include "co2Sensor.h"
+#include "co2EventBus.h"
+#include "co2FanRuntime.h"
+#include "co2Filter.h"
+#include "co2LogWriter.h"
+#include "co2Rollup.h"
+#include "co2SampleRing.h"
+#include "co2Scheduler.h"
+#include "co2SensorReader.h"
+#include "co2Trend.h"
+#include "fanOutput.h"
+#include "fanSpeedController.h"
+#include "latencyHistogram.h"
 
 class Co2Monitor
 {
     public:
-        Co2Monitor(zmq::context_t& ctx, int sockType);
+        Co2Monitor(zmq::context_t& ctx, int sockType, Co2SampleRing& sampleRing, Co2EventBus& eventBus);
 
         ~Co2Monitor();
 
         void run();
 
+        // Messages received from Co2Main, by type
+        const CO2::MsgCounters& rxMsgCounters() const { return rxMsgCounters_; }
+
         static std::atomic<bool> shouldTerminate_;
 
     private:
@@ -30,52 +44,145 @@ class Co2Monitor
         void listener();
 
         void publishCo2State();
+        void sendStats();
 
         void startFanManOnTimer();
         void stopFanManOnTimer();
+        void fanManOnTimerExpired();
         void updateFanState();
         void updateFanState(Co2Display::FanAutoManStates newFanAutoManState);
         void updateFanState(co2Message::FanConfig_FanOverride fanOverride);
 
         void fanControl();
-        void initCo2Sensor();
-        void readCo2Sensor();
+        bool autoFanStateOn();
+        int fanSpeedDuty();
+        void createCo2Sensors();
+        void publishSensorInfo(const std::string& sensorType, const Co2Sensor::Location& location);
+        bool fuseCo2Readings();
+        size_t trendCapacity(std::chrono::microseconds sampleInterval) const;
+        void acquireCo2Reading();
+        void adaptSampleInterval();
+        void changeSampleInterval(std::chrono::seconds sampleInterval);
 
         void init();
 
         zmq::context_t& ctx_;
         zmq::socket_t mainSocket_;
         zmq::socket_t subSocket_;
+        CO2::MsgCounters rxMsgCounters_;
 
         CO2::ThreadFSM* threadState_;
 
-        std::string sensorPort_;
-        std::string sensorType_;
-        Co2Sensor* co2Sensor_;
+        typedef struct {
+            std::string sensorType;
+            std::string sensorPort;
+        } SensorConfig;
+
+        // Sensors are read concurrently, each in its own thread,
+        // and their readings fused into one Co2State.
+        static const int kMaxSensors_ = 4;
+
+        std::vector<SensorConfig> sensorConfigs_;
+        std::vector<Co2SensorReader*> co2SensorReaders_;
+        uint32_t failedSensorMask_;   // so we only log when a sensor fails or recovers
+        bool co2SensorsHaveFailed_;   // true when no sensor is working
+        co2Message::SensorInfo lastSensorInfo_;  // where I2C sensor was found last time
+        co2Message::Co2Message co2StateMsg_;     // reused by publishCo2State()
 
         int temperature_;
         int relHumidity_;
         int filterRelHumidity_;
         int co2_;
         int filterCo2_;
+        Co2Filter co2Filter_;         // fused readings in, filter*_ out
+        Co2SampleRing& sampleRing_;   // every fused sample, for in-process readers
+        Co2EventBus& eventBus_;
+        Co2EventBus::Transport messageTransport_;  // for Co2State
         std::atomic<int> relHumidityThreshold_;
         std::atomic<int> co2Threshold_;
         time_t fanOnOverrideTime_;
         bool fanStateOn_;
         std::atomic<Co2Display::FanAutoManStates> fanAutoManState_;
-        std::atomic<time_t> fanManOnEndTime_;
+
+        // Auto fan control tuning and trends, guarded by fanControlMutex_
+        co2Message::FanConfig_FanControlMode fanControlMode_;
+        time_t fanPredictHorizon_;    // seconds
+        time_t fanTrendWindow_;       // seconds
+        int co2Hysteresis_;           // ppm
+        int relHumidityHysteresis_;   // 1/100 %
+        time_t fanMinOnTime_;         // seconds
+        time_t fanMinOffTime_;        // seconds
+        std::chrono::steady_clock::time_point fanSwitchTime_;
+        bool hasFanSwitched_;         // false until fanSwitchTime_ is set
+        Co2Trend co2Trend_;           // of filtered readings
+        Co2Trend relHumidityTrend_;
+        static const size_t kMaxTrendSamples_ = 4096;   // in case of stress mode
+
+        // Fan output, and its speed when variable speed. Also guarded by
+        // fanControlMutex_ (apart from settings only read before init).
+        std::string fanOutputType_;
+        std::string fanOutputPath_;
+        int fanPwmFrequency_;         // Hz
+        FanOutput* fanOutput_;        // created by init()
+        FanSpeedController fanSpeedController_;
+        int fanDuty_;                 // percent
+        std::chrono::steady_clock::time_point lastSpeedUpdateTime_;
+        Co2FanRuntime fanRuntime_;
+
+        int scd30RdyGpio_;
+        std::string replayStart_;
+        std::string replayEnd_;
+        int replaySpeed_;
 
         std::string co2LogBaseDirStr_;
+        Co2LogWriter::LogFormat co2LogFormat_;
+        bool co2LogCompress_;
+        size_t co2LogQueueSize_;
+        time_t co2LogFlushInterval_;
+        time_t co2LogFsyncInterval_;
+        Co2LogWriter* co2LogWriter_;
+        Co2Rollup* co2Rollup_;
 
         bool hasCo2Config_;
         bool hasFanConfig_;
         const uint32_t kFanGpioPin_;
 
         time_t kPublishInterval_;
-        time_t timeLastPublish_;
-
-        int consecutiveCo2SensorHwErrorCount_;     // used to trigger restart if hardware acting up
-        const int kHwErrorThreshold_; // the number of consecutive h/w errors to trigger restart
+        time_t kPublishOffset_;
+        std::chrono::milliseconds kFuseOffset_;
+
+        // In stress mode sensors are read, and every sample fused and
+        // published, stressSampleRate_ times a second rather than once
+        // every kPublishInterval_, to find where the pipeline saturates.
+        int stressSampleRate_;
+        std::chrono::microseconds sampleInterval_;
+
+        // Sampling (and publishing) speeds up to sampleIntervalMin_ while
+        // readings are changing quickly, and slows down, a doubling at a
+        // time, to sampleIntervalMax_ once they have settled.
+        std::chrono::seconds sampleIntervalMin_;
+        std::chrono::seconds sampleIntervalMax_;
+        double fastSampleCo2Rate_;      // ppm/minute
+        double fastSampleRelHumRate_;   // 1/100 %/minute
+        Co2Trend co2RateTrend_;         // short trends, for rate of change
+        Co2Trend relHumidityRateTrend_;
+        int settledSampleCount_;
+        static const size_t kRateTrendSamples_ = 5;
+        static const int kSettledSamples_ = 6;  // before slowing down
+
+        uint64_t lastSequence_[kMaxSensors_]; // last reading fused from each sensor
+        uint64_t missedSampleCount_;          // readings never fused
+        LatencyHistogram fuseLatency_;        // from sensor read to fused reading
+        LatencyHistogram publishLatency_;     // to publish and log a Co2State
+        LatencyHistogram readToPublishLatency_; // from sensor read to its Co2State being published
+        std::chrono::steady_clock::time_point fusedReadTime_; // newest reading in co2_, etc.
+
+        Co2Scheduler scheduler_;
+        Co2Scheduler::TaskId sensorFusionTask_;
+        Co2Scheduler::TaskId publishTask_;
+        Co2Scheduler::TaskId logFlushTask_;
+        Co2Scheduler::TaskId fanTimerTask_;
+        Co2Scheduler::TaskId statsTask_;
 
         static std::mutex fanControlMutex_;
 
@@ -6,6 +6,7 @@
  */
 
 #include <fstream>
+#include <vector>
 #include <thread>         // std::thread
 #include <unistd.h>
 #include <syslog.h>
@@ -16,6 +17,7 @@
 
 #include "netMonitor.h"
 #include "co2Monitor.h"
+#include "co2EventBus.h"
 #include "restartMgr.h"
 #include "parseConfigFile.h"
 #include "co2Defaults.h"
@@ -50,6 +52,10 @@ class Co2Main
         void publishCo2Cfg(void);
         void readCo2CfgMsg(std::string& cfgStr, bool bPublish);
         void readMsgFromCo2Monitor();
+        void readCo2StatesFromBus();
+        void recordCo2StateLatency(const Co2EventBus::Co2StateEvent& co2State);
+        void logLatency();
+        void dumpStats();
 
         void netMonFSM(void);
         void publishNetCfg(void);
@@ -59,7 +65,8 @@ class Co2Main
         void readMsgFromUI(void);
 
         void publishFanCfg(void);
-        void saveFanState(const co2Message::Co2State& co2State);
+        void saveFanState(const Co2EventBus::Co2StateEvent& co2State);
+        void saveFanRuntime(const Co2EventBus::Co2StateEvent& co2State);
 
         void publishAllConfig(void);
         void publishNetState(void);
@@ -70,12 +77,17 @@ class Co2Main
 
         void threadStateChangeNotify(co2Message::ThreadState_ThreadStates threadState, const char* threadName);
 
+        void publish(const co2Message::Co2Message& co2Msg);
+        void publish(co2Message::Co2Message_Co2MessageType msgType, zmq::message_t& msg);
+        void logMsgCounters(const char* threadName, const CO2::MsgCounters& rxMsgCounters);
+
         zmq::context_t context_;
         int zSockType_;
         zmq::socket_t mainPubSkt_;
         zmq::socket_t netMonSkt_;
         zmq::socket_t uiSkt_;
         zmq::socket_t co2MonSkt_;
+        CO2::MsgCounters pubMsgCounters_;  // published on mainPubSkt_
 
         //std::mutex mutex_; // used to control access to attributes used by multiple threads
 
@@ -97,9 +109,31 @@ class Co2Main
 
         RestartMgr* restartMgr_;
         static std::atomic<bool> shouldTerminate_;
+        static std::atomic<bool> shouldDumpStats_;   // SIGUSR1 received
+
+        // Co2State latency from Co2Monitor (over zmq or the bus) to us
+        LatencyHistogram publishToMainLatency_;
+        LatencyHistogram readToMainLatency_;
+
+        time_t fanRuntimeCheckpointInterval_;  // seconds
+        time_t timeNextFanRuntimeCheckpoint_;
 
         Co2PersistentConfigStore* persistentConfigStore_;
 
+        // Written by Co2Monitor, read by Co2Display. About 3 hours of
+        // samples at the usual rate.
+        static const size_t kSampleRingCapacity_ = 1024;
+        Co2SampleRing sampleRing_;
+
+        // Co2State from Co2Monitor to us and Co2Display, if MessageTransport is "bus"
+        Co2EventBus eventBus_;
+
+        // Messages from threads are all received and parsed in the main
+        // thread, into these, so their memory is reused rather than
+        // reallocated.
+        zmq::message_t rxMsg_;
+        CO2::MsgArena rxMsgArena_;
+
         static Co2Main::FailType failType_;
         static Co2Main::TerminateReasonType terminateReason_;
         static Co2Main::UserReqType userReqType_;
@@ -112,8 +146,10 @@ class Co2Main
             mainPubSkt_(context_, ZMQ_PUB),
             netMonSkt_(context_, zSockType_),
             uiSkt_(context_, zSockType_),
-            co2MonSkt_(context_, zSockType_) {
+            co2MonSkt_(context_, zSockType_),
+            sampleRing_(kSampleRingCapacity_) {
             shouldTerminate_.store(false, std::memory_order_relaxed);
+            shouldDumpStats_.store(false, std::memory_order_relaxed);
 
             myThreadState_ = new CO2::ThreadFSM("Co2MonitorMain");
             netState_.store(co2Message::NetState_NetStates_START, std::memory_order_relaxed);
@@ -126,6 +162,9 @@ class Co2Main
             co2MonThreadState_.store(co2Message::ThreadState_ThreadStates_INIT, std::memory_order_relaxed);
             displayThreadState_.store(co2Message::ThreadState_ThreadStates_INIT, std::memory_order_relaxed);
 
+            fanRuntimeCheckpointInterval_ = 600;
+            timeNextFanRuntimeCheckpoint_ = 0;
+
             restartMgr_ = new RestartMgr;
 
             if (!restartMgr_) {
@@ -164,6 +203,7 @@ class Co2Main
             sigaction(SIGINT, &action, 0);
             sigaction(SIGQUIT, &action, 0);
             sigaction(SIGTERM, &action, 0);
+            sigaction(SIGUSR1, &action, 0);
 
         }
 
@@ -192,11 +232,36 @@ class Co2Main
 };
 
 std::atomic<bool> Co2Main::shouldTerminate_;
+std::atomic<bool> Co2Main::shouldDumpStats_;
 
 Co2Main::FailType Co2Main::failType_;
 Co2Main::TerminateReasonType Co2Main::terminateReason_;
 Co2Main::UserReqType Co2Main::userReqType_;
 
+// Splits a comma separated config value, e.g. SensorType="K30,SCD30"
+static std::vector<std::string> splitConfigList(const std::string& str)
+{
+    std::vector<std::string> items;
+    size_t startPos = 0;
+
+    while (startPos <= str.length()) {
+        size_t endPos = str.find(',', startPos);
+
+        if (endPos == std::string::npos) {
+            endPos = str.length();
+        }
+
+        std::string item = str.substr(startPos, endPos - startPos);
+        size_t first = item.find_first_not_of(" \t");
+        size_t last = item.find_last_not_of(" \t");
+
+        items.push_back((first == std::string::npos) ? "" : item.substr(first, last - first + 1));
+        startPos = endPos + 1;
+    }
+
+    return items;
+}
+
 const char* Co2Main::failTypeStr()
 {
     switch (Co2Main::failType_) {
@@ -320,6 +385,10 @@ void Co2Main::init(const char* progName)
         throw CO2::exceptionLevel("Missing Persistent Store file name", true);
     }
 
+    if (cfg_.find("FanRuntimeCheckpointInterval") != cfg_.end()) {
+        fanRuntimeCheckpointInterval_ = cfg_.find("FanRuntimeCheckpointInterval")->second->getInt();
+    }
+
     if (cfg_.find("PersistentStoreConfigFile") != cfg_.end()) {
         const char* persistentStoreConfigFile = cfg_.find("PersistentStoreConfigFile")->second->getStr();
         persistentConfigStore_->init(persistentStoreConfigFile);
@@ -340,23 +409,95 @@ void Co2Main::publishCo2Cfg()
     co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_CO2_CFG);
 
     if (cfg_.find("SensorType") != cfg_.end()) {
-        const char* sensorType = cfg_.find("SensorType")->second->getStr();
-        co2Cfg->set_sensortype(sensorType);
+        // SensorType and SensorPort are comma separated lists when more than
+        // one sensor is connected, e.g. "K30,SCD30" and "/dev/serial0,I2C"
+        std::vector<std::string> sensorTypes = splitConfigList(cfg_.find("SensorType")->second->getStr());
+        std::vector<std::string> sensorPorts;
 
-        // No port is necessary for simulated sensor
-        if (strcmp(sensorType, "sim")) {
-            if (cfg_.find("SensorPort") != cfg_.end()) {
-                co2Cfg->set_sensorport(cfg_.find("SensorPort")->second->getStr());
-            } else {
-                configIsOk = false;
-                syslog(LOG_ERR, "Missing Sensor Port config");
+        if (cfg_.find("SensorPort") != cfg_.end()) {
+            sensorPorts = splitConfigList(cfg_.find("SensorPort")->second->getStr());
+        }
+
+        for (size_t i = 0; i < sensorTypes.size(); i++) {
+            co2Message::SensorConfig* sensorCfg = co2Cfg->add_sensors();
+            sensorCfg->set_sensortype(sensorTypes[i]);
+
+            // No port is necessary for simulated sensor
+            if (sensorTypes[i] != "sim") {
+                if ((i < sensorPorts.size()) && !sensorPorts[i].empty()) {
+                    sensorCfg->set_sensorport(sensorPorts[i]);
+                } else {
+                    configIsOk = false;
+                    syslog(LOG_ERR, "Missing Sensor Port config for %s sensor", sensorTypes[i].c_str());
+                }
             }
         }
+
+        // first sensor is also given on its own for anyone only expecting one
+        co2Cfg->set_sensortype(co2Cfg->sensors(0).sensortype());
+
+        if (co2Cfg->sensors(0).has_sensorport()) {
+            co2Cfg->set_sensorport(co2Cfg->sensors(0).sensorport());
+        }
     } else {
         configIsOk = false;
         syslog(LOG_ERR, "Missing Sensor Type config");
     }
 
+    if (cfg_.find("SCD30RdyGpio") != cfg_.end()) {
+        co2Cfg->set_scd30rdygpio(cfg_.find("SCD30RdyGpio")->second->getInt());
+    }
+
+    co2Message::SensorInfo sensorInfo;
+
+    if (restartMgr_->sensorInfo(sensorInfo)) {
+        *co2Cfg->mutable_lastsensorinfo() = sensorInfo;
+    }
+
+    if (cfg_.find("ReplayStart") != cfg_.end()) {
+        co2Cfg->set_replaystart(cfg_.find("ReplayStart")->second->getStr());
+    }
+
+    if (cfg_.find("ReplayEnd") != cfg_.end()) {
+        co2Cfg->set_replayend(cfg_.find("ReplayEnd")->second->getStr());
+    }
+
+    if (cfg_.find("ReplaySpeed") != cfg_.end()) {
+        co2Cfg->set_replayspeed(cfg_.find("ReplaySpeed")->second->getInt());
+    }
+
+    if (cfg_.find("StressSampleRate") != cfg_.end()) {
+        co2Cfg->set_stresssamplerate(cfg_.find("StressSampleRate")->second->getInt());
+    }
+
+    if (cfg_.find("SampleIntervalMin") != cfg_.end()) {
+        co2Cfg->set_sampleintervalmin(cfg_.find("SampleIntervalMin")->second->getInt());
+    }
+
+    if (cfg_.find("SampleIntervalMax") != cfg_.end()) {
+        co2Cfg->set_sampleintervalmax(cfg_.find("SampleIntervalMax")->second->getInt());
+    }
+
+    if (cfg_.find("FastSampleCo2Rate") != cfg_.end()) {
+        co2Cfg->set_fastsampleco2rate(cfg_.find("FastSampleCo2Rate")->second->getInt());
+    }
+
+    if (cfg_.find("FastSampleRelHumRate") != cfg_.end()) {
+        co2Cfg->set_fastsamplerelhumrate(cfg_.find("FastSampleRelHumRate")->second->getDouble());
+    }
+
+    if (cfg_.find("FilterCo2") != cfg_.end()) {
+        co2Cfg->set_filterco2(cfg_.find("FilterCo2")->second->getStr());
+    }
+
+    if (cfg_.find("FilterTemperature") != cfg_.end()) {
+        co2Cfg->set_filtertemperature(cfg_.find("FilterTemperature")->second->getStr());
+    }
+
+    if (cfg_.find("FilterRelHumidity") != cfg_.end()) {
+        co2Cfg->set_filterrelhumidity(cfg_.find("FilterRelHumidity")->second->getStr());
+    }
+
     if (cfg_.find("Co2LogBaseDir") != cfg_.end()) {
         co2Cfg->set_co2monlogbasedir(cfg_.find("Co2LogBaseDir")->second->getStr());
     } else {
@@ -364,14 +505,32 @@ void Co2Main::publishCo2Cfg()
         syslog(LOG_ERR, "Missing CO2 Mon log dir config");
     }
 
-    if (configIsOk) {
-        std::string cfgStr;
-        co2Msg.SerializeToString(&cfgStr);
+    if (cfg_.find("Co2LogFormat") != cfg_.end()) {
+        co2Cfg->set_co2logformat(cfg_.find("Co2LogFormat")->second->getStr());
+    }
+
+    if (cfg_.find("MessageTransport") != cfg_.end()) {
+        co2Cfg->set_messagetransport(cfg_.find("MessageTransport")->second->getStr());
+    }
+
+    if (cfg_.find("Co2LogCompress") != cfg_.end()) {
+        co2Cfg->set_co2logcompress(cfg_.find("Co2LogCompress")->second->getInt() != 0);
+    }
 
-        zmq::message_t configMsg(cfgStr.size());
+    if (cfg_.find("Co2LogQueueSize") != cfg_.end()) {
+        co2Cfg->set_co2logqueuesize(cfg_.find("Co2LogQueueSize")->second->getInt());
+    }
+
+    if (cfg_.find("Co2LogFlushInterval") != cfg_.end()) {
+        co2Cfg->set_co2logflushinterval(cfg_.find("Co2LogFlushInterval")->second->getInt());
+    }
 
-        memcpy(configMsg.data(), cfgStr.c_str(), cfgStr.size());
-        mainPubSkt_.send(configMsg, zmq::send_flags::none);
+    if (cfg_.find("Co2LogFsyncInterval") != cfg_.end()) {
+        co2Cfg->set_co2logfsyncinterval(cfg_.find("Co2LogFsyncInterval")->second->getInt());
+    }
+
+    if (configIsOk) {
+        publish(co2Msg);
         syslog(LOG_DEBUG, "sent Co2 config");
     } else {
         throw CO2::exceptionLevel("Missing Co2Config", true);
@@ -460,13 +619,7 @@ void Co2Main::publishNetCfg()
     }
 
     if (configIsOk) {
-        std::string cfgStr;
-        co2Msg.SerializeToString(&cfgStr);
-
-        zmq::message_t configMsg(cfgStr.size());
-
-        memcpy(configMsg.data(), cfgStr.c_str(), cfgStr.size());
-        mainPubSkt_.send(configMsg, zmq::send_flags::none);
+        publish(co2Msg);
         syslog(LOG_DEBUG, "sent Net config");
     } else {
         throw CO2::exceptionLevel("Missing NetConfig", true);
@@ -477,16 +630,13 @@ void Co2Main::readMsgFromNetMonitor()
 {
     DBG_TRACE();
 
-    try {
-        zmq::message_t msg;
+    zmq::message_t& msg = rxMsg_;
+    co2Message::Co2Message& co2Msg = *rxMsgArena_.newMsg();
 
+    try {
         if (netMonSkt_.recv(msg, zmq::recv_flags::none)) {
 
-            std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-
-            co2Message::Co2Message co2Msg;
-
-            if (!co2Msg.ParseFromString(msg_str)) {
+            if (!CO2::parseMsg(msg, co2Msg)) {
                 throw CO2::exceptionLevel("couldn't parse message from netMonitor", false);
             }
 
@@ -551,16 +701,13 @@ void Co2Main::readMsgFromCo2Monitor()
 {
     DBG_TRACE();
 
-    try {
-        zmq::message_t msg;
+    zmq::message_t& msg = rxMsg_;
+    co2Message::Co2Message& co2Msg = *rxMsgArena_.newMsg();
 
+    try {
         if (co2MonSkt_.recv(msg, zmq::recv_flags::none)) {
 
-            std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-
-            co2Message::Co2Message co2Msg;
-
-            if (!co2Msg.ParseFromString(msg_str)) {
+            if (!CO2::parseMsg(msg, co2Msg)) {
                 throw CO2::exceptionLevel("couldn't parse message from Co2 monitor", false);
             }
 
@@ -569,10 +716,14 @@ void Co2Main::readMsgFromCo2Monitor()
                 case co2Message::Co2Message_Co2MessageType_CO2_STATE:
                     if (co2Msg.has_co2state()) {
 
-                        const co2Message::Co2State& co2State = co2Msg.co2state();
+                        Co2EventBus::Co2StateEvent co2State;
+
+                        Co2EventBus::fromMsg(co2Msg.co2state(), co2State);
+                        recordCo2StateLatency(co2State);
                         saveFanState(co2State);
+                        saveFanRuntime(co2State);
 
-                        mainPubSkt_.send(msg, zmq::send_flags::none);
+                        publish(co2Msg.messagetype(), msg);
                         DBG_MSG(LOG_DEBUG, "published Co2 state");
 
                     } else {
@@ -581,6 +732,18 @@ void Co2Main::readMsgFromCo2Monitor()
 
                     break;
 
+                case co2Message::Co2Message_Co2MessageType_SENSOR_INFO:
+                    if (co2Msg.has_sensorinfo()) {
+                        const co2Message::SensorInfo& sensorInfo = co2Msg.sensorinfo();
+
+                        restartMgr_->saveSensorInfo(sensorInfo);
+                        syslog(LOG_INFO, "%s sensor now on I2C bus %u", sensorInfo.sensortype().c_str(), sensorInfo.i2cbus());
+                    } else {
+                        throw CO2::exceptionLevel("missing sensor info", false);
+                    }
+
+                    break;
+
                 case co2Message::Co2Message_Co2MessageType_THREAD_STATE:
                     if (co2Msg.has_threadstate()) {
                         const co2Message::ThreadState& threadStateMsg = co2Msg.threadstate();
@@ -597,6 +760,10 @@ void Co2Main::readMsgFromCo2Monitor()
 
                     break;
 
+                case co2Message::Co2Message_Co2MessageType_STATS:
+                    CO2::logStats(LOG_INFO, co2Msg.stats());
+                    break;
+
                 default:
                     throw CO2::exceptionLevel("unexpected message from Co2 monitor thread", false);
             }
@@ -613,20 +780,68 @@ void Co2Main::readMsgFromCo2Monitor()
     }
 }
 
+// Co2State straight from Co2Monitor, when its MessageTransport is "bus".
+// Co2Display gets its own copy, so there is nothing to republish.
+void Co2Main::readCo2StatesFromBus()
+{
+    Co2EventBus::Co2StateEvent co2State;
+
+    while (eventBus_.co2StateToMain().pop(co2State)) {
+        recordCo2StateLatency(co2State);
+        saveFanState(co2State);
+        saveFanRuntime(co2State);
+    }
+}
+
+void Co2Main::recordCo2StateLatency(const Co2EventBus::Co2StateEvent& co2State)
+{
+    auto rxTime = std::chrono::steady_clock::now();
+
+    if (co2State.publishTime != std::chrono::steady_clock::time_point()) {
+        publishToMainLatency_.record(rxTime - co2State.publishTime);
+    }
+
+    if (co2State.readTime != std::chrono::steady_clock::time_point()) {
+        readToMainLatency_.record(rxTime - co2State.readTime);
+    }
+}
+
+void Co2Main::logLatency()
+{
+    co2Message::Stats stats;
+
+    stats.set_threadname("Co2Main");
+    CO2::addLatency(stats, "publish to Co2Main", publishToMainLatency_);
+    CO2::addLatency(stats, "read to Co2Main", readToMainLatency_);
+
+    CO2::logStats(LOG_INFO, stats);
+}
+
+// On SIGUSR1: log our latency histograms and ask Co2Monitor and
+// Co2Display for theirs, which are logged as their replies arrive.
+void Co2Main::dumpStats()
+{
+    co2Message::Co2Message co2Msg;
+
+    logLatency();
+
+    co2Msg.set_messagetype(co2Message::Co2Message_Co2MessageType_STATS);
+    co2Msg.mutable_stats();
+
+    publish(co2Msg);
+}
+
 void Co2Main::readMsgFromUI()
 {
     DBG_TRACE();
 
-    try {
-        zmq::message_t msg;
+    zmq::message_t& msg = rxMsg_;
+    co2Message::Co2Message& co2Msg = *rxMsgArena_.newMsg();
 
+    try {
         if (uiSkt_.recv(msg, zmq::recv_flags::none)) {
 
-            std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-
-            co2Message::Co2Message co2Msg;
-
-            if (!co2Msg.ParseFromString(msg_str)) {
+            if (!CO2::parseMsg(msg, co2Msg)) {
                 throw CO2::exceptionLevel("couldn't parse message from UI", false);
             }
 
@@ -635,7 +850,7 @@ void Co2Main::readMsgFromUI()
                 case co2Message::Co2Message_Co2MessageType_FAN_CFG:
                     if (co2Msg.has_fanconfig()) {
 
-                        mainPubSkt_.send(msg, zmq::send_flags::none);
+                        publish(co2Msg.messagetype(), msg);
                         DBG_MSG(LOG_DEBUG, "published fan config");
 
                         const co2Message::FanConfig& fanConfigMsg = co2Msg.fanconfig();
@@ -711,6 +926,10 @@ void Co2Main::readMsgFromUI()
 
                     break;
 
+                case co2Message::Co2Message_Co2MessageType_STATS:
+                    CO2::logStats(LOG_INFO, co2Msg.stats());
+                    break;
+
                 default:
                     throw CO2::exceptionLevel("unexpected message from Display thread", false);
             }
@@ -795,13 +1014,7 @@ void Co2Main::publishUICfg()
     }
 
     if (configIsOk) {
-        std::string cfgStr;
-        co2Msg.SerializeToString(&cfgStr);
-
-        zmq::message_t configMsg(cfgStr.size());
-
-        memcpy(configMsg.data(), cfgStr.c_str(), cfgStr.size());
-        mainPubSkt_.send(configMsg, zmq::send_flags::none);
+        publish(co2Msg);
         syslog(LOG_DEBUG, "sent UI config");
     } else {
         throw CO2::exceptionLevel("Missing UIConfig", true);
@@ -826,6 +1039,74 @@ void Co2Main::publishFanCfg()
         syslog(LOG_ERR, "Missing FanOnOverrideTime config");
     }
 
+    if (cfg_.find("FanControlMode") != cfg_.end()) {
+        std::string fanControlModeStr = cfg_.find("FanControlMode")->second->getStr();
+
+        if (fanControlModeStr == "threshold") {
+            fanCfg->set_fancontrolmode(co2Message::FanConfig_FanControlMode_THRESHOLD);
+        } else if (fanControlModeStr == "predictive") {
+            fanCfg->set_fancontrolmode(co2Message::FanConfig_FanControlMode_PREDICTIVE);
+        } else {
+            configIsOk = false;
+            syslog(LOG_ERR, "Unknown FanControlMode \"%s\" - must be threshold or predictive", fanControlModeStr.c_str());
+        }
+    }
+
+    if (cfg_.find("FanPredictHorizon") != cfg_.end()) {
+        fanCfg->set_predicthorizon(cfg_.find("FanPredictHorizon")->second->getInt());
+    }
+
+    if (cfg_.find("FanTrendWindow") != cfg_.end()) {
+        fanCfg->set_trendwindow(cfg_.find("FanTrendWindow")->second->getInt());
+    }
+
+    if (cfg_.find("CO2FanHysteresis") != cfg_.end()) {
+        fanCfg->set_co2hysteresis(cfg_.find("CO2FanHysteresis")->second->getInt());
+    }
+
+    if (cfg_.find("RelHumFanHysteresis") != cfg_.end()) {
+        fanCfg->set_relhumhysteresis(cfg_.find("RelHumFanHysteresis")->second->getInt());
+    }
+
+    if (cfg_.find("FanMinOnTime") != cfg_.end()) {
+        fanCfg->set_fanminontime(cfg_.find("FanMinOnTime")->second->getInt());
+    }
+
+    if (cfg_.find("FanMinOffTime") != cfg_.end()) {
+        fanCfg->set_fanminofftime(cfg_.find("FanMinOffTime")->second->getInt());
+    }
+
+    if (cfg_.find("FanOutput") != cfg_.end()) {
+        std::string fanOutputStr = cfg_.find("FanOutput")->second->getStr();
+
+        if ((fanOutputStr == "gpio") || (fanOutputStr == "pwm") || (fanOutputStr == "file")) {
+            fanCfg->set_fanoutput(fanOutputStr);
+        } else {
+            configIsOk = false;
+            syslog(LOG_ERR, "Unknown FanOutput \"%s\" - must be gpio, pwm or file", fanOutputStr.c_str());
+        }
+    }
+
+    if (cfg_.find("FanOutputPath") != cfg_.end()) {
+        fanCfg->set_fanoutputpath(cfg_.find("FanOutputPath")->second->getStr());
+    }
+
+    if (cfg_.find("FanPwmFrequency") != cfg_.end()) {
+        fanCfg->set_pwmfrequency(cfg_.find("FanPwmFrequency")->second->getInt());
+    }
+
+    if (cfg_.find("FanPwmCurve") != cfg_.end()) {
+        fanCfg->set_pwmcurve(cfg_.find("FanPwmCurve")->second->getStr());
+    }
+
+    if (cfg_.find("FanPwmKp") != cfg_.end()) {
+        fanCfg->set_pwmkp(cfg_.find("FanPwmKp")->second->getDouble());
+    }
+
+    if (cfg_.find("FanPwmKi") != cfg_.end()) {
+        fanCfg->set_pwmki(cfg_.find("FanPwmKi")->second->getDouble());
+    }
+
     bool hasSavedConfig = persistentConfigStore_->hasConfig() && persistentConfigStore_->read();
 
     syslog(LOG_DEBUG, "%s: hasSavedConfig=%s", __FUNCTION__, hasSavedConfig ? "TRUE" : "FALSE");
@@ -868,49 +1149,67 @@ void Co2Main::publishFanCfg()
         fanCfg->set_fanoverride(fan);
         persistentConfigStore_->write();
 
-        std::string cfgStr;
-        co2Msg.SerializeToString(&cfgStr);
+        // so Co2Monitor carries on with today's fan runtime after a restart
+        co2Message::FanRuntime fanRuntime;
 
-        zmq::message_t configMsg(cfgStr.size());
+        if (restartMgr_->fanRuntime(fanRuntime)) {
+            *fanCfg->mutable_fanruntime() = fanRuntime;
+        }
 
-        memcpy(configMsg.data(), cfgStr.c_str(), cfgStr.size());
-        mainPubSkt_.send(configMsg, zmq::send_flags::none);
+        publish(co2Msg);
         syslog(LOG_DEBUG, "sent Fan config");
     } else {
         throw CO2::exceptionLevel("Missing Fan Config", true);
     }
 }
 
-void Co2Main::saveFanState(const co2Message::Co2State& co2State)
+void Co2Main::saveFanState(const Co2EventBus::Co2StateEvent& co2State)
 {
-    if (co2State.has_fanstate()) {
-        co2Message::FanConfig_FanOverride fan;
+    co2Message::FanConfig_FanOverride fan;
 
-        switch (co2State.fanstate()) {
-            case co2Message::Co2State_FanStates_AUTO_OFF:
-            case co2Message::Co2State_FanStates_AUTO_ON:
-                fan = co2Message::FanConfig_FanOverride_AUTO;
-                break;
+    switch (co2State.fanState) {
+        case co2Message::Co2State_FanStates_AUTO_OFF:
+        case co2Message::Co2State_FanStates_AUTO_ON:
+            fan = co2Message::FanConfig_FanOverride_AUTO;
+            break;
 
-            case co2Message::Co2State_FanStates_MANUAL_OFF:
-                fan = co2Message::FanConfig_FanOverride_MANUAL_OFF;
-                break;
+        case co2Message::Co2State_FanStates_MANUAL_OFF:
+            fan = co2Message::FanConfig_FanOverride_MANUAL_OFF;
+            break;
 
-            case co2Message::Co2State_FanStates_MANUAL_ON:
-                fan = co2Message::FanConfig_FanOverride_MANUAL_ON;
-                break;
+        case co2Message::Co2State_FanStates_MANUAL_ON:
+            fan = co2Message::FanConfig_FanOverride_MANUAL_ON;
+            break;
+
+        default:
+            // We won't flag this as an error as there are other valid
+            // Co2State_FanStates which don't change the fan override.
+            syslog(LOG_DEBUG, "%s - unknown fan state:%d", __FUNCTION__, co2State.fanState);
+            return;
+    }
+
+    // persistentConfigStore will only save this fan state
+    // if it has changed from the previous one.
+    persistentConfigStore_->setFanOverride(fan);
+    persistentConfigStore_->write();
+}
 
-            default:
-                // We won't flag this as an error as there are other valid
-                // Co2State_FanStates which don't change the fan override.
-                syslog(LOG_DEBUG, "%s - unknown fan state:%d", __FUNCTION__, co2State.fanstate());
-                return;
+// Latest fan runtime is always passed on to the restart manager, which
+// saves it on shutdown, but only checkpointed to the persistent store
+// every fanRuntimeCheckpointInterval_ so as not to wear out flash.
+void Co2Main::saveFanRuntime(const Co2EventBus::Co2StateEvent& co2State)
+{
+    if (co2State.hasFanRuntime) {
+        co2Message::FanRuntime fanRuntime;
+        time_t timeNow = time(0);
+        bool shouldWrite = (timeNow >= timeNextFanRuntimeCheckpoint_);
+
+        if (shouldWrite) {
+            timeNextFanRuntimeCheckpoint_ = timeNow + fanRuntimeCheckpointInterval_;
         }
 
-        // persistentConfigStore will only save this fan state
-        // if it has changed from the previous one.
-        persistentConfigStore_->setFanOverride(fan);
-        persistentConfigStore_->write();
+        Co2EventBus::toFanRuntime(co2State, fanRuntime);
+        restartMgr_->saveFanRuntime(fanRuntime, shouldWrite);
     }
 }
 
@@ -931,7 +1230,6 @@ void Co2Main::publishNetState()
 {
     DBG_TRACE();
 
-    std::string netStateStr;
     co2Message::Co2Message co2Msg;
     co2Message::NetState* netState = co2Msg.mutable_netstate();
 
@@ -942,21 +1240,43 @@ void Co2Main::publishNetState()
         netState->set_myipaddress(myIPAddress_);
     }
 
-    co2Msg.SerializeToString(&netStateStr);
-
-    zmq::message_t netStateMsg(netStateStr.size());
-
-    memcpy (netStateMsg.data(), netStateStr.c_str(), netStateStr.size());
-    mainPubSkt_.send(netStateMsg, zmq::send_flags::none);
+    publish(co2Msg);
     syslog(LOG_DEBUG, "Published Net State");
     myIPAddressChanged_ = false;
 }
 
+void Co2Main::publish(const co2Message::Co2Message& co2Msg)
+{
+    if (CO2::publishMsg(mainPubSkt_, co2Msg)) {
+        pubMsgCounters_.add(co2Msg.messagetype());
+    }
+}
+
+void Co2Main::publish(co2Message::Co2Message_Co2MessageType msgType, zmq::message_t& msg)
+{
+    if (CO2::publishMsg(mainPubSkt_, msgType, msg)) {
+        pubMsgCounters_.add(msgType);
+    }
+}
+
+// Messages a thread didn't receive were dropped by zmq, as it hadn't
+// subscribed to them (or hadn't yet connected when they were published).
+void Co2Main::logMsgCounters(const char* threadName, const CO2::MsgCounters& rxMsgCounters)
+{
+    uint64_t published = pubMsgCounters_.total();
+    uint64_t received = rxMsgCounters.total();
+
+    syslog(LOG_INFO, "%s received %llu of %llu published messages, %llu dropped (CO2_STATE %llu of %llu)",
+           threadName, static_cast<unsigned long long>(received), static_cast<unsigned long long>(published),
+           static_cast<unsigned long long>((published > received) ? (published - received) : 0),
+           static_cast<unsigned long long>(rxMsgCounters.count(co2Message::Co2Message_Co2MessageType_CO2_STATE)),
+           static_cast<unsigned long long>(pubMsgCounters_.count(co2Message::Co2Message_Co2MessageType_CO2_STATE)));
+}
+
 void Co2Main::terminateAllThreads()
 {
     DBG_TRACE();
 
-    std::string terminateMsgStr;
     co2Message::Co2Message co2Msg;
     co2Message::ThreadState* threadState = co2Msg.mutable_threadstate();
 
@@ -964,12 +1284,7 @@ void Co2Main::terminateAllThreads()
 
     threadState->set_threadstate(co2Message::ThreadState_ThreadStates_STOPPING);
 
-    co2Msg.SerializeToString(&terminateMsgStr);
-
-    zmq::message_t pubMsg(terminateMsgStr.size());
-
-    memcpy(pubMsg.data(), terminateMsgStr.c_str(), terminateMsgStr.size());
-    mainPubSkt_.send(pubMsg, zmq::send_flags::none);
+    publish(co2Msg);
 
     // give threads some time to tidy up and terminate
     std::this_thread::sleep_for(std::chrono::seconds(5));
@@ -979,17 +1294,30 @@ void Co2Main::listener()
 {
     DBG_TRACE();
 
+    Co2EventBus::Co2StateQueue& co2StateQueue = eventBus_.co2StateToMain();
+
     zmq::pollitem_t rxItems [] = {
         { static_cast<void*>(netMonSkt_), 0, ZMQ_POLLIN, 0 },   // 0
         { static_cast<void*>(co2MonSkt_), 0, ZMQ_POLLIN, 0 },   // 1
-        { static_cast<void*>(uiSkt_), 0, ZMQ_POLLIN, 0 }        // 2
+        { static_cast<void*>(uiSkt_), 0, ZMQ_POLLIN, 0 },       // 2
+        { nullptr, co2StateQueue.fd(), ZMQ_POLLIN, 0 }          // 3
     };
     int numRxItems = sizeof(rxItems) / sizeof(rxItems[0]);
 
 
     while (!Co2Main::shouldTerminate_.load(std::memory_order_relaxed)) {
         try {
-            int nItems = zmq::poll(rxItems, numRxItems, rxTimeoutMsec_);
+            if (Co2Main::shouldDumpStats_.exchange(false, std::memory_order_relaxed)) {
+                dumpStats();
+            }
+
+            std::chrono::milliseconds timeout = co2StateQueue.prepareWait() ? rxTimeoutMsec_ : std::chrono::milliseconds(0);
+            int nItems = zmq::poll(rxItems, numRxItems, timeout);
+
+            co2StateQueue.endWait();
+
+            // Co2Monitor (bus)
+            readCo2StatesFromBus();
 
             if (nItems == 0) {
                 // timed out
@@ -1011,6 +1339,11 @@ void Co2Main::listener()
                 readMsgFromUI();
             }
 
+        } catch (zmq::error_t& ze) {
+            // poll is interrupted by signals, e.g. SIGUSR1, which is fine
+            if (ze.num() != EINTR) {
+                syslog(LOG_ERR, "%s zmq exception: %s", __FUNCTION__, ze.what());
+            }
         } catch (CO2::exceptionLevel& el) {
             if (el.isFatal()) {
                 syslog(LOG_ERR, "%s fatal exception: %s", __FUNCTION__, el.what());
@@ -1109,7 +1442,7 @@ void Co2Main::runloop()
 
         DBG_TRACE_MSG("Co2Main::runloop: starting Co2Monitor");
         threadName = "Co2Monitor";
-        co2Mon = new Co2Monitor(context_, zSockType_);
+        co2Mon = new Co2Monitor(context_, zSockType_, sampleRing_, eventBus_);
 
         if (co2Mon) {
             co2MonThread = new std::thread(&Co2Monitor::run, co2Mon);
@@ -1119,7 +1452,7 @@ void Co2Main::runloop()
 
         DBG_TRACE_MSG("Co2Main::runloop: starting Co2Display");
         threadName = "Co2Display";
-        co2Display = new Co2Display(context_, zSockType_);
+        co2Display = new Co2Display(context_, zSockType_, sampleRing_, eventBus_);
 
         if (co2Display) {
             displayThread = new std::thread(&Co2Display::run, co2Display);
@@ -1313,6 +1646,7 @@ void Co2Main::runloop()
     DBG_TRACE_MSG("joined co2MonThread");
 
     if (co2Mon) {
+        logMsgCounters("Co2Monitor", co2Mon->rxMsgCounters());
         delete co2Mon;
         co2Mon = nullptr;
     }
@@ -1326,6 +1660,7 @@ void Co2Main::runloop()
     DBG_TRACE_MSG("joined displayThread");
 
     if (co2Display) {
+        logMsgCounters("Co2Display", co2Display->rxMsgCounters());
         delete co2Display;
         co2Display = nullptr;
     }
@@ -1338,7 +1673,18 @@ void Co2Main::runloop()
     netMonThread->join();
     DBG_TRACE_MSG("joined netMonThread");
 
+    logLatency();
+
+    if (eventBus_.co2StateToMain().pushCount() > 0) {
+        syslog(LOG_INFO, "bus: %llu Co2States to Co2Main (%llu dropped), %llu to Co2Display (%llu dropped)",
+               static_cast<unsigned long long>(eventBus_.co2StateToMain().pushCount()),
+               static_cast<unsigned long long>(eventBus_.co2StateToMain().dropCount()),
+               static_cast<unsigned long long>(eventBus_.co2StateToDisplay().pushCount()),
+               static_cast<unsigned long long>(eventBus_.co2StateToDisplay().dropCount()));
+    }
+
     if (netMon) {
+        logMsgCounters("NetMonitor", netMon->rxMsgCounters());
         delete netMon;
         netMon = nullptr;
     }
@@ -1406,6 +1752,11 @@ void Co2Main::sigHandler(int sig, siginfo_t* siginfo, void* context)
             Co2Main::shouldTerminate_.store(true, std::memory_order_relaxed);
             break;
 
+        case SIGUSR1:
+            // dumped by the listener thread
+            Co2Main::shouldDumpStats_.store(true, std::memory_order_relaxed);
+            break;
+
         default:
             // This signal handler should only be
             // receiving above signals, so we'll just
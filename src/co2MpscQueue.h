@@ -0,0 +1,214 @@
+/*
+ * co2MpscQueue.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2MPSCQUEUE_H
+#define CO2MPSCQUEUE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#include "utils.h"
+
+// Bounded queue of T, which any number of threads push to and one thread
+// pops from, without locks.
+//
+// Each slot has a sequence number, which tells a producer whether the slot
+// is free for the position it has claimed (by incrementing tail_), and the
+// consumer whether the value for its position has been written yet. When
+// the queue is full, as when a zmq socket is at its high water mark, new
+// values are dropped and counted.
+//
+// The consumer can wait for values on fd(), along with anything else
+// (e.g. in zmq::poll()):
+//
+//     int timeout = queue.prepareWait() ? timeoutMsec : 0;
+//     ... poll fd() ...
+//     queue.endWait();
+//     while (queue.pop(value)) { ... }
+//
+// Producers only write to the eventfd when the consumer is waiting, so
+// while it is busy values are passed without any system calls.
+//
+template <typename T>
+class Co2MpscQueue
+{
+    public:
+        static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+        // capacity is rounded up to a power of two
+        explicit Co2MpscQueue(size_t capacity) :
+            capacity_(roundUpPow2(capacity)),
+            mask_(capacity_ - 1),
+            slots_(new Slot[capacity_]),
+            head_(0),
+            eventFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+            if (eventFd_ < 0) {
+                delete [] slots_;
+                throw CO2::exceptionLevel(fmt::format("cannot create eventfd for queue ({})", strerror(errno)), true);
+            }
+
+            for (size_t i = 0; i < capacity_; i++) {
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+            }
+
+            tail_.store(0, std::memory_order_relaxed);
+            isWaiting_.store(false, std::memory_order_relaxed);
+            pushCount_.store(0, std::memory_order_relaxed);
+            dropCount_.store(0, std::memory_order_relaxed);
+        }
+
+        ~Co2MpscQueue()
+        {
+            close(eventFd_);
+            delete [] slots_;
+        }
+
+        size_t capacity() const { return capacity_; }
+        uint64_t pushCount() const { return pushCount_.load(std::memory_order_relaxed); }
+        uint64_t dropCount() const { return dropCount_.load(std::memory_order_relaxed); }
+
+        // Any thread. False if the queue was full, so value was dropped.
+        bool push(const T& value)
+        {
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            Slot* slot;
+
+            while (true) {
+                slot = &slots_[pos & mask_];
+
+                int64_t diff = int64_t(slot->seq.load(std::memory_order_acquire)) - int64_t(pos);
+
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    // consumer hasn't popped the value a lap ago yet
+                    dropCount_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    // another producer claimed pos first
+                    pos = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->value = value;
+            slot->seq.store(pos + 1, std::memory_order_release);
+            pushCount_.fetch_add(1, std::memory_order_relaxed);
+
+            // pairs with the fence in prepareWait(): either the consumer
+            // sees this value, or we see that it is waiting
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (isWaiting_.load(std::memory_order_relaxed) && isWaiting_.exchange(false, std::memory_order_relaxed)) {
+                uint64_t one = 1;
+
+                if (write(eventFd_, &one, sizeof(one)) < 0) {
+                    // only fails if the count would overflow, in which case the consumer will wake anyway
+                }
+            }
+
+            return true;
+        }
+
+        // Consumer only. False if the queue is empty.
+        bool pop(T& value)
+        {
+            Slot& slot = slots_[head_ & mask_];
+
+            if (slot.seq.load(std::memory_order_acquire) != (head_ + 1)) {
+                return false;
+            }
+
+            value = slot.value;
+            slot.seq.store(head_ + capacity_, std::memory_order_release);
+            head_++;
+
+            return true;
+        }
+
+        // Readable when values may have been pushed since prepareWait()
+        int fd() const { return eventFd_; }
+
+        // Consumer only, before waiting on fd(). True if the queue is
+        // empty, so the consumer can block until fd() is readable.
+        bool prepareWait()
+        {
+            isWaiting_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (slots_[head_ & mask_].seq.load(std::memory_order_acquire) == (head_ + 1)) {
+                isWaiting_.store(false, std::memory_order_relaxed);
+                return false;
+            }
+
+            return true;
+        }
+
+        // Consumer only, after waiting on fd()
+        void endWait()
+        {
+            uint64_t count;
+
+            isWaiting_.store(false, std::memory_order_relaxed);
+
+            // Always drained, whether or not a producer cleared isWaiting_:
+            // one which did may not have written yet, so its write could
+            // otherwise be left for a later wait, which would then never block.
+            if (read(eventFd_, &count, sizeof(count)) < 0) {
+                // EAGAIN: nothing written (yet)
+            }
+        }
+
+    private:
+        Co2MpscQueue();
+        Co2MpscQueue(const Co2MpscQueue& rhs);
+        Co2MpscQueue& operator=(const Co2MpscQueue& rhs);
+
+        static const size_t kCacheLineSize = 64;
+
+        struct alignas(kCacheLineSize) Slot {
+            std::atomic<uint64_t> seq;
+            T value;
+        };
+
+        static size_t roundUpPow2(size_t n)
+        {
+            size_t pow2 = 1;
+
+            while (pow2 < n) {
+                pow2 <<= 1;
+            }
+
+            return pow2;
+        }
+
+        const size_t capacity_;
+        const size_t mask_;
+        Slot* slots_;
+
+        // producers and consumer each on their own cache line
+        alignas(kCacheLineSize) std::atomic<uint64_t> tail_;
+        alignas(kCacheLineSize) uint64_t head_;
+        std::atomic<bool> isWaiting_;
+        int eventFd_;
+
+        alignas(kCacheLineSize) std::atomic<uint64_t> pushCount_;
+        std::atomic<uint64_t> dropCount_;
+
+    protected:
+};
+
+#endif /* CO2MPSCQUEUE_H */
@@ -26,7 +26,9 @@ Co2PersistentStore::Co2PersistentStore() :
     co2_(0),
     co2WasSet_(false),
     relHumidity_(0),
-    relHumidityWasSet_(false)
+    relHumidityWasSet_(false),
+    fanRuntimeWasSet_(false),
+    sensorInfoWasSet_(false)
 {
 }
 
@@ -155,6 +157,19 @@ void Co2PersistentStore::read()
         syslogBuf += fmt::format("Rel Humidity = {}", relHumidity_);
     }
 
+    // Kept, so it is written back until Co2Monitor has carried on from it
+    if (co2Store.has_fanruntime()) {
+        fanRuntime_ = co2Store.fanruntime();
+        fanRuntimeWasSet_ = true;
+        syslogBuf += fmt::format(", fan on {}s, switched on {} times", fanRuntime_.ontime(), fanRuntime_.switchcount());
+    }
+
+    if (co2Store.has_sensorinfo()) {
+        sensorInfo_ = co2Store.sensorinfo();
+        sensorInfoWasSet_ = true;
+        syslogBuf += fmt::format(", {} on I2C bus {}", sensorInfo_.sensortype(), sensorInfo_.i2cbus());
+    }
+
     if (syslogBuf[0]) {
         syslog(LOG_INFO, "%s", syslogBuf.c_str());
     }
@@ -208,6 +223,14 @@ void Co2PersistentStore::write()
         co2Store.set_relhumidity(relHumidity_);
     }
 
+    if (fanRuntimeWasSet_) {
+        *co2Store.mutable_fanruntime() = fanRuntime_;
+    }
+
+    if (sensorInfoWasSet_) {
+        *co2Store.mutable_sensorinfo() = sensorInfo_;
+    }
+
     if (!pathName_.empty()) {
         syslog(LOG_DEBUG, "Writing to: \"%s\"", pathName_.c_str());
         std::fstream output(pathName_.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
@@ -259,4 +282,14 @@ void Co2PersistentStore::setRelHumidity(uint32_t relHumidity)
     relHumidityWasSet_ = true;
 }
 
+void Co2PersistentStore::setFanRuntime(const co2Message::FanRuntime& fanRuntime)
+{
+    fanRuntime_ = fanRuntime;
+    fanRuntimeWasSet_ = true;
+}
 
+void Co2PersistentStore::setSensorInfo(const co2Message::SensorInfo& sensorInfo)
+{
+    sensorInfo_ = sensorInfo;
+    sensorInfoWasSet_ = true;
+}
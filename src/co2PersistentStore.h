@@ -53,6 +53,26 @@ class Co2PersistentStore
             return relHumidity_;
         }
 
+        void setFanRuntime(const co2Message::FanRuntime& fanRuntime);
+
+        bool hasFanRuntime() {
+            return fanRuntimeWasSet_;
+        }
+
+        const co2Message::FanRuntime& fanRuntime() {
+            return fanRuntime_;
+        }
+
+        void setSensorInfo(const co2Message::SensorInfo& sensorInfo);
+
+        bool hasSensorInfo() {
+            return sensorInfoWasSet_;
+        }
+
+        const co2Message::SensorInfo& sensorInfo() {
+            return sensorInfo_;
+        }
+
     private:
         std::string pathName_;
 
@@ -72,6 +92,12 @@ class Co2PersistentStore
 
         uint32_t relHumidity_;
         bool relHumidityWasSet_;
+
+        co2Message::FanRuntime fanRuntime_;
+        bool fanRuntimeWasSet_;
+
+        co2Message::SensorInfo sensorInfo_;
+        bool sensorInfoWasSet_;
 };
 
 #endif /* CO2PERSISTENTSTORE_H */
@@ -0,0 +1,201 @@
+/*
+ * co2Rollup.cpp
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/core.h>
+
+#include "co2LogSegment.h"
+#include "co2Rollup.h"
+
+Co2Rollup::Co2Rollup(ClosedBucketFn closedBucketFn) :
+    closedBucketFn_(closedBucketFn)
+{
+    memset(buckets_, 0, sizeof(buckets_));
+}
+
+Co2Rollup::~Co2Rollup()
+{
+}
+
+const char* Co2Rollup::resolutionStr(Resolution resolution)
+{
+    switch (resolution) {
+    case Minute:
+        return "1m";
+
+    case Hour:
+        return "1h";
+
+    case Day:
+        return "1d";
+
+    default:
+        return "??";
+    }
+}
+
+time_t Co2Rollup::bucketStart(Resolution resolution, time_t timestamp)
+{
+    time_t dayStart = Co2LogSegment::dayStart(timestamp);
+
+    switch (resolution) {
+    case Minute:
+        return dayStart + (((timestamp - dayStart) / 60) * 60);
+
+    case Hour:
+        return dayStart + (((timestamp - dayStart) / (60 * 60)) * (60 * 60));
+
+    default:
+        return dayStart;
+    }
+}
+
+std::string Co2Rollup::fileName(const std::string& logBaseDir, Resolution resolution, time_t startTime)
+{
+    struct tm tmStart;
+
+    if (!localtime_r(&startTime, &tmStart)) {
+        return std::string();
+    }
+
+    if (resolution == Day) {
+        return fmt::format("{}/{}/{}.{}",
+                           logBaseDir,
+                           CO2::zeroPadNumber(2, tmStart.tm_year + 1900),
+                           CO2::zeroPadNumber(2, tmStart.tm_mon + 1),
+                           resolutionStr(resolution));
+    }
+
+    return fmt::format("{}/{}/{}/{}.{}",
+                       logBaseDir,
+                       CO2::zeroPadNumber(2, tmStart.tm_year + 1900),
+                       CO2::zeroPadNumber(2, tmStart.tm_mon + 1),
+                       CO2::zeroPadNumber(2, tmStart.tm_mday),
+                       resolutionStr(resolution));
+}
+
+void Co2Rollup::addToChannel(Channel& channel, int value, bool isFirst)
+{
+    if (isFirst) {
+        channel.min = value;
+        channel.max = value;
+        channel.sum = value;
+    } else {
+        channel.min = std::min(channel.min, value);
+        channel.max = std::max(channel.max, value);
+        channel.sum += value;
+    }
+}
+
+void Co2Rollup::add(time_t timestamp, int temperature, int relHumidity, int co2, bool fanStateOn,
+                    const Co2FanRuntime::Counters& fanRuntime)
+{
+    for (int r = Minute; r < ResolutionCount; r++) {
+        Bucket& bucket = buckets_[r];
+        time_t startTime = bucketStart(Resolution(r), timestamp);
+
+        if (bucket.count && (bucket.startTime != startTime)) {
+            closedBucketFn_(Resolution(r), bucket);
+            bucket.count = 0;
+        }
+
+        bool isFirst = (bucket.count == 0);
+
+        if (isFirst) {
+            bucket.startTime = startTime;
+            bucket.fanOnCount = 0;
+            bucket.fanOnMsec = 0;
+            bucket.fanDutyMsec = 0;
+            bucket.fanSwitchCount = 0;
+        }
+
+        addToChannel(bucket.temperature, temperature, isFirst);
+        addToChannel(bucket.relHumidity, relHumidity, isFirst);
+        addToChannel(bucket.co2, co2, isFirst);
+
+        bucket.count++;
+        bucket.fanOnCount += fanStateOn ? 1 : 0;
+        bucket.fanOnMsec += uint32_t(fanRuntime.onMsec);
+        bucket.fanDutyMsec += uint32_t(fanRuntime.dutyMsec);
+        bucket.fanSwitchCount += fanRuntime.switchCount;
+    }
+}
+
+void Co2Rollup::flush()
+{
+    for (int r = Minute; r < ResolutionCount; r++) {
+        if (buckets_[r].count) {
+            closedBucketFn_(Resolution(r), buckets_[r]);
+            buckets_[r].count = 0;
+        }
+    }
+}
+
+void Co2Rollup::merge(Bucket& bucket, const Bucket& other)
+{
+    if (!other.count) {
+        return;
+    }
+
+    if (!bucket.count) {
+        bucket = other;
+        return;
+    }
+
+    auto mergeChannel = [](Channel& channel, const Channel& otherChannel) {
+        channel.min = std::min(channel.min, otherChannel.min);
+        channel.max = std::max(channel.max, otherChannel.max);
+        channel.sum += otherChannel.sum;
+    };
+
+    mergeChannel(bucket.temperature, other.temperature);
+    mergeChannel(bucket.relHumidity, other.relHumidity);
+    mergeChannel(bucket.co2, other.co2);
+
+    bucket.count += other.count;
+    bucket.fanOnCount += other.fanOnCount;
+    bucket.fanOnMsec += other.fanOnMsec;
+    bucket.fanDutyMsec += other.fanDutyMsec;
+    bucket.fanSwitchCount += other.fanSwitchCount;
+}
+
+size_t Co2Rollup::bucketSize(const Header& header)
+{
+    if ((header.magic != kMagic) || (header.headerSize != sizeof(Header))) {
+        return 0;
+    }
+
+    size_t size = 0;
+
+    if (header.schemaVersion == kSchemaVersion) {
+        size = sizeof(Bucket);
+    } else if (header.schemaVersion == kMinSchemaVersion) {
+        size = kSchema1BucketSize;
+    }
+
+    return (header.recordSize == size) ? size : 0;
+}
+
+void Co2Rollup::toBuckets(const Header& header, const void* data, size_t size, std::vector<Bucket>& buckets)
+{
+    size_t recordSize = bucketSize(header);
+
+    buckets.clear();
+
+    if (!recordSize) {
+        return;
+    }
+
+    buckets.resize(size / recordSize);
+
+    for (size_t i = 0; i < buckets.size(); i++) {
+        // older buckets are a prefix of the current one
+        memset(&buckets[i], 0, sizeof(Bucket));
+        memcpy(&buckets[i], static_cast<const char*>(data) + (i * recordSize), recordSize);
+    }
+}
@@ -0,0 +1,129 @@
+/*
+ * co2Rollup.h
+ *
+ * Created on: 2026-10-17
+ *     Author: patw
+ */
+
+#ifndef CO2ROLLUP_H
+#define CO2ROLLUP_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "co2FanRuntime.h"
+#include "utils.h"
+
+// Streaming min/max/mean/count of readings per minute, hour and day.
+//
+// Each reading is added to the open bucket for every resolution. Once a
+// reading falls into a later bucket, the open one is closed and handed to
+// the closed bucket function, e.g. to be appended to its rollup file:
+//
+//     logBaseDir/YYYY/MM/DD.1m    one bucket per minute
+//     logBaseDir/YYYY/MM/DD.1h    one bucket per hour
+//     logBaseDir/YYYY/MM.1d       one bucket per day
+//
+// A rollup file is a small header followed by fixed size buckets in time
+// order. Partly filled buckets are written when the monitor stops, so the
+// same bucket may appear twice in a row after a restart: readers merge
+// adjacent buckets with the same start time.
+//
+// Schema 1 buckets are the same without the fan runtime at the end, and
+// are read back with it zero.
+//
+class Co2Rollup
+{
+    public:
+        typedef enum {
+            Minute,
+            Hour,
+            Day,
+            ResolutionCount
+        } Resolution;
+
+        typedef struct {
+            int32_t min;
+            int32_t max;
+            int64_t sum;
+        } Channel;
+
+        typedef struct {
+            int64_t  startTime;   // seconds since epoch
+            uint32_t count;       // number of readings
+            uint32_t fanOnCount;  // number of readings with fan on
+            Channel  temperature; // 1/100 degrees C
+            Channel  relHumidity; // 1/100 %
+            Channel  co2;         // ppm
+            uint32_t fanOnMsec;       // timed with monotonic clock
+            uint32_t fanDutyMsec;     // on time weighted by duty cycle
+            uint32_t fanSwitchCount;  // times fan switched on
+            uint32_t reserved;
+        } Bucket;
+
+        typedef struct {
+            uint32_t magic;
+            uint16_t schemaVersion;
+            uint16_t headerSize;
+            uint16_t recordSize;
+            uint16_t resolution;  // Resolution
+            uint32_t reserved;
+        } Header;
+
+        static const uint32_t kMagic = 0x52324f43; // "CO2R"
+        static const uint16_t kSchemaVersion = 2;
+        static const uint16_t kMinSchemaVersion = 1;
+        static const uint16_t kSchema1BucketSize = 64;
+
+        typedef std::function<void(Resolution resolution, const Bucket& bucket)> ClosedBucketFn;
+
+        Co2Rollup(ClosedBucketFn closedBucketFn);
+
+        ~Co2Rollup();
+
+        // fanRuntime is what has been counted since the last reading
+        void add(time_t timestamp, int temperature, int relHumidity, int co2, bool fanStateOn,
+                 const Co2FanRuntime::Counters& fanRuntime);
+
+        // Closes all open buckets, even if they are only partly filled.
+        void flush();
+
+        static time_t bucketStart(Resolution resolution, time_t timestamp);
+
+        // Rollup file containing bucket starting at startTime.
+        static std::string fileName(const std::string& logBaseDir, Resolution resolution, time_t startTime);
+
+        static const char* resolutionStr(Resolution resolution);
+
+        static double mean(const Channel& channel, uint32_t count) {
+            return count ? double(channel.sum) / count : 0.0;
+        }
+
+        // Combines other into bucket, e.g. when reading back a bucket
+        // which was split by a restart.
+        static void merge(Bucket& bucket, const Bucket& other);
+
+        // Size of buckets in a rollup file with header, or 0 if header
+        // isn't valid or is an unknown schema.
+        static size_t bucketSize(const Header& header);
+
+        // Buckets from a rollup file's data following its header, of any
+        // supported schema.
+        static void toBuckets(const Header& header, const void* data, size_t size, std::vector<Bucket>& buckets);
+
+    private:
+        Co2Rollup();
+
+        static void addToChannel(Channel& channel, int value, bool isFirst);
+
+        ClosedBucketFn closedBucketFn_;
+        Bucket buckets_[ResolutionCount];
+
+    protected:
+};
+
+static_assert(sizeof(Co2Rollup::Bucket) == 80, "Co2Rollup::Bucket must be 80 bytes");
+static_assert(sizeof(Co2Rollup::Header) == 16, "Co2Rollup::Header must be 16 bytes");
+
+#endif /* CO2ROLLUP_H */
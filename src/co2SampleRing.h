@@ -0,0 +1,232 @@
+/*
+ * co2SampleRing.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2SAMPLERING_H
+#define CO2SAMPLERING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Fixed-size ring of the most recent fused samples, so threads in this
+// process can see recent history without asking for it over zmq.
+//
+// There is one writer (Co2Monitor), which never waits for readers: once
+// the ring is full each new sample overwrites the oldest. Readers never
+// write to the ring, so any number of them can read lock-free at the same
+// time, each with its own Cursor.
+//
+// Each slot is a seqlock on its own cache line. Its sequence is odd while
+// the slot is being written, then 2 * (sample number + 1), so a reader can
+// tell whether the sample it copied is the one it wanted and was not
+// overwritten while it was copying.
+//
+class Co2SampleRing
+{
+    public:
+        typedef struct {
+            int64_t timestamp;          // msec since epoch
+            int32_t co2;                // ppm
+            int32_t filterCo2;          // ppm
+            int32_t temperature;        // 1/100 C
+            int32_t relHumidity;        // 1/100 %
+            int32_t filterRelHumidity;  // 1/100 %
+            int32_t fanDuty;            // percent
+        } Sample;
+
+        // Where a reader has got to. overruns counts samples which were
+        // overwritten before this reader got to them.
+        typedef struct {
+            uint64_t next;
+            uint64_t overruns;
+        } Cursor;
+
+        // capacity is rounded up to a power of two
+        explicit Co2SampleRing(size_t capacity) :
+            capacity_(roundUpPow2(capacity)),
+            mask_(capacity_ - 1),
+            slots_(new Slot[capacity_])
+        {
+            for (size_t i = 0; i < capacity_; i++) {
+                slots_[i].seq.store(0, std::memory_order_relaxed);
+            }
+
+            writeCount_.store(0, std::memory_order_relaxed);
+        }
+
+        ~Co2SampleRing()
+        {
+            delete [] slots_;
+        }
+
+        size_t capacity() const
+        {
+            return capacity_;
+        }
+
+        // Samples pushed since the ring was created
+        uint64_t writeCount() const
+        {
+            return writeCount_.load(std::memory_order_acquire);
+        }
+
+        // Writer only.
+        void push(const Sample& sample)
+        {
+            uint64_t n = writeCount_.load(std::memory_order_relaxed);
+            Slot& slot = slots_[n & mask_];
+            uint64_t words[kSampleWords];
+
+            std::memcpy(words, &sample, sizeof(words));
+
+            slot.seq.store((2 * n) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for (size_t i = 0; i < kSampleWords; i++) {
+                slot.words[i].store(words[i], std::memory_order_relaxed);
+            }
+
+            slot.seq.store(2 * (n + 1), std::memory_order_release);
+            writeCount_.store(n + 1, std::memory_order_release);
+        }
+
+        // Cursor from which next() returns only samples pushed from now on
+        Cursor cursor() const
+        {
+            return { writeCount(), 0 };
+        }
+
+        // Copies the next sample after cursor, if there is one. If the
+        // writer has lapped this reader the cursor skips forward to the
+        // oldest sample still in the ring, and the skipped samples are
+        // added to cursor.overruns.
+        bool next(Cursor& cursor, Sample& sample) const
+        {
+            while (true) {
+                uint64_t written = writeCount();
+
+                if (cursor.next >= written) {
+                    return false;
+                }
+
+                uint64_t oldest = (written > capacity_) ? (written - capacity_) : 0;
+
+                if (cursor.next < oldest) {
+                    cursor.overruns += oldest - cursor.next;
+                    cursor.next = oldest;
+                }
+
+                if (read(cursor.next++, sample)) {
+                    return true;
+                }
+
+                // overwritten while it was being copied
+                cursor.overruns++;
+            }
+        }
+
+        // Copies the most recent sample. False if nothing has been pushed.
+        bool latest(Sample& sample) const
+        {
+            while (true) {
+                uint64_t written = writeCount();
+
+                if (written == 0) {
+                    return false;
+                }
+
+                if (read(written - 1, sample)) {
+                    return true;
+                }
+            }
+        }
+
+        // Copies up to maxSamples of the most recent samples, oldest
+        // first, and returns how many were copied.
+        size_t history(Sample samples[], size_t maxSamples) const
+        {
+            uint64_t written = writeCount();
+            uint64_t count = std::min<uint64_t>(std::min<uint64_t>(maxSamples, capacity_), written);
+            size_t copied = 0;
+
+            for (uint64_t n = written - count; n < written; n++) {
+                // any overwritten while being copied are the oldest, so are just left out
+                if (read(n, samples[copied])) {
+                    copied++;
+                }
+            }
+
+            return copied;
+        }
+
+    private:
+        Co2SampleRing();
+        Co2SampleRing(const Co2SampleRing& rhs);
+        Co2SampleRing& operator=(const Co2SampleRing& rhs);
+
+        static_assert(std::is_trivially_copyable<Sample>::value, "Sample must be trivially copyable");
+        static_assert((sizeof(Sample) % sizeof(uint64_t)) == 0, "Sample must be a whole number of words");
+
+        static const size_t kSampleWords = sizeof(Sample) / sizeof(uint64_t);
+        static const size_t kCacheLineSize = 64;
+
+        struct alignas(kCacheLineSize) Slot {
+            std::atomic<uint64_t> seq;
+            std::atomic<uint64_t> words[kSampleWords];
+        };
+
+        static size_t roundUpPow2(size_t n)
+        {
+            size_t pow2 = 1;
+
+            while (pow2 < n) {
+                pow2 <<= 1;
+            }
+
+            return pow2;
+        }
+
+        // Copies sample number n, if it is still in the ring
+        bool read(uint64_t n, Sample& sample) const
+        {
+            const Slot& slot = slots_[n & mask_];
+            uint64_t expectedSeq = 2 * (n + 1);
+            uint64_t words[kSampleWords];
+
+            if (slot.seq.load(std::memory_order_acquire) != expectedSeq) {
+                return false;
+            }
+
+            for (size_t i = 0; i < kSampleWords; i++) {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (slot.seq.load(std::memory_order_relaxed) != expectedSeq) {
+                return false;
+            }
+
+            std::memcpy(&sample, words, sizeof(sample));
+
+            return true;
+        }
+
+        const size_t capacity_;
+        const size_t mask_;
+        Slot* slots_;
+
+        // own cache line, so readers polling it don't slow the writer's slot stores
+        alignas(kCacheLineSize) std::atomic<uint64_t> writeCount_;
+
+    protected:
+};
+
+#endif /* CO2SAMPLERING_H */
@@ -0,0 +1,367 @@
+/*
+ * co2Scheduler.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <fmt/core.h>
+
+#include "co2Scheduler.h"
+
+static const int64_t kNsecPerSec = 1000000000LL;
+static const int64_t kNsecPerMsec = 1000000LL;
+static const int64_t kNsecPerUsec = 1000LL;
+
+static inline struct timespec toTimespec(int64_t nsec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = nsec / kNsecPerSec;
+    ts.tv_nsec = nsec % kNsecPerSec;
+
+    return ts;
+}
+
+Co2Scheduler::Co2Scheduler() :
+    epollFd_(-1),
+    eventFd_(-1),
+    taskCount_(0)
+{
+    shouldStop_.store(false, std::memory_order_relaxed);
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+
+    if (epollFd_ < 0) {
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot create epoll ({})", strerror(errno)), true);
+    }
+
+    eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (eventFd_ < 0) {
+        close(epollFd_);
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot create eventfd ({})", strerror(errno)), true);
+    }
+
+    // eventfd is tagged with kMaxTasks, timers with their TaskId
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = kMaxTasks;
+
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &ev) < 0) {
+        close(eventFd_);
+        close(epollFd_);
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot add eventfd ({})", strerror(errno)), true);
+    }
+}
+
+Co2Scheduler::~Co2Scheduler()
+{
+    for (int i = 0; i < taskCount_; i++) {
+        close(tasks_[i].timerFd);
+    }
+
+    close(eventFd_);
+    close(epollFd_);
+}
+
+int64_t Co2Scheduler::monotonicNsec()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t(ts.tv_sec) * kNsecPerSec) + ts.tv_nsec;
+}
+
+Co2Scheduler::TaskId Co2Scheduler::addTask(const std::string& name, std::chrono::microseconds period,
+                                           std::chrono::microseconds offset, TaskFn taskFn)
+{
+    if (taskCount_ >= kMaxTasks) {
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - too many tasks adding \"{}\"", name), true);
+    }
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (timerFd < 0) {
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot create timer for \"{}\" ({})", name, strerror(errno)), true);
+    }
+
+    TaskId taskId = taskCount_;
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.u32 = taskId;
+
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, timerFd, &ev) < 0) {
+        close(timerFd);
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot add timer for \"{}\" ({})", name, strerror(errno)), true);
+    }
+
+    Task& task = tasks_[taskId];
+
+    task.name = name;
+    task.timerFd = timerFd;
+    task.periodNsec.store(period.count() * kNsecPerUsec, std::memory_order_relaxed);
+    task.offsetNsec = offset.count() * kNsecPerUsec;
+    task.dueNsec.store(0, std::memory_order_relaxed);
+    task.taskFn = taskFn;
+    task.isTriggered.store(false, std::memory_order_relaxed);
+    task.overrunLogNsec = 0;
+    memset(&task.stats, 0, sizeof(task.stats));
+
+    taskCount_.store(taskId + 1, std::memory_order_release);
+
+    return taskId;
+}
+
+void Co2Scheduler::setPeriod(TaskId taskId, std::chrono::microseconds period, std::chrono::microseconds offset)
+{
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    tasks_[taskId].periodNsec.store(period.count() * kNsecPerUsec, std::memory_order_relaxed);
+    tasks_[taskId].offsetNsec = offset.count() * kNsecPerUsec;
+}
+
+void Co2Scheduler::changePeriod(TaskId taskId, std::chrono::microseconds period,
+                                std::chrono::steady_clock::time_point nextDue)
+{
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire)) || (period.count() <= 0)) {
+        return;
+    }
+
+    Task& task = tasks_[taskId];
+
+    // steady_clock is CLOCK_MONOTONIC, so its times can be used as they are
+    int64_t periodNsec = period.count() * kNsecPerUsec;
+    int64_t dueNsec = std::chrono::duration_cast<std::chrono::nanoseconds>(nextDue.time_since_epoch()).count();
+
+    // A due time already gone would make the timer fire straight away
+    // and then count every period since as an overrun.
+    dueNsec = std::max(dueNsec, monotonicNsec() + 1);
+
+    task.periodNsec.store(periodNsec, std::memory_order_relaxed);
+    task.dueNsec.store(dueNsec, std::memory_order_relaxed);
+    setTimer(task, dueNsec, periodNsec, TFD_TIMER_ABSTIME);
+}
+
+void Co2Scheduler::setTimer(Task& task, int64_t expiryNsec, int64_t periodNsec, int flags)
+{
+    struct itimerspec its;
+
+    its.it_value = toTimespec(expiryNsec);
+    its.it_interval = toTimespec(periodNsec);
+
+    if (timerfd_settime(task.timerFd, flags, &its, nullptr) < 0) {
+        throw CO2::exceptionLevel(fmt::format("Co2Scheduler - cannot set timer for \"{}\" ({})", task.name, strerror(errno)), false);
+    }
+}
+
+void Co2Scheduler::schedule(TaskId taskId, std::chrono::milliseconds delay)
+{
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    Task& task = tasks_[taskId];
+
+    // A zero it_value would disarm the timer
+    int64_t expiryNsec = monotonicNsec() + std::max<int64_t>(delay.count() * kNsecPerMsec, 1);
+
+    task.dueNsec.store(expiryNsec, std::memory_order_relaxed);
+    setTimer(task, expiryNsec, 0, TFD_TIMER_ABSTIME);
+}
+
+void Co2Scheduler::cancel(TaskId taskId)
+{
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    setTimer(tasks_[taskId], 0, 0, 0);
+}
+
+void Co2Scheduler::trigger(TaskId taskId)
+{
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    tasks_[taskId].isTriggered.store(true, std::memory_order_release);
+
+    uint64_t one = 1;
+
+    if (write(eventFd_, &one, sizeof(one)) < 0) {
+        syslog(LOG_ERR, "Co2Scheduler - cannot trigger \"%s\" (%s)", tasks_[taskId].name.c_str(), strerror(errno));
+    }
+}
+
+void Co2Scheduler::stop()
+{
+    shouldStop_.store(true, std::memory_order_release);
+
+    uint64_t one = 1;
+
+    if (write(eventFd_, &one, sizeof(one)) < 0) {
+        syslog(LOG_ERR, "Co2Scheduler - cannot stop (%s)", strerror(errno));
+    }
+}
+
+void Co2Scheduler::runTask(Task& task)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    task.taskFn();
+
+    uint64_t runUsec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    task.stats.runCount++;
+    task.stats.lastRunUsec = runUsec;
+
+    if (runUsec > task.stats.maxRunUsec) {
+        task.stats.maxRunUsec = runUsec;
+    }
+}
+
+// False if the timer hadn't expired after all, so the task wasn't run
+bool Co2Scheduler::expireTask(Task& task, int64_t timeNowNsec)
+{
+    uint64_t expirations = 0;
+
+    if (read(task.timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        // EAGAIN if timer was re-armed or cancelled since epoll_wait()
+        return false;
+    }
+
+    int64_t dueNsec = task.dueNsec.load(std::memory_order_relaxed);
+    uint64_t lateUsec = (timeNowNsec > dueNsec) ? (timeNowNsec - dueNsec) / 1000 : 0;
+
+    // At high rates an overloaded task could overrun on every run,
+    // so don't log more than once a second. All are counted.
+    if ((expirations > 1) && ((timeNowNsec - task.overrunLogNsec) >= kNsecPerSec)) {
+        task.overrunLogNsec = timeNowNsec;
+        syslog(LOG_WARNING, "Co2Scheduler - \"%s\" overrun: missed %llu run(s) (last run took %lluus)",
+               task.name.c_str(), (unsigned long long)(expirations - 1), (unsigned long long)task.stats.lastRunUsec);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        task.stats.overrunCount += expirations - 1;
+
+        if (lateUsec > task.stats.maxLateUsec) {
+            task.stats.maxLateUsec = lateUsec;
+        }
+    }
+
+    // Skip missed runs, so the task is next due on its original schedule
+    task.dueNsec.store(dueNsec + (task.periodNsec.load(std::memory_order_relaxed) * expirations), std::memory_order_relaxed);
+
+    runTask(task);
+
+    return true;
+}
+
+void Co2Scheduler::run()
+{
+    int64_t startNsec = monotonicNsec();
+
+    for (int i = 0; i < taskCount_; i++) {
+        Task& task = tasks_[i];
+
+        int64_t periodNsec = task.periodNsec.load(std::memory_order_relaxed);
+
+        if (periodNsec > 0) {
+            int64_t dueNsec = startNsec + std::max<int64_t>(task.offsetNsec, 1);
+
+            task.dueNsec.store(dueNsec, std::memory_order_relaxed);
+            setTimer(task, dueNsec, periodNsec, TFD_TIMER_ABSTIME);
+        }
+    }
+
+    struct epoll_event events[kMaxTasks + 1];
+
+    while (!shouldStop_.load(std::memory_order_acquire)) {
+        int nEvents = epoll_wait(epollFd_, events, kMaxTasks + 1, -1);
+
+        if (nEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("Co2Scheduler - epoll_wait ({})", strerror(errno)), true);
+        }
+
+        // Run due tasks in the order they were added, whatever order
+        // epoll reports them in.
+        bool isDue[kMaxTasks + 1] = { false };
+
+        for (int e = 0; e < nEvents; e++) {
+            isDue[events[e].data.u32] = true;
+        }
+
+        if (isDue[kMaxTasks]) {
+            uint64_t count;
+
+            if ((read(eventFd_, &count, sizeof(count)) < 0) && (errno != EAGAIN)) {
+                syslog(LOG_ERR, "Co2Scheduler - eventfd read (%s)", strerror(errno));
+            }
+        }
+
+        int64_t timeNowNsec = monotonicNsec();
+
+        for (int i = 0; (i < taskCount_) && !shouldStop_.load(std::memory_order_acquire); i++) {
+            Task& task = tasks_[i];
+
+            bool isTriggered = task.isTriggered.exchange(false, std::memory_order_acquire);
+            bool hasRun = isDue[i] && expireTask(task, timeNowNsec);
+
+            // a trigger still runs the task if its timer turned out not to have expired
+            if (isTriggered && !hasRun) {
+                {
+                    std::lock_guard<std::mutex> lock(statsMutex_);
+                    task.stats.triggerCount++;
+                }
+
+                runTask(task);
+            }
+        }
+    }
+
+    for (int i = 0; i < taskCount_; i++) {
+        setTimer(tasks_[i], 0, 0, 0);
+    }
+}
+
+Co2Scheduler::TaskStats Co2Scheduler::stats(TaskId taskId)
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+
+    if ((taskId < 0) || (taskId >= taskCount_.load(std::memory_order_acquire))) {
+        TaskStats noStats;
+        memset(&noStats, 0, sizeof(noStats));
+        return noStats;
+    }
+
+    return tasks_[taskId].stats;
+}
+
+void Co2Scheduler::logStats(int priority)
+{
+    for (int i = 0; i < taskCount_; i++) {
+        TaskStats s = stats(i);
+
+        syslog(priority, "Co2Scheduler \"%s\": runs=%llu triggered=%llu overruns=%llu  run time last=%lluus max=%lluus  max late=%lluus",
+               tasks_[i].name.c_str(), (unsigned long long)s.runCount, (unsigned long long)s.triggerCount,
+               (unsigned long long)s.overrunCount, (unsigned long long)s.lastRunUsec, (unsigned long long)s.maxRunUsec,
+               (unsigned long long)s.maxLateUsec);
+    }
+}
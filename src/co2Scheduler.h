@@ -0,0 +1,116 @@
+/*
+ * co2Scheduler.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2SCHEDULER_H
+#define CO2SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "utils.h"
+
+// Runs periodic and one-shot tasks in the calling thread.
+//
+// Each task has its own CLOCK_MONOTONIC timerfd. Periodic timers are armed
+// with absolute expiry times, so time spent in a task (e.g. sensor I/O)
+// doesn't make the schedule drift, and the thread only wakes when a task is
+// due. If a task is still running when it next falls due, the missed runs
+// are counted and reported as an overrun rather than queued up.
+//
+// schedule(), cancel(), trigger() and stop() may be called from any thread.
+// Tasks themselves only ever run in the thread which calls run().
+//
+class Co2Scheduler
+{
+    public:
+        typedef std::function<void()> TaskFn;
+        typedef int TaskId;
+
+        typedef struct {
+            uint64_t runCount;
+            uint64_t triggerCount;  // runs requested by trigger()
+            uint64_t overrunCount;  // scheduled runs missed
+            uint64_t lastRunUsec;
+            uint64_t maxRunUsec;
+            uint64_t maxLateUsec;   // longest wait beyond due time
+        } TaskStats;
+
+        Co2Scheduler();
+
+        ~Co2Scheduler();
+
+        // A period of 0 adds a one-shot task which only runs after
+        // schedule() or trigger(). Otherwise the task first runs offset
+        // after run() is called and every period after that.
+        // Tasks must be added before run() is called, and by one thread.
+        TaskId addTask(const std::string& name, std::chrono::microseconds period,
+                       std::chrono::microseconds offset, TaskFn taskFn);
+
+        // Changes the period and offset of a task, e.g. once config is
+        // known. Only before run() is called.
+        void setPeriod(TaskId taskId, std::chrono::microseconds period, std::chrono::microseconds offset);
+
+        // Changes the period of a periodic task while running, so that it
+        // next runs at nextDue and every period after that. nextDue lets
+        // tasks in different schedulers keep in step with each other.
+        void changePeriod(TaskId taskId, std::chrono::microseconds period,
+                          std::chrono::steady_clock::time_point nextDue);
+
+        // Runs a one-shot task delay from now, replacing any earlier schedule().
+        void schedule(TaskId taskId, std::chrono::milliseconds delay);
+        void cancel(TaskId taskId);
+
+        // Runs task as soon as possible, without affecting its schedule.
+        void trigger(TaskId taskId);
+
+        // Runs tasks until stop() is called. Exceptions thrown by
+        // tasks are passed on to the caller.
+        void run();
+        void stop();
+
+        TaskStats stats(TaskId taskId);
+        void logStats(int priority);
+
+    private:
+        Co2Scheduler& operator=(const Co2Scheduler& rhs);
+        Co2Scheduler(const Co2Scheduler& rhs);
+
+        typedef struct {
+            std::string name;
+            int timerFd;
+            std::atomic<int64_t> periodNsec;
+            int64_t offsetNsec;
+            std::atomic<int64_t> dueNsec; // monotonic time task is next due
+            TaskFn taskFn;
+            std::atomic<bool> isTriggered;
+            int64_t overrunLogNsec;       // when overrun was last logged
+            TaskStats stats;
+        } Task;
+
+        bool expireTask(Task& task, int64_t timeNowNsec);
+        void runTask(Task& task);
+        void setTimer(Task& task, int64_t expiryNsec, int64_t periodNsec, int flags);
+
+        static int64_t monotonicNsec();
+
+        // Co2Monitor has a handful of tasks
+        static const int kMaxTasks = 8;
+
+        int epollFd_;
+        int eventFd_;
+        Task tasks_[kMaxTasks];
+        std::atomic<int> taskCount_;
+        std::atomic<bool> shouldStop_;
+        std::mutex statsMutex_;
+
+    protected:
+};
+
+#endif /* CO2SCHEDULER_H */
@@ -106,9 +106,12 @@ class StatusScreen: public Co2Screen
             Co2Text_2,
             Co2Value,
             Co2UnitText,
+            Co2Rising,
+            Co2Falling,
             FanOverrideAutoText,
             FanOverrideManText,
             FanManOnCountdown,
+            FanDutyText,
             FanOnFirst,
             FanOnLast = FanOnFirst + FanOnImages - 1,
             FanOff,
@@ -130,8 +133,10 @@ class StatusScreen: public Co2Screen
         void setTemperature(int temperature);
         void setRelHumidity(int relHumidity);
         void setCo2(int co2);
+        void setCo2Trend(int trend);
         void setFanState(bool isOn);
         void setFanAuto(bool isAuto);
+        void setFanDuty(int duty);
         void startFanManOnTimer(time_t duration);
         void stopFanManOnTimer();
         void setWiFiState(bool isOn);
@@ -140,14 +145,18 @@ class StatusScreen: public Co2Screen
     private:
 
         void updateFanManOnCountdown();
+        void updateFanDutyText();
 
         bool temperatureChanged_;
         bool relHumChanged_;
         bool co2Changed_;
+        int co2Trend_;     // 1 rising, -1 falling, 0 steady
         bool fanStateOn_;
         bool fanStateChanged_;
         bool fanAuto_;
         bool fanAutoChanged_;
+        int fanDuty_;
+        bool fanDutyChanged_;
         time_t fanManOnEndTime_;
         bool wifiStateOn_;
         bool wifiStateChanged_;
@@ -8,6 +8,8 @@
 #ifndef CO2SENSOR_H
 #define CO2SENSOR_H
 
+#include <chrono>
+
 #include "utils.h"
 
 class Co2Sensor
@@ -23,6 +25,24 @@ class Co2Sensor
         virtual void readMeasurements(int& co2ppm, int& temperature, int& relHumidity) {};
         virtual void readMeasurements(float& co2ppm, float& temperature, float& relHumidity) {};
 
+        // Logs any I/O statistics the sensor keeps
+        virtual void logStats(int priority) {};
+
+        // Where a sensor was found, so it can be looked for there first
+        // next time.
+        typedef struct {
+            int i2cBus;             // -1 if unknown
+            int i2cAddress;
+            int firmwareRevision;   // (major << 8) | minor, or -1 if unknown
+        } Location;
+
+        // False for sensors which aren't looked for, e.g. on a serial port
+        virtual bool location(Location& location) { return false; };
+
+        // How often readMeasurements() will now be called, for sensors
+        // which measure on their own schedule.
+        virtual void setSampleInterval(std::chrono::seconds interval) {};
+
     private:
 
     protected:
@@ -0,0 +1,61 @@
+/*
+ * co2SensorFactory.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <fmt/core.h>
+
+#include "co2SensorFactory.h"
+
+std::map<std::string, Co2SensorFactory::CreateFn>& Co2SensorFactory::registry()
+{
+    static std::map<std::string, CreateFn> drivers;
+
+    return drivers;
+}
+
+Co2SensorFactory::Registrar::Registrar(const std::string& sensorType, CreateFn createFn)
+{
+    registry()[sensorType] = createFn;
+}
+
+Co2Sensor* Co2SensorFactory::create(const std::string& sensorType, const SensorParams& params)
+{
+    auto it = registry().find(sensorType);
+
+    if (it == registry().end()) {
+        std::string knownTypes;
+
+        for (auto& type : sensorTypes()) {
+            knownTypes += knownTypes.empty() ? type : ", " + type;
+        }
+
+        throw CO2::exceptionLevel(fmt::format("Unknown CO2 sensor type \"{}\" (known types: {})", sensorType, knownTypes), true);
+    }
+
+    Co2Sensor* co2Sensor = it->second(params);
+
+    if (!co2Sensor) {
+        throw CO2::exceptionLevel(fmt::format("Unable to create {} sensor", sensorType), true);
+    }
+
+    return co2Sensor;
+}
+
+bool Co2SensorFactory::isRegistered(const std::string& sensorType)
+{
+    return registry().find(sensorType) != registry().end();
+}
+
+std::vector<std::string> Co2SensorFactory::sensorTypes()
+{
+    std::vector<std::string> types;
+
+    for (auto& driver : registry()) {
+        types.push_back(driver.first);
+    }
+
+    return types;
+}
@@ -0,0 +1,64 @@
+/*
+ * co2SensorFactory.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2SENSORFACTORY_H
+#define CO2SENSORFACTORY_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "co2Sensor.h"
+
+// Creates CO2 sensor drivers by name ("K30", "SCD30", "sim", ...).
+//
+// Each driver registers itself with a static Registrar in its own .cpp
+// file, so adding a driver doesn't mean touching Co2Monitor:
+//
+//   static Co2SensorFactory::Registrar registrar("K30", [](const Co2SensorFactory::SensorParams& params) {
+//       return new Co2SensorK30(params.port);
+//   });
+//
+class Co2SensorFactory
+{
+    public:
+        typedef struct {
+            std::string port;         // serial port, "I2C", log dir for replay, etc.
+            int scd30RdyGpio;         // -1 if not connected
+            std::string replayStart;  // see Co2SensorReplay
+            std::string replayEnd;
+            int replaySpeed;
+            Co2Sensor::Location lastLocation;  // where sensor was found last time, if i2cBus >= 0
+        } SensorParams;
+
+        typedef std::function<Co2Sensor*(const SensorParams& params)> CreateFn;
+
+        class Registrar
+        {
+            public:
+                Registrar(const std::string& sensorType, CreateFn createFn);
+        };
+
+        // Throws a fatal exceptionLevel for an unknown sensor type,
+        // or if the driver cannot be created.
+        static Co2Sensor* create(const std::string& sensorType, const SensorParams& params);
+
+        static bool isRegistered(const std::string& sensorType);
+        static std::vector<std::string> sensorTypes();
+
+    private:
+        Co2SensorFactory();
+
+        // Registrars run during static initialisation, so the
+        // registry must be constructed on first use.
+        static std::map<std::string, CreateFn>& registry();
+
+    protected:
+};
+
+#endif /* CO2SENSORFACTORY_H */
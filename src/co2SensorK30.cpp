@@ -10,22 +10,54 @@
 #include <fcntl.h>
 #include <fmt/core.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 
 #include "co2SensorK30.h"
+#include "co2SensorFactory.h"
+#include "checksum.h"
 
-Co2SensorK30::Co2SensorK30(std::string co2Device) : timeoutMs_(100)
+static Co2SensorFactory::Registrar registrar("K30", [](const Co2SensorFactory::SensorParams& params) -> Co2Sensor* {
+    if (params.port.empty()) {
+        throw CO2::exceptionLevel("No sensor port configured for K30 sensor", true);
+    }
+
+    return new Co2SensorK30(params.port);
+});
+
+Co2SensorK30::Co2SensorK30(std::string co2Device) :
+    epollFd_(-1),
+    timeoutMs_(200),
+    readAllState_(ReadAllUntried),
+    readAllFailures_(0)
 {
-    sensorFileDesc_ = open(co2Device.c_str(), O_RDWR | O_NDELAY | O_NOCTTY);
+    memset(stats_, 0, sizeof(stats_));
 
-    if (sensorFileDesc_ >= 0) {
-        /* Cancel the O_NDELAY flag. */
-        int flag = fcntl(sensorFileDesc_, F_GETFL, 0);
-        fcntl(sensorFileDesc_, F_SETFL, flag & ~O_NDELAY);
-    } else {
+    // Port stays non-blocking: replies are read as they arrive
+    sensorFileDesc_ = open(co2Device.c_str(), O_RDWR | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+
+    if (sensorFileDesc_ < 0) {
         syslog(LOG_ERR, "Cannot open CO2 port: \"%s\"", co2Device.c_str());
         throw CO2::exceptionLevel("Error opening CO2 port", true);
     }
 
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = sensorFileDesc_;
+
+    if ((epollFd_ < 0) || (epoll_ctl(epollFd_, EPOLL_CTL_ADD, sensorFileDesc_, &ev) < 0)) {
+        syslog(LOG_ERR, "Cannot poll CO2 port: \"%s\" (%s)", co2Device.c_str(), strerror(errno));
+
+        if (epollFd_ >= 0) {
+            close(epollFd_);
+        }
+
+        close(sensorFileDesc_);
+        throw CO2::exceptionLevel("Error polling CO2 port", true);
+    }
+
     serialPort = new SerialPort(sensorFileDesc_);
 
     if (isatty(sensorFileDesc_)) {
@@ -37,6 +69,8 @@ Co2SensorK30::~Co2SensorK30()
 {
     delete serialPort;
 
+    close(epollFd_);
+
     if (close(sensorFileDesc_) < 0) {
         if (errno == EINTR) {
             // we were interrupted by a signal, so try again
@@ -49,29 +83,12 @@ Co2SensorK30::~Co2SensorK30()
 
 int Co2SensorK30::checkCrc16(uint8_t* byteArray, int size)
 {
-    int i, j;
-    uint16_t crc16 = 0xffff;
-    const uint16_t polyVal = 0xa001;
-    uint16_t crc16Actual;
-
     if (size < 2) {
         return EXIT_FAILURE;
     }
 
-    crc16Actual = ((byteArray[size - 1] & 0xff) << 8) | (byteArray[size - 2] & 0xff);
-
-    for (i = 0; i < (size - 2); i++) {
-        crc16 ^= byteArray[i] & 0xff;
-
-        for (j = 0; j < 8; j++) {
-            if (crc16 & 1) {
-                crc16 >>= 1;
-                crc16 ^= polyVal;
-            } else {
-                crc16 >>= 1;
-            }
-        }
-    }
+    uint16_t crc16Actual = ((byteArray[size - 1] & 0xff) << 8) | (byteArray[size - 2] & 0xff);
+    uint16_t crc16 = Checksum::crc16Modbus(byteArray, size - 2);
 
     if (crc16 != crc16Actual) {
         syslog(LOG_ERR, "CRC16 act=%#4x  exp=%#4x\n", crc16Actual, crc16);
@@ -81,57 +98,122 @@ int Co2SensorK30::checkCrc16(uint8_t* byteArray, int size)
     return EXIT_SUCCESS;
 }
 
-/* Check if there is IO pending. */
-int Co2SensorK30::co2CheckIo(uint8_t* buf, int bufsize, int* bytes_read)
+void Co2SensorK30::discardInput()
+{
+    uint8_t buf[64];
+
+    // Anything already waiting is stale, e.g. the tail of a reply which
+    // arrived after we gave up on it.
+    while (read(sensorFileDesc_, buf, sizeof(buf)) > 0) {
+    }
+}
+
+void Co2SensorK30::awaitReply(Co2SensorK30::Co2CmdType cmd, uint8_t* reply, std::chrono::steady_clock::time_point deadline)
 {
-    int n = 0, i;
-    struct timeval tv;
-    fd_set fds;
+    const Co2CmdReply& cmdReply = co2CmdReply[cmd];
+    int replyBytes = 0;
 
-    tv.tv_sec = timeoutMs_ / 1000;
-    tv.tv_usec = (timeoutMs_ % 1000) * 1000L;
+    while (replyBytes < cmdReply.replyLen) {
+        auto remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
 
-    i = sensorFileDesc_;
+        if (remainingMs <= 0) {
+            stats_[cmd].timeouts++;
+            throw CO2::exceptionLevel(fmt::format("timeout reading from serial port ({}/{})",
+                                                  replyBytes, cmdReply.replyLen), false);
+        }
+
+        struct epoll_event ev;
+        int nEvents = epoll_wait(epollFd_, &ev, 1, static_cast<int>(remainingMs));
+
+        if (nEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("error polling serial port ({})", strerror(errno)), false);
+        } else if (nEvents == 0) {
+            continue;
+        }
 
-    FD_ZERO(&fds);
+        ssize_t n = read(sensorFileDesc_, reply + replyBytes, cmdReply.replyLen - replyBytes);
 
-    if (sensorFileDesc_ >= 0) {
-        FD_SET(sensorFileDesc_, &fds);
-    } else {
-        sensorFileDesc_ = 0;
+        if (n < 0) {
+            if ((errno == EAGAIN) || (errno == EINTR)) {
+                continue;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("error reading from serial port ({})", strerror(errno)), false);
+        } else if (n == 0) {
+            throw CO2::exceptionLevel("serial port closed", false);
+        }
+
+        replyBytes += n;
+
+        // Check the frame as soon as we have its address and function code,
+        // so that an exception reply (function code | 0x80, exception code
+        // and CRC) doesn't have to wait for the timeout.
+        if ((replyBytes >= 5) && (reply[0] == cmdReply.cmd[0]) && (reply[1] == (cmdReply.cmd[1] | 0x80))) {
+            stats_[cmd].exceptions++;
+            throw CO2::exceptionLevel(fmt::format("exception reply [{:#04x}]", reply[2]), false);
+        } else if ((replyBytes >= 2) &&
+                   ((reply[0] != cmdReply.cmd[0]) || ((reply[1] != cmdReply.cmd[1]) && (reply[1] != (cmdReply.cmd[1] | 0x80))))) {
+            throw CO2::exceptionLevel(fmt::format("error in reply [{:#04x} {:#04x}]",
+                                                  reply[0], reply[1]), false);
+        }
     }
 
-    if (select(i + 1, &fds, NULL, NULL, &tv) > 0) {
-        n = (FD_ISSET(sensorFileDesc_, &fds) > 0);
+    if (checkCrc16(reply, cmdReply.replyLen)) {
+        throw CO2::exceptionLevel("bad CRC", false);
     }
+}
 
-    /* If there is data put it in the co2Buffer. */
-    if (buf) {
-        i = 0;
+void Co2SensorK30::transact(Co2SensorK30::Co2CmdType cmd, uint8_t* reply)
+{
+    const Co2CmdReply& cmdReply = co2CmdReply[cmd];
+    TransactionStats& stats = stats_[cmd];
 
-        if ((n & 1) == 1) {
-            i = read(sensorFileDesc_, buf, bufsize);
-        }
+    discardInput();
 
-        buf[i > 0 ? i : 0] = 0;
+    auto startTime = std::chrono::steady_clock::now();
 
-        if (bytes_read) {
-            *bytes_read = i;
+    try {
+        int n = write(sensorFileDesc_, cmdReply.cmd, cmdReply.cmdLen);
+
+        if (n != cmdReply.cmdLen) {
+            throw CO2::exceptionLevel(fmt::format("error writing to serial port ({}/{})",
+                                                  n, cmdReply.cmdLen), false);
         }
+
+        awaitReply(cmd, reply, startTime + std::chrono::milliseconds(timeoutMs_));
+    } catch (...) {
+        stats.count++;
+        stats.errors++;
+        throw;
+    }
+
+    uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    if ((stats.count == stats.errors) || (usec < stats.minUsec)) {
+        stats.minUsec = usec;
+    }
+
+    if (usec > stats.maxUsec) {
+        stats.maxUsec = usec;
     }
 
-    return n;
+    stats.count++;
+    stats.lastUsec = usec;
+    stats.totalUsec += usec;
+
+    DBG_MSG(LOG_DEBUG, "K30 command %#04x @%#04x: %d byte reply in %lluus",
+            cmdReply.cmd[1], cmdReply.cmd[3], cmdReply.replyLen, (unsigned long long)usec);
 }
 
 void Co2SensorK30::init()
 {
-    int n;
-    uint8_t reply[100];
     uint32_t val;
 
     try {
-        // flush anything ingressed on serial port
-        (void)co2CheckIo(reply, sizeof(reply), &n);
         sendCmd(INITIATE, &val);
     } catch (CO2::exceptionLevel& el) {
         throw CO2::exceptionLevel(fmt::format("{}:{} - Error sending INITIATE to CO2 sensor ({})", __FUNCTION__, __LINE__, el.what()), el.isFatal());
@@ -145,36 +227,11 @@ void Co2SensorK30::init()
 
 void Co2SensorK30::sendCmd(Co2SensorK30::Co2CmdType cmd, uint32_t* pVal)
 {
-    uint8_t reply[100];
+    uint8_t reply[kMaxReplyLen];
 
     *pVal = 0;
 
-    int n = write(sensorFileDesc_, co2CmdReply[cmd].cmd, co2CmdReply[cmd].cmdLen);
-
-    if (n != co2CmdReply[cmd].cmdLen) {
-        throw CO2::exceptionLevel(fmt::format("error writing to serial port ({}/{})",
-                                              n, co2CmdReply[cmd].cmdLen), false);
-    }
-
-    // give co2 sensor time to reply
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-    co2CheckIo(reply, co2CmdReply[cmd].replyLen, &n);
-
-    if (n != co2CmdReply[cmd].replyLen) {
-        throw CO2::exceptionLevel(fmt::format("error reading from serial port ({}/{})",
-                                              n, co2CmdReply[cmd].cmdLen), false);
-    }
-
-    if ( (reply[0] != co2CmdReply[cmd].cmd[0]) ||
-            (reply[1] != co2CmdReply[cmd].cmd[1]) ) {
-        throw CO2::exceptionLevel(fmt::format("error in reply [{:#04x} {:#04x}]",
-                                              reply[0], reply[1]), false);
-    }
-
-    if (checkCrc16(reply, co2CmdReply[cmd].replyLen)) {
-        throw CO2::exceptionLevel("bad CRC", false);
-    }
+    transact(cmd, reply);
 
     if (co2CmdReply[cmd].replySize) {
         int i;
@@ -215,6 +272,16 @@ int Co2SensorK30::readRelHumidity()
     return static_cast<int>(rh & 0xffff);
 }
 
+int Co2SensorK30::co2ppmFromReply(uint32_t co2ppm)
+{
+    if ((co2ppm & 0x7fff) == 0x7fff) {
+        // need to reset sensor
+        throw CO2::exceptionLevel(fmt::format("{}:{} - bad CO2 sensor reading", __FUNCTION__, __LINE__), false);
+    }
+
+    return static_cast<int>(co2ppm & 0xffff);
+}
+
 int Co2SensorK30::readCo2ppm()
 {
     uint32_t co2ppm;
@@ -227,16 +294,46 @@ int Co2SensorK30::readCo2ppm()
         throw;
     }
 
-    if ((co2ppm & 0x7fff) == 0x7fff) {
-        // need to reset sensor
-        throw CO2::exceptionLevel(fmt::format("{}:{} - bad CO2 sensor reading", __FUNCTION__, __LINE__), false);
+    return co2ppmFromReply(co2ppm);
+}
+
+bool Co2SensorK30::readAll(int& co2ppm, int& temperature, int& relHumidity)
+{
+    uint8_t reply[kMaxReplyLen];
+    uint64_t exceptions = stats_[READ_ALL].exceptions;
+
+    try {
+        transact(READ_ALL, reply);
+    } catch (CO2::exceptionLevel& el) {
+        // Not all K30 firmware will read this much RAM at once, which
+        // it says with an exception reply. Anything else (timeout, noise,
+        // sensor still warming up) is tried again on the next sample
+        // unless it keeps on failing.
+        if ((readAllState_ == ReadAllUntried) &&
+            ((stats_[READ_ALL].exceptions != exceptions) || (++readAllFailures_ >= kMaxReadAllFailures))) {
+            syslog(LOG_WARNING, "K30 multi-register read failed (%s) - reading registers separately", el.what());
+            readAllState_ = ReadAllUnsupported;
+            return false;
+        }
+
+        throw CO2::exceptionLevel(fmt::format("{}:{} - {}", __FUNCTION__, __LINE__, el.what()), el.isFatal());
     }
 
-    return static_cast<int>(co2ppm & 0xffff);
+    readAllState_ = ReadAllSupported;
+
+    co2ppm = co2ppmFromReply((reply[kReadAllCo2Pos] << 8) | reply[kReadAllCo2Pos + 1]);
+    temperature = (reply[kReadAllTempPos] << 8) | reply[kReadAllTempPos + 1];
+    relHumidity = (reply[kReadAllRhPos] << 8) | reply[kReadAllRhPos + 1];
+
+    return true;
 }
 
 void Co2SensorK30::readMeasurements(int& co2ppm, int& temperature, int& relHumidity)
 {
+    if ((readAllState_ != ReadAllUnsupported) && readAll(co2ppm, temperature, relHumidity)) {
+        return;
+    }
+
     co2ppm = this->readCo2ppm();
     temperature = this->readTemperature();
     relHumidity = this->readRelHumidity();
@@ -244,8 +341,33 @@ void Co2SensorK30::readMeasurements(int& co2ppm, int& temperature, int& relHumid
 
 void Co2SensorK30::readMeasurements(float& co2ppm, float& temperature, float& relHumidity)
 {
-    co2ppm = this->readCo2ppm() * 1.0;
-    temperature = (this->readTemperature() * 1.0) / 100.0;
-    relHumidity = (this->readRelHumidity() * 1.0) / 100.0;
+    int co2;
+    int t;
+    int rh;
+
+    readMeasurements(co2, t, rh);
+
+    co2ppm = co2 * 1.0;
+    temperature = (t * 1.0) / 100.0;
+    relHumidity = (rh * 1.0) / 100.0;
 }
 
+void Co2SensorK30::logStats(int priority)
+{
+    static const char* cmdStr[CO2_CMD_MAX] = { "initiate", "read CO2", "read temp", "read RH", "read all" };
+
+    for (int cmd = 0; cmd < CO2_CMD_MAX; cmd++) {
+        const TransactionStats& s = stats_[cmd];
+        uint64_t okCount = s.count - s.errors;
+
+        if (!s.count) {
+            continue;
+        }
+
+        syslog(priority, "K30 %s: transactions=%llu errors=%llu timeouts=%llu exceptions=%llu  latency last=%lluus min=%lluus max=%lluus mean=%lluus",
+               cmdStr[cmd], (unsigned long long)s.count, (unsigned long long)s.errors, (unsigned long long)s.timeouts,
+               (unsigned long long)s.exceptions,
+               (unsigned long long)s.lastUsec, (unsigned long long)s.minUsec, (unsigned long long)s.maxUsec,
+               (unsigned long long)(okCount ? s.totalUsec / okCount : 0));
+    }
+}
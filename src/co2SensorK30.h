@@ -28,9 +28,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 “That great poets imitate and improve, whereas small ones steal and spoil.” W. H. Davenport Adams
 http://books.google.com/books?id=5w34DT0fdeUC&q=%22ones+steal%22#v=snippet&
 */
+#include <chrono>
+
 #include "serialPort.h"
 #include "co2Sensor.h"
 
+// Senseair K30 on a serial port.
+//
+// Each command is a Modbus style transaction. The port is non-blocking and
+// replies are read as they arrive (waiting on epoll), so a transaction
+// completes as soon as the whole reply is in and its CRC checked.
+// CO2, temperature and RH are fetched with a single read of the sensor RAM
+// which covers all three, unless the sensor rejects it, in which case they
+// are read one at a time as before.
+//
 class Co2SensorK30 : public Co2Sensor
 {
     public:
@@ -43,6 +54,8 @@ class Co2SensorK30 : public Co2Sensor
         void readMeasurements(int& co2ppm, int& temperature, int& relHumidity);
         void readMeasurements(float& co2ppm, float& temperature, float& relHumidity);
 
+        virtual void logStats(int priority);
+
     private:
         typedef struct {
             int cmdLen;
@@ -57,27 +70,65 @@ class Co2SensorK30 : public Co2Sensor
             READ_CO2,
             READ_TEMP,
             READ_RH,
+            READ_ALL,
             CO2_CMD_MAX
         } Co2CmdType;
 
+        // READ_ALL reads RAM 0x08 to 0x15, so CO2 (0x08), temperature (0x12)
+        // and RH (0x14) are at these offsets in its reply.
+        static const int kReadAllCo2Pos = 3;
+        static const int kReadAllTempPos = 3 + (0x12 - 0x08);
+        static const int kReadAllRhPos = 3 + (0x14 - 0x08);
+        static const int kMaxReplyLen = 19;
+
+        // READ_ALL failures, other than an exception reply, before we
+        // give up on it and read registers separately.
+        static const int kMaxReadAllFailures = 3;
+
         const Co2CmdReply co2CmdReply[CO2_CMD_MAX] = {
             { 8, 4, 0, 0, { 0xfe, 0x41, 0x00, 0x60, 0x01, 0x35, 0xe8, 0x53, 0, 0 } },
             { 7, 7, 3, 2, { 0xfe, 0x44, 0x00, 0x08, 0x02, 0x9f, 0x25, 0, 0, 0 } },
             { 7, 7, 3, 2, { 0xfe, 0x44, 0x00, 0x12, 0x02, 0x94, 0x45, 0, 0, 0 } },
-            { 7, 7, 3, 2, { 0xfe, 0x44, 0x00, 0x14, 0x02, 0x97, 0xe5, 0, 0, 0 } }
+            { 7, 7, 3, 2, { 0xfe, 0x44, 0x00, 0x14, 0x02, 0x97, 0xe5, 0, 0, 0 } },
+            { 7, kMaxReplyLen, 3, 14, { 0xfe, 0x44, 0x00, 0x08, 0x0e, 0x9f, 0x20, 0, 0, 0 } }
         };
 
+        typedef enum {
+            ReadAllUntried,
+            ReadAllSupported,
+            ReadAllUnsupported
+        } ReadAllState;
+
+        typedef struct {
+            uint64_t count;
+            uint64_t errors;     // includes timeouts and exception replies
+            uint64_t timeouts;
+            uint64_t exceptions; // Modbus exception replies
+            uint64_t lastUsec;
+            uint64_t minUsec;
+            uint64_t maxUsec;
+            uint64_t totalUsec;
+        } TransactionStats;
+
         int sensorFileDesc_;
+        int epollFd_;
         const int timeoutMs_;
+        ReadAllState readAllState_;
+        int readAllFailures_;
+        TransactionStats stats_[CO2_CMD_MAX];
 
         Co2SensorK30();
 
+        void transact(Co2CmdType cmd, uint8_t* reply);
+        void awaitReply(Co2CmdType cmd, uint8_t* reply, std::chrono::steady_clock::time_point deadline);
+        void discardInput();
         void sendCmd(Co2CmdType cmd, uint32_t* pVal);
-        int co2CheckIo(uint8_t* buf, int bufsize, int* bytes_read);
         int checkCrc16(uint8_t* byteArray, int size);
         int readTemperature(void);
         int readRelHumidity(void);
         int readCo2ppm(void);
+        int co2ppmFromReply(uint32_t co2ppm);
+        bool readAll(int& co2ppm, int& temperature, int& relHumidity);
 
         SerialPort* serialPort;
 
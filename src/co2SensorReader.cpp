@@ -0,0 +1,183 @@
+/*
+ * co2SensorReader.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <syslog.h>
+#include <fmt/core.h>
+
+#include "co2SensorReader.h"
+
+Co2SensorReader::Co2SensorReader(const std::string& name, const std::string& sensorType,
+                                 Co2Sensor* co2Sensor, std::chrono::microseconds readInterval) :
+    name_(name),
+    sensorType_(sensorType),
+    co2Sensor_(co2Sensor),
+    readTask_(-1),
+    readerThread_(nullptr),
+    sensorIntervalUsec_(readInterval.count()),
+    readCount_(0),
+    errorCount_(0),
+    cpuNsec_(0)
+{
+    reading_.co2 = 0;
+    reading_.temperature = 0;
+    reading_.relHumidity = 0;
+    reading_.sequence = 0;
+    reading_.isValid = false;
+
+    consecutiveErrorCount_.store(0, std::memory_order_relaxed);
+    hasFatalError_.store(false, std::memory_order_relaxed);
+    readIntervalUsec_.store(readInterval.count(), std::memory_order_relaxed);
+
+    readTask_ = scheduler_.addTask(name_ + " read", readInterval, std::chrono::microseconds(0), [this] { readSensor(); });
+}
+
+Co2SensorReader::~Co2SensorReader()
+{
+    stop();
+
+    if (co2Sensor_) {
+        delete co2Sensor_;
+    }
+}
+
+void Co2SensorReader::initSensor()
+{
+    int permittedInitFails = 3;
+
+    while (true) {
+        try {
+            co2Sensor_->init();
+            return;
+        } catch (CO2::exceptionLevel& el) {
+            if ( (--permittedInitFails <= 0) || el.isFatal() ) {
+                throw;
+            }
+        } catch (...) {
+            throw;
+        }
+    }
+}
+
+void Co2SensorReader::readSensor()
+{
+    int co2ppm;
+    int t;
+    int rh;
+
+    try {
+        int64_t readIntervalUsec = readIntervalUsec_.load(std::memory_order_relaxed);
+
+        if (readIntervalUsec != sensorIntervalUsec_) {
+            sensorIntervalUsec_ = readIntervalUsec;
+            co2Sensor_->setSampleInterval(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::microseconds(readIntervalUsec)));
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+
+        co2Sensor_->readMeasurements(co2ppm, t, rh);
+
+        auto readTime = std::chrono::steady_clock::now();
+
+        readLatency_.record(readTime - startTime);
+        readCount_++;
+
+        // ignore readings if co2ppm is 0 as it
+        // probably means that sensor is not ready
+        if (co2ppm) {
+            consecutiveErrorCount_.store(0, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(readingMutex_);
+            reading_.co2 = co2ppm;
+            reading_.temperature = t;
+            reading_.relHumidity = rh;
+            reading_.readTime = readTime;
+            reading_.sequence++;
+            reading_.isValid = true;
+        }
+    } catch (CO2::exceptionLevel& el) {
+        errorCount_++;
+        int errorCount = consecutiveErrorCount_.fetch_add(1, std::memory_order_relaxed) + 1;
+        syslog(LOG_DEBUG, "%s: %s: consecutive error count = %d", name_.c_str(), el.what(), errorCount);
+
+        if (el.isFatal()) {
+            throw;
+        }
+
+        // non fatal sensor errors might be cured
+        // with re-initialisation.
+        try {
+            initSensor();
+        } catch (CO2::exceptionLevel& initEl) {
+            if (initEl.isFatal()) {
+                throw;
+            }
+
+            syslog(LOG_ERR, "%s: cannot re-initialise sensor: %s", name_.c_str(), initEl.what());
+        }
+    }
+}
+
+void Co2SensorReader::runReader()
+{
+    try {
+        scheduler_.run();
+    } catch (CO2::exceptionLevel& el) {
+        syslog(LOG_ERR, "%s: sensor failed: %s", name_.c_str(), el.what());
+        hasFatalError_.store(true, std::memory_order_relaxed);
+    } catch (...) {
+        syslog(LOG_ERR, "%s: sensor failed: unknown exception", name_.c_str());
+        hasFatalError_.store(true, std::memory_order_relaxed);
+    }
+
+    cpuNsec_ = LatencyHistogram::threadCpuNsec();
+}
+
+void Co2SensorReader::start()
+{
+    if (!readerThread_) {
+        readerThread_ = new std::thread(&Co2SensorReader::runReader, this);
+    }
+}
+
+void Co2SensorReader::stop()
+{
+    if (readerThread_) {
+        scheduler_.stop();
+        readerThread_->join();
+        delete readerThread_;
+        readerThread_ = nullptr;
+    }
+}
+
+void Co2SensorReader::setReadInterval(std::chrono::microseconds interval, std::chrono::steady_clock::time_point nextRead)
+{
+    readIntervalUsec_.store(interval.count(), std::memory_order_relaxed);
+    scheduler_.changePeriod(readTask_, interval, nextRead);
+}
+
+Co2SensorReader::Reading Co2SensorReader::latest()
+{
+    std::lock_guard<std::mutex> lock(readingMutex_);
+
+    return reading_;
+}
+
+bool Co2SensorReader::hasFailed()
+{
+    return hasFatalError_.load(std::memory_order_relaxed) ||
+           (consecutiveErrorCount_.load(std::memory_order_relaxed) > kHwErrorThreshold_);
+}
+
+void Co2SensorReader::logStats(int priority)
+{
+    syslog(priority, "%s: reads=%llu errors=%llu%s  cpu=%.3fs", name_.c_str(), (unsigned long long)readCount_,
+           (unsigned long long)errorCount_, hasFailed() ? " (failed)" : "", cpuNsec_ / 1e9);
+    syslog(priority, "%s: read latency %s", name_.c_str(), readLatency_.summary().c_str());
+
+    scheduler_.logStats(priority);
+    co2Sensor_->logStats(priority);
+}
@@ -0,0 +1,112 @@
+/*
+ * co2SensorReader.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2SENSORREADER_H
+#define CO2SENSORREADER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "co2Scheduler.h"
+#include "co2Sensor.h"
+#include "latencyHistogram.h"
+
+// Reads one CO2 sensor in its own thread.
+//
+// Each sensor has its own scheduler and thread, so a slow or unresponsive
+// sensor (e.g. a K30 waiting out a serial timeout) cannot hold up readings
+// from any other sensor. Co2Monitor picks up the latest reading from each
+// with latest() and fuses them.
+//
+class Co2SensorReader
+{
+    public:
+        typedef struct {
+            int co2;
+            int temperature;
+            int relHumidity;
+            std::chrono::steady_clock::time_point readTime;
+            uint64_t sequence;  // counts good readings, so missed ones can be spotted
+            bool isValid;       // false until first good reading
+        } Reading;
+
+        // Takes ownership of co2Sensor.
+        Co2SensorReader(const std::string& name, const std::string& sensorType,
+                        Co2Sensor* co2Sensor, std::chrono::microseconds readInterval);
+
+        ~Co2SensorReader();
+
+        // Initialises sensor in the calling thread, retrying non-fatal errors.
+        void initSensor();
+
+        void start();
+        void stop();
+
+        // Changes how often the sensor is read, from nextRead. May be
+        // called from any thread; the sensor itself is told in the reader
+        // thread, before its next read.
+        void setReadInterval(std::chrono::microseconds interval, std::chrono::steady_clock::time_point nextRead);
+
+        Reading latest();
+
+        // True after a fatal error, or once there have been too many
+        // consecutive errors for readings to be trusted.
+        bool hasFailed();
+
+        const std::string& name() { return name_; }
+        const std::string& sensorType() { return sensorType_; }
+
+        // Only valid once initSensor() has returned
+        bool location(Co2Sensor::Location& location) { return co2Sensor_->location(location); }
+
+        // Time taken by each readMeasurements() call
+        const LatencyHistogram& readLatency() { return readLatency_; }
+
+        // CPU used by reader thread (once it has stopped)
+        uint64_t cpuNsec() { return cpuNsec_; }
+
+        void logStats(int priority);
+
+    private:
+        Co2SensorReader();
+        Co2SensorReader& operator=(const Co2SensorReader& rhs);
+        Co2SensorReader(const Co2SensorReader& rhs);
+
+        void readSensor();
+        void runReader();
+
+        std::string name_;
+        std::string sensorType_;
+        Co2Sensor* co2Sensor_;
+
+        Co2Scheduler scheduler_;
+        Co2Scheduler::TaskId readTask_;
+        std::thread* readerThread_;
+
+        std::atomic<int64_t> readIntervalUsec_;
+        int64_t sensorIntervalUsec_;    // last interval the sensor was told about
+
+        std::mutex readingMutex_;
+        Reading reading_;
+
+        std::atomic<int> consecutiveErrorCount_;
+        std::atomic<bool> hasFatalError_;
+        uint64_t readCount_;
+        uint64_t errorCount_;
+        LatencyHistogram readLatency_;
+        uint64_t cpuNsec_;
+
+        // the number of consecutive h/w errors after which sensor is considered failed
+        static const int kHwErrorThreshold_ = 3;
+
+    protected:
+};
+
+#endif /* CO2SENSORREADER_H */
@@ -0,0 +1,208 @@
+/*
+ * co2SensorReplay.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <syslog.h>
+#include <fmt/core.h>
+
+#include "co2SensorReplay.h"
+#include "co2SensorFactory.h"
+
+// SensorPort is the log base dir to replay from. ReplayStart defaults to
+// the start of yesterday and ReplayEnd to a day after ReplayStart.
+static Co2SensorFactory::Registrar registrar("replay", [](const Co2SensorFactory::SensorParams& params) -> Co2Sensor* {
+    if (params.port.empty()) {
+        throw CO2::exceptionLevel("No log directory configured for replay sensor", true);
+    }
+
+    time_t startTime;
+    time_t endTime;
+
+    if (params.replayStart.empty()) {
+        startTime = Co2LogSegment::dayStart(Co2LogSegment::dayStart(time(0)) - 1);
+    } else if (!Co2SensorReplay::parseTime(params.replayStart, startTime)) {
+        throw CO2::exceptionLevel(fmt::format("Invalid replay start time \"{}\"", params.replayStart), true);
+    }
+
+    if (params.replayEnd.empty()) {
+        endTime = startTime + (24 * 60 * 60) - 1;
+    } else if (!Co2SensorReplay::parseTime(params.replayEnd, endTime)) {
+        throw CO2::exceptionLevel(fmt::format("Invalid replay end time \"{}\"", params.replayEnd), true);
+    }
+
+    return new Co2SensorReplay(params.port, startTime, endTime, params.replaySpeed);
+});
+
+Co2SensorReplay::Co2SensorReplay(const std::string& logBaseDir, time_t startTime, time_t endTime,
+                                 int speed, bool shouldLoop) :
+    logReader_(logBaseDir),
+    startTime_(startTime),
+    endTime_(endTime),
+    speed_(speed),
+    shouldLoop_(shouldLoop),
+    nextIndex_(0),
+    chunkEndTime_(startTime - 1),
+    hasLastReading_(false),
+    replayCount_(0),
+    passCount_(0)
+{
+    if (endTime_ < startTime_) {
+        throw CO2::exceptionLevel("Replay end time is before start time", true);
+    }
+
+    if (speed_ < 0) {
+        throw CO2::exceptionLevel(fmt::format("Invalid replay speed ({})", speed_), true);
+    }
+
+    memset(&lastReading_, 0, sizeof(lastReading_));
+}
+
+Co2SensorReplay::~Co2SensorReplay()
+{
+}
+
+void Co2SensorReplay::init()
+{
+    rewind();
+
+    if (!peekReading()) {
+        throw CO2::exceptionLevel("No readings logged in replay period", true);
+    }
+}
+
+bool Co2SensorReplay::parseTime(const std::string& timeStr, time_t& time)
+{
+    static const char* const kFormats[] = { "%Y-%m-%d %H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d" };
+
+    for (auto format : kFormats) {
+        struct tm tmTime;
+
+        memset(&tmTime, 0, sizeof(tmTime));
+
+        const char* end = strptime(timeStr.c_str(), format, &tmTime);
+
+        if (end && !*end) {
+            tmTime.tm_isdst = -1;
+            time = mktime(&tmTime);
+            return (time != -1);
+        }
+    }
+
+    return false;
+}
+
+void Co2SensorReplay::rewind()
+{
+    readings_.clear();
+    nextIndex_ = 0;
+    chunkEndTime_ = startTime_ - 1;
+    hasLastReading_ = false;
+    replayStartTime_ = std::chrono::steady_clock::now();
+}
+
+bool Co2SensorReplay::loadNextChunk()
+{
+    while (chunkEndTime_ < endTime_) {
+        time_t chunkStartTime = chunkEndTime_ + 1;
+
+        chunkEndTime_ = std::min(chunkStartTime + kChunkSeconds - 1, endTime_);
+        readings_.clear();
+        nextIndex_ = 0;
+
+        logReader_.read(chunkStartTime, chunkEndTime_, [this](const Co2LogReader::Reading& reading) {
+            readings_.push_back(reading);
+            return true;
+        });
+
+        if (!readings_.empty()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const Co2LogReader::Reading* Co2SensorReplay::peekReading()
+{
+    if ((nextIndex_ >= readings_.size()) && !loadNextChunk()) {
+        return nullptr;
+    }
+
+    return &readings_[nextIndex_];
+}
+
+void Co2SensorReplay::restartReplay()
+{
+    if (!shouldLoop_) {
+        throw CO2::exceptionLevel("Replay finished", true);
+    }
+
+    passCount_++;
+    syslog(LOG_NOTICE, "Replay finished pass %d - starting again", passCount_);
+
+    rewind();
+
+    if (!peekReading()) {
+        throw CO2::exceptionLevel("No readings logged in replay period", true);
+    }
+}
+
+void Co2SensorReplay::readMeasurements(int& co2ppm, int& temperature, int& relHumidity)
+{
+    const Co2LogReader::Reading* reading;
+
+    if (speed_ == 0) {
+        if (!(reading = peekReading())) {
+            restartReplay();
+            reading = peekReading();
+        }
+
+        lastReading_ = *reading;
+        hasLastReading_ = true;
+        nextIndex_++;
+        replayCount_++;
+    } else {
+        // time in the log which replay has reached
+        auto elapsed = std::chrono::steady_clock::now() - replayStartTime_;
+        time_t replayTime = startTime_ + std::chrono::duration_cast<std::chrono::seconds>(elapsed * speed_).count();
+
+        if (replayTime > endTime_) {
+            restartReplay();
+            replayTime = startTime_;
+        }
+
+        // readings recorded since the last call are skipped over
+        while ((reading = peekReading()) && (reading->timestamp <= replayTime)) {
+            lastReading_ = *reading;
+            hasLastReading_ = true;
+            nextIndex_++;
+            replayCount_++;
+        }
+    }
+
+    // co2ppm of 0 means not ready, until the first reading is due
+    co2ppm = hasLastReading_ ? lastReading_.co2 : 0;
+    temperature = lastReading_.temperature;
+    relHumidity = lastReading_.relHumidity;
+}
+
+void Co2SensorReplay::readMeasurements(float& co2ppm, float& temperature, float& relHumidity)
+{
+    int co2ppmInt;
+    int temperatureInt;
+    int relHumidityInt;
+    this->readMeasurements(co2ppmInt, temperatureInt, relHumidityInt);
+    co2ppm = co2ppmInt * 1.0;
+    temperature = (temperatureInt * 1.0) / 100.0;
+    relHumidity = (relHumidityInt * 1.0) / 100.0;
+}
+
+void Co2SensorReplay::logStats(int priority)
+{
+    syslog(priority, "Replay: %zu readings replayed at %s, %d complete pass(es)",
+           replayCount_, speed_ ? fmt::format("{}x", speed_).c_str() : "one per read", passCount_);
+}
@@ -0,0 +1,86 @@
+/*
+ * co2SensorReplay.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2SENSORREPLAY_H
+#define CO2SENSORREPLAY_H
+
+#include <chrono>
+#include <vector>
+
+#include "co2LogReader.h"
+#include "co2Sensor.h"
+
+// Plays back readings from the daily logs, so that Co2Monitor (and
+// everything downstream of it) sees the sequence recorded on a given day.
+//
+// With a speed of 1 each reading is returned at the time it was recorded,
+// relative to when replay started; a speed of N runs N times faster,
+// returning the latest reading recorded by then. A speed of 0 returns the
+// next reading on every call, however often that is, so runs are
+// repeatable. Readings are loaded a day at a time.
+//
+class Co2SensorReplay : public Co2Sensor
+{
+    public:
+        // Replays readings between startTime and endTime (inclusive), going
+        // back to startTime at the end if shouldLoop, otherwise throwing a
+        // fatal exceptionLevel.
+        Co2SensorReplay(const std::string& logBaseDir, time_t startTime, time_t endTime,
+                        int speed = 1, bool shouldLoop = true);
+
+        ~Co2SensorReplay();
+
+        void init();
+
+        void readMeasurements(int& co2ppm, int& temperature, int& relHumidity);
+        void readMeasurements(float& co2ppm, float& temperature, float& relHumidity);
+
+        void logStats(int priority);
+
+        // Accepts "YYYY-MM-DD" or "YYYY-MM-DD HH:MM[:SS]" (local time)
+        static bool parseTime(const std::string& timeStr, time_t& time);
+
+        // readings replayed so far, including any skipped over at speed
+        size_t replayCount() const { return replayCount_; }
+        int passCount() const { return passCount_; }
+
+    private:
+        Co2SensorReplay();
+
+        // Loads the next chunk of readings after chunkEndTime_, skipping
+        // any days with none. Returns false at endTime_.
+        bool loadNextChunk();
+
+        // Next reading to be replayed, or nullptr at endTime_
+        const Co2LogReader::Reading* peekReading();
+
+        void rewind();
+        void restartReplay();
+
+        static const time_t kChunkSeconds = 24 * 60 * 60;
+
+        Co2LogReader logReader_;
+        time_t startTime_;
+        time_t endTime_;
+        int speed_;
+        bool shouldLoop_;
+
+        std::vector<Co2LogReader::Reading> readings_;
+        size_t nextIndex_;
+        time_t chunkEndTime_;
+
+        Co2LogReader::Reading lastReading_;
+        bool hasLastReading_;
+        std::chrono::steady_clock::time_point replayStartTime_;
+
+        size_t replayCount_;
+        int passCount_;
+
+    protected:
+};
+
+#endif /* CO2SENSORREPLAY_H */
@@ -5,11 +5,18 @@
  *     Author: patw
  */
 
+#include <algorithm>
+#include <array>
+#include <future>
 #include <thread>          // std::thread
 #include <fmt/core.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <syslog.h>
 #include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include <unistd.h>
 
@@ -20,8 +27,36 @@ extern "C" {
 #endif /* HAS_I2C */
 
 #include "co2SensorSCD30.h"
+#include "co2SensorFactory.h"
+#include "checksum.h"
 
-Co2SensorSCD30::Co2SensorSCD30(std::string i2cDevice) :
+static Co2SensorFactory::Registrar registrar("SCD30", [](const Co2SensorFactory::SensorParams& params) -> Co2Sensor* {
+    if (params.port.empty()) {
+        throw CO2::exceptionLevel("No sensor port configured for SCD30 sensor", true);
+    }
+
+    if (params.port != "I2C") {
+        throw CO2::exceptionLevel(fmt::format("Unsupported port ({}) for SCD30 sensor", params.port), true);
+    }
+
+#ifdef HAS_I2C
+    // find the I2C bus to which the device is attached
+    int i2cBus = Co2SensorSCD30::findI2cBus(params.lastLocation);
+
+    if (i2cBus < 0) {
+        throw CO2::exceptionLevel("SCD30 sensor not found on any I2C bus", true);
+    }
+
+    return new Co2SensorSCD30(i2cBus, params.scd30RdyGpio);
+#else
+    throw CO2::exceptionLevel("No I2C support for SCD30 sensor", true);
+#endif /* HAS_I2C */
+});
+
+Co2SensorSCD30::Co2SensorSCD30(std::string i2cDevice, int rdyGpio) :
+    i2cBus_(-1),
+    firmwareRevision_(-1),
+    rdyFd_(-1),
     measurementInterval_(2),
     lastMeasurementTime_(0)
 {
@@ -36,40 +71,162 @@ Co2SensorSCD30::Co2SensorSCD30(std::string i2cDevice) :
         i2cfd_ = -1;
         throw CO2::exceptionLevel(fmt::format("Failed to set address for I2c device \"{}\" ({})", i2cDevice, strerror(errno)), true);
     }
+
+    if (rdyGpio >= 0) {
+        openRdyGpio(rdyGpio);
+    }
 }
 
-Co2SensorSCD30::Co2SensorSCD30(uint16_t bus) : Co2SensorSCD30("/dev/i2c-" + std::to_string(bus))
+Co2SensorSCD30::Co2SensorSCD30(uint16_t bus, int rdyGpio) : Co2SensorSCD30("/dev/i2c-" + std::to_string(bus), rdyGpio)
 {
+    i2cBus_ = bus;
 }
 
 Co2SensorSCD30::~Co2SensorSCD30()
 {
     if (i2cfd_ >= 0) {
-        stopContinuousMeasurement();
+        try {
+            stopContinuousMeasurement();
+        } catch (...) {
+        }
+
         close(i2cfd_);
         i2cfd_ = -1;
     }
+
+    if (rdyFd_ >= 0) {
+        close(rdyFd_);
+    }
 }
 
-// Polynomial: x^8 + x^5 + x^4 + 1 (0x31, MSB)
-// Initialization: 0xFF
-//
-// Algorithm adapted from:
-// https://en.wikipedia.org/wiki/Computation_of_cyclic_redundancy_checks
-uint8_t Co2SensorSCD30::crc8(const uint8_t bytes[sizeof(uint16_t)])
+void Co2SensorSCD30::openRdyGpio(int rdyGpio)
 {
-    const uint8_t polynomial = 0x31;
-    uint8_t       crc = 0xff;
+    const char* gpioChip = "/dev/gpiochip0";
+    int chipFd = open(gpioChip, O_RDONLY | O_CLOEXEC);
 
-    for (int j = 0; j < int(sizeof(uint16_t)); j++) {
-        crc ^= bytes[j];
+    if (chipFd < 0) {
+        syslog(LOG_WARNING, "Unable to open %s (%s) - polling SCD30 for data ready", gpioChip, strerror(errno));
+        return;
+    }
+
+    // RDY goes high when a measurement is ready and low once it's read
+    struct gpioevent_request req;
+
+    memset(&req, 0, sizeof(req));
+    req.lineoffset = rdyGpio;
+    req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    req.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(req.consumer_label, "co2mon SCD30 RDY", sizeof(req.consumer_label) - 1);
+
+    if (ioctl(chipFd, GPIO_GET_LINEEVENT_IOCTL, &req) < 0) {
+        syslog(LOG_WARNING, "Unable to request %s line %d for SCD30 RDY (%s) - polling SCD30 for data ready",
+               gpioChip, rdyGpio, strerror(errno));
+        close(chipFd);
+        return;
+    }
+
+    close(chipFd);
+
+    int flags = fcntl(req.fd, F_GETFL, 0);
+    fcntl(req.fd, F_SETFL, flags | O_NONBLOCK);
+
+    rdyFd_ = req.fd;
+}
+
+bool Co2SensorSCD30::rdyGpioIsHigh(void)
+{
+    struct gpiohandle_data data;
+
+    if (ioctl(rdyFd_, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+        throw CO2::exceptionLevel(fmt::format("Unable to read SCD30 RDY line ({})", strerror(errno)), false);
+    }
+
+    return data.values[0] != 0;
+}
+
+void Co2SensorSCD30::waitForRdyGpio(std::chrono::milliseconds timeout)
+{
+    struct gpioevent_data event;
+
+    // Throw away edges from measurements we have already read. Any
+    // edge after this is queued, so can't be missed between checking
+    // the line and waiting for it.
+    while (read(rdyFd_, &event, sizeof(event)) == sizeof(event)) {
+    }
 
-        for (int i = 8; i; --i) {
-            crc = (crc & 0x80) ? (crc << 1) ^ polynomial : (crc << 1);
+    if (rdyGpioIsHigh()) {
+        return;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    while (true) {
+        auto remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+        if (remainingMs <= 0) {
+            throw CO2::exceptionLevel("Timed out waiting for SCD30 RDY", false);
+        }
+
+        struct pollfd pfd;
+
+        pfd.fd = rdyFd_;
+        pfd.events = POLLIN;
+
+        int rc = poll(&pfd, 1, static_cast<int>(remainingMs));
+
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw CO2::exceptionLevel(fmt::format("Error waiting for SCD30 RDY ({})", strerror(errno)), false);
+        }
+
+        if ((rc > 0) && (read(rdyFd_, &event, sizeof(event)) == sizeof(event))) {
+            return;
+        }
+    }
+}
+
+void Co2SensorSCD30::transfer(uint8_t* buf, int len, bool isRead)
+{
+    struct i2c_msg msg;
+    struct i2c_rdwr_ioctl_data xfer;
+
+    if (isRead) {
+        // The interface description requires a >3ms delay between a
+        // command and reading its response.
+        auto readTime = lastCommandTime_ + kResponseDelay_;
+
+        if (readTime > std::chrono::steady_clock::now()) {
+            std::this_thread::sleep_until(readTime);
         }
     }
 
-    return crc;
+    msg.addr = i2cAddr_;
+    msg.flags = isRead ? I2C_M_RD : 0;
+    msg.len = len;
+    msg.buf = buf;
+
+    xfer.msgs = &msg;
+    xfer.nmsgs = 1;
+
+    // Each transfer is a single message ending in STOP as the SCD30
+    // doesn't support repeated START.
+    if (ioctl(i2cfd_, I2C_RDWR, &xfer) != 1) {
+        throw CO2::exceptionLevel(fmt::format("{} error: {} bytes ({})", isRead ? "Receive" : "Send", len, strerror(errno)), false);
+    }
+
+    if (!isRead) {
+        lastCommandTime_ = std::chrono::steady_clock::now();
+    }
+}
+
+// Polynomial: x^8 + x^5 + x^4 + 1 (0x31, MSB)
+// Initialization: 0xFF
+uint8_t Co2SensorSCD30::crc8(const uint8_t bytes[sizeof(uint16_t)])
+{
+    return Checksum::crc8Sensirion(bytes, sizeof(uint16_t));
 }
 
 float Co2SensorSCD30::bytes2float(uint8_t bytes[])
@@ -84,72 +241,100 @@ float Co2SensorSCD30::bytes2float(uint8_t bytes[])
     return val.f;
 }
 
-void Co2SensorSCD30::sendCommand(Commands command, VU16& arglist)
+int Co2SensorSCD30::encodeCommand(uint16_t command, std::span<const uint16_t> args, std::span<uint8_t, kCommandBufSize> buf)
 {
-    uint8_t buf[100];
+    if (args.size() > kMaxCommandArgs) {
+        throw CO2::exceptionLevel(fmt::format("Too many arguments ({}) for command {:#06x}", args.size(), command), false);
+    }
+
     int i = 0;
     buf[i++] = (command >> 8) & 0xff;
     buf[i++] = command & 0xff;
 
-for (auto & arg: arglist) {
+    for (auto arg : args) {
         buf[i] = (arg >> 8) & 0xff;
         buf[i + 1] = arg & 0xff;
         buf[i + 2] = crc8(&buf[i]);
         i += 3;
     }
 
-    int nBytes = write(i2cfd_, buf, i);
+    return i;
+}
+
+void Co2SensorSCD30::decodeResponse(std::span<const uint8_t> buf, std::span<uint16_t> responseWords)
+{
+    for (size_t w = 0; w < responseWords.size(); w++) {
+        size_t i = w * 3;
+        unsigned int exp = buf[i + 2] & 0xff;
+        unsigned int act = crc8(&buf[i]);
+
+        if (act != exp) {
+            throw CO2::exceptionLevel(fmt::format("CRC error - expected: {:#04x} - actual: {:#04x}", exp, act), false);
+        }
+
+        responseWords[w] = ((uint16_t)buf[i] << 8) | (uint16_t)buf[i + 1];
+    }
+}
+
+void Co2SensorSCD30::decodeMeasurements(std::span<const uint16_t, kMeasurementWords> responseWords,
+                                        float& co2ppm, float& temperature, float& relHumidity)
+{
+    float measurements[kMeasurementWords / 2];
 
-    if (nBytes != i) {
-        throw CO2::exceptionLevel(fmt::format("Send error: {}:{} bytes written", nBytes, i), false);
+    for (int i = 0; i < (kMeasurementWords / 2); i++) {
+        uint8_t bytes[4];
+        int responseIdx = i * 2;
+        bytes[0] = (responseWords[responseIdx] >> 8) & 0xff;
+        bytes[1] = responseWords[responseIdx] & 0xff;
+        responseIdx++;
+        bytes[2] = (responseWords[responseIdx] >> 8) & 0xff;
+        bytes[3] = responseWords[responseIdx] & 0xff;
+        measurements[i] = bytes2float(bytes);
     }
 
-    // The interface description suggests a >3ms delay between writes and
-    // reads for most commands.
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    co2ppm = measurements[0];
+    temperature = measurements[1];
+    relHumidity = measurements[2];
+}
+
+void Co2SensorSCD30::sendCommand(Commands command, std::span<const uint16_t> args)
+{
+    std::array<uint8_t, kCommandBufSize> buf;
+    int len = encodeCommand(command, args, buf);
+
+    transfer(buf.data(), len, false);
 }
 
 void Co2SensorSCD30::sendCommand(Commands command, uint16_t arg)
 {
-    VU16 vArg {arg};
-    sendCommand(command, vArg);
+    sendCommand(command, std::span<const uint16_t>(&arg, 1));
 }
 
 void Co2SensorSCD30::sendCommand(Commands command)
 {
-    VU16 dummyArg;
-    sendCommand(command, dummyArg);
+    sendCommand(command, std::span<const uint16_t>());
 }
 
-void Co2SensorSCD30::readResponse(int nResponseWords, VU16& responseWords)
+void Co2SensorSCD30::readResponse(std::span<uint16_t> responseWords)
 {
-    // read 3 bytes per response word (2 bytes per word + crc)
-    const int nRespBytes = nResponseWords * 3;
-    uint8_t buf[100];
-    int nBytes = read(i2cfd_, buf, nRespBytes);
-
-    if (nBytes != nRespBytes) {
-        throw CO2::exceptionLevel(fmt::format("Receive error: {}:{} bytes read", nBytes, nRespBytes), false);
+    if (responseWords.size() > kMaxResponseWords) {
+        throw CO2::exceptionLevel(fmt::format("Too many response words ({})", responseWords.size()), false);
     }
 
-    for (int i = 0; i < nRespBytes; i += 3) {
-        unsigned int exp = buf[i + 2] & 0xff;
-        unsigned int act = crc8(&buf[i]);
+    // read 3 bytes per response word (2 bytes per word + crc)
+    std::array<uint8_t, kResponseBufSize> buf;
+    const int nRespBytes = responseWords.size() * 3;
 
-        if (act != exp) {
-            throw CO2::exceptionLevel(fmt::format("CRC error - expected: {:#04x} - actual: {:#04x}", exp, act), false);
-        }
+    transfer(buf.data(), nRespBytes, true);
 
-        uint16_t responseWord = ((uint16_t)buf[i] << 8) | (uint16_t)buf[i + 1];
-        responseWords.push_back(responseWord);
-    }
+    decodeResponse(std::span<const uint8_t>(buf.data(), nRespBytes), responseWords);
 }
 
 uint16_t Co2SensorSCD30::readResponse()
 {
-    VU16 response;
-    readResponse(1, response);
-    return response[0];
+    uint16_t response;
+    readResponse(std::span<uint16_t>(&response, 1));
+    return response;
 }
 
 void Co2SensorSCD30::triggerContinuousMeasurement(uint16_t ambientPressure)
@@ -159,8 +344,7 @@ void Co2SensorSCD30::triggerContinuousMeasurement(uint16_t ambientPressure)
                                               ambientPressure), false);
     }
 
-    VU16 arg {ambientPressure};
-    sendCommand(TriggerContMeasCmd, arg);
+    sendCommand(TriggerContMeasCmd, ambientPressure);
 }
 
 void Co2SensorSCD30::stopContinuousMeasurement(void)
@@ -174,8 +358,7 @@ uint16_t Co2SensorSCD30::setMeasurementInterval(uint16_t interval)
         throw CO2::exceptionLevel(fmt::format("Interval ({}) must be in the range [2..1800] (sec)", interval), false);
     }
 
-    VU16 arg {interval};
-    sendCommand(MeasIntervalCmd, arg);
+    sendCommand(MeasIntervalCmd, interval);
 
     uint16_t newInterval = readResponse();
 
@@ -206,6 +389,14 @@ void Co2SensorSCD30::waitForDataReady(void)
     auto endTime = std::chrono::nanoseconds(lastMeasurementTime_) + std::chrono::seconds(measurementInterval_);
     auto waitTime = endTime - std::chrono::steady_clock::now().time_since_epoch();
 
+    if (rdyFd_ >= 0) {
+        // The RDY line tells us as soon as the measurement is ready,
+        // without any I2C traffic.
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(waitTime) + std::chrono::seconds(1);
+        waitForRdyGpio(std::max(timeout, std::chrono::milliseconds(1000)));
+        return;
+    }
+
     auto sleepTime = std::chrono::duration_cast<std::chrono::milliseconds>(waitTime);
 
     if (sleepTime.count() > 0) {
@@ -232,36 +423,13 @@ void Co2SensorSCD30::readMeasurements(float& co2ppm, float& temperature, float&
 {
     waitForDataReady();
 
-    VU16 responseList;
-    const int nMeasurements = 3;
-    const int expectedResponseWords = nMeasurements * 2;
+    std::array<uint16_t, kMeasurementWords> responseWords;
     sendCommand(ReadMeasurementCmd);
-    readResponse(expectedResponseWords, responseList);
-
-    if (responseList.size() != expectedResponseWords) {
-        throw CO2::exceptionLevel(fmt::format("Failed to read measurements - (actual: {}, expected: {})",
-                                              responseList.size(), expectedResponseWords), false);
-    }
+    readResponse(responseWords);
 
     lastMeasurementTime_ = std::chrono::steady_clock::now().time_since_epoch().count();
 
-    int i = 0;
-    float measurements[3];
-
-    for (int i = 0; i < nMeasurements; i++) {
-        uint8_t bytes[4];
-        int responseListIdx = i * 2;
-        bytes[0] = (responseList[responseListIdx] >> 8) & 0xff;
-        bytes[1] = responseList[responseListIdx] & 0xff;
-        responseListIdx++;
-        bytes[2] = (responseList[responseListIdx] >> 8) & 0xff;
-        bytes[3] = responseList[responseListIdx] & 0xff;
-        measurements[i] = bytes2float(bytes);
-    }
-
-    co2ppm = measurements[0];
-    temperature = measurements[1];
-    relHumidity = measurements[2];
+    decodeMeasurements(responseWords, co2ppm, temperature, relHumidity);
 }
 
 void Co2SensorSCD30::readMeasurements(int& co2ppm, int& temperature, int& relHumidity)
@@ -277,8 +445,7 @@ void Co2SensorSCD30::readMeasurements(int& co2ppm, int& temperature, int& relHum
 
 void Co2SensorSCD30::activateAutomaticSelfCalibration(bool activate)
 {
-    VU16 vArg((activate ? 1 : 0));
-    sendCommand(AscCmd, vArg);
+    sendCommand(AscCmd, activate ? 1 : 0);
 }
 
 bool Co2SensorSCD30::automaticSelfCalibration(void)
@@ -344,6 +511,16 @@ void Co2SensorSCD30::init(void)
     this->stopContinuousMeasurement();
     this->softReset();
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    if (firmwareRevision_ < 0) {
+        int major;
+        int minor;
+
+        this->firmwareRevision(major, minor);
+        firmwareRevision_ = (major << 8) | minor;
+        syslog(LOG_INFO, "SCD30 firmware revision %d.%d", major, minor);
+    }
+
     this->setMeasurementInterval(measurementInterval_);
     this->triggerContinuousMeasurement();
     lastMeasurementTime_ = std::chrono::steady_clock::now().time_since_epoch().count();
@@ -375,6 +552,32 @@ static int findI2cDevOnBus(const int i2cBus, const int i2cDevAddr)
     return rc;
 }
 
+// Measuring at half the rate we read means there is always a fresh
+// measurement when we read, without the SCD30 (and us, waiting for it)
+// being woken every 2s when readings are only wanted every minute.
+void Co2SensorSCD30::setSampleInterval(std::chrono::seconds interval)
+{
+    uint16_t measurementInterval = std::clamp<int64_t>(interval.count() / 2, 2, 1800);
+
+    if (measurementInterval != measurementInterval_) {
+        this->setMeasurementInterval(measurementInterval);
+        syslog(LOG_DEBUG, "SCD30 measurement interval now %us", measurementInterval);
+    }
+}
+
+bool Co2SensorSCD30::location(Location& location)
+{
+    if (i2cBus_ < 0) {
+        return false;
+    }
+
+    location.i2cBus = i2cBus_;
+    location.i2cAddress = i2cAddr_;
+    location.firmwareRevision = firmwareRevision_;
+
+    return true;
+}
+
 void Co2SensorSCD30::findI2cBusAll(std::vector<int>& i2cBusList)
 {
     // "sysfs is always at /sys" according to www.kernel.org documentation;
@@ -385,6 +588,8 @@ void Co2SensorSCD30::findI2cBusAll(std::vector<int>& i2cBusList)
     struct dirent* pDirEnt;
     DIR* pDir;
     int rc = 0;
+    std::vector<int> candidateBusList;
+    std::vector<std::future<int>> probes;
 
     pDir = opendir(i2cDevDir.c_str());
 
@@ -411,12 +616,27 @@ void Co2SensorSCD30::findI2cBusAll(std::vector<int>& i2cBusList)
             continue;
         }
 
-        if (findI2cDevOnBus(i2cBus, i2cAddr_) == 0) {
-            i2cBusList.push_back(i2cBus);
-        }
+        candidateBusList.push_back(i2cBus);
     }
 
     closedir(pDir);
+
+    // A bus with nothing at the address can take a while to say so,
+    // so all busses are probed at the same time.
+    for (auto i2cBus : candidateBusList) {
+        probes.push_back(std::async(std::launch::async, findI2cDevOnBus, i2cBus, int(i2cAddr_)));
+    }
+
+    for (size_t i = 0; i < probes.size(); i++) {
+        try {
+            if (probes[i].get() == 0) {
+                i2cBusList.push_back(candidateBusList[i]);
+            }
+        } catch (CO2::exceptionLevel& el) {
+            // one bus we can't use mustn't stop us finding the SCD30 on another
+            syslog(LOG_WARNING, "%s", el.what());
+        }
+    }
 }
 
 int Co2SensorSCD30::findI2cBus(void)
@@ -434,3 +654,39 @@ int Co2SensorSCD30::findI2cBus(void)
     return i2cBusList.front();
 }
 
+int Co2SensorSCD30::findI2cBus(const Location& lastLocation)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    int i2cBus = -1;
+    const char* howFound = "last known bus";
+
+    if ((lastLocation.i2cBus >= 0) && (lastLocation.i2cAddress == i2cAddr_)) {
+        try {
+            if (findI2cDevOnBus(lastLocation.i2cBus, i2cAddr_) == 0) {
+                i2cBus = lastLocation.i2cBus;
+            }
+        } catch (CO2::exceptionLevel& el) {
+            syslog(LOG_WARNING, "%s", el.what());
+        }
+
+        if (i2cBus < 0) {
+            syslog(LOG_NOTICE, "SCD30 no longer on I2C bus %d - probing all busses", lastLocation.i2cBus);
+        }
+    }
+
+    if (i2cBus < 0) {
+        howFound = "probing all busses";
+        i2cBus = findI2cBus();
+    }
+
+    auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+    if (i2cBus >= 0) {
+        syslog(LOG_INFO, "SCD30 found on I2C bus %d by %s in %lldms", i2cBus, howFound, static_cast<long long>(msec));
+    } else {
+        syslog(LOG_INFO, "SCD30 not found after %lldms", static_cast<long long>(msec));
+    }
+
+    return i2cBus;
+}
+
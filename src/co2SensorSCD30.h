@@ -8,15 +8,29 @@
 #ifndef CO2SENSORSCD30_H
 #define CO2SENSORSCD30_H
 
-#include "co2Sensor.h"
+#include <chrono>
+#include <span>
 
-using VU16 = std::vector<uint16_t>;
+#include "co2Sensor.h"
 
+// Sensirion SCD30 on I2C.
+//
+// Commands and responses are I2C_RDWR transfers. The SCD30 doesn't support
+// a repeated START, so a response is read in its own transfer, no sooner
+// than the 3ms after the command which the interface description requires.
+//
+// If rdyGpio is set (>= 0), it is the gpiochip0 line wired to the SCD30 RDY
+// pin, and we wait for its rising edge rather than polling the data ready
+// status over I2C.
+//
+// Commands and responses are built in fixed size buffers on the stack, so
+// reading measurements doesn't allocate any memory.
+//
 class Co2SensorSCD30 : public Co2Sensor
 {
     public:
-        Co2SensorSCD30(std::string i2cDevice);
-        Co2SensorSCD30(uint16_t bus);
+        Co2SensorSCD30(std::string i2cDevice, int rdyGpio = -1);
+        Co2SensorSCD30(uint16_t bus, int rdyGpio = -1);
         ~Co2SensorSCD30();
         void triggerContinuousMeasurement(uint16_t ambientPressure = 0);
         void stopContinuousMeasurement(void);
@@ -36,6 +50,8 @@ class Co2SensorSCD30 : public Co2Sensor
         void softReset(void);
 
         virtual void init();
+        virtual bool location(Location& location);
+        virtual void setSampleInterval(std::chrono::seconds interval);
 
         int readTemperature();
         int readRelHumidity();
@@ -43,11 +59,31 @@ class Co2SensorSCD30 : public Co2Sensor
         void readMeasurements(int& co2ppm, int& temperature, int& relHumidity);
         void readMeasurements(float& co2ppm, float& temperature, float& relHumidity);
 
+        // Busses are probed in parallel
         static void findI2cBusAll(std::vector<int>& i2cBusList);
         static int findI2cBus(void);
+
+        // Tries lastLocation first, and only probes every bus if the
+        // SCD30 is no longer there.
+        static int findI2cBus(const Location& lastLocation);
         static void findI2cDeviceAll(std::vector<std::string>& i2cDeviceList);
         static void findI2cDevice(std::string& i2cDevice);
 
+        // Each word in a command or response is followed by its CRC8.
+        static const int kMaxCommandArgs = 1;
+        static const int kMaxResponseWords = 6;
+        static const int kCommandBufSize = 2 + (kMaxCommandArgs * 3);
+        static const int kResponseBufSize = kMaxResponseWords * 3;
+        static const int kMeasurementWords = 6;
+
+        // Framing, used by the I2C path (and co2Bench).
+        // encodeCommand() returns number of bytes in buf.
+        // decodeResponse() throws CO2::exceptionLevel on CRC error.
+        static int encodeCommand(uint16_t command, std::span<const uint16_t> args, std::span<uint8_t, kCommandBufSize> buf);
+        static void decodeResponse(std::span<const uint8_t> buf, std::span<uint16_t> responseWords);
+        static void decodeMeasurements(std::span<const uint16_t, kMeasurementWords> responseWords,
+                                       float& co2ppm, float& temperature, float& relHumidity);
+
     private:
         typedef enum {
             TriggerContMeasCmd = 0x0010,
@@ -64,19 +100,32 @@ class Co2SensorSCD30 : public Co2Sensor
         } Commands;
 
         int i2cfd_;
+        int i2cBus_;              // -1 if opened by device name
+        int firmwareRevision_;    // read by init()
         static const int i2cAddr_ = 0x61;
 
+        // gpiochip line event for RDY pin (or -1 if not used)
+        int rdyFd_;
+
         uint16_t measurementInterval_;
         int64_t lastMeasurementTime_;
 
+        // minimum time between a command and reading its response
+        const std::chrono::microseconds kResponseDelay_ = std::chrono::microseconds(3000);
+        std::chrono::steady_clock::time_point lastCommandTime_;
+
         Co2SensorSCD30();
-        void sendCommand(Commands command, VU16& arglist);
+        void openRdyGpio(int rdyGpio);
+        bool rdyGpioIsHigh(void);
+        void waitForRdyGpio(std::chrono::milliseconds timeout);
+        void transfer(uint8_t* buf, int len, bool isRead);
+        void sendCommand(Commands command, std::span<const uint16_t> args);
         void sendCommand(Commands command, uint16_t arg);
         void sendCommand(Commands command);
-        void readResponse(int nResponseWords, VU16& responseWords);
+        void readResponse(std::span<uint16_t> responseWords);
         uint16_t readResponse(void);
-        uint8_t crc8(const uint8_t bytes[sizeof(uint16_t)]);
-        float bytes2float(uint8_t bytes[]);
+        static uint8_t crc8(const uint8_t bytes[sizeof(uint16_t)]);
+        static float bytes2float(uint8_t bytes[]);
 
     protected:
 };
@@ -6,6 +6,11 @@
  */
 
 #include "co2SensorSim.h"
+#include "co2SensorFactory.h"
+
+static Co2SensorFactory::Registrar registrar("sim", [](const Co2SensorFactory::SensorParams& params) -> Co2Sensor* {
+    return new Co2SensorSim();
+});
 
 Co2SensorSim::Co2SensorSim() : i_(0)
 {
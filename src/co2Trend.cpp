@@ -0,0 +1,182 @@
+/*
+ * co2Trend.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "co2Trend.h"
+
+Co2Trend::Co2Trend() :
+    head_(0),
+    count_(0),
+    addsSinceRebase_(0),
+    originTime_(0),
+    sumX_(0),
+    sumY_(0),
+    sumXX_(0),
+    sumXY_(0)
+{
+}
+
+Co2Trend::~Co2Trend()
+{
+}
+
+void Co2Trend::setCapacity(size_t capacity)
+{
+    ring_.assign(capacity, Sample());
+    clear();
+}
+
+void Co2Trend::clear()
+{
+    head_ = 0;
+    count_ = 0;
+    addsSinceRebase_ = 0;
+    originTime_ = 0;
+    sumX_ = 0;
+    sumY_ = 0;
+    sumXX_ = 0;
+    sumXY_ = 0;
+}
+
+void Co2Trend::resize(size_t capacity)
+{
+    size_t keep = std::min(count_, capacity);
+    std::vector<Sample> samples;
+
+    samples.reserve(keep);
+
+    for (size_t i = keep; i > 0; i--) {
+        samples.push_back(ring_[(head_ + ring_.size() - i) % ring_.size()]);
+    }
+
+    setCapacity(capacity);
+
+    for (auto& sample : samples) {
+        add(sample.time, sample.value);
+    }
+}
+
+void Co2Trend::rebase()
+{
+    size_t oldest = (head_ + ring_.size() - count_) % ring_.size();
+
+    originTime_ = ring_[oldest].time;
+    sumX_ = 0;
+    sumY_ = 0;
+    sumXX_ = 0;
+    sumXY_ = 0;
+
+    for (size_t i = 0; i < count_; i++) {
+        const Sample& sample = ring_[(oldest + i) % ring_.size()];
+        double x = sample.time - originTime_;
+
+        sumX_ += x;
+        sumY_ += sample.value;
+        sumXX_ += x * x;
+        sumXY_ += x * sample.value;
+    }
+
+    addsSinceRebase_ = 0;
+}
+
+void Co2Trend::add(double time, double value)
+{
+    if (ring_.empty()) {
+        return;
+    }
+
+    if (count_ == 0) {
+        originTime_ = time;
+    }
+
+    if (count_ == ring_.size()) {
+        // drop oldest, which is about to be overwritten
+        const Sample& oldest = ring_[head_];
+        double x = oldest.time - originTime_;
+
+        sumX_ -= x;
+        sumY_ -= oldest.value;
+        sumXX_ -= x * x;
+        sumXY_ -= x * oldest.value;
+        count_--;
+    }
+
+    double x = time - originTime_;
+
+    ring_[head_] = { time, value };
+    head_ = (head_ + 1) % ring_.size();
+    count_++;
+
+    sumX_ += x;
+    sumY_ += value;
+    sumXX_ += x * x;
+    sumXY_ += x * value;
+
+    // once per window, so still O(1) per sample
+    if (++addsSinceRebase_ >= ring_.size()) {
+        rebase();
+    }
+}
+
+bool Co2Trend::hasSlope() const
+{
+    if (count_ < kMinSamples) {
+        return false;
+    }
+
+    double n = count_;
+
+    // all samples at (almost) the same time
+    return ((n * sumXX_) - (sumX_ * sumX_)) > (1e-9 * n * n);
+}
+
+double Co2Trend::slope() const
+{
+    if (!hasSlope()) {
+        return 0;
+    }
+
+    double n = count_;
+
+    return ((n * sumXY_) - (sumX_ * sumY_)) / ((n * sumXX_) - (sumX_ * sumX_));
+}
+
+double Co2Trend::fittedValue(double time) const
+{
+    if (count_ == 0) {
+        return 0;
+    }
+
+    double n = count_;
+    double meanX = sumX_ / n;
+    double meanY = sumY_ / n;
+
+    return meanY + (slope() * ((time - originTime_) - meanX));
+}
+
+double Co2Trend::timeToRise(double threshold, double time) const
+{
+    if (!hasSlope()) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    double value = fittedValue(time);
+    double gradient = slope();
+
+    if (value >= threshold) {
+        return 0;
+    }
+
+    if (gradient <= 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    return (threshold - value) / gradient;
+}
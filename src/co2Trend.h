@@ -0,0 +1,83 @@
+/*
+ * co2Trend.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef CO2TREND_H
+#define CO2TREND_H
+
+#include <cstddef>
+#include <vector>
+
+// Least-squares straight line through the most recent samples of a
+// reading, kept in a fixed-size ring buffer.
+//
+// Running sums of x, y, xx and xy are updated as each sample is added and
+// the oldest dropped, so the slope is O(1) per sample however long the
+// window. Times are relative to an origin which moves up to the oldest
+// sample once per window (recomputing the sums), which keeps x small
+// enough that rounding errors cannot build up.
+//
+class Co2Trend
+{
+    public:
+        Co2Trend();
+
+        ~Co2Trend();
+
+        // Clears all samples. A trend with capacity 0 never has a slope.
+        void setCapacity(size_t capacity);
+        void clear();
+
+        // Changes capacity, keeping as many of the newest samples as fit,
+        // e.g. when they are to be taken further apart or closer together.
+        void resize(size_t capacity);
+
+        // time is in seconds, and must not go backwards
+        void add(double time, double value);
+
+        size_t count() const { return count_; }
+        size_t capacity() const { return ring_.size(); }
+
+        // True once there are enough samples, over a long enough time,
+        // for the slope to mean anything.
+        bool hasSlope() const;
+
+        // Change in value per second
+        double slope() const;
+
+        // Value of the fitted line at time
+        double fittedValue(double time) const;
+
+        // Seconds from time until the fitted line rises to threshold: 0 if
+        // it is already there, or infinity if there is no slope yet or it
+        // is not rising.
+        double timeToRise(double threshold, double time) const;
+
+    private:
+        typedef struct {
+            double time;
+            double value;
+        } Sample;
+
+        void rebase();
+
+        static const size_t kMinSamples = 3;
+
+        std::vector<Sample> ring_;
+        size_t head_;    // next to be written
+        size_t count_;
+        size_t addsSinceRebase_;
+
+        double originTime_;
+        double sumX_;
+        double sumY_;
+        double sumXX_;
+        double sumXY_;
+
+    protected:
+};
+
+#endif /* CO2TREND_H */
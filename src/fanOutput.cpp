@@ -0,0 +1,219 @@
+/*
+ * fanOutput.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <fcntl.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+#ifdef HAS_WIRINGPI
+#include <wiringPi.h>
+#endif
+
+#include "fanOutput.h"
+
+FanOutput::FanOutput()
+{
+}
+
+FanOutput::~FanOutput()
+{
+}
+
+FanOutput* FanOutput::create(const std::string& outputType, const std::string& path,
+                             int gpioPin, int pwmFrequency)
+{
+    if (outputType == "gpio") {
+        return new FanOutputGpio(gpioPin);
+    } else if (outputType == "pwm") {
+        return new FanOutputPwm(path, pwmFrequency);
+    } else if (outputType == "file") {
+        return new FanOutputFile(path);
+    }
+
+    throw CO2::exceptionLevel(fmt::format("unknown fan output \"{}\" - must be gpio, pwm or file", outputType), true);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+FanOutputGpio::FanOutputGpio(int gpioPin) :
+    gpioPin_(gpioPin),
+    isOn_(false)
+{
+}
+
+FanOutputGpio::~FanOutputGpio()
+{
+}
+
+void FanOutputGpio::init()
+{
+#ifdef HAS_WIRINGPI
+    // setup GPIO pin to control fan
+    pinMode(gpioPin_, OUTPUT);
+    digitalWrite(gpioPin_, 0);
+#endif
+    isOn_ = false;
+}
+
+void FanOutputGpio::setDuty(int duty)
+{
+    bool isOn = (duty > 0);
+
+    if (isOn != isOn_) {
+#ifdef HAS_WIRINGPI
+        digitalWrite(gpioPin_, isOn ? 1 : 0);
+#endif
+        isOn_ = isOn;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+FanOutputPwm::FanOutputPwm(const std::string& pwmPath, int frequency) :
+    pwmPath_(pwmPath),
+    periodNsec_(1000000000ULL / ((frequency > 0) ? frequency : 1)),
+    duty_(-1),
+    isEnabled_(false)
+{
+}
+
+FanOutputPwm::~FanOutputPwm()
+{
+    if (isEnabled_) {
+        try {
+            writeAttr("duty_cycle", 0);
+            writeAttr("enable", 0);
+        } catch (...) {
+            // nothing more we can do
+        }
+    }
+}
+
+void FanOutputPwm::writeAttr(const std::string& attr, uint64_t value)
+{
+    std::string fileName = pwmPath_ + "/" + attr;
+    int fd = open(fileName.c_str(), O_WRONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        throw CO2::exceptionLevel(fmt::format("cannot open \"{}\" ({})", fileName, strerror(errno)), false);
+    }
+
+    char buf[24];
+    char* end = fmt::format_to_n(buf, sizeof(buf), "{}\n", value).out;
+    ssize_t len = end - buf;
+    bool isOk = (write(fd, buf, len) == len);
+    int writeErrno = errno;
+
+    close(fd);
+
+    if (!isOk) {
+        throw CO2::exceptionLevel(fmt::format("cannot write {} to \"{}\" ({})", value, fileName, strerror(writeErrno)), false);
+    }
+}
+
+void FanOutputPwm::init()
+{
+    namespace fs = std::filesystem;
+
+    fs::path pwmPath(pwmPath_);
+    std::string channelName = pwmPath.filename().string();
+
+    if ((channelName.compare(0, 3, "pwm") != 0) || (channelName.length() <= 3)) {
+        throw CO2::exceptionLevel(fmt::format("\"{}\" is not a PWM channel, e.g. /sys/class/pwm/pwmchip0/pwm0", pwmPath_), true);
+    }
+
+    try {
+        if (!fs::exists(pwmPath)) {
+            std::string exportFileName = (pwmPath.parent_path() / "export").string();
+            int fd = open(exportFileName.c_str(), O_WRONLY | O_CLOEXEC);
+            std::string channel = channelName.substr(3) + "\n";
+
+            if ((fd < 0) || (write(fd, channel.c_str(), channel.length()) != ssize_t(channel.length()))) {
+                int exportErrno = errno;
+
+                if (fd >= 0) {
+                    close(fd);
+                }
+
+                throw CO2::exceptionLevel(fmt::format("cannot export \"{}\" ({})", pwmPath_, strerror(exportErrno)), true);
+            }
+
+            close(fd);
+
+            // udev takes a moment to set permissions on a newly exported channel
+            for (int i = 0; (i < 20) && (access((pwmPath / "period").c_str(), W_OK) < 0); i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+
+        // duty cycle must never be more than period, even briefly
+        writeAttr("duty_cycle", 0);
+        writeAttr("period", periodNsec_);
+        writeAttr("enable", 1);
+    } catch (CO2::exceptionLevel& el) {
+        throw CO2::exceptionLevel(fmt::format("PWM fan output: {}", el.what()), true);
+    }
+
+    isEnabled_ = true;
+    duty_ = 0;
+
+    syslog(LOG_INFO, "PWM fan output %s at %lluHz", pwmPath_.c_str(), 1000000000ULL / periodNsec_);
+}
+
+void FanOutputPwm::setDuty(int duty)
+{
+    duty = std::clamp(duty, 0, 100);
+
+    if (duty != duty_) {
+        writeAttr("duty_cycle", (periodNsec_ * duty) / 100);
+        duty_ = duty;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+FanOutputFile::FanOutputFile(const std::string& fileName) :
+    fileName_(fileName),
+    fd_(-1)
+{
+}
+
+FanOutputFile::~FanOutputFile()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+void FanOutputFile::init()
+{
+    fd_ = open(fileName_.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+        throw CO2::exceptionLevel(fmt::format("cannot open fan output file \"{}\" ({})", fileName_, strerror(errno)), true);
+    }
+
+    setDuty(0);
+}
+
+void FanOutputFile::setDuty(int duty)
+{
+    char buf[8];
+    char* end = fmt::format_to_n(buf, sizeof(buf), "{}\n", std::clamp(duty, 0, 100)).out;
+    ssize_t len = end - buf;
+
+    if ((pwrite(fd_, buf, len, 0) != len) || (ftruncate(fd_, len) < 0)) {
+        throw CO2::exceptionLevel(fmt::format("cannot write fan output file \"{}\" ({})", fileName_, strerror(errno)), false);
+    }
+}
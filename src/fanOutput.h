@@ -0,0 +1,110 @@
+/*
+ * fanOutput.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef FANOUTPUT_H
+#define FANOUTPUT_H
+
+#include <string>
+
+#include "utils.h"
+
+// Drives the fan, on/off or at a variable speed.
+//
+//   gpio   on/off through a GPIO pin (the original fan relay)
+//   pwm    sysfs PWM channel, e.g. /sys/class/pwm/pwmchip0/pwm0, which is
+//          exported if necessary
+//   file   writes duty cycle to a file, so variable speed control can be
+//          tried out and tested without hardware
+//
+class FanOutput
+{
+    public:
+        virtual ~FanOutput();
+
+        // Throws a fatal exceptionLevel if the output cannot be used.
+        virtual void init() = 0;
+
+        // duty is percent: 0 is off, 100 is full speed. On/off outputs
+        // switch on for any duty above 0. Throws a non-fatal
+        // exceptionLevel if the output cannot be set.
+        virtual void setDuty(int duty) = 0;
+
+        virtual bool isVariableSpeed() const = 0;
+
+        // Throws a fatal exceptionLevel for an unknown outputType.
+        static FanOutput* create(const std::string& outputType, const std::string& path,
+                                 int gpioPin, int pwmFrequency);
+
+    protected:
+        FanOutput();
+};
+
+class FanOutputGpio : public FanOutput
+{
+    public:
+        FanOutputGpio(int gpioPin);
+
+        ~FanOutputGpio();
+
+        void init();
+        void setDuty(int duty);
+        bool isVariableSpeed() const { return false; }
+
+    private:
+        FanOutputGpio();
+
+        int gpioPin_;
+        bool isOn_;
+
+    protected:
+};
+
+class FanOutputPwm : public FanOutput
+{
+    public:
+        FanOutputPwm(const std::string& pwmPath, int frequency);
+
+        ~FanOutputPwm();
+
+        void init();
+        void setDuty(int duty);
+        bool isVariableSpeed() const { return true; }
+
+    private:
+        FanOutputPwm();
+
+        void writeAttr(const std::string& attr, uint64_t value);
+
+        std::string pwmPath_;
+        uint64_t periodNsec_;
+        int duty_;
+        bool isEnabled_;
+
+    protected:
+};
+
+class FanOutputFile : public FanOutput
+{
+    public:
+        FanOutputFile(const std::string& fileName);
+
+        ~FanOutputFile();
+
+        void init();
+        void setDuty(int duty);
+        bool isVariableSpeed() const { return true; }
+
+    private:
+        FanOutputFile();
+
+        std::string fileName_;
+        int fd_;
+
+    protected:
+};
+
+#endif /* FANOUTPUT_H */
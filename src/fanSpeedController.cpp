@@ -0,0 +1,120 @@
+/*
+ * fanSpeedController.cpp
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
+
+#include "fanSpeedController.h"
+
+const char* FanSpeedController::kDefaultCurve = "0:30,20:70,50:100";
+
+FanSpeedController::FanSpeedController() :
+    kp_(0),
+    ki_(0),
+    integral_(0)
+{
+    setCurve(kDefaultCurve);
+}
+
+FanSpeedController::~FanSpeedController()
+{
+}
+
+void FanSpeedController::setCurve(const std::string& curve)
+{
+    std::vector<Point> points;
+    size_t startPos = 0;
+
+    while (startPos <= curve.length()) {
+        size_t endPos = curve.find(',', startPos);
+
+        if (endPos == std::string::npos) {
+            endPos = curve.length();
+        }
+
+        std::string pointStr = curve.substr(startPos, endPos - startPos);
+        Point point;
+        size_t colonPos = pointStr.find(':');
+
+        try {
+            if (colonPos == std::string::npos) {
+                throw std::invalid_argument("no colon");
+            }
+
+            point.excess = std::stod(pointStr.substr(0, colonPos));
+            point.duty = std::stod(pointStr.substr(colonPos + 1));
+        } catch (std::exception& e) {
+            throw CO2::exceptionLevel(fmt::format("fan curve \"{}\": \"{}\" is not excess:duty", curve, pointStr), true);
+        }
+
+        if ((point.duty < 0) || (point.duty > 100)) {
+            throw CO2::exceptionLevel(fmt::format("fan curve \"{}\": duty must be 0 to 100", curve), true);
+        }
+
+        if (!points.empty() && (point.excess <= points.back().excess)) {
+            throw CO2::exceptionLevel(fmt::format("fan curve \"{}\": excess must increase", curve), true);
+        }
+
+        points.push_back(point);
+        startPos = endPos + 1;
+    }
+
+    curve_ = points;
+    reset();
+}
+
+void FanSpeedController::setGains(double kp, double ki)
+{
+    kp_ = kp;
+    ki_ = ki;
+    reset();
+}
+
+void FanSpeedController::reset()
+{
+    integral_ = 0;
+}
+
+double FanSpeedController::curveDuty(double excessPct) const
+{
+    if (excessPct <= curve_.front().excess) {
+        return curve_.front().duty;
+    }
+
+    for (size_t i = 1; i < curve_.size(); i++) {
+        const Point& upper = curve_[i];
+
+        if (excessPct < upper.excess) {
+            const Point& lower = curve_[i - 1];
+
+            return lower.duty + ((excessPct - lower.excess) * (upper.duty - lower.duty) / (upper.excess - lower.excess));
+        }
+    }
+
+    return curve_.back().duty;
+}
+
+int FanSpeedController::minDuty() const
+{
+    return std::max(1L, std::lround(curveDuty(0)));
+}
+
+int FanSpeedController::update(double excessPct, double dtSecs)
+{
+    double low = minDuty();
+    double duty = curveDuty(std::max(excessPct, 0.0)) + (kp_ * excessPct);
+    double output = duty + (ki_ * integral_);
+
+    // stop integrating while the output is at a limit and would only go further past it
+    if (!((output >= 100) && (excessPct > 0)) && !((output <= low) && (excessPct < 0))) {
+        integral_ += excessPct * std::max(dtSecs, 0.0) / 60;
+        output = duty + (ki_ * integral_);
+    }
+
+    return int(std::lround(std::clamp(output, low, 100.0)));
+}
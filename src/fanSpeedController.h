@@ -0,0 +1,68 @@
+/*
+ * fanSpeedController.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef FANSPEEDCONTROLLER_H
+#define FANSPEEDCONTROLLER_H
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+// Works out the fan speed (duty cycle, percent) from how far CO2 or
+// relative humidity is above its fan-on threshold.
+//
+// The curve maps excess (percent above threshold) to duty, and is a comma
+// separated list of excess:duty points with straight lines between them,
+// e.g. "0:30,20:70,50:100". Excess below the first point gives the first
+// duty, above the last point the last duty.
+//
+// A PI term on top of the curve corrects for a room where the curve alone
+// settles above threshold: kp is duty per percent of excess, and ki is
+// duty per percent of excess per minute. Both default to 0, i.e. curve only.
+// The integral stops growing while the output is at a limit, so it cannot
+// wind up while the fan is already flat out.
+//
+class FanSpeedController
+{
+    public:
+        FanSpeedController();
+
+        ~FanSpeedController();
+
+        // Throws a fatal exceptionLevel for an invalid curve.
+        void setCurve(const std::string& curve);
+        void setGains(double kp, double ki);
+
+        void reset();
+
+        // excessPct is percent above threshold (negative when below), and
+        // dtSecs the time since the last update. Returns duty, percent.
+        int update(double excessPct, double dtSecs);
+
+        // Duty the fan runs at when just on
+        int minDuty() const;
+
+        static const char* kDefaultCurve;
+
+    private:
+        typedef struct {
+            double excess;
+            double duty;
+        } Point;
+
+        double curveDuty(double excessPct) const;
+
+        std::vector<Point> curve_;
+        double kp_;
+        double ki_;
+        double integral_;    // percent-minutes
+
+    protected:
+};
+
+#endif /* FANSPEEDCONTROLLER_H */
@@ -0,0 +1,168 @@
+/*
+ * latencyHistogram.h
+ *
+ * Created on: 2026-10-18
+ *     Author: patw
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <time.h>
+#include <fmt/core.h>
+
+// Histogram of latencies (in nsec) with log-linear buckets: each power of
+// two is split into 16 buckets, so percentiles are within about 6%, from
+// nanoseconds up to hours, in a fixed 5KB with no allocation.
+//
+// One thread records; any thread may read percentiles at the same time.
+//
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram()
+        {
+            reset();
+        }
+
+        void record(uint64_t nsec)
+        {
+            buckets_[bucketIndex(nsec)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sumNsec_.fetch_add(nsec, std::memory_order_relaxed);
+
+            if (nsec > maxNsec_.load(std::memory_order_relaxed)) {
+                maxNsec_.store(nsec, std::memory_order_relaxed);
+            }
+        }
+
+        void record(std::chrono::steady_clock::duration duration)
+        {
+            int64_t nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            record(uint64_t((nsec > 0) ? nsec : 0));
+        }
+
+        void reset()
+        {
+            for (auto& bucket : buckets_) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+
+            count_.store(0, std::memory_order_relaxed);
+            sumNsec_.store(0, std::memory_order_relaxed);
+            maxNsec_.store(0, std::memory_order_relaxed);
+        }
+
+        uint64_t count() const
+        {
+            return count_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t maxNsec() const
+        {
+            return maxNsec_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t meanNsec() const
+        {
+            uint64_t n = count();
+            return n ? sumNsec_.load(std::memory_order_relaxed) / n : 0;
+        }
+
+        // Smallest latency which percent% of those recorded didn't exceed
+        // (to within a bucket), e.g. percentileNsec(99.0).
+        uint64_t percentileNsec(double percent) const
+        {
+            uint64_t n = count();
+
+            if (n == 0) {
+                return 0;
+            }
+
+            uint64_t rank = uint64_t((percent / 100.0) * n + 0.5);
+            uint64_t seen = 0;
+
+            rank = (rank < 1) ? 1 : rank;
+
+            for (int i = 0; i < kBucketCount; i++) {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+
+                if (seen >= rank) {
+                    uint64_t upperBound = bucketUpperBound(i);
+                    return (upperBound < maxNsec()) ? upperBound : maxNsec();
+                }
+            }
+
+            return maxNsec();
+        }
+
+        // e.g. "n=1000 mean=12.1us p50=11.5us p90=14.0us p99=31.0us p99.9=95.0us max=120.3us"
+        std::string summary() const
+        {
+            return fmt::format("n={} mean={:.1f}us p50={:.1f}us p90={:.1f}us p99={:.1f}us p99.9={:.1f}us max={:.1f}us",
+                               count(), meanNsec() / 1e3, percentileNsec(50.0) / 1e3, percentileNsec(90.0) / 1e3,
+                               percentileNsec(99.0) / 1e3, percentileNsec(99.9) / 1e3, maxNsec() / 1e3);
+        }
+
+        // CPU time used by the calling thread, so that stages can report
+        // how much CPU they take alongside their latency.
+        static uint64_t threadCpuNsec()
+        {
+            struct timespec ts;
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+            return (uint64_t(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+        }
+
+    private:
+        LatencyHistogram(const LatencyHistogram& rhs);
+        LatencyHistogram& operator=(const LatencyHistogram& rhs);
+
+        static const int kSubBucketBits = 4;
+        static const int kSubBuckets = 1 << kSubBucketBits;
+        static const int kMaxShift = 40;   // 2^44 nsec is nearly 5 hours
+        static const int kBucketCount = (kMaxShift + 2) * kSubBuckets;
+
+        // Values below kSubBuckets have a bucket each. Above that, bucket
+        // is picked by the position of the top bit and the 4 bits below it.
+        static int bucketIndex(uint64_t nsec)
+        {
+            if (nsec < uint64_t(kSubBuckets)) {
+                return int(nsec);
+            }
+
+            int shift = (63 - __builtin_clzll(nsec)) - kSubBucketBits;
+
+            if (shift > kMaxShift) {
+                return kBucketCount - 1;
+            }
+
+            return ((shift + 1) * kSubBuckets) + int((nsec >> shift) & (kSubBuckets - 1));
+        }
+
+        static uint64_t bucketUpperBound(int index)
+        {
+            if (index < kSubBuckets) {
+                return index;
+            }
+
+            int shift = (index / kSubBuckets) - 1;
+            uint64_t lowerBound = uint64_t(kSubBuckets + (index % kSubBuckets)) << shift;
+
+            return lowerBound + (uint64_t(1) << shift) - 1;
+        }
+
+        std::atomic<uint64_t> buckets_[kBucketCount];
+        std::atomic<uint64_t> count_;
+        std::atomic<uint64_t> sumNsec_;
+        std::atomic<uint64_t> maxNsec_;
+
+    protected:
+};
+
+#endif /* LATENCYHISTOGRAM_H */
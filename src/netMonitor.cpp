@@ -510,18 +510,22 @@ void NetMonitor::listener(int terminatePipeFd)
     bool shouldTerminate = false;
 
     subSocket_.connect(CO2::co2MainPubEndpoint);
-    subSocket_.set(zmq::sockopt::subscribe, "");
+
+    // only the messages handled below
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_NET_CFG);
+    CO2::subscribe(subSocket_, co2Message::Co2Message_Co2MessageType_TERMINATE);
+
+    // reused for every message, so that its buffer is too
+    zmq::message_t msg;
+    CO2::MsgArena msgArena;
 
     while (!shouldTerminate) {
         try {
-            zmq::message_t msg;
-
-            if (subSocket_.recv(msg, zmq::recv_flags::none)) {
+            if (CO2::recvPublished(subSocket_, msg, rxMsgCounters_)) {
 
-                std::string msg_str(static_cast<char*>(msg.data()), msg.size());
-                co2Message::Co2Message co2Msg;
+                co2Message::Co2Message& co2Msg = *msgArena.newMsg();
 
-                if (!co2Msg.ParseFromString(msg_str)) {
+                if (!CO2::parseMsg(msg, co2Msg)) {
                     throw CO2::exceptionLevel("couldn't parse published message", false);
                 }
 
@@ -568,7 +572,6 @@ void NetMonitor::listener(int terminatePipeFd)
 void NetMonitor::sendNetState()
 {
     DBG_TRACE();
-    std::string netStateStr;
     co2Message::Co2Message co2Msg;
     co2Message::NetState* netState = co2Msg.mutable_netstate();
 
@@ -579,12 +582,7 @@ void NetMonitor::sendNetState()
         netState->set_myipaddress(myIPAddress_);
     }
 
-    co2Msg.SerializeToString(&netStateStr);
-
-    zmq::message_t netStateMsg(netStateStr.size());
-    memcpy(netStateMsg.data(), netStateStr.c_str(), netStateStr.size());
-
-    mainSocket_.send(netStateMsg, zmq::send_flags::none);
+    CO2::sendMsg(mainSocket_, co2Msg);
 }
 
 void NetMonitor::getConfigFromMsg(co2Message::Co2Message& netCfgMsg)
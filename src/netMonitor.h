@@ -35,6 +35,7 @@ class NetMonitor
         zmq::context_t& ctx_;
         zmq::socket_t mainSocket_;
         zmq::socket_t subSocket_;
+        CO2::MsgCounters rxMsgCounters_;
 
         time_t networkCheckPeriod_;
 
@@ -67,6 +68,9 @@ class NetMonitor
 
         void run();
 
+        // Messages received from Co2Main, by type
+        const CO2::MsgCounters& rxMsgCounters() const { return rxMsgCounters_; }
+
 };
 
 #endif /* NETMONITOR_H */
@@ -13,6 +13,7 @@
 #include <unistd.h>
 
 #include "ping.h"
+#include "checksum.h"
 #include "utils.h"
 
 // Define some constants.
@@ -45,26 +46,7 @@ const char* Ping::statestr()
 
 uint16_t Ping::checksum (void* addr, int len)
 {
-    uint32_t sum = 0;
-    uint16_t* pBuf = (uint16_t*)addr;
-
-    // Main summing loop
-    while (len > 1) {
-        sum +=  *pBuf++;
-        len -= sizeof(uint16_t);
-    }
-
-    // Add left-over byte, if any
-    if (len > 0) {
-        sum +=  *(uint8_t*)pBuf;
-    }
-
-    // Fold 32-bit sum to 16 bits
-    while (sum >> 16) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
-    }
-
-    return (uint16_t)~sum;
+    return Checksum::internet(addr, len);
 }
 
 uint32_t Ping::getRandom32(void)
@@ -280,4 +280,39 @@ co2Message::Co2PersistentStore_RestartReason RestartMgr::restartReason()
     return persistentStore_->restartReason();
 }
 
+void RestartMgr::saveFanRuntime(const co2Message::FanRuntime& fanRuntime, bool shouldWrite)
+{
+    persistentStore_->setFanRuntime(fanRuntime);
+
+    if (shouldWrite) {
+        persistentStore_->write();
+    }
+}
+
+bool RestartMgr::fanRuntime(co2Message::FanRuntime& fanRuntime)
+{
+    if (!persistentStore_->hasFanRuntime()) {
+        return false;
+    }
+
+    fanRuntime = persistentStore_->fanRuntime();
+
+    return true;
+}
 
+void RestartMgr::saveSensorInfo(const co2Message::SensorInfo& sensorInfo)
+{
+    persistentStore_->setSensorInfo(sensorInfo);
+    persistentStore_->write();
+}
+
+bool RestartMgr::sensorInfo(co2Message::SensorInfo& sensorInfo)
+{
+    if (!persistentStore_->hasSensorInfo()) {
+        return false;
+    }
+
+    sensorInfo = persistentStore_->sensorInfo();
+
+    return true;
+}
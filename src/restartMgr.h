@@ -32,6 +32,16 @@ class RestartMgr
 
         co2Message::Co2PersistentStore_RestartReason restartReason();
 
+        // Fan runtime is kept up to date here, and only written to the
+        // persistent store (flash) when shouldWrite, to save wear.
+        void saveFanRuntime(const co2Message::FanRuntime& fanRuntime, bool shouldWrite);
+        bool fanRuntime(co2Message::FanRuntime& fanRuntime);
+
+        // Where the I2C sensor was found. Written straight away, as it
+        // only changes when hardware does.
+        void saveSensorInfo(const co2Message::SensorInfo& sensorInfo);
+        bool sensorInfo(co2Message::SensorInfo& sensorInfo);
+
     private:
 
         void doShutdown(uint32_t temperature, uint32_t co2, uint32_t relHumidity);
@@ -19,10 +19,13 @@ StatusScreen::StatusScreen() :
     temperatureChanged_(false),
     relHumChanged_(false),
     co2Changed_(false),
+    co2Trend_(0),
     fanStateOn_(false),
     fanStateChanged_(false),
     fanAuto_(false),
     fanAutoChanged_(false),
+    fanDuty_(0),
+    fanDutyChanged_(false),
     fanManOnEndTime_(0),
     wifiStateOn_(false),
     wifiStateChanged_(false)
@@ -152,6 +155,22 @@ void StatusScreen::init(SDL_Window* window, std::string& sdlBmpDir, std::array<C
 
     addElement(element, &position, fgColour, bgColour, text, fontSize);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    element = static_cast<int>(Co2Rising);
+    text.clear();
+    text = sdlBitMapDir_ + "arrow-up-red.bmp";
+    bgColour = {0, 0, 0};
+    position = {440, 300, 0, 0};
+
+    addElement(element, &position, bgColour, text);
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    element = static_cast<int>(Co2Falling);
+    text.clear();
+    text = sdlBitMapDir_ + "arrow-down-green.bmp";
+
+    addElement(element, &position, bgColour, text);
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////
     element = static_cast<int>(FanOverrideAutoText);
     text.clear();
@@ -180,6 +199,15 @@ void StatusScreen::init(SDL_Window* window, std::string& sdlBmpDir, std::array<C
 
     addElement(element, &position, fgColour, bgColour, text, fontSize);
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    element = static_cast<int>(FanDutyText);
+    text.clear();
+    text = "    ";
+    position = {500, 190, 0, 0};
+    fontSize = Co2Display::Small;
+
+    addElement(element, &position, fgColour, bgColour, text, fontSize);
+
     ////////////////////////////////////////////////////////////////////////////////////////////////////
 
     int fanOnImageIndexOffset = static_cast<int>(FanOnFirst);
@@ -279,6 +307,12 @@ void StatusScreen::draw(bool refreshOnly)
             elements.push_back(static_cast<int>(FanManOnCountdown));
         }
 
+        if (fanDutyChanged_ && fanStateOn_ && fanAuto_) {
+            updateFanDutyText();
+            elements.push_back(static_cast<int>(FanDutyText));
+            displayElements_[static_cast<int>(FanDutyText)]->setClearBeforeDraw();
+        }
+
         if (wifiStateChanged_) {
             int wifiStateIdx = wifiStateOn_ ? static_cast<int>(WiFiStateOn) : static_cast<int>(WiFiStateOff);
             elements.push_back(wifiStateIdx);
@@ -299,8 +333,19 @@ void StatusScreen::draw(bool refreshOnly)
         elements.push_back(static_cast<int>(Co2Value));
         elements.push_back(static_cast<int>(Co2UnitText));
 
+        if (co2Trend_ > 0) {
+            elements.push_back(static_cast<int>(Co2Rising));
+        } else if (co2Trend_ < 0) {
+            elements.push_back(static_cast<int>(Co2Falling));
+        }
+
         if (fanAuto_) {
             elements.push_back(static_cast<int>(FanOverrideAutoText));
+
+            if (fanStateOn_) {
+                updateFanDutyText();
+                elements.push_back(static_cast<int>(FanDutyText));
+            }
         } else {
             elements.push_back(static_cast<int>(FanOverrideManText));
 
@@ -382,6 +427,18 @@ void StatusScreen::setCo2(int co2)
     co2Changed_ = true;
 }
 
+void StatusScreen::setCo2Trend(int trend)
+{
+    if (!initComplete_) {
+        throw CO2::exceptionLevel("Screen not initialised", true);
+    }
+
+    if (co2Trend_ != trend) {
+        co2Trend_ = trend;
+        setNeedsRedraw();   // so an arrow no longer wanted is cleared
+    }
+}
+
 void StatusScreen::setFanState(bool isOn)
 {
     if (!initComplete_) {
@@ -409,6 +466,18 @@ void StatusScreen::setFanAuto(bool isAuto)
     }
 }
 
+void StatusScreen::setFanDuty(int duty)
+{
+    if (!initComplete_) {
+        throw CO2::exceptionLevel("Screen not initialised", true);
+    }
+
+    if (fanDuty_ != duty) {
+        fanDuty_ = duty;
+        fanDutyChanged_ = true;
+    }
+}
+
 void StatusScreen::startFanManOnTimer(time_t duration)
 {
     if (!initComplete_) {
@@ -471,6 +540,27 @@ void StatusScreen::updateFanManOnCountdown()
     setElementText(element, text);
 }
 
+// Speed is only shown for a variable speed fan running below full
+// speed, as on/off fans always run at 100%.
+void StatusScreen::updateFanDutyText()
+{
+    if (!initComplete_) {
+        throw CO2::exceptionLevel("Screen not initialised", true);
+    }
+
+    int element = static_cast<int>(FanDutyText);
+    std::string text;
+
+    if ((fanDuty_ > 0) && (fanDuty_ < 100)) {
+        text = CO2::zeroPadNumber(3, fanDuty_, ' ') + "%";
+    } else {
+        text = "    ";
+    }
+
+    setElementText(element, text);
+    fanDutyChanged_ = false;
+}
+
 void StatusScreen::setWiFiState(bool isOn)
 {
     if (!initComplete_) {
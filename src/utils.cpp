@@ -6,6 +6,7 @@
  */
 
 #include <syslog.h>
+#include <fmt/core.h>
 
 #include "utils.h"
 
@@ -279,7 +280,6 @@ void CO2::ThreadFSM::sendThreadState()
         return;
     }
 
-    std::string threadStateStr;
     co2Message::Co2Message co2Msg;
     co2Message::ThreadState* threadState = co2Msg.mutable_threadstate();
 
@@ -287,13 +287,185 @@ void CO2::ThreadFSM::sendThreadState()
 
     threadState->set_threadstate(state_.load(std::memory_order_relaxed));
 
-    co2Msg.SerializeToString(&threadStateStr);
+    CO2::sendMsg(*pSendSocket_, co2Msg);
+    syslog(LOG_DEBUG, "%s sent new state %s", threadName_.c_str(), stateStr());
+}
 
-    zmq::message_t threadStateMsg(threadStateStr.size());
-    memcpy (threadStateMsg.data(), threadStateStr.c_str(), threadStateStr.size());
+void CO2::serializeMsg(const co2Message::Co2Message& co2Msg, zmq::message_t& msg)
+{
+    // ByteSizeLong() caches the size of each sub-message, so serializing
+    // with the cached sizes doesn't have to work them out again.
+    msg.rebuild(co2Msg.ByteSizeLong());
+    co2Msg.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(msg.data()));
+}
 
-    pSendSocket_->send(threadStateMsg, zmq::send_flags::none);
-    syslog(LOG_DEBUG, "%s sent new state %s", threadName_.c_str(), stateStr());
+bool CO2::sendMsg(zmq::socket_t& socket, const co2Message::Co2Message& co2Msg, zmq::send_flags flags)
+{
+    zmq::message_t msg;
+
+    CO2::serializeMsg(co2Msg, msg);
+
+    return socket.send(msg, flags).has_value();
+}
+
+bool CO2::parseMsg(const zmq::message_t& msg, co2Message::Co2Message& co2Msg)
+{
+    return co2Msg.ParseFromArray(msg.data(), static_cast<int>(msg.size()));
+}
+
+bool CO2::publishMsg(zmq::socket_t& socket, const co2Message::Co2Message& co2Msg)
+{
+    zmq::message_t msg;
+
+    CO2::serializeMsg(co2Msg, msg);
+
+    return CO2::publishMsg(socket, co2Msg.messagetype(), msg);
+}
+
+bool CO2::publishMsg(zmq::socket_t& socket, co2Message::Co2Message_Co2MessageType msgType, zmq::message_t& msg)
+{
+    const uint8_t topic = static_cast<uint8_t>(msgType);
+
+    if (!socket.send(zmq::buffer(&topic, sizeof(topic)), zmq::send_flags::sndmore)) {
+        return false;
+    }
+
+    return socket.send(msg, zmq::send_flags::none).has_value();
+}
+
+void CO2::subscribe(zmq::socket_t& socket, co2Message::Co2Message_Co2MessageType msgType)
+{
+    char topic = static_cast<char>(msgType);
+
+    socket.set(zmq::sockopt::subscribe, std::string_view(&topic, sizeof(topic)));
+}
+
+bool CO2::recvPublished(zmq::socket_t& socket, zmq::message_t& msg, CO2::MsgCounters& rxCounters)
+{
+    // topic frame first, into msg as it's about to be replaced anyway
+    if (!socket.recv(msg, zmq::recv_flags::none)) {
+        return false;
+    }
+
+    if ((msg.size() != 1) || !msg.more()) {
+        throw CO2::exceptionLevel(fmt::format("published message has no topic ({} byte first frame)", msg.size()), false);
+    }
+
+    int msgType = *static_cast<const uint8_t*>(msg.data());
+
+    if (co2Message::Co2Message_Co2MessageType_IsValid(msgType)) {
+        rxCounters.add(static_cast<co2Message::Co2Message_Co2MessageType>(msgType));
+    }
+
+    return socket.recv(msg, zmq::recv_flags::none).has_value();
+}
+
+uint64_t CO2::steadyNsec(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::chrono::steady_clock::time_point CO2::steadyTime(uint64_t nsec)
+{
+    return std::chrono::steady_clock::time_point(
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(nsec)));
+}
+
+void CO2::addLatency(co2Message::Stats& stats, const std::string& name, const LatencyHistogram& latency)
+{
+    co2Message::Stats_Latency* hop = stats.add_latencies();
+
+    hop->set_name(name);
+    hop->set_count(latency.count());
+    hop->set_meannsec(latency.meanNsec());
+    hop->set_p50nsec(latency.percentileNsec(50.0));
+    hop->set_p90nsec(latency.percentileNsec(90.0));
+    hop->set_p99nsec(latency.percentileNsec(99.0));
+    hop->set_p999nsec(latency.percentileNsec(99.9));
+    hop->set_maxnsec(latency.maxNsec());
+}
+
+void CO2::logStats(int priority, const co2Message::Stats& stats)
+{
+    for (const co2Message::Stats_Latency& hop : stats.latencies()) {
+        // same format as LatencyHistogram::summary()
+        std::string summary = fmt::format("n={} mean={:.1f}us p50={:.1f}us p90={:.1f}us p99={:.1f}us p99.9={:.1f}us max={:.1f}us",
+                                          hop.count(), hop.meannsec() / 1e3, hop.p50nsec() / 1e3, hop.p90nsec() / 1e3,
+                                          hop.p99nsec() / 1e3, hop.p999nsec() / 1e3, hop.maxnsec() / 1e3);
+
+        syslog(priority, "%s: %s latency %s", stats.threadname().c_str(), hop.name().c_str(), summary.c_str());
+    }
+}
+
+CO2::MsgCounters::MsgCounters()
+{
+    for (auto& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+CO2::MsgCounters::~MsgCounters()
+{
+}
+
+void CO2::MsgCounters::add(co2Message::Co2Message_Co2MessageType msgType)
+{
+    counts_[msgType].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t CO2::MsgCounters::count(co2Message::Co2Message_Co2MessageType msgType) const
+{
+    return counts_[msgType].load(std::memory_order_relaxed);
+}
+
+uint64_t CO2::MsgCounters::total() const
+{
+    uint64_t total = 0;
+
+    for (auto& count : counts_) {
+        total += count.load(std::memory_order_relaxed);
+    }
+
+    return total;
+}
+
+CO2::MsgArena::MsgArena() :
+    arena_(arenaOptions(block_, sizeof(block_))),
+    msgCount_(0),
+    resetCount_(0),
+    overflowCount_(0)
+{
+}
+
+CO2::MsgArena::~MsgArena()
+{
+}
+
+google::protobuf::ArenaOptions CO2::MsgArena::arenaOptions(char* block, size_t size)
+{
+    google::protobuf::ArenaOptions options;
+
+    options.initial_block = block;
+    options.initial_block_size = size;
+
+    return options;
+}
+
+co2Message::Co2Message* CO2::MsgArena::newMsg()
+{
+    if (arena_.SpaceUsed() >= (kBlockSize_ / 2)) {
+        if (arena_.SpaceAllocated() > kBlockSize_) {
+            overflowCount_++;
+        }
+
+        // frees every message in the batch, and any blocks beyond our own
+        arena_.Reset();
+        resetCount_++;
+    }
+
+    msgCount_++;
+
+    return google::protobuf::Arena::CreateMessage<co2Message::Co2Message>(&arena_);
 }
 
 
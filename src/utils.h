@@ -8,10 +8,12 @@
 #ifndef _UTILS_H_
 #define _UTILS_H_
 
+#include <chrono>
 #include <zmq.hpp>
 
 #include "config.h"
 #include "co2Message.pb.h"
+#include "latencyHistogram.h"
 
 #ifdef DEBUG
 #define DBG_TRACE_MSG(MSG)  syslog(LOG_DEBUG, "%s::%s: (line %u) - " MSG, typeid(this).name(), __FUNCTION__, __LINE__)
@@ -69,6 +71,69 @@ class ThreadFSM
         zmq::socket_t* pSendSocket_;
 };
 
+// Messages counted by type, e.g. those published by Co2Main or received
+// by one of its subscribers. Can be counted and read from any thread.
+//
+class MsgCounters
+{
+    public:
+        MsgCounters();
+        ~MsgCounters();
+
+        void add(co2Message::Co2Message_Co2MessageType msgType);
+
+        uint64_t count(co2Message::Co2Message_Co2MessageType msgType) const;
+        uint64_t total() const;
+
+    private:
+        MsgCounters(const MsgCounters& rhs);
+        MsgCounters& operator=(const MsgCounters& rhs);
+
+        static const int kMsgTypes_ = co2Message::Co2Message_Co2MessageType_Co2MessageType_ARRAYSIZE;
+
+        std::atomic<uint64_t> counts_[kMsgTypes_];
+
+    protected:
+};
+
+// Co2Messages received by one thread are parsed into this arena rather
+// than onto the heap. It starts with a block of its own, and is reset
+// once a batch of messages has used half of it, so a running listener
+// doesn't call the global allocator to parse messages. Only a message
+// too big for what is left of the block (a config with long strings,
+// say) makes the arena allocate more from the heap, until it is reset.
+//
+class MsgArena
+{
+    public:
+        MsgArena();
+        ~MsgArena();
+
+        // New, empty message on the arena. Messages from earlier calls may
+        // be freed by this, so must no longer be in use.
+        co2Message::Co2Message* newMsg();
+
+        uint64_t msgCount() const { return msgCount_; }
+        uint64_t resetCount() const { return resetCount_; }
+        uint64_t overflowCount() const { return overflowCount_; } // batches which didn't fit in the block
+
+    private:
+        MsgArena(const MsgArena& rhs);
+        MsgArena& operator=(const MsgArena& rhs);
+
+        static google::protobuf::ArenaOptions arenaOptions(char* block, size_t size);
+
+        static const size_t kBlockSize_ = 16 * 1024;
+
+        alignas(8) char block_[kBlockSize_];
+        google::protobuf::Arena arena_;
+        uint64_t msgCount_;
+        uint64_t resetCount_;
+        uint64_t overflowCount_;
+
+    protected:
+};
+
 class exceptionLevel: public std::exception
 {
         std::string errorStr_;
@@ -140,6 +205,45 @@ const char* getLogLevelStr(int logLevel);
 
 const char* threadStateStr(co2Message::ThreadState_ThreadStates);
 
+// Serializes co2Msg straight into msg, which is resized to fit, rather
+// than into a std::string which then has to be copied into msg.
+void serializeMsg(const co2Message::Co2Message& co2Msg, zmq::message_t& msg);
+
+// Serializes co2Msg into a new zmq message and sends it. False if it
+// could not be sent.
+bool sendMsg(zmq::socket_t& socket, const co2Message::Co2Message& co2Msg,
+             zmq::send_flags flags = zmq::send_flags::none);
+
+// Messages on Co2Main's PUB socket are two frames: a one byte topic,
+// which is the message type, then the message itself. Subscribers
+// subscribe to just the message types they handle, so zmq drops the
+// rest without them ever being received, let alone parsed.
+bool publishMsg(zmq::socket_t& socket, const co2Message::Co2Message& co2Msg);
+
+// Publishes msg, which is already a serialized message of msgType
+bool publishMsg(zmq::socket_t& socket, co2Message::Co2Message_Co2MessageType msgType, zmq::message_t& msg);
+
+void subscribe(zmq::socket_t& socket, co2Message::Co2Message_Co2MessageType msgType);
+
+// Receives a message published by publishMsg() into msg, and counts it
+// by its topic in rxCounters. False if nothing was received.
+bool recvPublished(zmq::socket_t& socket, zmq::message_t& msg, MsgCounters& rxCounters);
+
+// Parses co2Msg from msg's own buffer, with no copy. co2Msg is cleared
+// first, so the same one can be reused for every message received.
+bool parseMsg(const zmq::message_t& msg, co2Message::Co2Message& co2Msg);
+
+// Steady clock times as they are carried in messages, e.g. Co2State's
+// readTimeNsec. 0 is a time that was never set.
+uint64_t steadyNsec(std::chrono::steady_clock::time_point time);
+std::chrono::steady_clock::time_point steadyTime(uint64_t nsec);
+
+// Adds latency to stats as the hop called name
+void addLatency(co2Message::Stats& stats, const std::string& name, const LatencyHistogram& latency);
+
+// Logs each latency in stats, one line per hop
+void logStats(int priority, const co2Message::Stats& stats);
+
 std::string zeroPadNumber(int width, double num, char pad = '0', int precision = 0);
 std::string zeroPadNumber(int width, int num, char pad = '0');
 
@@ -40,7 +40,7 @@ usage()
        ${PROGNAME} -u | --uninstall
   where:
       LOGLEVEL is one of DEBUG, INFO, NOTICE, WARNING, ERR, CRIT, ALERT.
-      SENSOR is one of K30, SCD30, sim\n" 1>&2
+      SENSOR is one of K30, SCD30, sim, replay\n" 1>&2
   exit 2
 }
 
@@ -82,6 +82,10 @@ do
                     SENSOR_TYPE=sim
                     SENSOR_PORT=
                     ;;
+                REPLAY)
+                    SENSOR_TYPE=replay
+                    SENSOR_PORT=${CO2MON_LOG_DIR}
+                    ;;
                 *)
                     printf "Unknown sensor type: \"$2\"\n" 1>&2
                     usage
@@ -229,17 +233,80 @@ fi
 
 if [[ ! -f ${MON_SERVICE_CONF_FILE} ]]; then
 cat <<xEOFx >${MON_SERVICE_CONF_FILE} 
-# CO2 Sensor is defined here for co2Monitor to configure at runtime
+# CO2 Sensor is defined here for co2Monitor to configure at runtime.
+# Several sensors can be read side by side, and their readings combined,
+# by listing them with their ports, e.g. SensorType="K30,SCD30" and
+# SensorPort="/dev/serial0,I2C"
 SensorType="${SENSOR_TYPE}"
 SensorPort="${SENSOR_PORT}"
 
+# gpiochip0 line wired to the SCD30 RDY pin, so we are told when a measurement
+# is ready rather than polling the sensor for it. -1 if RDY is not connected.
+SCD30RdyGpio=-1
+
+# The replay sensor plays back readings logged under SensorPort between
+# ReplayStart and ReplayEnd ("YYYY-MM-DD [HH:MM[:SS]]"), ReplaySpeed times
+# faster than real time, or one reading per sensor read if ReplaySpeed is 0.
+# It starts again at the end. Default is the whole of yesterday in real time.
+ReplayStart=""
+ReplayEnd=""
+ReplaySpeed=1
+
+# Stress mode, for finding how many samples/s the pipeline can cope with:
+# sensors are read StressSampleRate times a second (up to 10000, which only
+# the sim sensor can manage) and every sample is published and logged.
+# 0 for normal operation.
+StressSampleRate=0
+
+# Sensors are read, and readings published, every SampleIntervalMin seconds
+# while CO2 is changing by FastSampleCo2Rate ppm/minute or more, or RH by
+# FastSampleRelHumRate %/minute or more. Once readings have settled the
+# interval doubles, up to SampleIntervalMax seconds. Setting both intervals
+# to 10 reads sensors every 10 seconds, whatever the readings.
+SampleIntervalMin=5
+SampleIntervalMax=40
+FastSampleCo2Rate=20
+FastSampleRelHumRate=1.0
+
+# Readings (Co2State) go from the CO2 monitor thread to the main and display
+# threads through zmq sockets, serialized as protobuf ("zmq"), or as C++
+# structs through lock-free in-process queues ("bus"). Everything else
+# always goes through zmq.
+MessageTransport="zmq"
+
+# Readings are smoothed before fan control and logging by a chain of filters
+# per channel, applied in order: "none", "ema:ALPHA", "median:N",
+# "hampel:N:K" (outliers more than K sigma from median of last N samples are
+# replaced by that median) and "kalman:Q:R", e.g. "hampel:7:3,ema:0.2".
+FilterCo2="ema:0.2"
+FilterTemperature="none"
+FilterRelHumidity="ema:0.2"
+
 # where we store states, info, etc. which must persist between app restarts and system reboots
 PersistentStoreFileName="${PERSISTENT_STORE_FILE}"
 PersistentStoreConfigFile="${PERSISTENT_STORE_CONF_FILE}"
 
-# where we store sensor readings in timestamped CSV daily files: ${CO2MON_LOG_DIR}/YYYY/MM/DD
+# Today's fan runtime is saved in the persistent store this often
+# (seconds), as well as on shutdown, so it carries on after a restart.
+FanRuntimeCheckpointInterval=600
+
+# where we store sensor readings in timestamped daily files: ${CO2MON_LOG_DIR}/YYYY/MM/DD
 Co2LogBaseDir="${CO2MON_LOG_DIR}"
 
+# Readings are stored as fixed size binary records in YYYY/MM/DD.bin ("binary"),
+# as CSV in YYYY/MM/DD ("csv") or both. Use co2logcsv to convert binary to CSV.
+Co2LogFormat="binary"
+
+# Compress each day's binary log (to YYYY/MM/DD.co2z) once the day is over (1) or not (0)
+Co2LogCompress=1
+
+# Readings are batched and written to the log every Co2LogFlushInterval seconds
+# and synced to storage every Co2LogFsyncInterval seconds. Up to Co2LogQueueSize
+# readings may be waiting for the log writer before new ones are dropped.
+Co2LogQueueSize=64
+Co2LogFlushInterval=60
+Co2LogFsyncInterval=600
+
 # Log level is one of DEBUG (verbose), INFO, NOTICE, WARNING, ERR, CRIT, ALERT (highest)
 LogLevel=${LOGLEVEL}
 
@@ -284,6 +351,36 @@ RelHumFanOnThreshold=80
 # CO2 threshold (ppm) above which fan starts
 CO2FanOnThreshold=800
 
+# In "threshold" mode the fan starts once a threshold is crossed. In
+# "predictive" mode it also starts when the trend over the last
+# FanTrendWindow seconds will reach a threshold within FanPredictHorizon
+# seconds, so the room need not go over the limit.
+FanControlMode="threshold"
+FanPredictHorizon=300
+FanTrendWindow=300
+
+# In Auto the fan stays on until readings are this far below their
+# thresholds, and won't switch again for the minimum time (seconds), so
+# it doesn't chatter on and off around a threshold.
+CO2FanHysteresis=50
+RelHumFanHysteresis=3
+FanMinOnTime=120
+FanMinOffTime=60
+
+# Fan output: "gpio" switches the fan relay on and off. "pwm" runs a
+# variable speed fan from a sysfs PWM channel (FanOutputPath, e.g.
+# /sys/class/pwm/pwmchip0/pwm0) and "file" writes the duty cycle to
+# FanOutputPath instead, for trying it out without hardware.
+# With either, speed follows FanPwmCurve: points of percent above
+# threshold:duty cycle percent. FanPwmKp and FanPwmKi add a PI
+# correction (duty % per % above threshold, and the same per minute).
+FanOutput="gpio"
+FanOutputPath=""
+FanPwmFrequency=25000
+FanPwmCurve="0:30,20:70,50:100"
+FanPwmKp=0.0
+FanPwmKi=0.0
+
 
 xEOFx
 fi